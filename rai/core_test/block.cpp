@@ -129,6 +129,35 @@ TEST (block, change_serialize_json)
     ASSERT_EQ (block1, block2);
 }
 
+TEST (block, value)
+{
+	rai::keypair key1;
+	rai::send_block send (0, 1, 2, key1.prv, 4, 5);
+	rai::receive_block receive (0, 1, key1.prv, 3, 4);
+	rai::open_block open (0, 1, 2, key1.prv, 4, 5);
+	rai::change_block change (0, 1, key1.prv, 3, 4);
+	std::vector <rai::block_value> values;
+	for (rai::block * i: std::vector <rai::block *> ({ &send, &receive, &open, &change }))
+	{
+		values.push_back (rai::block_value (*i));
+		std::vector <uint8_t> bytes;
+		{
+			rai::vectorstream stream (bytes);
+			i->serialize (stream);
+		}
+		rai::block_value value (i->type (), bytes.data ());
+		ASSERT_EQ (i->type (), value.type);
+		ASSERT_TRUE (std::equal (bytes.begin (), bytes.end (), value.bytes.begin ()));
+	}
+	ASSERT_EQ (send.hash (), values [0].view ().hash ());
+	ASSERT_EQ (receive.hash (), values [1].view ().hash ());
+	ASSERT_EQ (open.hash (), values [2].view ().hash ());
+	ASSERT_EQ (change.hash (), values [3].view ().hash ());
+	ASSERT_EQ (open.root (), values [2].view ().root ());
+	ASSERT_EQ (send, *values [0].view ().block ());
+	ASSERT_EQ (change, *values [3].view ().block ());
+}
+
 TEST (uint512_union, parse_zero)
 {
     rai::uint512_union input (rai::uint512_t (0));
@@ -287,6 +316,39 @@ TEST (frontier_req, serialization)
     ASSERT_EQ (request1, request2);
 }
 
+TEST (checksum_req, serialization)
+{
+    rai::checksum_req request1 (0x1230000000000000, 12);
+    request1.frontiers_set (true);
+    std::vector <uint8_t> bytes;
+    {
+        rai::vectorstream stream (bytes);
+        request1.serialize (stream);
+    }
+    ASSERT_EQ (8 + rai::checksum_req::size, bytes.size ());
+    rai::bufferstream buffer (bytes.data (), bytes.size ());
+    rai::checksum_req request2;
+    ASSERT_FALSE (request2.deserialize (buffer));
+    ASSERT_EQ (request1, request2);
+    ASSERT_TRUE (request2.frontiers ());
+}
+
+TEST (checksum_req, invalid)
+{
+    // Prefix bits below the depth and depths between levels are rejected
+    for (auto request1: { rai::checksum_req (0x1230000000000000, 8), rai::checksum_req (0, 6), rai::checksum_req (0, rai::checksum_leaf_depth + rai::checksum_level_bits) })
+    {
+        std::vector <uint8_t> bytes;
+        {
+            rai::vectorstream stream (bytes);
+            request1.serialize (stream);
+        }
+        rai::bufferstream buffer (bytes.data (), bytes.size ());
+        rai::checksum_req request2;
+        ASSERT_TRUE (request2.deserialize (buffer));
+    }
+}
+
 TEST (block, publish_req_serialization)
 {
     rai::keypair key1;
@@ -35,6 +35,45 @@ TEST (block_store, add_item)
 	ASSERT_EQ (nullptr, latest3);
 }
 
+TEST (block_store, block_view)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::keypair key1;
+	rai::open_block open (0, 1, key1.pub, key1.prv, key1.pub, 4);
+	rai::send_block send (open.hash (), 2, 3, key1.prv, key1.pub, 5);
+	rai::receive_block receive (send.hash (), 6, key1.prv, key1.pub, 7);
+	rai::change_block change (receive.hash (), 8, key1.prv, key1.pub, 9);
+	rai::transaction transaction (store.environment, nullptr, true);
+	ASSERT_FALSE (store.block_get_view (transaction, open.hash ()).valid ());
+	store.block_put (transaction, open.hash (), open);
+	store.block_put (transaction, send.hash (), send);
+	store.block_put (transaction, receive.hash (), receive);
+	store.block_put (transaction, change.hash (), change);
+	std::vector <std::pair <rai::block *, rai::block_hash>> blocks ({ { &open, send.hash () }, { &send, receive.hash () }, { &receive, change.hash () }, { &change, 0 } });
+	for (auto & i: blocks)
+	{
+		auto & block (*i.first);
+		auto view (store.block_get_view (transaction, block.hash ()));
+		ASSERT_TRUE (view.valid ());
+		ASSERT_EQ (block.type (), view.type ());
+		ASSERT_EQ (block.hash (), view.hash ());
+		ASSERT_EQ (block.previous (), view.previous ());
+		ASSERT_EQ (block.source (), view.source ());
+		ASSERT_EQ (block.root (), view.root ());
+		ASSERT_EQ (block.representative (), view.representative ());
+		ASSERT_EQ (block.block_work (), view.block_work ());
+		ASSERT_EQ (i.second, view.successor ());
+		ASSERT_EQ (block, *view.block ());
+	}
+	auto view (store.block_get_view (transaction, send.hash ()));
+	ASSERT_EQ (rai::account (2), view.destination ());
+	ASSERT_EQ (rai::amount (3), view.balance ());
+	ASSERT_TRUE (store.block_get_view (transaction, open.hash ()).destination ().is_zero ());
+	ASSERT_FALSE (store.block_get_view (transaction, 1).valid ());
+}
+
 TEST (block_store, add_nonempty_block)
 {
     bool init (false);
@@ -360,6 +399,73 @@ TEST (block_store, two_account)
     ASSERT_EQ (end, begin);
 }
 
+TEST (block_store, cache)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	size_t hits (0);
+	size_t misses (0);
+	store.cache.account_observer = [&hits, &misses] (bool hit_a)
+	{
+		++(hit_a ? hits : misses);
+	};
+	rai::account account1 (1);
+	rai::account_info info1 (2, 3, 4, 5, 6);
+	{
+		rai::transaction transaction (store.environment, nullptr, true);
+		store.account_put (transaction, account1, info1);
+	}
+	rai::account_info info2;
+	{
+		// Read-only transactions never consult the cache
+		rai::transaction transaction (store.environment, nullptr, false);
+		ASSERT_FALSE (store.account_get (transaction, account1, info2));
+		ASSERT_EQ (info1, info2);
+		ASSERT_EQ (0, hits + misses);
+	}
+	{
+		rai::transaction transaction (store.environment, nullptr, true);
+		ASSERT_FALSE (store.account_get (transaction, account1, info2));
+		ASSERT_EQ (info1, info2);
+		ASSERT_EQ (1, hits);
+		store.account_del (transaction, account1);
+		ASSERT_TRUE (store.account_get (transaction, account1, info2));
+		ASSERT_EQ (1, misses);
+		store.representation_put (transaction, account1, 7);
+		ASSERT_EQ (7, store.representation_get (transaction, account1));
+		ASSERT_EQ (0, store.representation_get (transaction, 2));
+	}
+	rai::transaction transaction (store.environment, nullptr, false);
+	ASSERT_TRUE (store.account_get (transaction, account1, info2));
+	ASSERT_EQ (7, store.representation_get (transaction, account1));
+}
+
+TEST (block_store, cache_capacity)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	store.cache.capacity = 2;
+	rai::transaction transaction (store.environment, nullptr, true);
+	for (auto i (1); i < 5; ++i)
+	{
+		store.account_put (transaction, rai::account (i), rai::account_info (i, i, i, i, i));
+	}
+	ASSERT_EQ (2, store.cache.accounts.size ());
+	for (auto i (1); i < 5; ++i)
+	{
+		rai::account_info info;
+		ASSERT_FALSE (store.account_get (transaction, rai::account (i), info));
+		ASSERT_EQ (rai::block_hash (i), info.head);
+	}
+	ASSERT_EQ (2, store.cache.accounts.size ());
+	store.cache.capacity = 0;
+	store.cache.clear ();
+	store.account_put (transaction, rai::account (5), rai::account_info (5, 5, 5, 5, 5));
+	ASSERT_TRUE (store.cache.accounts.empty ());
+}
+
 TEST (block_store, latest_find)
 {
     bool init (false);
@@ -631,6 +737,7 @@ TEST (block_store, upgrade_v2_v3)
 	rai::account_info info;
 	ASSERT_FALSE (store.account_get (transaction, rai::test_genesis_key.pub, info));
 	ASSERT_EQ (change_hash, info.rep_block);
+	ASSERT_FALSE (store.weights_stale (transaction));
 }
 
 TEST (block_store, upgrade_v3_v4)
@@ -695,6 +802,201 @@ TEST (block_store, upgrade_v4_v5)
 	ASSERT_EQ (hash, store.block_successor (transaction, genesis_hash));
 }
 
+TEST (block_store, upgrade_v5_v6)
+{
+	rai::block_hash genesis_hash (0);
+	rai::block_hash hash (0);
+	auto path (rai::unique_path ());
+	{
+		bool init (false);
+		rai::block_store store (init, path);
+		ASSERT_FALSE (init);
+		rai::transaction transaction (store.environment, nullptr, true);
+		rai::genesis genesis;
+		genesis.initialize (transaction, store);
+		genesis_hash = genesis.hash ();
+		rai::ledger ledger (store);
+		rai::keypair key0;
+		rai::send_block block0 (genesis_hash, key0.pub, rai::genesis_amount - rai::Grai_ratio, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, block0).code);
+		hash = block0.hash ();
+		store.version_put (transaction, 5);
+		mdb_drop (transaction, store.heights, 0);
+		ASSERT_EQ (0, store.height_latest (transaction, rai::test_genesis_key.pub));
+	}
+	bool init (false);
+	rai::block_store store (init, path);
+	ASSERT_FALSE (init);
+	rai::transaction transaction (store.environment, nullptr, false);
+	ASSERT_LT (5, store.version_get (transaction));
+	ASSERT_EQ (2, store.height_latest (transaction, rai::test_genesis_key.pub));
+	ASSERT_EQ (genesis_hash, store.height_get (transaction, rai::test_genesis_key.pub, 1));
+	ASSERT_EQ (hash, store.height_get (transaction, rai::test_genesis_key.pub, 2));
+	ASSERT_EQ (genesis_hash, store.block_previous (transaction, hash));
+	ASSERT_TRUE (store.block_previous (transaction, genesis_hash).is_zero ());
+}
+
+TEST (block_store, upgrade_v6_v7)
+{
+	rai::checksum root;
+	auto path (rai::unique_path ());
+	{
+		bool init (false);
+		rai::block_store store (init, path);
+		ASSERT_FALSE (init);
+		rai::transaction transaction (store.environment, nullptr, true);
+		rai::genesis genesis;
+		genesis.initialize (transaction, store);
+		rai::ledger ledger (store);
+		rai::keypair key0;
+		rai::send_block block0 (genesis.hash (), key0.pub, rai::genesis_amount - rai::Grai_ratio, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, block0).code);
+		rai::open_block block1 (block0.hash (), 1, key0.pub, key0.prv, key0.pub, 0);
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, block1).code);
+		root = store.checksum_node (transaction, 0, 0);
+		ASSERT_EQ (block0.hash () ^ block1.hash (), root);
+		store.version_put (transaction, 6);
+		// Version 6 stores only kept the root
+		mdb_drop (transaction, store.checksum, 0);
+		store.checksum_put (transaction, 0, 0, 0);
+	}
+	bool init (false);
+	rai::block_store store (init, path);
+	ASSERT_FALSE (init);
+	rai::transaction transaction (store.environment, nullptr, false);
+	ASSERT_LT (6, store.version_get (transaction));
+	ASSERT_EQ (root, store.checksum_node (transaction, 0, 0));
+	auto prefix (rai::checksum_prefix (rai::test_genesis_key.pub, rai::checksum_leaf_depth));
+	ASSERT_FALSE (store.checksum_node (transaction, prefix, rai::checksum_leaf_depth).is_zero ());
+}
+
+TEST (block_store, compact)
+{
+	auto path (rai::unique_path ());
+	rai::send_block block1 (0, 1, 2, rai::keypair ().prv, 4, 5);
+	{
+		bool init (false);
+		rai::block_store store (init, path);
+		ASSERT_FALSE (init);
+		{
+			rai::transaction transaction (store.environment, nullptr, true);
+			for (auto i (0); i < 10000; ++i)
+			{
+				store.unchecked_put (transaction, rai::block_hash (i), block1);
+			}
+		}
+		rai::transaction transaction (store.environment, nullptr, true);
+		for (auto i (1); i < 10000; ++i)
+		{
+			store.unchecked_del (transaction, rai::block_hash (i));
+		}
+	}
+	auto before (boost::filesystem::file_size (path));
+	ASSERT_FALSE (rai::compact_store (path));
+	ASSERT_GT (before, boost::filesystem::file_size (path));
+	ASSERT_FALSE (boost::filesystem::exists (path.string () + ".compact"));
+	bool init (false);
+	rai::block_store store (init, path);
+	ASSERT_FALSE (init);
+	rai::transaction transaction (store.environment, nullptr, false);
+	auto block2 (store.unchecked_get (transaction, rai::block_hash (0)));
+	ASSERT_NE (nullptr, block2);
+	ASSERT_EQ (block1, *block2);
+	ASSERT_EQ (nullptr, store.unchecked_get (transaction, rai::block_hash (1)));
+}
+
+TEST (block_store, read_only)
+{
+	auto path (rai::unique_path ());
+	bool init1 (false);
+	rai::block_store store1 (init1, path);
+	ASSERT_FALSE (init1);
+	rai::genesis genesis;
+	{
+		rai::transaction transaction (store1.environment, nullptr, true);
+		genesis.initialize (transaction, store1);
+	}
+	bool init2 (false);
+	rai::block_store store2 (init2, path, true);
+	ASSERT_FALSE (init2);
+	{
+		rai::transaction transaction (store2.environment, nullptr, false);
+		ASSERT_TRUE (store2.block_exists (transaction, genesis.hash ()));
+	}
+	// The writer grows the file well past the reader's map
+	rai::send_block block1 (0, 1, 2, rai::keypair ().prv, 4, 5);
+	for (auto i (0); i < 320; ++i)
+	{
+		rai::transaction transaction (store1.environment, nullptr, true);
+		for (auto j (0); j < 100; ++j)
+		{
+			store1.unchecked_put (transaction, rai::block_hash (i * 100 + j), block1);
+		}
+	}
+	MDB_envinfo info1;
+	mdb_env_info (store1.environment, &info1);
+	MDB_envinfo info2;
+	mdb_env_info (store2.environment, &info2);
+	MDB_stat stats;
+	mdb_env_stat (store1.environment, &stats);
+	ASSERT_GT ((info1.me_last_pgno + 1) * stats.ms_psize, info2.me_mapsize);
+	rai::transaction transaction (store2.environment, nullptr, false);
+	ASSERT_NE (nullptr, store2.unchecked_get (transaction, rai::block_hash (31999)));
+	ASSERT_TRUE (store2.block_exists (transaction, genesis.hash ()));
+}
+
+TEST (block_store, read_only_missing)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path (), true);
+	ASSERT_TRUE (init);
+}
+
+TEST (block_store, rebuild_weights)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_FALSE (init);
+	rai::ledger ledger (store);
+	rai::genesis genesis;
+	rai::keypair key1;
+	rai::keypair key2;
+	rai::keypair key3;
+	{
+		rai::transaction transaction (store.environment, nullptr, true);
+		genesis.initialize (transaction, store);
+		rai::send_block send (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send).code);
+		rai::open_block open (send.hash (), key2.pub, key1.pub, key1.prv, key1.pub, 0);
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, open).code);
+		// Drift in both directions and a representative nobody delegates to
+		store.representation_put (transaction, key2.pub, 99);
+		store.representation_put (transaction, rai::test_genesis_key.pub, 5);
+		store.representation_put (transaction, key3.pub, 7);
+	}
+	ASSERT_EQ (3, store.rebuild_weights (4));
+	rai::transaction transaction (store.environment, nullptr, false);
+	ASSERT_EQ (100, ledger.weight (transaction, key2.pub));
+	ASSERT_EQ (rai::genesis_amount - 100, ledger.weight (transaction, rai::test_genesis_key.pub));
+	ASSERT_EQ (0, ledger.weight (transaction, key3.pub));
+	auto entries (0);
+	for (auto i (store.representation_begin (transaction)), n (store.representation_end ()); i != n; ++i)
+	{
+		++entries;
+	}
+	ASSERT_EQ (2, entries);
+}
+
+TEST (block_store, account_range_starts)
+{
+	auto starts (rai::account_range_starts (4));
+	ASSERT_EQ (4, starts.size ());
+	ASSERT_TRUE (starts [0].is_zero ());
+	ASSERT_EQ (0x3f, starts [1].bytes [0]);
+	ASSERT_EQ (0x7f, starts [2].bytes [0]);
+	ASSERT_EQ (0xbf, starts [3].bytes [0]);
+}
+
 TEST (block_store, block_random)
 {
     bool init (false);
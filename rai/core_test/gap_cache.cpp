@@ -49,6 +49,32 @@ TEST (gap_cache, comparison)
     ASSERT_EQ (arrival, cache.blocks.get <1> ().begin ()->arrival);
 }
 
+TEST (gap_cache, budget)
+{
+    rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+    rai::send_block block1 (0, 1, 2, rai::keypair ().prv, 4, 5);
+	node1.config.gap_cache_bytes = 2 * rai::gap_cache::entry_size (block1);
+    rai::gap_cache cache (node1);
+    cache.add (block1, block1.previous ());
+    rai::send_block block2 (1, 1, 2, rai::keypair ().prv, 4, 5);
+    cache.add (block2, block2.previous ());
+    ASSERT_EQ (2, cache.blocks.size ());
+    ASSERT_EQ (node1.config.gap_cache_bytes, cache.size ());
+    rai::send_block block3 (2, 1, 2, rai::keypair ().prv, 4, 5);
+    cache.add (block3, block3.previous ());
+	// The oldest block is evicted to make room
+    ASSERT_EQ (2, cache.blocks.size ());
+    ASSERT_EQ (cache.blocks.end (), cache.blocks.find (block1.previous ()));
+    ASSERT_NE (cache.blocks.end (), cache.blocks.find (block3.previous ()));
+	ASSERT_EQ (1, cache.evicted.value ());
+	auto blocks (cache.get (block2.previous ()));
+	ASSERT_EQ (1, blocks.size ());
+	ASSERT_EQ (block2, *blocks [0]);
+    ASSERT_EQ (rai::gap_cache::entry_size (block3), cache.size ());
+	ASSERT_TRUE (cache.get (block2.previous ()).empty ());
+}
+
 TEST (gap_cache, gap_bootstrap)
 {
 	rai::system system (24000, 2);
@@ -73,6 +99,8 @@ TEST (gap_cache, gap_bootstrap)
 		++iterations2;
 		ASSERT_LT (iterations2, 200);
 	}
+	// Only the missing block was asked for, no full bootstrap was needed
+	ASSERT_LT (0, system.nodes [1]->gap_cache.requests.value ());
 }
 
 TEST (gap_cache, two_dependencies)
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#include <rai/node/ipc.hpp>
+#include <rai/node/testing.hpp>
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+TEST (ipc, account_balance)
+{
+	rai::system system (24000, 1);
+	rai::ipc_server server (*system.nodes [0], rai::ipc_config ());
+	server.start ();
+	boost::asio::io_service service;
+	rai::ipc_client client (service);
+	client.connect (server.path ());
+	std::vector <uint8_t> arguments (rai::test_genesis_key.pub.bytes.begin (), rai::test_genesis_key.pub.bytes.end ());
+	std::vector <uint8_t> results;
+	ASSERT_EQ (rai::ipc_status::success, client.request (rai::ipc_action::account_balance, arguments, results));
+	ASSERT_EQ (32, results.size ());
+	rai::amount balance;
+	rai::amount pending;
+	std::copy (results.begin (), results.begin () + 16, balance.bytes.begin ());
+	std::copy (results.begin () + 16, results.end (), pending.bytes.begin ());
+	ASSERT_EQ (std::numeric_limits <rai::uint128_t>::max (), balance.number ());
+	ASSERT_EQ (0, pending.number ());
+}
+
+TEST (ipc, block)
+{
+	rai::system system (24000, 1);
+	rai::ipc_server server (*system.nodes [0], rai::ipc_config ());
+	server.start ();
+	boost::asio::io_service service;
+	rai::ipc_client client (service);
+	client.connect (server.path ());
+	auto latest (system.nodes [0]->latest (rai::test_genesis_key.pub));
+	std::vector <uint8_t> arguments (latest.bytes.begin (), latest.bytes.end ());
+	std::vector <uint8_t> results;
+	ASSERT_EQ (rai::ipc_status::success, client.request (rai::ipc_action::block, arguments, results));
+	rai::bufferstream stream (results.data (), results.size ());
+	auto block (rai::deserialize_block (stream));
+	ASSERT_NE (nullptr, block);
+	ASSERT_EQ (latest, block->hash ());
+	arguments.assign (32, 1);
+	ASSERT_EQ (rai::ipc_status::not_found, client.request (rai::ipc_action::block, arguments, results));
+	ASSERT_TRUE (results.empty ());
+}
+
+TEST (ipc, block_count)
+{
+	rai::system system (24000, 1);
+	rai::ipc_server server (*system.nodes [0], rai::ipc_config ());
+	server.start ();
+	boost::asio::io_service service;
+	rai::ipc_client client (service);
+	client.connect (server.path ());
+	std::vector <uint8_t> results;
+	ASSERT_EQ (rai::ipc_status::success, client.request (rai::ipc_action::block_count, std::vector <uint8_t> (), results));
+	ASSERT_EQ (16, results.size ());
+	uint64_t count;
+	uint64_t unchecked;
+	std::copy (results.begin (), results.begin () + 8, reinterpret_cast <uint8_t *> (&count));
+	std::copy (results.begin () + 8, results.end (), reinterpret_cast <uint8_t *> (&unchecked));
+	ASSERT_EQ (1, count);
+	ASSERT_EQ (0, unchecked);
+}
+
+TEST (ipc, process)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::ipc_server server (node1, rai::ipc_config ());
+	server.start ();
+	boost::asio::io_service service;
+	rai::ipc_client client (service);
+	client.connect (server.path ());
+	rai::keypair key;
+	auto latest (node1.latest (rai::test_genesis_key.pub));
+	rai::send_block send (latest, key.pub, 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, node1.generate_work (latest));
+	std::vector <uint8_t> arguments;
+	{
+		rai::vectorstream stream (arguments);
+		rai::serialize_block (stream, send);
+	}
+	std::vector <uint8_t> results;
+	ASSERT_EQ (rai::ipc_status::success, client.request (rai::ipc_action::process, arguments, results));
+	ASSERT_EQ (send.hash (), node1.latest (rai::test_genesis_key.pub));
+	std::vector <uint8_t> account (rai::test_genesis_key.pub.bytes.begin (), rai::test_genesis_key.pub.bytes.end ());
+	ASSERT_EQ (rai::ipc_status::success, client.request (rai::ipc_action::frontier, account, results));
+	auto hash (send.hash ());
+	ASSERT_EQ (std::vector <uint8_t> (hash.bytes.begin (), hash.bytes.end ()), results);
+	send.block_work_set (0);
+	arguments.clear ();
+	{
+		rai::vectorstream stream (arguments);
+		rai::serialize_block (stream, send);
+	}
+	ASSERT_EQ (rai::ipc_status::bad_work, client.request (rai::ipc_action::process, arguments, results));
+}
+
+TEST (ipc, malformed)
+{
+	rai::system system (24000, 1);
+	rai::ipc_server server (*system.nodes [0], rai::ipc_config ());
+	server.start ();
+	boost::asio::io_service service;
+	rai::ipc_client client (service);
+	client.connect (server.path ());
+	std::vector <uint8_t> results;
+	ASSERT_EQ (rai::ipc_status::unknown_action, client.request (static_cast <rai::ipc_action> (255), std::vector <uint8_t> (), results));
+	// Truncated and overlong arguments are both rejected
+	ASSERT_EQ (rai::ipc_status::bad_request, client.request (rai::ipc_action::account_balance, std::vector <uint8_t> (31), results));
+	ASSERT_EQ (rai::ipc_status::bad_request, client.request (rai::ipc_action::account_balance, std::vector <uint8_t> (33), results));
+	// The connection stays usable after an error
+	ASSERT_EQ (rai::ipc_status::success, client.request (rai::ipc_action::block_count, std::vector <uint8_t> (), results));
+}
+
+#endif
@@ -267,6 +267,42 @@ TEST (ledger, rollback_receiver)
 	ASSERT_TRUE (ledger.store.pending_get (transaction, rai::pending_key (key2.pub, info2.head), pending1));
 }
 
+TEST (ledger, heights)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::ledger ledger (store);
+	rai::genesis genesis;
+	rai::transaction transaction (store.environment, nullptr, true);
+	genesis.initialize (transaction, store);
+	ASSERT_EQ (1, store.height_latest (transaction, rai::test_genesis_key.pub));
+	ASSERT_EQ (genesis.hash (), store.height_get (transaction, rai::test_genesis_key.pub, 1));
+	rai::keypair key2;
+	rai::send_block send (genesis.hash (), key2.pub, 50, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send).code);
+	rai::open_block open (send.hash (), key2.pub, key2.pub, key2.prv, key2.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, open).code);
+	rai::change_block change (open.hash (), rai::test_genesis_key.pub, key2.prv, key2.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, change).code);
+	ASSERT_EQ (2, store.height_latest (transaction, rai::test_genesis_key.pub));
+	ASSERT_EQ (send.hash (), store.height_get (transaction, rai::test_genesis_key.pub, 2));
+	ASSERT_EQ (2, store.height_latest (transaction, key2.pub));
+	ASSERT_EQ (open.hash (), store.height_get (transaction, key2.pub, 1));
+	ASSERT_EQ (change.hash (), store.height_get (transaction, key2.pub, 2));
+	std::vector <rai::block_hash> hashes;
+	for (auto i (store.height_begin (transaction, key2.pub, 1)), n (store.height_end ()); i != n && rai::height_key (i->first).account == key2.pub; ++i)
+	{
+		hashes.push_back (rai::block_hash (i->second));
+	}
+	ASSERT_EQ (std::vector <rai::block_hash> ({open.hash (), change.hash ()}), hashes);
+	// Rolling back the send removes the open and change stacked on it
+	ledger.rollback (transaction, send.hash ());
+	ASSERT_EQ (1, store.height_latest (transaction, rai::test_genesis_key.pub));
+	ASSERT_TRUE (store.height_get (transaction, rai::test_genesis_key.pub, 2).is_zero ());
+	ASSERT_EQ (0, store.height_latest (transaction, key2.pub));
+}
+
 TEST (ledger, rollback_representation)
 {
 	bool init (false);
@@ -523,6 +559,222 @@ TEST (ledger, DISABLED_checksum_range)
 	ASSERT_EQ (hash1, check3);
 }
 
+TEST (ledger, checksum_tree)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::genesis genesis;
+	rai::transaction transaction (store.environment, nullptr, true);
+	genesis.initialize (transaction, store);
+	rai::ledger ledger (store);
+	for (auto i (0); i < 64; ++i)
+	{
+		rai::keypair key;
+		rai::send_block send (ledger.latest (transaction, rai::test_genesis_key.pub), key.pub, rai::genesis_amount - i - 1, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send).code);
+		rai::open_block open (send.hash (), 1, key.pub, key.prv, key.pub, 0);
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, open).code);
+	}
+	// Every level sums to the root
+	for (uint8_t depth (rai::checksum_level_bits); depth <= rai::checksum_leaf_depth; depth += rai::checksum_level_bits)
+	{
+		rai::checksum sum (0);
+		for (auto i (store.latest_begin (transaction)), n (store.latest_end ()); i != n; ++i)
+		{
+			auto prefix (rai::checksum_prefix (rai::account (i->first), depth));
+			auto range (rai::checksum_range (prefix, depth));
+			ASSERT_FALSE (rai::account (i->first) < range.first);
+			ASSERT_FALSE (range.second < rai::account (i->first));
+			ASSERT_FALSE (store.checksum_node (transaction, prefix, depth).is_zero ());
+		}
+		for (uint64_t i (0); i < (1 << rai::checksum_level_bits); ++i)
+		{
+			sum ^= store.checksum_node (transaction, i << (64 - rai::checksum_level_bits), rai::checksum_level_bits);
+		}
+		ASSERT_EQ (store.checksum_node (transaction, 0, 0), sum);
+	}
+	auto brute_force ([&store, &transaction] (rai::uint256_t const & begin_a, rai::uint256_t const & end_a)
+	{
+		rai::checksum result (0);
+		for (auto i (store.latest_begin (transaction)), n (store.latest_end ()); i != n; ++i)
+		{
+			auto account (rai::account (i->first).number ());
+			if (account >= begin_a && account <= end_a)
+			{
+				result ^= rai::account_info (i->second).head;
+			}
+		}
+		return result;
+	});
+	for (auto i (0); i < 100; ++i)
+	{
+		rai::account first;
+		rai::account second;
+		rai::random_pool.GenerateBlock (first.bytes.data (), first.bytes.size ());
+		rai::random_pool.GenerateBlock (second.bytes.data (), second.bytes.size ());
+		auto begin (std::min (first.number (), second.number ()));
+		auto end (std::max (first.number (), second.number ()));
+		ASSERT_EQ (brute_force (begin, end), ledger.checksum (transaction, begin, end));
+	}
+	ASSERT_EQ (store.checksum_node (transaction, 0, 0), ledger.checksum (transaction, 0, std::numeric_limits <rai::uint256_t>::max ()));
+	// Ranges bounded by exact accounts include both ends
+	auto account (rai::account (store.latest_begin (transaction)->first));
+	ASSERT_EQ (ledger.latest (transaction, account), ledger.checksum (transaction, account, account));
+}
+
+TEST (ledger, prune)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::genesis genesis;
+	rai::transaction transaction (store.environment, nullptr, true);
+	genesis.initialize (transaction, store);
+	rai::ledger ledger (store);
+	rai::keypair key1;
+	std::vector <rai::block_hash> sends;
+	for (auto i (0); i < 10; ++i)
+	{
+		rai::send_block send (ledger.latest (transaction, rai::test_genesis_key.pub), key1.pub, rai::genesis_amount - (i + 1) * 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send).code);
+		sends.push_back (send.hash ());
+	}
+	rai::open_block open (sends [0], key1.pub, key1.pub, key1.prv, key1.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, open).code);
+	rai::receive_block receive1 (open.hash (), sends [1], key1.prv, key1.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, receive1).code);
+	auto weight (ledger.weight (transaction, rai::test_genesis_key.pub));
+	rai::account cursor (0);
+	// Genesis is 11 blocks high and key1 is within the tail
+	ASSERT_EQ (8, ledger.prune (transaction, cursor, 3, 1000));
+	ASSERT_TRUE (cursor.is_zero ());
+	// One record per pruned send, the newest of them is also the boundary
+	ASSERT_EQ (7, store.pruned_count (transaction));
+	// The open block is still the representative block
+	ASSERT_TRUE (store.block_exists (transaction, genesis.hash ()));
+	for (auto i (0); i < 7; ++i)
+	{
+		ASSERT_FALSE (store.block_exists (transaction, sends [i]));
+	}
+	for (auto i (7); i < 10; ++i)
+	{
+		ASSERT_TRUE (store.block_exists (transaction, sends [i]));
+	}
+	ASSERT_EQ (11, store.height_latest (transaction, rai::test_genesis_key.pub));
+	ASSERT_TRUE (store.height_get (transaction, rai::test_genesis_key.pub, 8).is_zero ());
+	ASSERT_EQ (sends [7], store.height_get (transaction, rai::test_genesis_key.pub, 9));
+	ASSERT_EQ (rai::genesis_amount - 900, ledger.balance (transaction, sends [8]));
+	ASSERT_EQ (100, ledger.amount (transaction, sends [7]));
+	ASSERT_EQ (100, ledger.amount (transaction, sends [3]));
+	ASSERT_EQ (rai::test_genesis_key.pub, ledger.account (transaction, sends [3]));
+	// The kept representative block's chain continues at the oldest block kept
+	ASSERT_EQ (sends [7], store.block_successor (transaction, genesis.hash ()));
+	ASSERT_EQ (rai::test_genesis_key.pub, ledger.account (transaction, genesis.hash ()));
+	ASSERT_EQ (genesis.hash (), ledger.representative (transaction, sends [9]));
+	ASSERT_EQ (200, ledger.balance (transaction, receive1.hash ()));
+	// Pruned sends stay receivable
+	rai::receive_block receive2 (receive1.hash (), sends [2], key1.prv, key1.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, receive2).code);
+	ASSERT_EQ (300, ledger.account_balance (transaction, key1.pub));
+	ASSERT_EQ (300, ledger.balance (transaction, receive2.hash ()));
+	ASSERT_EQ (weight, ledger.weight (transaction, rai::test_genesis_key.pub));
+	// Moving past a change block replaces the kept representative block
+	rai::change_block change (ledger.latest (transaction, rai::test_genesis_key.pub), key1.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, change).code);
+	rai::send_block send1 (change.hash (), key1.pub, rai::genesis_amount - 1100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send1).code);
+	rai::send_block send2 (send1.hash (), key1.pub, rai::genesis_amount - 1200, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send2).code);
+	ASSERT_EQ (7, ledger.prune (transaction, cursor, 1, 1000));
+	ASSERT_FALSE (store.block_exists (transaction, genesis.hash ()));
+	ASSERT_TRUE (store.block_exists (transaction, change.hash ()));
+	ASSERT_TRUE (store.block_exists (transaction, open.hash ()));
+	ASSERT_FALSE (store.block_exists (transaction, receive1.hash ()));
+	ASSERT_EQ (change.hash (), ledger.representative (transaction, send2.hash ()));
+	ASSERT_EQ (rai::test_genesis_key.pub, ledger.account (transaction, change.hash ()));
+	ASSERT_EQ (key1.pub, ledger.account (transaction, open.hash ()));
+	ASSERT_EQ (rai::genesis_amount - 1200, ledger.balance (transaction, send2.hash ()));
+	ASSERT_EQ (300, ledger.balance (transaction, receive2.hash ()));
+	// The old boundary was a send so its record stays
+	ASSERT_EQ (100, ledger.amount (transaction, sends [6]));
+}
+
+TEST (ledger, prune_batch)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::genesis genesis;
+	rai::transaction transaction (store.environment, nullptr, true);
+	genesis.initialize (transaction, store);
+	rai::ledger ledger (store);
+	rai::keypair key1;
+	for (auto i (0); i < 10; ++i)
+	{
+		rai::send_block send (ledger.latest (transaction, rai::test_genesis_key.pub), key1.pub, rai::genesis_amount - (i + 1) * 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send).code);
+	}
+	rai::account cursor (0);
+	// A full batch leaves the cursor on the account to resume
+	ASSERT_EQ (4, ledger.prune (transaction, cursor, 1, 4));
+	ASSERT_EQ (rai::test_genesis_key.pub, cursor);
+	ASSERT_EQ (4, ledger.prune (transaction, cursor, 1, 4));
+	ASSERT_EQ (2, ledger.prune (transaction, cursor, 1, 4));
+	ASSERT_TRUE (cursor.is_zero ());
+	ASSERT_EQ (0, ledger.prune (transaction, cursor, 1, 4));
+	ASSERT_EQ (rai::genesis_amount - 1000, ledger.balance (transaction, ledger.latest (transaction, rai::test_genesis_key.pub)));
+}
+
+TEST (ledger, prune_rollback)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::genesis genesis;
+	rai::transaction transaction (store.environment, nullptr, true);
+	genesis.initialize (transaction, store);
+	rai::ledger ledger (store);
+	rai::keypair key1;
+	std::vector <rai::block_hash> sends;
+	for (auto i (0); i < 6; ++i)
+	{
+		rai::send_block send (ledger.latest (transaction, rai::test_genesis_key.pub), key1.pub, rai::genesis_amount - (i + 1) * 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send).code);
+		sends.push_back (send.hash ());
+	}
+	rai::open_block open (sends [0], key1.pub, key1.pub, key1.prv, key1.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, open).code);
+	rai::receive_block receive1 (open.hash (), sends [1], key1.prv, key1.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, receive1).code);
+	rai::receive_block receive2 (receive1.hash (), sends [4], key1.prv, key1.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, receive2).code);
+	rai::receive_block receive3 (receive2.hash (), sends [2], key1.prv, key1.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, receive3).code);
+	// Genesis keeps sends 3 to 5, key1 keeps its last two receives
+	ASSERT_EQ (4, ledger.prune_account (transaction, rai::test_genesis_key.pub, 3, 1000));
+	ASSERT_EQ (2, ledger.prune_account (transaction, key1.pub, 2, 1000));
+	// Rolling back within the tail works with a pruned source
+	ASSERT_FALSE (ledger.rollback (transaction, receive3.hash ()));
+	ASSERT_EQ (receive2.hash (), ledger.latest (transaction, key1.pub));
+	ASSERT_TRUE (store.pending_exists (transaction, rai::pending_key (key1.pub, sends [2])));
+	ASSERT_EQ (300, ledger.account_balance (transaction, key1.pub));
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, receive3).code);
+	ASSERT_EQ (400, ledger.account_balance (transaction, key1.pub));
+	// The receive of sends 4 would have to go, leaving key1's head on a pruned block
+	ASSERT_TRUE (ledger.rollback (transaction, sends [4]));
+	ASSERT_EQ (sends [5], ledger.latest (transaction, rai::test_genesis_key.pub));
+	ASSERT_EQ (receive3.hash (), ledger.latest (transaction, key1.pub));
+	ASSERT_TRUE (ledger.rollback (transaction, receive2.hash ()));
+	ASSERT_TRUE (store.block_exists (transaction, receive2.hash ()));
+	ASSERT_FALSE (ledger.rollback (transaction, sends [5]));
+	ASSERT_EQ (sends [4], ledger.latest (transaction, rai::test_genesis_key.pub));
+	ASSERT_EQ (rai::genesis_amount - 500, ledger.account_balance (transaction, rai::test_genesis_key.pub));
+	// Sends 3's predecessor is pruned
+	ASSERT_TRUE (ledger.rollback (transaction, sends [3]));
+	ASSERT_TRUE (store.block_exists (transaction, sends [3]));
+}
+
 TEST (system, generate_send_existing)
 {
     rai::system system (24000, 1);
@@ -1373,6 +1625,53 @@ TEST (ledger, change_representative_move_representation)
 	ASSERT_EQ (rai::genesis_amount, ledger.weight (transaction, key3.pub));
 }
 
+TEST (ledger, rollback_cache)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::ledger ledger (store, 0);
+	rai::genesis genesis;
+	rai::keypair key1;
+	rai::account_info info1;
+	{
+		rai::transaction transaction (store.environment, nullptr, true);
+		genesis.initialize (transaction, store);
+		ASSERT_FALSE (store.account_get (transaction, rai::test_genesis_key.pub, info1));
+	}
+	rai::send_block send (info1.head, key1.pub, rai::genesis_amount - 50, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	rai::open_block open (send.hash (), key1.pub, key1.pub, key1.prv, key1.pub, 0);
+	{
+		rai::transaction transaction (store.environment, nullptr, true);
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send).code);
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, open).code);
+	}
+	{
+		rai::transaction transaction (store.environment, nullptr, true);
+		ASSERT_EQ (50, ledger.weight (transaction, key1.pub));
+		ledger.rollback (transaction, send.hash ());
+	}
+	// The cache the next writer reads from must agree with what was committed
+	rai::account_info cached;
+	rai::uint128_t cached_weight;
+	auto cached_open (false);
+	{
+		rai::transaction transaction (store.environment, nullptr, true);
+		ASSERT_FALSE (store.account_get (transaction, rai::test_genesis_key.pub, cached));
+		cached_weight = store.representation_get (transaction, key1.pub);
+		rai::account_info info;
+		cached_open = !store.account_get (transaction, key1.pub, info);
+	}
+	rai::transaction transaction (store.environment, nullptr, false);
+	rai::account_info stored;
+	ASSERT_FALSE (store.account_get (transaction, rai::test_genesis_key.pub, stored));
+	ASSERT_EQ (stored, cached);
+	ASSERT_EQ (info1, stored);
+	ASSERT_EQ (0, cached_weight);
+	ASSERT_EQ (0, store.representation_get (transaction, key1.pub));
+	ASSERT_FALSE (cached_open);
+}
+
 TEST (ledger, send_open_receive_rollback)
 {
 	bool init (false);
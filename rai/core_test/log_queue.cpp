@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include <rai/node/log_queue.hpp>
+#include <rai/node/stats.hpp>
+
+#include <future>
+
+TEST (log_queue, write)
+{
+	boost::log::sources::logger_mt log;
+	rai::stats stats;
+	std::atomic <int> formatted (0);
+	{
+		rai::log_queue queue (log, stats, 0);
+		for (auto i (0); i < 100; ++i)
+		{
+			ASSERT_FALSE (queue.add (rai::log_category::network_message, [&formatted] ()
+			{
+				++formatted;
+				return std::string ("message");
+			}));
+		}
+	}
+	// Stopping drains everything already queued
+	ASSERT_EQ (100, formatted);
+	ASSERT_EQ (100, stats.counter ("log", "written").value ());
+	ASSERT_EQ (0, stats.counter ("log", "overflow").value ());
+}
+
+TEST (log_queue, rate_limit)
+{
+	boost::log::sources::logger_mt log;
+	rai::stats stats;
+	rai::log_queue queue (log, stats, 10);
+	size_t dropped (0);
+	for (auto i (0); i < 100; ++i)
+	{
+		dropped += queue.add (rai::log_category::ledger, [] () { return std::string ("ledger"); }) ? 1 : 0;
+	}
+	// The writer may start a new one second window part way through
+	ASSERT_LE (80, dropped);
+	ASSERT_EQ (dropped, stats.counter ("log", "rate_limited").value ());
+	// Categories are limited separately
+	ASSERT_FALSE (queue.add (rai::log_category::vote, [] () { return std::string ("vote"); }));
+}
+
+TEST (log_queue, overflow)
+{
+	boost::log::sources::logger_mt log;
+	rai::stats stats;
+	rai::log_queue queue (log, stats, 0);
+	std::promise <void> started;
+	std::promise <void> release;
+	auto released (release.get_future ().share ());
+	ASSERT_FALSE (queue.add (rai::log_category::network_packet, [&started, released] ()
+	{
+		started.set_value ();
+		released.wait ();
+		return std::string ("blocking");
+	}));
+	// The writer has taken the first record and freed its slot
+	started.get_future ().wait ();
+	for (size_t i (0); i < rai::log_queue::capacity; ++i)
+	{
+		ASSERT_FALSE (queue.add (rai::log_category::network_packet, [] () { return std::string ("filler"); }));
+	}
+	for (auto i (0); i < 10; ++i)
+	{
+		ASSERT_TRUE (queue.add (rai::log_category::network_packet, [] () { return std::string ("overflow"); }));
+	}
+	ASSERT_EQ (10, stats.counter ("log", "overflow").value ());
+	release.set_value ();
+	queue.stop ();
+	ASSERT_EQ (rai::log_queue::capacity + 1, stats.counter ("log", "written").value ());
+}
+
+TEST (log_queue, producers)
+{
+	boost::log::sources::logger_mt log;
+	rai::stats stats;
+	std::atomic <int> formatted (0);
+	{
+		rai::log_queue queue (log, stats, 0);
+		std::vector <std::thread> threads;
+		for (auto i (0); i < 4; ++i)
+		{
+			threads.push_back (std::thread ([&queue, &formatted] ()
+			{
+				for (auto j (0); j < 1000; ++j)
+				{
+					while (queue.add (rai::log_category::vote, [&formatted] ()
+					{
+						++formatted;
+						return std::string ("vote");
+					}))
+					{
+						std::this_thread::yield ();
+					}
+				}
+			}));
+		}
+		for (auto & i: threads)
+		{
+			i.join ();
+		}
+	}
+	ASSERT_EQ (4000, formatted);
+}
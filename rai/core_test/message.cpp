@@ -39,6 +39,24 @@ TEST (message, keepalive_deserialize)
     ASSERT_EQ (message1.peers, message2.peers);
 }
 
+TEST (message, pruned_flag)
+{
+    rai::keepalive message1;
+    ASSERT_FALSE (message1.pruned ());
+    message1.pruned_set (true);
+    ASSERT_TRUE (message1.pruned ());
+    ASSERT_FALSE (message1.ipv4_only ());
+    std::vector <uint8_t> bytes;
+    {
+        rai::vectorstream stream (bytes);
+        message1.serialize (stream);
+    }
+    rai::bufferstream stream (bytes.data (), bytes.size ());
+    rai::keepalive message2;
+    ASSERT_FALSE (message2.deserialize (stream));
+    ASSERT_TRUE (message2.pruned ());
+}
+
 TEST (message, publish_serialization)
 {
     rai::publish publish (std::unique_ptr <rai::block> (new rai::send_block (0, 1, 2, rai::keypair ().prv, 4, 5)));
@@ -54,8 +72,8 @@ TEST (message, publish_serialization)
     ASSERT_EQ (8, bytes.size ());
     ASSERT_EQ (0x52, bytes [0]);
     ASSERT_EQ (0x41, bytes [1]);
-    ASSERT_EQ (0x01, bytes [2]);
-    ASSERT_EQ (0x01, bytes [3]);
+    ASSERT_EQ (0x02, bytes [2]);
+    ASSERT_EQ (0x02, bytes [3]);
     ASSERT_EQ (0x01, bytes [4]);
     ASSERT_EQ (static_cast <uint8_t> (rai::message_type::publish), bytes [5]);
     ASSERT_EQ (0x02, bytes [6]);
@@ -68,8 +86,8 @@ TEST (message, publish_serialization)
     std::bitset <16> extensions;
     ASSERT_FALSE (rai::message::read_header (stream, version_max, version_using, version_min, type, extensions));
     ASSERT_EQ (0x01, version_min);
-    ASSERT_EQ (0x01, version_using);
-    ASSERT_EQ (0x01, version_max);
+    ASSERT_EQ (0x02, version_using);
+    ASSERT_EQ (0x02, version_max);
     ASSERT_EQ (rai::message_type::publish, type);
 }
 
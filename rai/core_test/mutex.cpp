@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include <rai/mutex.hpp>
+
+#include <thread>
+
+TEST (mutex, registry)
+{
+	auto & stat1 (rai::mutexes.stat ("test_registry"));
+	auto & stat2 (rai::mutexes.stat ("test_registry"));
+	ASSERT_EQ (&stat1, &stat2);
+	stat1.acquired = 5;
+	boost::property_tree::ptree tree;
+	rai::mutexes.serialize_json (tree);
+	ASSERT_EQ ("5", tree.get <std::string> ("test_registry.acquired"));
+	rai::mutexes.reset ();
+	ASSERT_EQ (0, stat1.acquired);
+}
+
+TEST (mutex, lock)
+{
+	if (rai::mutex_stats_enabled)
+	{
+		rai::named_mutex mutex1 ("test_lock");
+		rai::named_mutex mutex2 ("test_lock");
+		auto & stat (rai::mutexes.stat ("test_lock"));
+		stat.reset ();
+		{
+			rai::lock_guard lock (mutex1);
+			std::this_thread::sleep_for (std::chrono::milliseconds (1));
+		}
+		{
+			rai::lock_guard lock (mutex2);
+		}
+		// Mutexes sharing a name share their counters
+		ASSERT_EQ (2, stat.acquired);
+		ASSERT_EQ (0, stat.contended);
+		ASSERT_LE (1000000, stat.hold_max);
+		ASSERT_LE (stat.hold_max, stat.hold_total);
+	}
+}
+
+TEST (mutex, contended)
+{
+	if (rai::mutex_stats_enabled)
+	{
+		rai::named_mutex mutex ("test_contended");
+		auto & stat (rai::mutexes.stat ("test_contended"));
+		stat.reset ();
+		rai::unique_lock lock (mutex);
+		std::thread thread ([&mutex] ()
+		{
+			rai::lock_guard lock (mutex);
+		});
+		std::this_thread::sleep_for (std::chrono::milliseconds (5));
+		lock.unlock ();
+		thread.join ();
+		ASSERT_EQ (2, stat.acquired);
+		ASSERT_EQ (1, stat.contended);
+		ASSERT_LT (0, stat.wait_max);
+		ASSERT_EQ (stat.wait_max, stat.wait_total);
+	}
+}
+
+TEST (mutex, condition)
+{
+	rai::named_mutex mutex ("test_condition");
+	rai::condition_variable condition;
+	auto done (false);
+	std::thread thread ([&] ()
+	{
+		rai::lock_guard lock (mutex);
+		done = true;
+		condition.notify_all ();
+	});
+	rai::unique_lock lock (mutex);
+	while (!done)
+	{
+		condition.wait (lock);
+	}
+	lock.unlock ();
+	thread.join ();
+}
@@ -56,9 +56,9 @@ TEST (network, self_discard)
 {
     rai::system system (24000, 1);
 	system.nodes [0]->network.remote = system.nodes [0]->network.endpoint ();
-	ASSERT_EQ (0, system.nodes [0]->network.bad_sender_count);
+	ASSERT_EQ (0, system.nodes [0]->network.bad_sender_count.value ());
 	system.nodes [0]->network.receive_action (boost::system::error_code {}, 0);
-	ASSERT_EQ (1, system.nodes [0]->network.bad_sender_count);
+	ASSERT_EQ (1, system.nodes [0]->network.bad_sender_count.value ());
 }
 
 TEST (network, send_keepalive)
@@ -70,11 +70,11 @@ TEST (network, send_keepalive)
     auto node1 (std::make_shared <rai::node> (init1, system.service, 24001, rai::unique_path (), system.alarm, system.logging, system.work));
     node1->start ();
     system.nodes [0]->network.send_keepalive (node1->network.endpoint ());
-    auto initial (system.nodes [0]->network.keepalive_count);
+    auto initial (system.nodes [0]->network.keepalive_count.value ());
     ASSERT_EQ (0, system.nodes [0]->peers.list ().size ());
     ASSERT_EQ (0, node1->peers.list ().size ());
     auto iterations (0);
-    while (system.nodes [0]->network.keepalive_count == initial)
+    while (system.nodes [0]->network.keepalive_count.value () == initial)
     {
         system.poll ();
         ++iterations;
@@ -98,9 +98,9 @@ TEST (network, keepalive_ipv4)
     auto node1 (std::make_shared <rai::node> (init1, system.service, 24001, rai::unique_path (), system.alarm, system.logging, system.work));
     node1->start ();
     node1->send_keepalive (rai::endpoint (boost::asio::ip::address_v4::loopback (), 24000));
-    auto initial (system.nodes [0]->network.keepalive_count);
+    auto initial (system.nodes [0]->network.keepalive_count.value ());
     auto iterations (0);
-    while (system.nodes [0]->network.keepalive_count == initial)
+    while (system.nodes [0]->network.keepalive_count.value () == initial)
     {
         system.poll ();
         ++iterations;
@@ -154,7 +154,7 @@ TEST (network, send_discarded_publish)
     ASSERT_EQ (genesis.hash (), system.nodes [0]->latest (rai::test_genesis_key.pub));
     ASSERT_EQ (genesis.hash (), system.nodes [1]->latest (rai::test_genesis_key.pub));
     auto iterations (0);
-    while (system.nodes [1]->network.publish_count == 0)
+    while (system.nodes [1]->network.publish_count.value () == 0)
     {
         system.poll ();
         ++iterations;
@@ -173,7 +173,7 @@ TEST (network, send_invalid_publish)
     ASSERT_EQ (genesis.hash (), system.nodes [0]->latest (rai::test_genesis_key.pub));
     ASSERT_EQ (genesis.hash (), system.nodes [1]->latest (rai::test_genesis_key.pub));
     auto iterations (0);
-    while (system.nodes [1]->network.publish_count == 0)
+    while (system.nodes [1]->network.publish_count.value () == 0)
     {
         system.poll ();
         ++iterations;
@@ -195,7 +195,7 @@ TEST (network, send_valid_confirm_ack)
     rai::block_hash latest2 (system.nodes [1]->latest (rai::test_genesis_key.pub));
 	system.nodes [0]->process_receive_republish (std::unique_ptr <rai::block> (new rai::send_block (block2)), 0);
     auto iterations (0);
-    while (system.nodes [1]->network.confirm_ack_count == 0)
+    while (system.nodes [1]->network.confirm_ack_count.value () == 0)
     {
         system.poll ();
         ++iterations;
@@ -219,7 +219,7 @@ TEST (network, send_valid_publish)
     rai::block_hash latest2 (system.nodes [1]->latest (rai::test_genesis_key.pub));
     system.nodes [1]->process_receive_republish (std::unique_ptr <rai::block> (new rai::send_block (block2)), 0);
     auto iterations (0);
-    while (system.nodes [0]->network.publish_count == 0)
+    while (system.nodes [0]->network.publish_count.value () == 0)
     {
         system.poll ();
         ++iterations;
@@ -243,15 +243,15 @@ TEST (network, send_insufficient_work)
     }
     auto node1 (system.nodes [1]->shared ());
     system.nodes [0]->network.send_buffer (bytes->data (), bytes->size (), system.nodes [1]->network.endpoint (), 0, [bytes, node1] (boost::system::error_code const & ec, size_t size) {});
-    ASSERT_EQ (0, system.nodes [0]->network.insufficient_work_count);
+    ASSERT_EQ (0, system.nodes [0]->network.insufficient_work_count.value ());
     auto iterations (0);
-    while (system.nodes [1]->network.insufficient_work_count == 0)
+    while (system.nodes [1]->network.insufficient_work_count.value () == 0)
     {
         system.poll ();
         ++iterations;
         ASSERT_LT (iterations, 200);
     }
-    ASSERT_EQ (1, system.nodes [1]->network.insufficient_work_count);
+    ASSERT_EQ (1, system.nodes [1]->network.insufficient_work_count.value ());
 }
 
 TEST (receivable_processor, confirm_insufficient_pos)
@@ -463,8 +463,7 @@ TEST (bulk_pull, none)
     req->end = genesis.hash ();
     connection->requests.push (std::unique_ptr <rai::message> {});
     auto request (std::make_shared <rai::bulk_pull_server> (connection, std::move (req)));
-    auto block (request->get_next ());
-    ASSERT_EQ (nullptr, block);
+    ASSERT_FALSE (request->get_next ());
 }
 
 TEST (bulk_pull, get_next_on_open)
@@ -476,7 +475,9 @@ TEST (bulk_pull, get_next_on_open)
     req->end.clear ();
     connection->requests.push (std::unique_ptr <rai::message> {});
     auto request (std::make_shared <rai::bulk_pull_server> (connection, std::move (req)));
-    auto block (request->get_next ());
+    ASSERT_TRUE (request->get_next ());
+    rai::bufferstream stream (request->send_buffer.data (), request->send_buffer.size ());
+    auto block (rai::deserialize_block (stream));
     ASSERT_NE (nullptr, block);
     ASSERT_TRUE (block->previous ().is_zero ());
     ASSERT_FALSE (connection->requests.empty ());
@@ -484,6 +485,26 @@ TEST (bulk_pull, get_next_on_open)
     ASSERT_EQ (request->current, request->request->end);
 }
 
+TEST (bulk_pull, block_hash)
+{
+    rai::system system (24000, 1);
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	ASSERT_NE (nullptr, system.wallet (0)->send_action (rai::test_genesis_key.pub, rai::test_genesis_key.pub, 100));
+	rai::genesis genesis;
+	auto latest (system.nodes [0]->latest (rai::test_genesis_key.pub));
+    auto connection (std::make_shared <rai::bootstrap_server> (nullptr, system.nodes [0]));
+    std::unique_ptr <rai::bulk_pull> req (new rai::bulk_pull {});
+    req->start = latest;
+    req->end.clear ();
+    connection->requests.push (std::unique_ptr <rai::message> {});
+    auto request (std::make_shared <rai::bulk_pull_server> (connection, std::move (req)));
+    ASSERT_EQ (latest, request->current);
+    ASSERT_TRUE (request->get_next ());
+    ASSERT_EQ (genesis.hash (), request->current);
+    ASSERT_TRUE (request->get_next ());
+    ASSERT_FALSE (request->get_next ());
+}
+
 TEST (bootstrap_processor, DISABLED_process_none)
 {
     rai::system system (24000, 1);
@@ -522,6 +543,65 @@ TEST (bootstrap_processor, process_one)
     node1->stop ();
 }
 
+// Only the chain below the requested block is pulled, down to where it joins the ledger
+TEST (bootstrap_processor, dependency_pull)
+{
+	rai::system system (24000, 1);
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	ASSERT_NE (nullptr, system.wallet (0)->send_action (rai::test_genesis_key.pub, rai::test_genesis_key.pub, 50));
+	rai::block_hash hash1 (system.nodes [0]->latest (rai::test_genesis_key.pub));
+	ASSERT_NE (nullptr, system.wallet (0)->send_action (rai::test_genesis_key.pub, rai::test_genesis_key.pub, 50));
+	rai::block_hash hash2 (system.nodes [0]->latest (rai::test_genesis_key.pub));
+	rai::node_init init1;
+	auto node1 (std::make_shared <rai::node> (init1, system.service, 24001, rai::unique_path (), system.alarm, system.logging, system.work));
+	auto endpoint (system.nodes [0]->network.endpoint ());
+	std::atomic <int> missing (-1);
+	auto pull (std::make_shared <rai::dependency_pull> (node1, rai::tcp_endpoint (endpoint.address (), endpoint.port ()), hash1, [&missing] (bool missing_a)
+	{
+		missing = missing_a;
+	}));
+	pull->run ();
+	auto iterations (0);
+	while (missing == -1)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_EQ (0, missing);
+	ASSERT_EQ (hash1, node1->latest (rai::test_genesis_key.pub));
+	ASSERT_TRUE (pull->completed);
+	ASSERT_EQ (1, pull->blocks.size ());
+	rai::transaction transaction (node1->store.environment, nullptr, false);
+	ASSERT_FALSE (node1->store.block_exists (transaction, hash2));
+	node1->stop ();
+}
+
+// A peer that doesn't have the block answers with nothing, the caller is told so it can bootstrap instead
+TEST (bootstrap_processor, dependency_pull_missing)
+{
+	rai::system system (24000, 1);
+	rai::node_init init1;
+	auto node1 (std::make_shared <rai::node> (init1, system.service, 24001, rai::unique_path (), system.alarm, system.logging, system.work));
+	auto endpoint (system.nodes [0]->network.endpoint ());
+	std::atomic <int> missing (-1);
+	auto pull (std::make_shared <rai::dependency_pull> (node1, rai::tcp_endpoint (endpoint.address (), endpoint.port ()), rai::block_hash (1), [&missing] (bool missing_a)
+	{
+		missing = missing_a;
+	}));
+	pull->run ();
+	auto iterations (0);
+	while (missing == -1)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_EQ (1, missing);
+	ASSERT_TRUE (pull->blocks.empty ());
+	node1->stop ();
+}
+
 TEST (bootstrap_processor, process_two)
 {
 	rai::system system (24000, 1);
@@ -580,6 +660,135 @@ TEST (bootstrap_processor, process_new)
 	node1->stop ();
 }
 
+TEST (bootstrap_processor, checksum_walk)
+{
+	rai::system system (24000, 1);
+	auto & node0 (*system.nodes [0]);
+	rai::node_init init1;
+	auto node1 (std::make_shared <rai::node> (init1, system.service, 24002, rai::unique_path (), system.alarm, system.logging, system.work));
+	ASSERT_FALSE (init1.error ());
+	// Both nodes share many accounts so the walk has to skip matching subtrees
+	for (auto i (0); i < 32; ++i)
+	{
+		rai::keypair key;
+		auto latest (node0.latest (rai::test_genesis_key.pub));
+		rai::send_block send (latest, key.pub, rai::genesis_amount - i - 1, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (latest));
+		rai::open_block open (send.hash (), 1, key.pub, key.prv, key.pub, system.work.generate (key.pub));
+		ASSERT_EQ (rai::process_result::progress, node0.process (send).code);
+		ASSERT_EQ (rai::process_result::progress, node0.process (open).code);
+		ASSERT_EQ (rai::process_result::progress, node1->process (send).code);
+		ASSERT_EQ (rai::process_result::progress, node1->process (open).code);
+	}
+	auto latest (node0.latest (rai::test_genesis_key.pub));
+	rai::send_block send (latest, rai::test_genesis_key.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (latest));
+	ASSERT_EQ (rai::process_result::progress, node0.process (send).code);
+	// As if node0 had advertised its version in a keepalive
+	node1->peers.insert (node0.network.endpoint ());
+	node1->peers.network_version (node0.network.endpoint (), rai::checksum_req::version);
+	node1->bootstrap_initiator.bootstrap (node0.network.endpoint ());
+	auto iterations (0);
+	while (node1->latest (rai::test_genesis_key.pub) != send.hash ())
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	// Only the path down to the genesis account's leaf differs
+	auto & requests (node1->stats.counter ("bootstrap", "checksum_requests"));
+	auto & leaves (node1->stats.counter ("bootstrap", "checksum_leaves"));
+	ASSERT_EQ (1, leaves.value ());
+	ASSERT_EQ (rai::checksum_leaf_depth / rai::checksum_level_bits + 1, requests.value ());
+	node1->stop ();
+}
+
+TEST (bootstrap_processor, checksum_far_behind)
+{
+	rai::system system (24000, 1);
+	auto & node0 (*system.nodes [0]);
+	rai::node_init init1;
+	auto node1 (std::make_shared <rai::node> (init1, system.service, 24002, rai::unique_path (), system.alarm, system.logging, system.work));
+	ASSERT_FALSE (init1.error ());
+	// Enough shared accounts that node1 walks the tree at all
+	auto open_account = [&system, &node0] (rai::node * other_a, rai::keypair const & key_a)
+	{
+		auto latest (node0.latest (rai::test_genesis_key.pub));
+		rai::send_block send (latest, key_a.pub, node0.balance (rai::test_genesis_key.pub) - 1, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (latest));
+		rai::open_block open (send.hash (), 1, key_a.pub, key_a.prv, key_a.pub, system.work.generate (key_a.pub));
+		ASSERT_EQ (rai::process_result::progress, node0.process (send).code);
+		ASSERT_EQ (rai::process_result::progress, node0.process (open).code);
+		if (other_a != nullptr)
+		{
+			ASSERT_EQ (rai::process_result::progress, other_a->process (send).code);
+			ASSERT_EQ (rai::process_result::progress, other_a->process (open).code);
+		}
+	};
+	for (size_t i (0); i <= rai::checksum_req_client::accounts_min; ++i)
+	{
+		open_account (node1.get (), rai::keypair ());
+	}
+	// Accounts node1 is missing land under nearly every root child
+	rai::account last;
+	for (auto i (0); i < 64; ++i)
+	{
+		rai::keypair key;
+		open_account (nullptr, key);
+		last = key.pub;
+	}
+	node1->peers.insert (node0.network.endpoint ());
+	node1->peers.network_version (node0.network.endpoint (), rai::checksum_req::version);
+	node1->bootstrap_initiator.bootstrap (node0.network.endpoint ());
+	auto iterations (0);
+	while (node1->latest (last) != node0.latest (last))
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	// The root's children are compared once, then all frontiers come in one stream
+	auto & requests (node1->stats.counter ("bootstrap", "checksum_requests"));
+	auto & subtrees (node1->stats.counter ("bootstrap", "checksum_subtrees"));
+	ASSERT_EQ (1, subtrees.value ());
+	ASSERT_EQ (2, requests.value ());
+	node1->stop ();
+}
+
+TEST (bootstrap_processor, checksum_old_peer)
+{
+	rai::system system (24000, 1);
+	auto & node0 (*system.nodes [0]);
+	rai::node_init init1;
+	auto node1 (std::make_shared <rai::node> (init1, system.service, 24002, rai::unique_path (), system.alarm, system.logging, system.work));
+	ASSERT_FALSE (init1.error ());
+	for (size_t i (0); i <= rai::checksum_req_client::accounts_min; ++i)
+	{
+		rai::keypair key;
+		auto latest (node0.latest (rai::test_genesis_key.pub));
+		rai::send_block send (latest, key.pub, rai::genesis_amount - i - 1, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (latest));
+		rai::open_block open (send.hash (), 1, key.pub, key.prv, key.pub, system.work.generate (key.pub));
+		ASSERT_EQ (rai::process_result::progress, node0.process (send).code);
+		ASSERT_EQ (rai::process_result::progress, node0.process (open).code);
+		ASSERT_EQ (rai::process_result::progress, node1->process (send).code);
+		ASSERT_EQ (rai::process_result::progress, node1->process (open).code);
+	}
+	auto latest (node0.latest (rai::test_genesis_key.pub));
+	rai::send_block send (latest, rai::test_genesis_key.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (latest));
+	ASSERT_EQ (rai::process_result::progress, node0.process (send).code);
+	// A peer that never advertised checksum support only gets a frontier_req
+	node1->peers.insert (node0.network.endpoint ());
+	node1->peers.network_version (node0.network.endpoint (), 0x01);
+	node1->bootstrap_initiator.bootstrap (node0.network.endpoint ());
+	auto iterations (0);
+	while (node1->latest (rai::test_genesis_key.pub) != send.hash ())
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_EQ (0, node1->stats.counter ("bootstrap", "checksum_requests").value ());
+	ASSERT_EQ (1, node1->stats.counter ("bootstrap", "frontier_requests").value ());
+	node1->stop ();
+}
+
 TEST (bootstrap_processor, pull_diamond)
 {
 	rai::system system (24000, 1);
@@ -374,7 +374,7 @@ TEST (node, connect_after_junk)
     uint64_t junk (0);
     node1->network.socket.async_send_to (boost::asio::buffer (&junk, sizeof (junk)), system.nodes [0]->network.endpoint (), [] (boost::system::error_code const &, size_t) {});
     auto iterations1 (0);
-    while (system.nodes [0]->network.error_count == 0)
+    while (system.nodes [0]->network.error_count.value () == 0)
     {
         system.poll ();
         ++iterations1;
@@ -416,6 +416,7 @@ TEST (logging, serialization)
 	logging1.work_generation_time_value = !logging1.work_generation_time_value;
 	logging1.log_to_cerr_value = !logging1.log_to_cerr_value;
 	logging1.max_size = 10;
+	logging1.rate_limit = 5;
 	boost::property_tree::ptree tree;
 	logging1.serialize_json (tree);
 	rai::logging logging2 (path);
@@ -436,6 +437,7 @@ TEST (logging, serialization)
 	ASSERT_EQ (logging1.work_generation_time_value, logging2.work_generation_time_value);
 	ASSERT_EQ (logging1.log_to_cerr_value, logging2.log_to_cerr_value);
 	ASSERT_EQ (logging1.max_size, logging2.max_size);
+	ASSERT_EQ (logging1.rate_limit, logging2.rate_limit);
 }
 
 TEST (logging, upgrade_v1_v2)
@@ -450,10 +452,27 @@ TEST (logging, upgrade_v1_v2)
 	tree.erase ("vote");
 	bool upgraded (false);
 	ASSERT_FALSE (logging2.deserialize_json (upgraded, tree));
-	ASSERT_EQ ("2", tree.get <std::string> ("version"));
+	ASSERT_EQ ("3", tree.get <std::string> ("version"));
 	ASSERT_EQ (false, tree.get <bool> ("vote"));
 }
 
+TEST (logging, upgrade_v2_v3)
+{
+	auto path1 (rai::unique_path ());
+	auto path2 (rai::unique_path ());
+	rai::logging logging1 (path1);
+	rai::logging logging2 (path2);
+	boost::property_tree::ptree tree;
+	logging1.serialize_json (tree);
+	tree.put ("version", "2");
+	tree.erase ("rate_limit");
+	bool upgraded (false);
+	ASSERT_FALSE (logging2.deserialize_json (upgraded, tree));
+	ASSERT_TRUE (upgraded);
+	ASSERT_EQ ("3", tree.get <std::string> ("version"));
+	ASSERT_EQ (1000, logging2.rate_limit);
+}
+
 TEST (node, price)
 {
 	rai::system system (24000, 1);
@@ -479,6 +498,8 @@ TEST (node_config, serialization)
 	config1.receive_minimum = 10;
 	config1.inactive_supply = 10;
 	config1.password_fanout = 10;
+	config1.prune_tail = 10;
+	config1.gap_cache_bytes = 10;
 	boost::property_tree::ptree tree;
 	config1.serialize_json (tree);
 	rai::logging logging2 (path);
@@ -492,6 +513,8 @@ TEST (node_config, serialization)
 	ASSERT_NE (config2.logging.node_lifetime_tracing_value, config1.logging.node_lifetime_tracing_value);
 	ASSERT_NE (config2.inactive_supply, config1.inactive_supply);
 	ASSERT_NE (config2.password_fanout, config1.password_fanout);
+	ASSERT_NE (config2.prune_tail, config1.prune_tail);
+	ASSERT_NE (config2.gap_cache_bytes, config1.gap_cache_bytes);
 	bool upgraded (false);
 	config2.deserialize_json (upgraded, tree);
 	ASSERT_FALSE (upgraded);
@@ -503,6 +526,8 @@ TEST (node_config, serialization)
 	ASSERT_EQ (config2.logging.node_lifetime_tracing_value, config1.logging.node_lifetime_tracing_value);
 	ASSERT_EQ (config2.inactive_supply, config1.inactive_supply);
 	ASSERT_EQ (config2.password_fanout, config1.password_fanout);
+	ASSERT_EQ (config2.prune_tail, config1.prune_tail);
+	ASSERT_EQ (config2.gap_cache_bytes, config1.gap_cache_bytes);
 }
 
 TEST (node_config, v1_v2_upgrade)
@@ -1018,7 +1043,7 @@ TEST (node, fork_no_vote_quorum)
 	rai::raw_key key3;
 	ASSERT_FALSE (system.wallet (1)->store.fetch (rai::transaction (system.wallet (1)->store.environment, nullptr, false), key1, key3));
 	node2.network.confirm_block (key3, key1, send2.clone (), 0, node3.network.endpoint (), 0);
-	while (node3.network.confirm_ack_count < 3)
+	while (node3.network.confirm_ack_count.value () < 3)
 	{
 		system.poll ();
 	}
@@ -1287,5 +1312,282 @@ TEST (node, no_voting)
 		++iterations;
 		ASSERT_GT (200, iterations);
 	}
-	ASSERT_EQ (0, node1.network.confirm_ack_count);
+	ASSERT_EQ (0, node1.network.confirm_ack_count.value ());
+}
+
+// Consecutive requests to the same work peer should reuse one connection
+TEST (node, work_peer_keepalive)
+{
+    rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	auto peer (std::make_shared <rai::fake_work_peer> (system.work, system.service, 24100, rai::work_peer_type::good));
+	peer->start ();
+	node1.config.work_peers.push_back (std::make_pair (peer->endpoint ().address (), peer->endpoint ().port ()));
+	for (auto i (0); i < 4; ++i)
+	{
+		rai::keypair key1;
+		uint64_t work (0);
+		node1.generate_work (key1.pub, [&work] (uint64_t work_a)
+		{
+			work = work_a;
+		});
+		auto iterations (0);
+		while (system.work.work_validate (key1.pub, work))
+		{
+			system.poll ();
+			++iterations;
+			ASSERT_GT (200, iterations);
+		}
+	}
+	ASSERT_EQ (4, peer->generations);
+	ASSERT_EQ (1, peer->connections);
+	peer->stop ();
+}
+
+// The first valid result wins and every other peer is told to stop
+TEST (node, work_peer_cancel)
+{
+    rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	auto good (std::make_shared <rai::fake_work_peer> (system.work, system.service, 24100, rai::work_peer_type::good));
+	good->start ();
+	auto silent (std::make_shared <rai::fake_work_peer> (system.work, system.service, 24101, rai::work_peer_type::silent));
+	silent->start ();
+	node1.config.work_peers.push_back (std::make_pair (good->endpoint ().address (), good->endpoint ().port ()));
+	node1.config.work_peers.push_back (std::make_pair (silent->endpoint ().address (), silent->endpoint ().port ()));
+	rai::keypair key1;
+	uint64_t work (0);
+	node1.generate_work (key1.pub, [&work] (uint64_t work_a)
+	{
+		work = work_a;
+	});
+	auto iterations (0);
+	while (system.work.work_validate (key1.pub, work) || silent->cancels == 0)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_GT (200, iterations);
+	}
+	ASSERT_EQ (1, silent->generations);
+	ASSERT_EQ (0, good->cancels);
+	good->stop ();
+	silent->stop ();
+}
+
+// Peers returning bad work are backed off and faster peers are asked first
+TEST (node, work_peer_health)
+{
+    rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	auto good (std::make_shared <rai::fake_work_peer> (system.work, system.service, 24100, rai::work_peer_type::good));
+	good->start ();
+	auto malicious (std::make_shared <rai::fake_work_peer> (system.work, system.service, 24101, rai::work_peer_type::malicious));
+	malicious->start ();
+	node1.config.work_peers.push_back (std::make_pair (malicious->endpoint ().address (), malicious->endpoint ().port ()));
+	for (auto i (0); i < rai::work_peer_client::failure_limit; ++i)
+	{
+		// Invalid results fall back to local generation
+		rai::keypair key1;
+		uint64_t work (0);
+		node1.generate_work (key1.pub, [&work] (uint64_t work_a)
+		{
+			work = work_a;
+		});
+		auto iterations (0);
+		while (system.work.work_validate (key1.pub, work))
+		{
+			system.poll ();
+			++iterations;
+			ASSERT_GT (200, iterations);
+		}
+	}
+	ASSERT_EQ (rai::work_peer_client::failure_limit, malicious->generations);
+	ASSERT_TRUE (node1.work_client.select ().empty ());
+	node1.config.work_peers.push_back (std::make_pair (good->endpoint ().address (), good->endpoint ().port ()));
+	auto peers1 (node1.work_client.select ());
+	ASSERT_EQ (1, peers1.size ());
+	ASSERT_EQ (good->endpoint (), peers1 [0]);
+	// Once the backoff has passed the peer is retried, ordered by latency
+	node1.work_client.success (good->endpoint (), std::chrono::microseconds (1000));
+	node1.work_client.success (malicious->endpoint (), std::chrono::microseconds (10));
+	node1.work_client.peers [malicious->endpoint ()].retry_after = std::chrono::steady_clock::now ();
+	auto peers2 (node1.work_client.select ());
+	ASSERT_EQ (2, peers2.size ());
+	ASSERT_EQ (malicious->endpoint (), peers2 [0]);
+	ASSERT_EQ (good->endpoint (), peers2 [1]);
+	good->stop ();
+	malicious->stop ();
+}
+
+TEST (node, prune)
+{
+	rai::system system (24000, 1);
+	rai::node_init init1;
+	rai::node_config config (24001, system.logging);
+	config.prune_tail = 2;
+	auto node1 (std::make_shared <rai::node> (init1, system.service, rai::unique_path (), system.alarm, config, system.work));
+	ASSERT_FALSE (init1.error ());
+	rai::keypair key;
+	std::vector <rai::block_hash> sends;
+	for (auto i (0); i < 5; ++i)
+	{
+		auto latest (node1->latest (rai::test_genesis_key.pub));
+		rai::send_block send (latest, key.pub, rai::genesis_amount - (i + 1) * 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (latest));
+		ASSERT_EQ (rai::process_result::progress, node1->process (send).code);
+		sends.push_back (send.hash ());
+	}
+	node1->start ();
+	auto & pruned (node1->stats.counter ("ledger", "pruned"));
+	auto iterations (0);
+	while (pruned.value () < 4)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_EQ (sends [4], node1->latest (rai::test_genesis_key.pub));
+	ASSERT_EQ (rai::genesis_amount - 500, node1->balance (rai::test_genesis_key.pub));
+	ASSERT_EQ (nullptr, node1->block (sends [2]));
+	ASSERT_NE (nullptr, node1->block (sends [3]));
+	// Its keepalives tell peers not to bootstrap from it
+	node1->network.send_keepalive (system.nodes [0]->network.endpoint ());
+	auto iterations2 (0);
+	auto peers (system.nodes [0]->peers.list ());
+	while (peers.empty () || !peers [0].pruned)
+	{
+		system.poll ();
+		++iterations2;
+		ASSERT_LT (iterations2, 200);
+		peers = system.nodes [0]->peers.list ();
+	}
+	ASSERT_EQ (rai::endpoint (boost::asio::ip::address_v6::any (), 0), system.nodes [0]->peers.bootstrap_peer ());
+	node1->stop ();
+}
+
+TEST (node, snapshot)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::keypair key;
+	rai::genesis genesis;
+	rai::send_block send1 (genesis.hash (), key.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (genesis.hash ()));
+	ASSERT_EQ (rai::process_result::progress, node1.process (send1).code);
+	rai::send_block send2 (send1.hash (), key.pub, rai::genesis_amount - 300, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (send1.hash ()));
+	ASSERT_EQ (rai::process_result::progress, node1.process (send2).code);
+	rai::open_block open (send1.hash (), key.pub, key.pub, key.prv, key.pub, system.work.generate (key.pub));
+	ASSERT_EQ (rai::process_result::progress, node1.process (open).code);
+	auto path (rai::unique_path ());
+	ASSERT_FALSE (node1.snapshot.start (path));
+	node1.snapshot.wait ();
+	ASSERT_FALSE (node1.snapshot.running ());
+	ASSERT_FALSE (node1.snapshot.error);
+	ASSERT_EQ (boost::filesystem::file_size (path), node1.snapshot.size);
+	ASSERT_EQ (1.0, node1.snapshot.progress ());
+	bool init (false);
+	rai::block_store store (init, path);
+	ASSERT_FALSE (init);
+	rai::ledger ledger (store);
+	rai::transaction transaction1 (node1.store.environment, nullptr, false);
+	rai::transaction transaction2 (store.environment, nullptr, false);
+	ASSERT_EQ (node1.store.block_count (transaction1).sum (), store.block_count (transaction2).sum ());
+	ASSERT_EQ (node1.store.checksum_node (transaction1, 0, 0), store.checksum_node (transaction2, 0, 0));
+	for (auto account: { rai::test_genesis_key.pub, key.pub })
+	{
+		ASSERT_EQ (node1.ledger.latest (transaction1, account), ledger.latest (transaction2, account));
+		ASSERT_EQ (node1.ledger.account_balance (transaction1, account), ledger.account_balance (transaction2, account));
+		ASSERT_EQ (node1.ledger.weight (transaction1, account), ledger.weight (transaction2, account));
+	}
+	// A second copy to an existing file fails without touching it
+	ASSERT_FALSE (node1.snapshot.start (path));
+	node1.snapshot.wait ();
+	ASSERT_TRUE (node1.snapshot.error);
+}
+
+TEST (ledger_validator, valid)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::keypair key1;
+	rai::keypair key2;
+	rai::genesis genesis;
+	rai::send_block send1 (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (genesis.hash ()));
+	ASSERT_EQ (rai::process_result::progress, node1.process (send1).code);
+	rai::send_block send2 (send1.hash (), key1.pub, rai::genesis_amount - 300, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (send1.hash ()));
+	ASSERT_EQ (rai::process_result::progress, node1.process (send2).code);
+	rai::open_block open (send1.hash (), key2.pub, key1.pub, key1.prv, key1.pub, system.work.generate (key1.pub));
+	ASSERT_EQ (rai::process_result::progress, node1.process (open).code);
+	rai::receive_block receive (open.hash (), send2.hash (), key1.prv, key1.pub, system.work.generate (open.hash ()));
+	ASSERT_EQ (rai::process_result::progress, node1.process (receive).code);
+	rai::send_block send3 (receive.hash (), key2.pub, 250, key1.prv, key1.pub, system.work.generate (receive.hash ()));
+	ASSERT_EQ (rai::process_result::progress, node1.process (send3).code);
+	rai::change_block change (send2.hash (), key2.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (send2.hash ()));
+	ASSERT_EQ (rai::process_result::progress, node1.process (change).code);
+	rai::ledger_validator validator (node1);
+	validator.run (4);
+	std::stringstream report;
+	ASSERT_FALSE (validator.report (report));
+	ASSERT_EQ (2, validator.accounts);
+	ASSERT_EQ (7, validator.blocks);
+	ASSERT_EQ (3, validator.sends);
+	ASSERT_EQ (2, validator.receives);
+	ASSERT_EQ (1, validator.pending);
+	ASSERT_TRUE (validator.failures.empty ());
+}
+
+TEST (ledger_validator, pruned)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::keypair key1;
+	auto latest (node1.latest (rai::test_genesis_key.pub));
+	for (auto i (0); i < 4; ++i)
+	{
+		rai::send_block send (latest, key1.pub, rai::genesis_amount - (i + 1) * 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (latest));
+		ASSERT_EQ (rai::process_result::progress, node1.process (send).code);
+		latest = send.hash ();
+	}
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		rai::account cursor (0);
+		ASSERT_LT (0, node1.ledger.prune (transaction, cursor, 1, 1024));
+	}
+	rai::ledger_validator validator (node1);
+	validator.run (1);
+	std::stringstream report;
+	ASSERT_FALSE (validator.report (report));
+	ASSERT_GT (5, validator.blocks);
+	ASSERT_EQ (4, validator.pending);
+}
+
+TEST (ledger_validator, corrupt)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::keypair key1;
+	rai::genesis genesis;
+	rai::send_block send1 (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (genesis.hash ()));
+	ASSERT_EQ (rai::process_result::progress, node1.process (send1).code);
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		// Weight that no account backs, a pending entry with the wrong amount and a block signed by the wrong key
+		node1.store.representation_put (transaction, key1.pub, 5);
+		node1.store.pending_put (transaction, rai::pending_key (key1.pub, send1.hash ()), rai::pending_info (rai::test_genesis_key.pub, 99));
+		rai::change_block change (send1.hash (), key1.pub, key1.prv, key1.pub, system.work.generate (send1.hash ()));
+		node1.store.block_put (transaction, change.hash (), change);
+		rai::account_info info;
+		ASSERT_FALSE (node1.store.account_get (transaction, rai::test_genesis_key.pub, info));
+		info.head = change.hash ();
+		node1.store.account_put (transaction, rai::test_genesis_key.pub, info);
+	}
+	rai::ledger_validator validator (node1);
+	validator.run (2);
+	std::stringstream report;
+	ASSERT_TRUE (validator.report (report));
+	// The genesis representative loses the weight the chain no longer leads to
+	ASSERT_EQ (2, validator.failures ["weight"]);
+	ASSERT_EQ (2, validator.failures ["pending"]);
+	ASSERT_EQ (1, validator.failures ["signature"]);
+	ASSERT_EQ (1, validator.failures ["representative"]);
+	ASSERT_EQ (0, validator.failures.count ("work"));
+	ASSERT_NE (std::string::npos, report.str ().find ("bad signature"));
 }
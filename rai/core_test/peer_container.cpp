@@ -139,3 +139,18 @@ TEST (peer_container, rep_weight)
 	ASSERT_EQ (100, reps [0].rep_weight.number ());
 	ASSERT_EQ (endpoint0, reps [0].endpoint);
 }
+
+TEST (peer_container, bootstrap_peer_pruned)
+{
+    rai::peer_container peers (rai::endpoint {});
+	rai::endpoint endpoint0 (boost::asio::ip::address_v6::loopback (), 24000);
+	rai::endpoint endpoint1 (boost::asio::ip::address_v6::loopback (), 24001);
+	peers.insert (endpoint0);
+	peers.pruned (endpoint0, true);
+	ASSERT_EQ (rai::endpoint (boost::asio::ip::address_v6::any (), 0), peers.bootstrap_peer ());
+	peers.insert (endpoint1);
+	ASSERT_EQ (endpoint1, peers.bootstrap_peer ());
+	ASSERT_EQ (endpoint1, peers.bootstrap_peer ());
+	peers.pruned (endpoint0, false);
+	ASSERT_EQ (endpoint0, peers.bootstrap_peer ());
+}
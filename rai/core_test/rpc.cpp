@@ -2,6 +2,7 @@
 
 #include <rai/node/testing.hpp>
 #include <rai/node/rpc.hpp>
+#include <rai/trace.hpp>
 
 #include <beast/http.hpp>
 #include <beast/http/string_body.hpp>
@@ -647,6 +648,38 @@ TEST (rpc, block_account)
     ASSERT_FALSE (account.decode_account (account_text));
 }
 
+TEST (rpc, block_account_pruned)
+{
+    rai::system system (24000, 1);
+	auto & node (*system.nodes [0]);
+	rai::keypair key;
+	for (auto i (0); i < 4; ++i)
+	{
+		auto latest (node.latest (rai::test_genesis_key.pub));
+		rai::send_block send (latest, key.pub, rai::genesis_amount - (i + 1) * 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (latest));
+		ASSERT_EQ (rai::process_result::progress, node.process (send).code);
+	}
+	{
+		rai::transaction transaction (node.store.environment, nullptr, true);
+		ASSERT_LT (0, node.ledger.prune_account (transaction, rai::test_genesis_key.pub, 1, 1000));
+	}
+    rai::rpc rpc (system.service, node, rai::rpc_config (true));
+	rpc.start ();
+	// The open block is kept as the representative block while the blocks after it are gone
+	rai::genesis genesis;
+	ASSERT_NE (nullptr, node.block (genesis.hash ()));
+    boost::property_tree::ptree request;
+    request.put ("action", "block_account");
+	request.put ("hash", genesis.hash ().to_string ());
+	test_response response (request, rpc, system.service);
+	while (response.status == 0)
+	{
+		system.poll ();
+	}
+    ASSERT_EQ (200, response.status);
+    ASSERT_EQ (rai::test_genesis_key.pub.to_account (), response.json.get <std::string> ("account"));
+}
+
 TEST (rpc, chain)
 {
     rai::system system (24000, 1);
@@ -710,6 +743,145 @@ TEST (rpc, chain_limit)
 	ASSERT_EQ (block->hash(), blocks [0]);
 }
 
+TEST (rpc, chain_cursor)
+{
+	rai::system system (24000, 1);
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	rai::keypair key;
+	auto genesis (system.nodes [0]->latest (rai::test_genesis_key.pub));
+	auto block1 (system.wallet (0)->send_action (rai::test_genesis_key.pub, key.pub, 1));
+	ASSERT_NE (nullptr, block1);
+	auto block2 (system.wallet (0)->send_action (rai::test_genesis_key.pub, key.pub, 1));
+	ASSERT_NE (nullptr, block2);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "chain");
+	request.put ("block", block2->hash ().to_string ());
+	request.put ("count", 2);
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	ASSERT_EQ (2, response1.json.get_child ("blocks").size ());
+	auto cursor (response1.json.get <std::string> ("cursor"));
+	request.put ("cursor", cursor);
+	test_response response2 (request, rpc, system.service);
+	while (response2.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response2.status);
+	auto & blocks2 (response2.json.get_child ("blocks"));
+	ASSERT_EQ (1, blocks2.size ());
+	ASSERT_EQ (genesis.to_string (), blocks2.front ().second.get <std::string> (""));
+	ASSERT_FALSE (response2.json.get_optional <std::string> ("cursor"));
+	// Walking forward from the open block by height
+	boost::property_tree::ptree request3;
+	request3.put ("action", "chain");
+	request3.put ("account", rai::test_genesis_key.pub.to_account ());
+	request3.put ("height", 2);
+	request3.put ("count", 10);
+	request3.put ("reverse", true);
+	test_response response3 (request3, rpc, system.service);
+	while (response3.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response3.status);
+	std::vector <std::string> blocks3;
+	for (auto & i: response3.json.get_child ("blocks"))
+	{
+		blocks3.push_back (i.second.get <std::string> (""));
+	}
+	ASSERT_EQ (std::vector <std::string> ({block1->hash ().to_string (), block2->hash ().to_string ()}), blocks3);
+}
+
+TEST (rpc, history_hashes_only)
+{
+	rai::system system (24000, 1);
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	rai::keypair key;
+	auto genesis (system.nodes [0]->latest (rai::test_genesis_key.pub));
+	auto block1 (system.wallet (0)->send_action (rai::test_genesis_key.pub, key.pub, 1));
+	ASSERT_NE (nullptr, block1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "history");
+	request.put ("hash", block1->hash ().to_string ());
+	request.put ("count", 1);
+	request.put ("hashes_only", true);
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	auto & history1 (response1.json.get_child ("history"));
+	ASSERT_EQ (1, history1.size ());
+	ASSERT_EQ (block1->hash ().to_string (), history1.front ().second.get <std::string> (""));
+	ASSERT_EQ (genesis.to_string (), response1.json.get <std::string> ("cursor"));
+	// Full entries carry on from the cursor
+	request.put ("hashes_only", false);
+	request.put ("cursor", response1.json.get <std::string> ("cursor"));
+	test_response response2 (request, rpc, system.service);
+	while (response2.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response2.status);
+	auto & history2 (response2.json.get_child ("history"));
+	ASSERT_EQ (1, history2.size ());
+	ASSERT_EQ (genesis.to_string (), history2.front ().second.get <std::string> ("hash"));
+	ASSERT_FALSE (response2.json.get_optional <std::string> ("cursor"));
+}
+
+TEST (rpc, frontier_cursor)
+{
+	rai::system system (24000, 1);
+	{
+		rai::transaction transaction (system.nodes [0]->store.environment, nullptr, true);
+		for (auto i (0); i < 10; ++i)
+		{
+			rai::keypair key;
+			system.nodes [0]->store.account_put (transaction, key.pub, rai::account_info (key.prv.data, 0, 0, 0, 0));
+		}
+	}
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	std::set <std::string> seen;
+	boost::property_tree::ptree request;
+	request.put ("action", "frontiers");
+	request.put ("account", rai::account (0).to_account ());
+	request.put ("count", 4);
+	auto pages (0);
+	while (true)
+	{
+		test_response response (request, rpc, system.service);
+		while (response.status == 0)
+		{
+			system.poll ();
+		}
+		ASSERT_EQ (200, response.status);
+		++pages;
+		for (auto & i: response.json.get_child ("frontiers"))
+		{
+			ASSERT_TRUE (seen.insert (i.first).second);
+		}
+		auto cursor (response.json.get_optional <std::string> ("cursor"));
+		if (!cursor)
+		{
+			break;
+		}
+		request.put ("cursor", cursor.get ());
+	}
+	ASSERT_EQ (3, pages);
+	ASSERT_EQ (11, seen.size ());
+}
+
 TEST (rpc, frontier)
 {
     rai::system system (24000, 1);
@@ -1313,7 +1485,7 @@ TEST (rpc, version)
     ASSERT_EQ (200, response1.status);
 	ASSERT_EQ ("1", response1.json.get <std::string> ("rpc_version"));
     ASSERT_EQ (200, response1.status);
-	ASSERT_EQ ("5", response1.json.get <std::string> ("store_version"));
+	ASSERT_EQ ("7", response1.json.get <std::string> ("store_version"));
 	ASSERT_EQ (boost::str (boost::format ("RaiBlocks %1%.%2%.%3%") % RAIBLOCKS_VERSION_MAJOR % RAIBLOCKS_VERSION_MINOR % RAIBLOCKS_VERSION_PATCH), response1.json.get <std::string> ("node_vendor"));
 	auto & headers (response1.resp.fields);
 	auto access_control (std::find_if (headers.begin (), headers.end (), [] (decltype (*headers.begin ()) & header_a) { return boost::iequals (header_a.first, "Access-Control-Allow-Origin"); }));
@@ -1723,3 +1895,734 @@ TEST (rpc, bootstrap)
 		ASSERT_GT (200, iterations);
 	}
 }
+
+namespace
+{
+void write_request (boost::asio::ip::tcp::socket & socket_a, std::string const & action_a, bool keep_alive_a)
+{
+	boost::property_tree::ptree request_l;
+	request_l.put ("action", action_a);
+	std::stringstream ostream;
+	boost::property_tree::write_json (ostream, request_l);
+	beast::http::request <beast::http::string_body> req;
+	req.method = "POST";
+	req.url = "/";
+	req.version = 11;
+	req.body = ostream.str ();
+	if (keep_alive_a)
+	{
+		beast::http::prepare (req, beast::http::connection::keep_alive);
+	}
+	else
+	{
+		beast::http::prepare (req, beast::http::connection::close);
+	}
+	beast::http::write (socket_a, req);
+}
+
+boost::property_tree::ptree read_response (boost::asio::ip::tcp::socket & socket_a, beast::streambuf & buffer_a)
+{
+	beast::http::response <beast::http::string_body> resp;
+	beast::http::read (socket_a, buffer_a, resp);
+	std::stringstream body (resp.body);
+	boost::property_tree::ptree result;
+	boost::property_tree::read_json (body, result);
+	return result;
+}
+}
+
+TEST (rpc, keepalive_pipelined)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	std::atomic <bool> done (false);
+	std::thread client ([&rpc, &done] ()
+	{
+		boost::asio::io_service service;
+		boost::asio::ip::tcp::socket socket (service);
+		socket.connect (rai::tcp_endpoint (boost::asio::ip::address_v6::loopback (), rpc.config.port));
+		beast::streambuf buffer;
+		// All three are written before any response is read
+		write_request (socket, "version", true);
+		write_request (socket, "block_count", true);
+		write_request (socket, "frontier_count", true);
+		auto response1 (read_response (socket, buffer));
+		EXPECT_EQ ("1", response1.get <std::string> ("rpc_version"));
+		auto response2 (read_response (socket, buffer));
+		EXPECT_EQ ("1", response2.get <std::string> ("count"));
+		auto response3 (read_response (socket, buffer));
+		EXPECT_EQ ("1", response3.get <std::string> ("count"));
+		EXPECT_FALSE (response3.get_optional <std::string> ("rpc_version"));
+		// Connection stays usable until the client asks to close it
+		write_request (socket, "version", false);
+		auto response4 (read_response (socket, buffer));
+		EXPECT_EQ ("1", response4.get <std::string> ("rpc_version"));
+		boost::system::error_code ec;
+		char byte;
+		boost::asio::read (socket, boost::asio::buffer (&byte, 1), ec);
+		EXPECT_EQ (boost::asio::error::eof, ec);
+		done = true;
+	});
+	auto iterations (0);
+	while (!done)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 2000);
+	}
+	client.join ();
+	ASSERT_EQ (1, rpc.connections.size ());
+}
+
+TEST (rpc, connection_limits)
+{
+	rai::system system (24000, 1);
+	rai::rpc_config config (true);
+	config.max_connections = 1;
+	config.idle_timeout = 1;
+	rai::rpc rpc (system.service, *system.nodes [0], config);
+	rpc.start ();
+	std::atomic <bool> done (false);
+	std::thread client ([&rpc, &done] ()
+	{
+		boost::asio::io_service service;
+		boost::asio::ip::tcp::socket socket1 (service);
+		socket1.connect (rai::tcp_endpoint (boost::asio::ip::address_v6::loopback (), rpc.config.port));
+		beast::streambuf buffer1;
+		write_request (socket1, "version", true);
+		EXPECT_EQ ("1", read_response (socket1, buffer1).get <std::string> ("rpc_version"));
+		// Over the limit, the server hangs up without answering
+		boost::asio::ip::tcp::socket socket2 (service);
+		socket2.connect (rai::tcp_endpoint (boost::asio::ip::address_v6::loopback (), rpc.config.port));
+		boost::system::error_code ec;
+		char byte;
+		boost::asio::read (socket2, boost::asio::buffer (&byte, 1), ec);
+		EXPECT_TRUE (ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset);
+		// Left idle the first connection is closed as well
+		auto begin (std::chrono::steady_clock::now ());
+		boost::asio::read (socket1, boost::asio::buffer (&byte, 1), ec);
+		EXPECT_EQ (boost::asio::error::eof, ec);
+		EXPECT_GE (std::chrono::steady_clock::now () - begin, std::chrono::milliseconds (500));
+		done = true;
+	});
+	auto iterations (0);
+	while (!done)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 20000);
+	}
+	client.join ();
+}
+
+TEST (rpc, json_writer)
+{
+	std::string output;
+	rai::json_writer writer (output);
+	writer.begin_object ();
+	writer.put ("text", "quote\" backslash\\ newline\n control\x01");
+	writer.begin_array ("empty");
+	writer.end_array ();
+	writer.begin_array ("list");
+	writer.put ("", "1");
+	writer.put ("", "2");
+	writer.end_array ();
+	boost::property_tree::ptree entry;
+	entry.put ("type", "send");
+	entry.put ("amount", "100");
+	writer.put_child ("entry", entry);
+	writer.end_object ();
+	ASSERT_EQ ("{\"text\":\"quote\\\" backslash\\\\ newline\\n control\\u0001\",\"empty\":[],\"list\":[\"1\",\"2\"],\"entry\":{\"type\":\"send\",\"amount\":\"100\"}}", output);
+	std::stringstream stream (output);
+	boost::property_tree::ptree tree;
+	boost::property_tree::read_json (stream, tree);
+	ASSERT_EQ ("quote\" backslash\\ newline\n control\x01", tree.get <std::string> ("text"));
+	ASSERT_EQ (2, tree.get_child ("list").size ());
+	ASSERT_EQ ("100", tree.get <std::string> ("entry.amount"));
+}
+
+TEST (rpc, accounts_batch)
+{
+	rai::system system (24000, 1);
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	rai::keypair key1;
+	rai::keypair key2;
+	auto block1 (system.wallet (0)->send_action (rai::test_genesis_key.pub, key1.pub, 100));
+	ASSERT_NE (nullptr, block1);
+	rai::rpc_config config (true);
+	config.batch_request_limit = 3;
+	rai::rpc rpc (system.service, *system.nodes [0], config);
+	rpc.start ();
+	boost::property_tree::ptree accounts;
+	for (auto & i: {rai::test_genesis_key.pub, key1.pub, key2.pub})
+	{
+		boost::property_tree::ptree entry;
+		entry.put ("", i.to_account ());
+		accounts.push_back (std::make_pair ("", entry));
+	}
+	boost::property_tree::ptree request;
+	request.put ("action", "accounts_balances");
+	request.add_child ("accounts", accounts);
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	auto & balances (response1.json.get_child ("balances"));
+	ASSERT_EQ (3, balances.size ());
+	ASSERT_EQ ((rai::genesis_amount - 100).convert_to <std::string> (), balances.get <std::string> (rai::test_genesis_key.pub.to_account () + ".balance"));
+	ASSERT_EQ ("0", balances.get <std::string> (key1.pub.to_account () + ".balance"));
+	ASSERT_EQ ("100", balances.get <std::string> (key1.pub.to_account () + ".pending"));
+	ASSERT_EQ ("0", balances.get <std::string> (key2.pub.to_account () + ".pending"));
+	request.put ("action", "accounts_frontiers");
+	test_response response2 (request, rpc, system.service);
+	while (response2.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response2.status);
+	auto & frontiers (response2.json.get_child ("frontiers"));
+	ASSERT_EQ (1, frontiers.size ());
+	ASSERT_EQ (block1->hash ().to_string (), frontiers.get <std::string> (rai::test_genesis_key.pub.to_account ()));
+	request.put ("action", "accounts_pending");
+	request.put ("count", "10");
+	test_response response3 (request, rpc, system.service);
+	while (response3.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response3.status);
+	auto & blocks (response3.json.get_child ("blocks"));
+	ASSERT_EQ (3, blocks.size ());
+	ASSERT_EQ (block1->hash ().to_string (), blocks.get_child (key1.pub.to_account ()).front ().second.get <std::string> (""));
+	ASSERT_TRUE (blocks.get_child (key2.pub.to_account ()).empty ());
+	// One more than batch_request_limit
+	boost::property_tree::ptree entry;
+	entry.put ("", key2.pub.to_account ());
+	request.get_child ("accounts").push_back (std::make_pair ("", entry));
+	test_response response4 (request, rpc, system.service);
+	while (response4.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response4.status);
+	ASSERT_EQ ("Too many items in batch", response4.json.get <std::string> ("error"));
+}
+
+TEST (rpc, blocks_info)
+{
+	rai::system system (24000, 1);
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	rai::keypair key;
+	auto genesis (system.nodes [0]->latest (rai::test_genesis_key.pub));
+	auto block1 (system.wallet (0)->send_action (rai::test_genesis_key.pub, key.pub, 100));
+	ASSERT_NE (nullptr, block1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	boost::property_tree::ptree hashes;
+	for (auto & i: {genesis, block1->hash ()})
+	{
+		boost::property_tree::ptree entry;
+		entry.put ("", i.to_string ());
+		hashes.push_back (std::make_pair ("", entry));
+	}
+	boost::property_tree::ptree request;
+	request.put ("action", "blocks_info");
+	request.add_child ("hashes", hashes);
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	auto & blocks (response1.json.get_child ("blocks"));
+	ASSERT_EQ (2, blocks.size ());
+	auto & info (blocks.get_child (block1->hash ().to_string ()));
+	ASSERT_EQ (rai::test_genesis_key.pub.to_account (), info.get <std::string> ("account"));
+	ASSERT_EQ ("100", info.get <std::string> ("amount"));
+	std::string contents;
+	block1->serialize_json (contents);
+	ASSERT_EQ (contents, info.get <std::string> ("contents"));
+	ASSERT_EQ (rai::test_genesis_key.pub.to_account (), blocks.get <std::string> (genesis.to_string () + ".account"));
+	boost::property_tree::ptree entry;
+	entry.put ("", rai::block_hash (1).to_string ());
+	request.get_child ("hashes").push_back (std::make_pair ("", entry));
+	test_response response2 (request, rpc, system.service);
+	while (response2.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response2.status);
+	ASSERT_EQ ("Block not found: " + rai::block_hash (1).to_string (), response2.json.get <std::string> ("error"));
+}
+
+namespace
+{
+std::string read_chunk (boost::asio::ip::tcp::socket & socket_a, boost::asio::streambuf & buffer_a)
+{
+	auto size (boost::asio::read_until (socket_a, buffer_a, "\r\n"));
+	std::string line (boost::asio::buffers_begin (buffer_a.data ()), boost::asio::buffers_begin (buffer_a.data ()) + size - 2);
+	buffer_a.consume (size);
+	auto length (std::stoul (line, nullptr, 16));
+	if (buffer_a.size () < length + 2)
+	{
+		boost::asio::read (socket_a, buffer_a, boost::asio::transfer_exactly (length + 2 - buffer_a.size ()));
+	}
+	std::string result (boost::asio::buffers_begin (buffer_a.data ()), boost::asio::buffers_begin (buffer_a.data ()) + length);
+	buffer_a.consume (length + 2);
+	return result;
+}
+}
+
+TEST (rpc, subscribe)
+{
+	rai::system system (24000, 1);
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	rai::keypair key;
+	std::atomic <bool> subscribed (false);
+	std::atomic <bool> done (false);
+	std::vector <boost::property_tree::ptree> events;
+	std::thread client ([&rpc, &key, &subscribed, &done, &events] ()
+	{
+		boost::asio::io_service service;
+		boost::asio::ip::tcp::socket socket (service);
+		socket.connect (rai::tcp_endpoint (boost::asio::ip::address_v6::loopback (), rpc.config.port));
+		std::stringstream ostream;
+		ostream << "{\"action\": \"subscribe\", \"topics\": [\"blocks\", \"confirmations\"], \"accounts\": [\"" << rai::test_genesis_key.pub.to_account () << "\"]}";
+		beast::http::request <beast::http::string_body> req;
+		req.method = "POST";
+		req.url = "/";
+		req.version = 11;
+		req.body = ostream.str ();
+		beast::http::prepare (req);
+		beast::http::write (socket, req);
+		boost::asio::streambuf buffer;
+		auto size (boost::asio::read_until (socket, buffer, "\r\n\r\n"));
+		std::string header (boost::asio::buffers_begin (buffer.data ()), boost::asio::buffers_begin (buffer.data ()) + size);
+		buffer.consume (size);
+		EXPECT_NE (std::string::npos, header.find ("Transfer-Encoding: chunked"));
+		subscribed = true;
+		auto confirmed (false);
+		while (!confirmed)
+		{
+			std::stringstream body (read_chunk (socket, buffer));
+			boost::property_tree::ptree event;
+			boost::property_tree::read_json (body, event);
+			events.push_back (event);
+			confirmed = event.get <std::string> ("topic") == "confirmations";
+		}
+		done = true;
+	});
+	auto iterations1 (0);
+	while (!subscribed)
+	{
+		system.poll ();
+		++iterations1;
+		ASSERT_LT (iterations1, 200);
+	}
+	auto block1 (system.wallet (0)->send_action (rai::test_genesis_key.pub, key.pub, 100));
+	ASSERT_NE (nullptr, block1);
+	auto iterations2 (0);
+	while (!done)
+	{
+		system.poll ();
+		++iterations2;
+		ASSERT_LT (iterations2, 400);
+	}
+	client.join ();
+	ASSERT_EQ (2, events.size ());
+	ASSERT_EQ ("blocks", events [0].get <std::string> ("topic"));
+	ASSERT_EQ (block1->hash ().to_string (), events [0].get <std::string> ("hash"));
+	ASSERT_EQ ("100", events [0].get <std::string> ("amount"));
+	ASSERT_EQ (rai::test_genesis_key.pub.to_account (), events [0].get <std::string> ("account"));
+	ASSERT_EQ (block1->hash ().to_string (), events [1].get <std::string> ("hash"));
+}
+
+TEST (rpc, subscription_queue_limit)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	auto connection (std::make_shared <rai::rpc_connection> (*system.nodes [0], rpc));
+	auto subscription (std::make_shared <rai::rpc_subscription> (std::unordered_set <std::string> ({"blocks"}), std::unordered_set <rai::account> ()));
+	subscription->connection = connection;
+	// Nothing drains the queue while the connection isn't streaming
+	for (size_t i (0); i < rai::rpc_subscription::queue_limit + 10; ++i)
+	{
+		subscription->push (std::to_string (i));
+	}
+	ASSERT_EQ (rai::rpc_subscription::queue_limit, subscription->events.size ());
+	ASSERT_EQ (10, subscription->dropped);
+	subscription->events.clear ();
+	subscription->push ("next");
+	ASSERT_EQ (2, subscription->events.size ());
+	ASSERT_EQ ("{\"topic\":\"dropped\",\"count\":\"10\"}\n", subscription->events.front ());
+	ASSERT_EQ ("next", subscription->events.back ());
+	ASSERT_EQ (0, subscription->dropped);
+}
+
+TEST (rpc, worker_busy)
+{
+	rai::system system (24000, 1);
+	rai::rpc_config config (true);
+	config.worker_queue_limit = 0;
+	rai::rpc rpc (system.service, *system.nodes [0], config);
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "frontiers");
+	request.put ("account", rai::account (0).to_account ());
+	request.put ("count", "1");
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	ASSERT_EQ ("RPC busy, try again later", response1.json.get <std::string> ("error"));
+	boost::property_tree::ptree request2;
+	request2.put ("action", "worker_stats");
+	test_response response2 (request2, rpc, system.service);
+	while (response2.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response2.status);
+	ASSERT_EQ ("1", response2.json.get <std::string> ("actions.frontiers.rejected"));
+	ASSERT_EQ ("0", response2.json.get <std::string> ("actions.frontiers.completed"));
+}
+
+TEST (rpc, worker_stats)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "frontiers");
+	request.put ("account", rai::account (0).to_account ());
+	request.put ("count", "1");
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	ASSERT_EQ (1, response1.json.get_child ("frontiers").size ());
+	boost::property_tree::ptree request2;
+	request2.put ("action", "worker_stats");
+	test_response response2 (request2, rpc, system.service);
+	while (response2.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response2.status);
+	ASSERT_EQ ("1", response2.json.get <std::string> ("actions.frontiers.completed"));
+	ASSERT_EQ ("1", response2.json.get <std::string> ("actions.frontiers.limit"));
+	ASSERT_EQ ("0", response2.json.get <std::string> ("actions.frontiers.running"));
+	ASSERT_EQ ("0", response2.json.get <std::string> ("queued"));
+}
+
+TEST (rpc_workers, action_limit)
+{
+	rai::rpc_config config;
+	config.worker_threads = 4;
+	config.action_limits = { {"slow", 1}, {"fast", 4} };
+	rai::rpc_workers workers (config);
+	std::mutex mutex;
+	std::condition_variable condition;
+	unsigned running (0);
+	unsigned running_max (0);
+	unsigned done (0);
+	auto job ([&] ()
+	{
+		{
+			std::lock_guard <std::mutex> lock (mutex);
+			running_max = std::max (running_max, ++running);
+		}
+		std::this_thread::sleep_for (std::chrono::milliseconds (20));
+		std::lock_guard <std::mutex> lock (mutex);
+		--running;
+		++done;
+		condition.notify_all ();
+	});
+	for (auto i (0); i < 4; ++i)
+	{
+		ASSERT_FALSE (workers.push ("slow", job));
+	}
+	// Jobs queued behind the limited action still get picked up
+	std::atomic <bool> fast (false);
+	ASSERT_FALSE (workers.push ("fast", [&fast] () { fast = true; }));
+	{
+		std::unique_lock <std::mutex> lock (mutex);
+		condition.wait (lock, [&done] () { return done == 4; });
+	}
+	ASSERT_EQ (1, running_max);
+	// Stats are recorded after each job returns
+	auto iterations (0);
+	std::unique_lock <std::mutex> lock (workers.mutex);
+	while (workers.stats ["slow"].completed < 4 || workers.stats ["fast"].completed < 1)
+	{
+		lock.unlock ();
+		std::this_thread::sleep_for (std::chrono::milliseconds (1));
+		++iterations;
+		ASSERT_LT (iterations, 1000);
+		lock.lock ();
+	}
+	ASSERT_TRUE (fast);
+}
+
+TEST (rpc_config, action_limits)
+{
+	rai::rpc_config config1;
+	boost::property_tree::ptree tree;
+	config1.serialize_json (tree);
+	tree.get_child ("action_limits").put ("history", "5");
+	rai::rpc_config config2;
+	ASSERT_FALSE (config2.deserialize_json (tree));
+	ASSERT_EQ (config1.io_threads, config2.io_threads);
+	ASSERT_EQ (config1.action_limits.size (), config2.action_limits.size ());
+	ASSERT_EQ (5, config2.action_limits ["history"]);
+	tree.get_child ("action_limits").put ("history", "0");
+	ASSERT_TRUE (config2.deserialize_json (tree));
+}
+
+TEST (rpc, stats)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	rai::keypair key;
+	ASSERT_NE (nullptr, system.wallet (0)->send_action (rai::test_genesis_key.pub, key.pub, 100));
+	boost::property_tree::ptree request;
+	request.put ("action", "stats");
+	request.put ("reset", "true");
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	ASSERT_EQ ("1", response1.json.get <std::string> ("counters.ledger.progress.value"));
+	ASSERT_LT (0, response1.json.get <uint64_t> ("histograms.lmdb.commit.count"));
+	ASSERT_EQ (0, system.nodes [0]->stats.counter ("ledger", "progress").value ());
+}
+
+TEST (rpc, stats_reset_control)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (false));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "stats");
+	request.put ("reset", "true");
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	ASSERT_EQ ("RPC control is disabled", response1.json.get <std::string> ("error"));
+}
+
+TEST (rpc, snapshot)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "snapshot");
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	ASSERT_EQ ("idle", response1.json.get <std::string> ("status"));
+	auto path (rai::unique_path ());
+	request.put ("path", path.string ());
+	test_response response2 (request, rpc, system.service);
+	while (response2.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response2.status);
+	ASSERT_EQ (path.string (), response2.json.get <std::string> ("path"));
+	system.nodes [0]->snapshot.wait ();
+	request.erase ("path");
+	test_response response3 (request, rpc, system.service);
+	while (response3.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response3.status);
+	ASSERT_EQ ("done", response3.json.get <std::string> ("status"));
+	ASSERT_EQ (std::to_string (boost::filesystem::file_size (path)), response3.json.get <std::string> ("size"));
+}
+
+TEST (rpc, snapshot_control)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (false));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "snapshot");
+	request.put ("path", rai::unique_path ().string ());
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	ASSERT_EQ ("RPC control is disabled", response1.json.get <std::string> ("error"));
+}
+
+TEST (rpc, replica)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::keypair key;
+	auto latest (node1.latest (rai::test_genesis_key.pub));
+	rai::send_block send (latest, key.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (latest));
+	ASSERT_EQ (rai::process_result::progress, node1.process (send).code);
+	rai::node_init init;
+	init.read_only = true;
+	rai::node_config config (0, system.logging);
+	auto node2 (std::make_shared <rai::node> (init, system.service, node1.application_path, system.alarm, config, system.work));
+	ASSERT_FALSE (init.error ());
+	rai::rpc rpc (system.service, *node2, rai::rpc_config (true));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "account_balance");
+	request.put ("account", rai::test_genesis_key.pub.to_account ());
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	ASSERT_EQ ((rai::genesis_amount - 100).convert_to <std::string> (), response1.json.get <std::string> ("balance"));
+	// Blocks the writer adds later are visible to the next request
+	rai::send_block send2 (send.hash (), key.pub, rai::genesis_amount - 200, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (send.hash ()));
+	ASSERT_EQ (rai::process_result::progress, node1.process (send2).code);
+	test_response response2 (request, rpc, system.service);
+	while (response2.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response2.status);
+	ASSERT_EQ ((rai::genesis_amount - 200).convert_to <std::string> (), response2.json.get <std::string> ("balance"));
+	boost::property_tree::ptree request2;
+	request2.put ("action", "wallet_create");
+	test_response response3 (request2, rpc, system.service);
+	while (response3.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response3.status);
+	ASSERT_EQ ("Action not available on a read-only replica", response3.json.get <std::string> ("error"));
+}
+
+TEST (rpc, metrics)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	system.nodes [0]->stats.counter ("network", "keepalive_in").add (3);
+	boost::asio::ip::tcp::socket socket (system.service);
+	socket.connect (rai::tcp_endpoint (boost::asio::ip::address_v6::loopback (), rpc.config.port));
+	beast::http::request <beast::http::string_body> req;
+	req.method = "GET";
+	req.url = "/metrics";
+	req.version = 11;
+	beast::http::prepare (req, beast::http::connection::close);
+	beast::http::write (socket, req);
+	beast::streambuf buffer;
+	beast::http::response <beast::http::string_body> resp;
+	beast::http::read (socket, buffer, resp);
+	ASSERT_EQ (200, resp.status);
+	ASSERT_NE (std::string::npos, resp.body.find ("rai_events_total{subsystem=\"network\",event=\"keepalive_in\"} 3\n"));
+	ASSERT_NE (std::string::npos, resp.body.find ("# TYPE rai_latency_microseconds summary\n"));
+}
+
+TEST (rpc, trace)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	boost::property_tree::ptree request1;
+	request1.put ("action", "trace");
+	request1.put ("enable", "true");
+	test_response response1 (request1, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	ASSERT_TRUE (rai::trace.enabled);
+	rai::keypair key;
+	ASSERT_NE (nullptr, system.wallet (0)->send_action (rai::test_genesis_key.pub, key.pub, 100));
+	boost::property_tree::ptree request2;
+	request2.put ("action", "trace");
+	request2.put ("enable", "false");
+	request2.put ("window", "60000");
+	test_response response2 (request2, rpc, system.service);
+	while (response2.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response2.status);
+	ASSERT_FALSE (rai::trace.enabled);
+	auto processed (false);
+	for (auto & i: response2.json.get_child ("traceEvents"))
+	{
+		processed |= i.second.get <std::string> ("cat") == "ledger" && i.second.get <std::string> ("name") == "process";
+	}
+	ASSERT_TRUE (processed);
+}
+
+TEST (rpc, trace_control)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (false));
+	rpc.start ();
+	boost::property_tree::ptree request;
+	request.put ("action", "trace");
+	request.put ("enable", "true");
+	test_response response1 (request, rpc, system.service);
+	while (response1.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response1.status);
+	ASSERT_EQ ("RPC control is disabled", response1.json.get <std::string> ("error"));
+	ASSERT_FALSE (rai::trace.enabled);
+}
+
+TEST (rpc, mutex_stats)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	rai::keypair key;
+	ASSERT_NE (nullptr, system.wallet (0)->send_action (rai::test_genesis_key.pub, key.pub, 100));
+	boost::property_tree::ptree request;
+	request.put ("action", "mutex_stats");
+	request.put ("reset", "true");
+	test_response response (request, rpc, system.service);
+	while (response.status == 0)
+	{
+		system.poll ();
+	}
+	ASSERT_EQ (200, response.status);
+	ASSERT_EQ (rai::mutex_stats_enabled, response.json.get <bool> ("enabled"));
+	if (rai::mutex_stats_enabled)
+	{
+		ASSERT_LT (0, response.json.get <uint64_t> ("mutexes.mdb_env.acquired"));
+		ASSERT_LT (0, response.json.get <uint64_t> ("mutexes.active_transactions.acquired"));
+	}
+}
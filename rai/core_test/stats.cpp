@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include <rai/node/stats.hpp>
+
+#include <thread>
+#include <vector>
+
+TEST (stat_counter, threads)
+{
+	rai::stat_counter counter;
+	std::vector <std::thread> threads;
+	for (auto i (0); i < 8; ++i)
+	{
+		threads.push_back (std::thread ([&counter] ()
+		{
+			for (auto j (0); j < 10000; ++j)
+			{
+				counter.add ();
+			}
+		}));
+	}
+	for (auto & i: threads)
+	{
+		i.join ();
+	}
+	ASSERT_EQ (80000, counter.value ());
+	counter.reset ();
+	ASSERT_EQ (0, counter.value ());
+}
+
+TEST (stat_histogram, buckets)
+{
+	for (uint64_t i (0); i < 16; ++i)
+	{
+		ASSERT_EQ (i, rai::stat_histogram::index (i));
+		ASSERT_EQ (i, rai::stat_histogram::lower_bound (i));
+	}
+	ASSERT_EQ (16, rai::stat_histogram::index (16));
+	ASSERT_EQ (16, rai::stat_histogram::index (17));
+	ASSERT_EQ (17, rai::stat_histogram::index (18));
+	ASSERT_EQ (rai::stat_histogram::bucket_count - 1, rai::stat_histogram::index (std::numeric_limits <uint64_t>::max ()));
+	// Every value falls in the bucket whose lower bound is the largest not above it
+	for (uint64_t i (1); i < std::numeric_limits <uint64_t>::max () / 3; i = i * 3 + 1)
+	{
+		auto index (rai::stat_histogram::index (i));
+		ASSERT_LE (rai::stat_histogram::lower_bound (index), i);
+		ASSERT_GT (rai::stat_histogram::lower_bound (index + 1), i);
+	}
+}
+
+TEST (stat_histogram, percentile)
+{
+	rai::stat_histogram histogram;
+	ASSERT_EQ (0, histogram.percentile (0.5));
+	for (uint64_t i (1); i <= 1000; ++i)
+	{
+		histogram.add (i);
+	}
+	ASSERT_EQ (1000, histogram.count ());
+	ASSERT_EQ (500500, histogram.sum ());
+	ASSERT_EQ (1000, histogram.max ());
+	auto p50 (histogram.percentile (0.5));
+	ASSERT_GE (p50, 500);
+	ASSERT_LE (p50, 500 + 500 / 8);
+	auto p99 (histogram.percentile (0.99));
+	ASSERT_GE (p99, 990);
+	ASSERT_LE (p99, 1000);
+	ASSERT_EQ (1000, histogram.percentile (1.0));
+	histogram.reset ();
+	ASSERT_EQ (0, histogram.count ());
+	ASSERT_EQ (0, histogram.max ());
+}
+
+TEST (stats, registry)
+{
+	rai::stats stats;
+	auto & counter (stats.counter ("network", "keepalive_in"));
+	ASSERT_EQ (&counter, &stats.counter ("network", "keepalive_in"));
+	ASSERT_NE (&counter, &stats.counter ("network", "keepalive_out"));
+	counter.add (5);
+	stats.histogram ("lmdb", "commit").add (100);
+	stats.sample ();
+	ASSERT_LT (0.0, stats.rates [rai::stats::key ("network", "keepalive_in")]);
+	boost::property_tree::ptree tree;
+	stats.serialize_json (tree);
+	ASSERT_EQ ("5", tree.get <std::string> ("counters.network.keepalive_in.value"));
+	ASSERT_EQ ("0", tree.get <std::string> ("counters.network.keepalive_out.value"));
+	ASSERT_EQ ("1", tree.get <std::string> ("histograms.lmdb.commit.count"));
+	ASSERT_EQ ("100", tree.get <std::string> ("histograms.lmdb.commit.max"));
+	auto text (stats.prometheus ());
+	ASSERT_NE (std::string::npos, text.find ("rai_events_total{subsystem=\"network\",event=\"keepalive_in\"} 5\n"));
+	ASSERT_NE (std::string::npos, text.find ("rai_latency_microseconds_count{subsystem=\"lmdb\",event=\"commit\"} 1\n"));
+	stats.reset ();
+	ASSERT_EQ (0, counter.value ());
+	ASSERT_EQ (0, stats.histogram ("lmdb", "commit").count ());
+}
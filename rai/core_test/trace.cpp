@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include <rai/trace.hpp>
+
+#include <boost/property_tree/json_parser.hpp>
+
+#include <sstream>
+#include <thread>
+
+namespace
+{
+// Spans recorded by other tests share the global tracer, only count the ones with our name
+size_t count_spans (std::string const & name_a, std::chrono::steady_clock::time_point since_a)
+{
+	std::stringstream stream;
+	rai::trace.chrome_json (stream, since_a);
+	boost::property_tree::ptree tree;
+	boost::property_tree::read_json (stream, tree);
+	size_t result (0);
+	for (auto & i: tree.get_child ("traceEvents"))
+	{
+		if (i.second.get <std::string> ("name") == name_a)
+		{
+			EXPECT_EQ ("X", i.second.get <std::string> ("ph"));
+			++result;
+		}
+	}
+	return result;
+}
+}
+
+TEST (trace, disabled)
+{
+	rai::trace.enabled = false;
+	auto begin (std::chrono::steady_clock::now ());
+	{
+		rai::trace_span span ("test", "disabled");
+	}
+	ASSERT_EQ (0, count_spans ("disabled", begin));
+}
+
+TEST (trace, span)
+{
+	auto begin (std::chrono::steady_clock::now ());
+	rai::trace.enabled = true;
+	{
+		rai::trace_span span ("test", "span");
+		std::this_thread::sleep_for (std::chrono::milliseconds (2));
+	}
+	rai::trace.enabled = false;
+	std::stringstream stream;
+	rai::trace.chrome_json (stream, begin);
+	boost::property_tree::ptree tree;
+	boost::property_tree::read_json (stream, tree);
+	auto found (false);
+	for (auto & i: tree.get_child ("traceEvents"))
+	{
+		if (i.second.get <std::string> ("name") == "span")
+		{
+			ASSERT_FALSE (found);
+			found = true;
+			ASSERT_EQ ("test", i.second.get <std::string> ("cat"));
+			ASSERT_LE (2000, i.second.get <uint64_t> ("dur"));
+		}
+	}
+	ASSERT_TRUE (found);
+}
+
+TEST (trace, threads)
+{
+	auto begin (std::chrono::steady_clock::now ());
+	rai::trace.enabled = true;
+	std::vector <std::thread> threads;
+	for (auto i (0); i < 4; ++i)
+	{
+		threads.push_back (std::thread ([] ()
+		{
+			for (auto j (0); j < 100; ++j)
+			{
+				rai::trace_span span ("test", "threads");
+			}
+		}));
+	}
+	for (auto & i: threads)
+	{
+		i.join ();
+	}
+	rai::trace.enabled = false;
+	ASSERT_EQ (400, count_spans ("threads", begin));
+}
+
+TEST (trace, wraparound)
+{
+	auto begin (std::chrono::steady_clock::now ());
+	rai::trace.enabled = true;
+	for (size_t i (0); i < rai::trace_buffer::size + 100; ++i)
+	{
+		rai::trace_span span ("test", "wraparound");
+	}
+	rai::trace.enabled = false;
+	// Only the most recent spans of the thread survive
+	ASSERT_EQ (rai::trace_buffer::size, count_spans ("wraparound", begin));
+}
+
+TEST (trace, window)
+{
+	rai::trace.enabled = true;
+	{
+		rai::trace_span span ("test", "window");
+	}
+	std::this_thread::sleep_for (std::chrono::milliseconds (5));
+	auto later (std::chrono::steady_clock::now ());
+	rai::trace.enabled = false;
+	ASSERT_LE (1, count_spans ("window", rai::trace.epoch));
+	ASSERT_EQ (0, count_spans ("window", later));
+}
@@ -668,6 +668,35 @@ TEST (wallet, work_generate)
     }
 }
 
+TEST (wallet, work_cache_hit)
+{
+    rai::system system (24000, 1);
+    auto wallet (system.wallet (0));
+	wallet->insert_adhoc (rai::test_genesis_key.prv);
+	rai::block_hash root;
+	{
+		rai::transaction transaction (system.nodes [0]->store.environment, nullptr, false);
+		root = system.nodes [0]->ledger.latest_root (transaction, rai::test_genesis_key.pub);
+	}
+	uint64_t work (0);
+	auto iterations (0);
+	while (system.work.work_validate (root, work))
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+		rai::transaction transaction (system.nodes [0]->store.environment, nullptr, false);
+		ASSERT_FALSE (wallet->store.work_get (transaction, rai::test_genesis_key.pub, work));
+	}
+	auto misses (system.nodes [0]->wallets.work_cache_misses.load ());
+	{
+		rai::transaction transaction (system.nodes [0]->store.environment, nullptr, false);
+		ASSERT_EQ (work, wallet->work_fetch (transaction, rai::test_genesis_key.pub, root));
+	}
+	ASSERT_EQ (1, system.nodes [0]->wallets.work_cache_hits);
+	ASSERT_EQ (misses, system.nodes [0]->wallets.work_cache_misses);
+}
+
 TEST (wallet, unsynced_work)
 {
     rai::system system (24000, 1);
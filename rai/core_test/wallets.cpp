@@ -69,4 +69,23 @@ TEST (wallets, DISABLED_remove)
 		ASSERT_FALSE (error);
 		ASSERT_EQ (0, wallets.items.size ());
 	}
-}
\ No newline at end of file
+}
+TEST (wallets, exists)
+{
+	rai::system system (24000, 1);
+	auto & wallets (system.nodes [0]->wallets);
+	rai::keypair key1;
+	rai::keypair key2;
+	ASSERT_FALSE (wallets.exists (key1.pub));
+	system.wallet (0)->insert_adhoc (key1.prv);
+	ASSERT_TRUE (wallets.exists (key1.pub));
+	ASSERT_FALSE (wallets.exists (key2.pub));
+	rai::uint256_union id (1);
+	auto wallet (wallets.create (id));
+	ASSERT_NE (nullptr, wallet);
+	wallet->insert_adhoc (key2.prv);
+	ASSERT_TRUE (wallets.exists (key2.pub));
+	wallets.destroy (id);
+	ASSERT_FALSE (wallets.exists (key2.pub));
+	ASSERT_TRUE (wallets.exists (key1.pub));
+}
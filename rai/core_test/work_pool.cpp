@@ -21,6 +21,31 @@ TEST (work, validate)
     ASSERT_FALSE (pool.work_validate (send_block));
 }
 
+TEST (work, validate_batch)
+{
+	rai::work_pool pool (std::numeric_limits <unsigned>::max (), nullptr);
+	std::vector <std::pair <rai::block_hash, uint64_t>> items;
+	for (uint64_t i (0); i < 7; ++i)
+	{
+		rai::block_hash root;
+		rai::random_pool.GenerateBlock (root.bytes.data (), root.bytes.size ());
+		items.push_back (std::make_pair (root, i * 0x0123456789abcdef));
+	}
+	rai::block_hash root (1);
+	items.push_back (std::make_pair (root, pool.generate (root)));
+	std::vector <uint64_t> values;
+	pool.work_value_batch (items, values);
+	auto insufficient (pool.work_validate_batch (items));
+	ASSERT_EQ (items.size (), values.size ());
+	ASSERT_EQ (items.size (), insufficient.size ());
+	for (size_t i (0); i < items.size (); ++i)
+	{
+		ASSERT_EQ (pool.work_value (items [i].first, items [i].second), values [i]);
+		ASSERT_EQ (pool.work_validate (items [i].first, items [i].second), insufficient [i]);
+	}
+	ASSERT_FALSE (insufficient.back ());
+}
+
 TEST (work, cancel)
 {
 	rai::work_pool pool (std::numeric_limits <unsigned>::max (), nullptr);
@@ -34,7 +59,7 @@ TEST (work, cancel)
 	auto done (false);
 	while (!done)
 	{
-		std::lock_guard <std::mutex> lock (pool.mutex);
+		rai::lock_guard lock (pool.mutex);
 		done = exited || !pool.pending.empty ();
 	}
 	pool.cancel (key);
@@ -83,6 +108,42 @@ TEST (work, cancel_many)
 	thread6.join ();
 }
 
+TEST (work, threshold)
+{
+	rai::work_pool pool (std::numeric_limits <unsigned>::max (), nullptr);
+	rai::uint256_union root (1);
+	uint64_t threshold (0xfff0000000000000);
+	auto work (pool.generate (root, rai::work_priority::rpc, threshold));
+	ASSERT_LE (threshold, pool.work_value (root, work));
+	rai::lock_guard lock (pool.mutex);
+	ASSERT_EQ (1, pool.stats [static_cast <size_t> (rai::work_priority::rpc)].solved);
+	ASSERT_EQ (0, pool.stats [static_cast <size_t> (rai::work_priority::interactive)].solved);
+}
+
+TEST (work, priority)
+{
+	rai::work_pool pool (std::numeric_limits <unsigned>::max (), nullptr);
+	rai::uint256_union root1 (1);
+	rai::uint256_union root2 (2);
+	std::promise <boost::optional <uint64_t>> precache;
+	// Unreachable threshold, this item can only finish by being cancelled
+	pool.generate (root1, [&precache] (boost::optional <uint64_t> const & work_a)
+	{
+		precache.set_value (work_a);
+	}, rai::work_priority::precache, std::numeric_limits <uint64_t>::max ());
+	auto work (pool.generate (root2));
+	ASSERT_FALSE (pool.work_validate (root2, work));
+	{
+		rai::lock_guard lock (pool.mutex);
+		ASSERT_EQ (1, pool.pending.size ());
+		ASSERT_EQ (root1, pool.pending.front ()->root);
+	}
+	pool.cancel (root1);
+	ASSERT_FALSE (precache.get_future ().get ());
+	rai::lock_guard lock (pool.mutex);
+	ASSERT_EQ (1, pool.stats [static_cast <size_t> (rai::work_priority::precache)].cancelled);
+}
+
 TEST (work, opencl)
 {
 	rai::logging logging (rai::unique_path ());
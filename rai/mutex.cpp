@@ -0,0 +1,111 @@
+#include <rai/mutex.hpp>
+
+rai::mutex_registry rai::mutexes;
+
+namespace
+{
+void update_max (std::atomic <uint64_t> & max_a, uint64_t value_a)
+{
+	auto max_l (max_a.load (std::memory_order_relaxed));
+	while (value_a > max_l && !max_a.compare_exchange_weak (max_l, value_a, std::memory_order_relaxed))
+	{
+	}
+}
+}
+
+rai::mutex_stat::mutex_stat ()
+{
+	reset ();
+}
+
+void rai::mutex_stat::reset ()
+{
+	acquired.store (0, std::memory_order_relaxed);
+	contended.store (0, std::memory_order_relaxed);
+	wait_total.store (0, std::memory_order_relaxed);
+	wait_max.store (0, std::memory_order_relaxed);
+	hold_total.store (0, std::memory_order_relaxed);
+	hold_max.store (0, std::memory_order_relaxed);
+}
+
+rai::mutex_stat & rai::mutex_registry::stat (std::string const & name_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto & result (stats [name_a]);
+	if (result == nullptr)
+	{
+		result.reset (new rai::mutex_stat);
+	}
+	return *result;
+}
+
+void rai::mutex_registry::serialize_json (boost::property_tree::ptree & tree_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto & i: stats)
+	{
+		auto & stat_l (*i.second);
+		boost::property_tree::ptree entry;
+		entry.put ("acquired", std::to_string (stat_l.acquired.load (std::memory_order_relaxed)));
+		entry.put ("contended", std::to_string (stat_l.contended.load (std::memory_order_relaxed)));
+		entry.put ("wait_total", std::to_string (stat_l.wait_total.load (std::memory_order_relaxed)));
+		entry.put ("wait_max", std::to_string (stat_l.wait_max.load (std::memory_order_relaxed)));
+		entry.put ("hold_total", std::to_string (stat_l.hold_total.load (std::memory_order_relaxed)));
+		entry.put ("hold_max", std::to_string (stat_l.hold_max.load (std::memory_order_relaxed)));
+		tree_a.add_child (i.first, entry);
+	}
+}
+
+void rai::mutex_registry::reset ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto & i: stats)
+	{
+		i.second->reset ();
+	}
+}
+
+#ifdef RAIBLOCKS_MUTEX_STATS
+rai::named_mutex::named_mutex (char const * name_a) :
+stat (rai::mutexes.stat (name_a))
+{
+}
+
+void rai::named_mutex::lock ()
+{
+	if (!mutex.try_lock ())
+	{
+		auto begin (std::chrono::steady_clock::now ());
+		mutex.lock ();
+		acquired = std::chrono::steady_clock::now ();
+		auto wait (std::chrono::duration_cast <std::chrono::nanoseconds> (acquired - begin).count ());
+		stat.contended.fetch_add (1, std::memory_order_relaxed);
+		stat.wait_total.fetch_add (wait, std::memory_order_relaxed);
+		update_max (stat.wait_max, wait);
+	}
+	else
+	{
+		acquired = std::chrono::steady_clock::now ();
+	}
+	stat.acquired.fetch_add (1, std::memory_order_relaxed);
+}
+
+bool rai::named_mutex::try_lock ()
+{
+	auto result (mutex.try_lock ());
+	if (result)
+	{
+		acquired = std::chrono::steady_clock::now ();
+		stat.acquired.fetch_add (1, std::memory_order_relaxed);
+	}
+	return result;
+}
+
+void rai::named_mutex::unlock ()
+{
+	auto hold (std::chrono::duration_cast <std::chrono::nanoseconds> (std::chrono::steady_clock::now () - acquired).count ());
+	stat.hold_total.fetch_add (hold, std::memory_order_relaxed);
+	update_max (stat.hold_max, hold);
+	mutex.unlock ();
+}
+#endif
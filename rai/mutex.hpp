@@ -0,0 +1,69 @@
+#pragma once
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace rai
+{
+// Contention counters shared by every mutex constructed with the same name, times are in nanoseconds
+class mutex_stat
+{
+public:
+	mutex_stat ();
+	void reset ();
+	std::atomic <uint64_t> acquired;
+	std::atomic <uint64_t> contended;
+	std::atomic <uint64_t> wait_total;
+	std::atomic <uint64_t> wait_max;
+	std::atomic <uint64_t> hold_total;
+	std::atomic <uint64_t> hold_max;
+};
+class mutex_registry
+{
+public:
+	rai::mutex_stat & stat (std::string const &);
+	void serialize_json (boost::property_tree::ptree &);
+	void reset ();
+	std::mutex mutex;
+	std::map <std::string, std::unique_ptr <rai::mutex_stat>> stats;
+};
+extern rai::mutex_registry mutexes;
+#ifdef RAIBLOCKS_MUTEX_STATS
+bool constexpr mutex_stats_enabled = true;
+// Times how long each acquisition waited and how long the lock was then held
+class named_mutex
+{
+public:
+	named_mutex (char const *);
+	void lock ();
+	bool try_lock ();
+	void unlock ();
+	std::mutex mutex;
+	rai::mutex_stat & stat;
+	std::chrono::steady_clock::time_point acquired; // Only touched by the current holder
+};
+using lock_guard = std::lock_guard <rai::named_mutex>;
+using unique_lock = std::unique_lock <rai::named_mutex>;
+using condition_variable = std::condition_variable_any;
+#else
+bool constexpr mutex_stats_enabled = false;
+// Without RAIBLOCKS_MUTEX_STATS this is a plain std::mutex and the name is dropped
+class named_mutex : public std::mutex
+{
+public:
+	named_mutex (char const *)
+	{
+	}
+};
+using lock_guard = std::lock_guard <std::mutex>;
+using unique_lock = std::unique_lock <std::mutex>;
+using condition_variable = std::condition_variable;
+#endif
+}
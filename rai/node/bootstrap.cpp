@@ -2,6 +2,7 @@
 
 #include <rai/node/common.hpp>
 #include <rai/node/node.hpp>
+#include <rai/trace.hpp>
 
 #include <boost/log/trivial.hpp>
 
@@ -271,20 +272,35 @@ void rai::bootstrap_client::run ()
 
 void rai::bootstrap_client::frontier_request ()
 {
-	std::unique_ptr <rai::frontier_req> request (new rai::frontier_req);
-	request->start.clear ();
-	request->age = std::numeric_limits <decltype (request->age)>::max ();
-	request->count = std::numeric_limits <decltype (request->age)>::max ();
-	auto send_buffer (std::make_shared <std::vector <uint8_t>> ());
+	auto checksums (node->peers.network_version (rai::endpoint (endpoint.address (), endpoint.port ())) >= rai::checksum_req::version);
+	if (checksums)
 	{
-		rai::vectorstream stream (*send_buffer);
-		request->serialize (stream);
+		rai::transaction transaction (node->store.environment, nullptr, false);
+		checksums = node->store.frontier_count (transaction) > rai::checksum_req_client::accounts_min;
 	}
-	auto this_l (shared_from_this ());
-	boost::asio::async_write (socket, boost::asio::buffer (send_buffer->data (), send_buffer->size ()), [this_l, send_buffer] (boost::system::error_code const & ec, size_t size_a)
+	if (checksums)
 	{
-		this_l->sent_request (ec, size_a);
-	});
+		auto client_l (std::make_shared <rai::checksum_req_client> (shared_from_this ()));
+		client_l->request_next ();
+	}
+	else
+	{
+		// Older peers don't know checksum_req and a nearly empty ledger differs everywhere, stream all frontiers
+		std::unique_ptr <rai::frontier_req> request (new rai::frontier_req);
+		request->start.clear ();
+		request->age = std::numeric_limits <decltype (request->age)>::max ();
+		request->count = std::numeric_limits <decltype (request->age)>::max ();
+		auto send_buffer (std::make_shared <std::vector <uint8_t>> ());
+		{
+			rai::vectorstream stream (*send_buffer);
+			request->serialize (stream);
+		}
+		auto this_l (shared_from_this ());
+		boost::asio::async_write (socket, boost::asio::buffer (send_buffer->data (), send_buffer->size ()), [this_l, send_buffer] (boost::system::error_code const & ec, size_t size_a)
+		{
+			this_l->sent_request (ec, size_a);
+		});
+	}
 }
 
 void rai::bootstrap_client::sent_request (boost::system::error_code const & ec, size_t size_a)
@@ -292,7 +308,11 @@ void rai::bootstrap_client::sent_request (boost::system::error_code const & ec,
     if (!ec)
     {
         auto this_l (shared_from_this ());
-        auto client_l (std::make_shared <rai::frontier_req_client> (this_l));
+        node->stats.counter ("bootstrap", "frontier_requests").add ();
+        auto client_l (std::make_shared <rai::frontier_req_client> (this_l, rai::account (0), rai::account (std::numeric_limits <rai::uint256_t>::max ()), [this_l] ()
+        {
+            this_l->attempt->completed_requests (this_l);
+        }));
         client_l->receive_frontier ();
     }
     else
@@ -309,9 +329,11 @@ std::shared_ptr <rai::bootstrap_client> rai::bootstrap_client::shared ()
 	return shared_from_this ();
 }
 
-rai::frontier_req_client::frontier_req_client (std::shared_ptr <rai::bootstrap_client> const & connection_a) :
+rai::frontier_req_client::frontier_req_client (std::shared_ptr <rai::bootstrap_client> const & connection_a, rai::account const & begin_a, rai::account const & end_a, std::function <void ()> const & completion_a) :
 connection (connection_a),
-current (0)
+current (begin_a.number () - 1),
+end (end_a),
+completion (completion_a)
 {
 	next ();
 }
@@ -345,8 +367,8 @@ void rai::frontier_req_client::unsynced (MDB_txn * transaction_a, rai::block_has
 	while (!current.is_zero () && current != theirs_a)
 	{
 		connection->node->store.unsynced_put (transaction_a, current);
-		auto block (connection->node->store.block_get (transaction_a, current));
-		current = block->previous ();
+		auto block (connection->node->store.block_get_view (transaction_a, current));
+		current = block.previous ();
 	}
 }
 
@@ -419,7 +441,7 @@ void rai::frontier_req_client::received_frontier (boost::system::error_code cons
 					next ();
 				}
 			}
-            connection->attempt->completed_requests (connection);
+            completion ();
         }
     }
     else
@@ -435,7 +457,7 @@ void rai::frontier_req_client::next ()
 {
 	rai::transaction transaction (connection->node->store.environment, nullptr, false);
 	auto iterator (connection->node->store.latest_begin (transaction, rai::uint256_union (current.number () + 1)));
-	if (iterator != connection->node->store.latest_end ())
+	if (iterator != connection->node->store.latest_end () && !(end < rai::account (iterator->first)))
 	{
 		current = rai::account (iterator->first);
 		info = rai::account_info (iterator->second);
@@ -446,6 +468,124 @@ void rai::frontier_req_client::next ()
 	}
 }
 
+rai::checksum_req_client::checksum_req_client (std::shared_ptr <rai::bootstrap_client> const & connection_a) :
+connection (connection_a),
+requests (connection_a->node->stats.counter ("bootstrap", "checksum_requests")),
+leaves (connection_a->node->stats.counter ("bootstrap", "checksum_leaves")),
+subtrees (connection_a->node->stats.counter ("bootstrap", "checksum_subtrees"))
+{
+	nodes.push_back (std::make_pair (0, 0));
+}
+
+size_t constexpr rai::checksum_req_client::descend_limit;
+size_t constexpr rai::checksum_req_client::accounts_min;
+
+void rai::checksum_req_client::request_next ()
+{
+	if (!nodes.empty ())
+	{
+		current = nodes.front ();
+		nodes.pop_front ();
+		send_request (current.second >= rai::checksum_leaf_depth);
+	}
+	else
+	{
+		connection->attempt->completed_requests (connection);
+	}
+}
+
+// Requests the children of current, or with frontiers_a the frontiers of every account below it
+void rai::checksum_req_client::send_request (bool frontiers_a)
+{
+	requests.add ();
+	rai::checksum_req request (current.first, current.second);
+	request.frontiers_set (frontiers_a);
+	auto send_buffer (std::make_shared <std::vector <uint8_t>> ());
+	{
+		rai::vectorstream stream (*send_buffer);
+		request.serialize (stream);
+	}
+	auto this_l (shared_from_this ());
+	boost::asio::async_write (connection->socket, boost::asio::buffer (send_buffer->data (), send_buffer->size ()), [this_l, send_buffer, frontiers_a] (boost::system::error_code const & ec, size_t size_a)
+	{
+		this_l->sent_request (ec, size_a, frontiers_a);
+	});
+}
+
+void rai::checksum_req_client::sent_request (boost::system::error_code const & ec, size_t size_a, bool frontiers_a)
+{
+	if (!ec)
+	{
+		auto this_l (shared_from_this ());
+		if (!frontiers_a)
+		{
+			boost::asio::async_read (connection->socket, boost::asio::buffer (receive_buffer.data (), receive_buffer.size ()), [this_l] (boost::system::error_code const & ec, size_t size_a)
+			{
+				this_l->received_checksums (ec, size_a);
+			});
+		}
+		else
+		{
+			// The peer answers with its frontiers for the node's range
+			(current.second < rai::checksum_leaf_depth ? subtrees : leaves).add ();
+			auto range (rai::checksum_range (current.first, current.second));
+			auto client_l (std::make_shared <rai::frontier_req_client> (connection, range.first, range.second, [this_l] ()
+			{
+				this_l->request_next ();
+			}));
+			client_l->receive_frontier ();
+		}
+	}
+	else
+	{
+		if (connection->node->config.logging.network_logging ())
+		{
+			BOOST_LOG (connection->node->log) << boost::str (boost::format ("Error while sending checksum request %1%") % ec.message ());
+		}
+	}
+}
+
+void rai::checksum_req_client::received_checksums (boost::system::error_code const & ec, size_t size_a)
+{
+	if (!ec)
+	{
+		assert (size_a == receive_buffer.size ());
+		uint8_t depth (current.second + rai::checksum_level_bits);
+		std::vector <std::pair <uint64_t, uint8_t>> differing;
+		{
+			rai::transaction transaction (connection->node->store.environment, nullptr, false);
+			for (uint64_t i (0); i < (1 << rai::checksum_level_bits); ++i)
+			{
+				rai::checksum theirs;
+				std::copy (receive_buffer.begin () + i * sizeof (theirs), receive_buffer.begin () + (i + 1) * sizeof (theirs), theirs.bytes.begin ());
+				auto prefix (current.first | (i << (64 - depth)));
+				if (theirs != connection->node->store.checksum_node (transaction, prefix, depth))
+				{
+					differing.push_back (std::make_pair (prefix, depth));
+				}
+			}
+		}
+		if (differing.size () > descend_limit)
+		{
+			// Mostly out of sync below here, likely far behind, one streamed frontier request replaces a round trip per child
+			send_request (true);
+		}
+		else
+		{
+			// Children go ahead of the remaining nodes so the walk stays in ascending account order
+			nodes.insert (nodes.begin (), differing.begin (), differing.end ());
+			request_next ();
+		}
+	}
+	else
+	{
+		if (connection->node->config.logging.network_logging ())
+		{
+			BOOST_LOG (connection->node->log) << boost::str (boost::format ("Error while receiving checksums %1%") % ec.message ());
+		}
+	}
+}
+
 void rai::bulk_pull_client::request (rai::pull_info const & pull_a)
 {
 	pull = pull_a;
@@ -549,54 +689,254 @@ void rai::bulk_pull_client::received_type ()
 }
 
 void rai::bulk_pull_client::received_block (boost::system::error_code const & ec, size_t size_a)
+{
+	rai::trace_span span ("bootstrap", "received_block");
+	if (!ec)
+	{
+		// receive_block only reads a full block of a known type so the bytes are used as they arrived
+		rai::block_value block (static_cast <rai::block_type> (connection.receive_buffer [0]), connection.receive_buffer.data () + 1);
+		assert (block.view ().block_size () == size_a);
+		pulled.add ();
+		auto hash (block.view ().hash ());
+		if (connection.node->config.logging.bulk_pull_logging ())
+		{
+			std::string block_l;
+			block.view ().block ()->serialize_json (block_l);
+			BOOST_LOG (connection.node->log) << boost::str (boost::format ("Pulled block %1% %2%") % hash.to_string () % block_l);
+		}
+		if (hash == expected)
+		{
+			expected = block.view ().previous ();
+		}
+		auto already_exists (false);
+		{
+			rai::transaction transaction (connection.node->store.environment, nullptr, false);
+			already_exists = connection.node->store.block_exists (transaction, hash);
+		}
+		if (!already_exists)
+		{
+			connection.attempt->cache.add_block (block);
+		}
+		receive_block ();
+	}
+	else
+	{
+		BOOST_LOG (connection.node->log) << boost::str (boost::format ("Error bulk receiving block: %1%") % ec.message ());
+	}
+}
+
+rai::bulk_pull_client::bulk_pull_client (rai::bootstrap_client & connection_a) :
+connection (connection_a),
+account_count (0),
+pulled (connection_a.node->stats.counter ("bootstrap", "blocks_pulled"))
+{
+}
+
+rai::bulk_pull_client::~bulk_pull_client ()
+{
+}
+
+size_t constexpr rai::dependency_pull::max_blocks;
+
+rai::dependency_pull::dependency_pull (std::shared_ptr <rai::node> node_a, rai::tcp_endpoint const & endpoint_a, rai::block_hash const & hash_a, std::function <void (bool)> const & completion_a) :
+node (node_a),
+socket (node_a->network.service),
+endpoint (endpoint_a),
+hash (hash_a),
+completed (false),
+completion (completion_a)
+{
+}
+
+void rai::dependency_pull::run ()
+{
+	auto this_l (shared_from_this ());
+	socket.async_connect (endpoint, [this_l] (boost::system::error_code const & ec)
+	{
+		if (!ec)
+		{
+			rai::bulk_pull req;
+			req.start = this_l->hash;
+			req.end.clear ();
+			auto buffer (std::make_shared <std::vector <uint8_t>> ());
+			{
+				rai::vectorstream stream (*buffer);
+				req.serialize (stream);
+			}
+			boost::asio::async_write (this_l->socket, boost::asio::buffer (buffer->data (), buffer->size ()), [this_l, buffer] (boost::system::error_code const & ec, size_t size_a)
+			{
+				if (!ec)
+				{
+					this_l->receive_block ();
+				}
+				else
+				{
+					BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Error sending dependency request %1% to %2%") % ec.message () % this_l->endpoint);
+					this_l->finish ();
+				}
+			});
+		}
+		else
+		{
+			if (this_l->node->config.logging.network_logging ())
+			{
+				BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Error connecting to %1% for dependency %2%: %3%") % this_l->endpoint % this_l->hash.to_string () % ec.message ());
+			}
+			this_l->finish ();
+		}
+	});
+	std::weak_ptr <rai::dependency_pull> this_w (this_l);
+	node->alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (15), [this_w] ()
+	{
+		auto this_l (this_w.lock ());
+		if (this_l != nullptr && !this_l->completed)
+		{
+			BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Dependency request for %1% to %2% timed out") % this_l->hash.to_string () % this_l->endpoint);
+			this_l->socket.close ();
+		}
+	});
+}
+
+void rai::dependency_pull::receive_block ()
+{
+	auto this_l (shared_from_this ());
+	boost::asio::async_read (socket, boost::asio::buffer (receive_buffer.data (), 1), [this_l] (boost::system::error_code const & ec, size_t size_a)
+	{
+		if (!ec)
+		{
+			this_l->received_type ();
+		}
+		else
+		{
+			BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Error receiving dependency block type %1%") % ec.message ());
+			this_l->finish ();
+		}
+	});
+}
+
+void rai::dependency_pull::received_type ()
+{
+	auto this_l (shared_from_this ());
+	rai::block_type type (static_cast <rai::block_type> (receive_buffer [0]));
+	size_t size (0);
+	switch (type)
+	{
+		case rai::block_type::send:
+			size = rai::send_block::size;
+			break;
+		case rai::block_type::receive:
+			size = rai::receive_block::size;
+			break;
+		case rai::block_type::open:
+			size = rai::open_block::size;
+			break;
+		case rai::block_type::change:
+			size = rai::change_block::size;
+			break;
+		case rai::block_type::not_a_block:
+			finish ();
+			break;
+		default:
+			BOOST_LOG (node->log) << boost::str (boost::format ("Unknown type received as block type: %1%") % static_cast <int> (type));
+			finish ();
+			break;
+	}
+	if (size != 0)
+	{
+		boost::asio::async_read (socket, boost::asio::buffer (receive_buffer.data () + 1, size), [this_l] (boost::system::error_code const & ec, size_t size_a)
+		{
+			this_l->received_block (ec, size_a);
+		});
+	}
+}
+
+void rai::dependency_pull::received_block (boost::system::error_code const & ec, size_t size_a)
 {
 	if (!ec)
 	{
-		rai::bufferstream stream (connection.receive_buffer.data (), 1 + size_a);
+		rai::bufferstream stream (receive_buffer.data (), size_a + 1);
 		auto block (rai::deserialize_block (stream));
 		if (block != nullptr)
 		{
-            auto hash (block->hash ());
-            if (connection.node->config.logging.bulk_pull_logging ())
-            {
-                std::string block_l;
-                block->serialize_json (block_l);
-                BOOST_LOG (connection.node->log) << boost::str (boost::format ("Pulled block %1% %2%") % hash.to_string () % block_l);
-            }
-			if (hash == expected)
+			auto known (false);
 			{
-				expected = block->previous ();
+				rai::transaction transaction (node->store.environment, nullptr, false);
+				known = node->store.block_exists (transaction, block->hash ());
 			}
-			auto already_exists (false);
+			// The first block has to be the one asked for, after that the chain is followed until it joins our ledger
+			if (blocks.empty () && block->hash () != hash)
 			{
-				rai::transaction transaction (connection.node->store.environment, nullptr, false);
-				already_exists = connection.node->store.block_exists (transaction, hash);
+				BOOST_LOG (node->log) << boost::str (boost::format ("%1% doesn't have dependency %2%") % endpoint % hash.to_string ());
+				finish ();
 			}
-			if (!already_exists)
+			else if (known)
+			{
+				finish ();
+			}
+			else
 			{
-				connection.attempt->cache.add_block (std::move (block));
+				blocks.push_back (std::move (block));
+				if (blocks.size () < max_blocks)
+				{
+					receive_block ();
+				}
+				else
+				{
+					finish ();
+				}
 			}
-            receive_block ();
 		}
-        else
-        {
-            BOOST_LOG (connection.node->log) << "Error deserializing block received from pull request";
-        }
+		else
+		{
+			BOOST_LOG (node->log) << boost::str (boost::format ("Error deserializing dependency block from %1%") % endpoint);
+			finish ();
+		}
 	}
 	else
 	{
-		BOOST_LOG (connection.node->log) << boost::str (boost::format ("Error bulk receiving block: %1%") % ec.message ());
+		BOOST_LOG (node->log) << boost::str (boost::format ("Error receiving dependency block: %1%") % ec.message ());
+		finish ();
 	}
 }
 
-rai::bulk_pull_client::bulk_pull_client (rai::bootstrap_client & connection_a) :
-connection (connection_a),
-account_count (0)
-{
-}
-
-rai::bulk_pull_client::~bulk_pull_client ()
+void rai::dependency_pull::finish ()
 {
+	// Errors can follow the timeout closing the socket, only the first way out counts
+	if (!completed.exchange (true))
+	{
+		boost::system::error_code ignored;
+		socket.close (ignored);
+		std::vector <std::pair <rai::block_hash, uint64_t>> work;
+		work.reserve (blocks.size ());
+		for (auto & i: blocks)
+		{
+			work.push_back (std::make_pair (i->root (), i->block_work ()));
+		}
+		auto insufficient (node->work.work_validate_batch (work));
+		// A requested block dropped for its work stays missing and is left to the bootstrap fallback
+		auto missing (true);
+		{
+			rai::transaction transaction (node->store.environment, nullptr, true);
+			for (auto i (blocks.size ()); i > 0; --i)
+			{
+				auto & block (*blocks [i - 1]);
+				if (!insufficient [i - 1])
+				{
+					node->process_receive_many (transaction, block);
+				}
+				else
+				{
+					BOOST_LOG (node->log) << boost::str (boost::format ("Insufficient work for dependency block %1% from %2%") % block.hash ().to_string () % endpoint);
+				}
+			}
+			missing = !node->store.block_exists (transaction, hash);
+		}
+		if (node->config.logging.network_logging ())
+		{
+			BOOST_LOG (node->log) << boost::str (boost::format ("Pulled %1% blocks for dependency %2% from %3%") % blocks.size () % hash.to_string () % endpoint);
+		}
+		completion (missing);
+	}
 }
 
 rai::bulk_push_client::bulk_push_client (std::shared_ptr <rai::bootstrap_client> const & connection_a) :
@@ -715,34 +1055,52 @@ void rai::bulk_push_client::push_block (rai::block const & block_a)
 }
 
 rai::bootstrap_pull_cache::bootstrap_pull_cache (rai::bootstrap_attempt & attempt_a) :
-attempt (attempt_a)
+attempt (attempt_a),
+mutex ("bootstrap_pull_cache")
 {
+	blocks.reserve (block_count);
 }
 
-void rai::bootstrap_pull_cache::add_block (std::unique_ptr <rai::block> block_a)
+void rai::bootstrap_pull_cache::add_block (rai::block_value const & block_a)
 {
-	std::lock_guard <std::mutex> lock (mutex);
-	blocks.emplace_back (std::move (block_a));
+	rai::lock_guard lock (mutex);
+	blocks.push_back (block_a);
 }
 
 void rai::bootstrap_pull_cache::flush (size_t minimum_a)
 {
+	rai::trace_span span ("bootstrap", "flush");
 	decltype (blocks) blocks_l;
 	{
-		std::lock_guard <std::mutex> lock (mutex);
+		rai::lock_guard lock (mutex);
 		if (blocks.size () > minimum_a)
 		{
 			blocks.swap (blocks_l);
+			blocks.reserve (block_count);
 		}
 	}
 	if (!blocks_l.empty ())
 	{
+		std::vector <std::pair <rai::block_hash, uint64_t>> work;
+		work.reserve (blocks_l.size ());
+		for (auto & i: blocks_l)
+		{
+			auto view (i.view ());
+			work.push_back (std::make_pair (view.root (), view.block_work ()));
+		}
+		auto insufficient (attempt.node->work.work_validate_batch (work));
 		rai::transaction transaction (attempt.node->store.environment, nullptr, true);
-		while (!blocks_l.empty ())
+		for (size_t i (0), n (blocks_l.size ()); i < n; ++i)
 		{
-			auto & front (blocks_l.front ());
-			attempt.node->store.unchecked_put (transaction, front->hash(), *front);
-			blocks_l.pop_front ();
+			auto view (blocks_l [i].view ());
+			if (!insufficient [i])
+			{
+				attempt.node->store.unchecked_put (transaction, view.hash (), view);
+			}
+			else
+			{
+				BOOST_LOG (attempt.node->log) << boost::str (boost::format ("Insufficient work for pulled block %1%") % view.hash ().to_string ());
+			}
 		}
 	}
 }
@@ -765,7 +1123,8 @@ attempts (0)
 rai::bootstrap_attempt::bootstrap_attempt (std::shared_ptr <rai::node> node_a) :
 node (node_a),
 cache (*this),
-state (rai::attempt_state::starting)
+state (rai::attempt_state::starting),
+mutex ("bootstrap_attempt")
 {
 }
 
@@ -780,7 +1139,7 @@ void rai::bootstrap_attempt::populate_connections ()
 	std::weak_ptr <rai::bootstrap_attempt> this_w (shared_from_this ());
 	std::shared_ptr <rai::bootstrap_client> client;
 	{
-		std::lock_guard <std::mutex> lock (mutex);
+		rai::lock_guard lock (mutex);
 		if (connecting.size () + active.size () + idle.size () < 1)
 		{
 			auto peer (node->peers.bootstrap_peer ());
@@ -812,7 +1171,7 @@ void rai::bootstrap_attempt::add_connection (rai::endpoint const & endpoint_a)
 {
 	std::shared_ptr <rai::bootstrap_client> client;
 	{
-		std::lock_guard <std::mutex> lock (mutex);
+		rai::lock_guard lock (mutex);
 		client = start_connection (endpoint_a);
 	}
 }
@@ -834,7 +1193,7 @@ std::shared_ptr <rai::bootstrap_client> rai::bootstrap_attempt::start_connection
 
 void rai::bootstrap_attempt::stop ()
 {
-	std::lock_guard <std::mutex> lock (mutex);
+	rai::lock_guard lock (mutex);
 	state = rai::attempt_state::complete;
 	for (auto i: connecting)
 	{
@@ -858,7 +1217,7 @@ void rai::bootstrap_attempt::stop ()
 void rai::bootstrap_attempt::pool_connection (std::shared_ptr <rai::bootstrap_client> client_a)
 {
 	{
-		std::lock_guard <std::mutex> lock (mutex);
+		rai::lock_guard lock (mutex);
 		auto erased_active (active.erase (client_a.get ()));
 		auto erased_connecting (connecting.erase (client_a.get ()));
 		assert (erased_active == 1 || erased_connecting == 1);
@@ -871,7 +1230,7 @@ void rai::bootstrap_attempt::connection_ending (rai::bootstrap_client * client_a
 {
 	if (state != rai::attempt_state::complete)
 	{
-		std::lock_guard <std::mutex> lock (mutex);
+		rai::lock_guard lock (mutex);
 		if (!client_a->pull_client.pull.account.is_zero ())
 		{
 			// If this connection is ending and request_account hasn't been cleared it didn't finish, requeue
@@ -885,7 +1244,7 @@ void rai::bootstrap_attempt::connection_ending (rai::bootstrap_client * client_a
 void rai::bootstrap_attempt::completed_requests (std::shared_ptr <rai::bootstrap_client> client_a)
 {
 	{
-		std::lock_guard <std::mutex> lock (mutex);
+		rai::lock_guard lock (mutex);
 		if (node->config.logging.network_logging ())
 		{
 			BOOST_LOG (node->log) << boost::str (boost::format ("Completed frontier request, %1% out of sync accounts according to %2%") % pulls.size () % client_a->endpoint);
@@ -898,7 +1257,7 @@ void rai::bootstrap_attempt::completed_requests (std::shared_ptr <rai::bootstrap
 void rai::bootstrap_attempt::completed_pull (std::shared_ptr <rai::bootstrap_client> client_a)
 {
 	{
-		std::lock_guard <std::mutex> lock (mutex);
+		rai::lock_guard lock (mutex);
 		if (client_a->pull_client.expected != client_a->pull_client.pull.end)
 		{
 			requeue_pull (client_a->pull_client.pull);
@@ -922,7 +1281,7 @@ void rai::bootstrap_attempt::completed_pulls (std::shared_ptr <rai::bootstrap_cl
 void rai::bootstrap_attempt::completed_pushes (std::shared_ptr <rai::bootstrap_client> client_a)
 {
 	std::vector <std::shared_ptr <rai::bootstrap_client>> discard;
-	std::lock_guard <std::mutex> lock (mutex);
+	rai::lock_guard lock (mutex);
 	state = rai::attempt_state::complete;
 	discard.swap (idle);
 }
@@ -931,7 +1290,7 @@ void rai::bootstrap_attempt::dispatch_work ()
 {
 	std::function <void ()> action;
 	{
-		std::lock_guard <std::mutex> lock (mutex);
+		rai::lock_guard lock (mutex);
 		if (!idle.empty ())
 		{
 			// We have a connection we could do something with
@@ -1008,13 +1367,14 @@ void rai::bootstrap_attempt::requeue_pull (rai::pull_info const & pull_a)
 
 rai::bootstrap_initiator::bootstrap_initiator (rai::node & node_a) :
 node (node_a),
-stopped (false)
+stopped (false),
+mutex ("bootstrap_initiator")
 {
 }
 
 void rai::bootstrap_initiator::bootstrap ()
 {
-	std::lock_guard <std::mutex> lock (mutex);
+	rai::lock_guard lock (mutex);
 	if (attempt.lock () == nullptr && !stopped)
 	{
 		auto attempt_l (std::make_shared <rai::bootstrap_attempt> (node.shared ()));
@@ -1026,7 +1386,7 @@ void rai::bootstrap_initiator::bootstrap ()
 void rai::bootstrap_initiator::bootstrap (rai::endpoint const & endpoint_a)
 {
 	bootstrap ();
-	std::lock_guard <std::mutex> lock (mutex);
+	rai::lock_guard lock (mutex);
 	if (auto attempt_l = attempt.lock ())
 	{
 		if (!stopped)
@@ -1038,7 +1398,7 @@ void rai::bootstrap_initiator::bootstrap (rai::endpoint const & endpoint_a)
 
 void rai::bootstrap_initiator::add_observer (std::function <void (bool)> const & observer_a)
 {
-	std::lock_guard <std::mutex> lock (mutex);
+	rai::lock_guard lock (mutex);
 	observers.push_back (observer_a);
 }
 
@@ -1049,7 +1409,7 @@ bool rai::bootstrap_initiator::in_progress ()
 
 void rai::bootstrap_initiator::stop ()
 {
-	std::lock_guard <std::mutex> lock (mutex);
+	rai::lock_guard lock (mutex);
 	stopped = true;
 	auto attempt_l (attempt.lock ());
 	if (attempt_l != nullptr)
@@ -1179,6 +1539,15 @@ void rai::bootstrap_server::receive_header_action (boost::system::error_code con
                     add_request (std::unique_ptr <rai::message> (new rai::bulk_push));
                     break;
                 }
+				case rai::message_type::checksum_req:
+				{
+					auto this_l (shared_from_this ());
+					boost::asio::async_read (*socket, boost::asio::buffer (receive_buffer.data () + 8, rai::checksum_req::size), [this_l] (boost::system::error_code const & ec, size_t size_a)
+					{
+						this_l->receive_checksum_req_action (ec, size_a);
+					});
+					break;
+				}
 				default:
 				{
 					if (node->config.logging.network_logging ())
@@ -1244,6 +1613,39 @@ void rai::bootstrap_server::receive_frontier_req_action (boost::system::error_co
     }
 }
 
+void rai::bootstrap_server::receive_checksum_req_action (boost::system::error_code const & ec, size_t size_a)
+{
+	if (!ec)
+	{
+		std::unique_ptr <rai::checksum_req> request (new rai::checksum_req);
+		rai::bufferstream stream (receive_buffer.data (), 8 + rai::checksum_req::size);
+		auto error (request->deserialize (stream));
+		if (!error)
+		{
+			if (node->config.logging.bulk_pull_logging ())
+			{
+				BOOST_LOG (node->log) << boost::str (boost::format ("Received checksum request for prefix %1% depth %2%") % request->prefix % static_cast <unsigned> (request->depth));
+			}
+			add_request (std::unique_ptr <rai::message> (request.release ()));
+			receive ();
+		}
+		else
+		{
+			if (node->config.logging.network_logging ())
+			{
+				BOOST_LOG (node->log) << "Received invalid checksum request";
+			}
+		}
+	}
+	else
+	{
+		if (node->config.logging.network_logging ())
+		{
+			BOOST_LOG (node->log) << boost::str (boost::format ("Error receiving checksum request %1%") % ec.message ());
+		}
+	}
+}
+
 void rai::bootstrap_server::add_request (std::unique_ptr <rai::message> message_a)
 {
 	std::lock_guard <std::mutex> lock (mutex);
@@ -1305,6 +1707,26 @@ public:
         auto response (std::make_shared <rai::frontier_req_server> (connection, std::unique_ptr <rai::frontier_req> (static_cast <rai::frontier_req *> (connection->requests.front ().release ()))));
         response->send_next ();
     }
+    void checksum_req (rai::checksum_req const & request_a) override
+    {
+        if (request_a.depth < rai::checksum_leaf_depth && !request_a.frontiers ())
+        {
+            auto response (std::make_shared <rai::checksum_req_server> (connection, std::unique_ptr <rai::checksum_req> (static_cast <rai::checksum_req *> (connection->requests.front ().release ()))));
+            response->send_checksums ();
+        }
+        else
+        {
+            // Leaves, and nodes the client asked frontiers for, are answered like a frontier request limited to the node's accounts
+            auto range (rai::checksum_range (request_a.prefix, request_a.depth));
+            std::unique_ptr <rai::frontier_req> request (new rai::frontier_req);
+            request->start = range.first;
+            request->age = std::numeric_limits <decltype (request->age)>::max ();
+            request->count = std::numeric_limits <decltype (request->count)>::max ();
+            auto response (std::make_shared <rai::frontier_req_server> (connection, std::move (request)));
+            response->end = range.second;
+            response->send_next ();
+        }
+    }
     std::shared_ptr <rai::bootstrap_server> connection;
 };
 }
@@ -1337,6 +1759,11 @@ void rai::bulk_pull_server::set_current_end ()
 			BOOST_LOG (connection->node->log) << boost::str (boost::format ("Request for unknown account: %1%") % request->start.to_account ());
 		}
 		current = request->end;
+		// A block hash instead of an account asks for the chain below that block
+		if (connection->node->store.block_exists (transaction, request->start))
+		{
+			current = request->start;
+		}
 	}
 	else
 	{
@@ -1361,19 +1788,9 @@ void rai::bulk_pull_server::set_current_end ()
 
 void rai::bulk_pull_server::send_next ()
 {
-    std::unique_ptr <rai::block> block (get_next ());
-    if (block != nullptr)
+    if (get_next ())
     {
-        {
-            send_buffer.clear ();
-            rai::vectorstream stream (send_buffer);
-            rai::serialize_block (stream, *block);
-        }
         auto this_l (shared_from_this ());
-        if (connection->node->config.logging.bulk_pull_logging ())
-        {
-            BOOST_LOG (connection->node->log) << boost::str (boost::format ("Sending block: %1%") % block->hash ().to_string ());
-        }
         async_write (*connection->socket, boost::asio::buffer (send_buffer.data (), send_buffer.size ()), [this_l] (boost::system::error_code const & ec, size_t size_a)
         {
             this_l->sent_action (ec, size_a);
@@ -1385,22 +1802,35 @@ void rai::bulk_pull_server::send_next ()
     }
 }
 
-std::unique_ptr <rai::block> rai::bulk_pull_server::get_next ()
+// Copies the next block's stored bytes into send_buffer, false once the requested range has been sent
+bool rai::bulk_pull_server::get_next ()
 {
-    std::unique_ptr <rai::block> result;
+    auto result (false);
     if (current != request->end)
     {
 		rai::transaction transaction (connection->node->store.environment, nullptr, false);
-        result = connection->node->store.block_get (transaction, current);
-        assert (result != nullptr);
-        auto previous (result->previous ());
-        if (!previous.is_zero ())
-        {
-            current = previous;
-        }
-        else
+        auto block (connection->node->store.block_get_view (transaction, current));
+        // Pruned ledgers send the chain only as far back as it's stored
+        if (block.valid ())
         {
-            request->end = current;
+            // Stored blocks are already in wire format, only the type prefix is added
+            send_buffer.clear ();
+            send_buffer.push_back (static_cast <uint8_t> (block.type ()));
+            send_buffer.insert (send_buffer.end (), block.data, block.data + block.block_size ());
+            if (connection->node->config.logging.bulk_pull_logging ())
+            {
+                BOOST_LOG (connection->node->log) << boost::str (boost::format ("Sending block: %1%") % block.hash ().to_string ());
+            }
+            result = true;
+            auto previous (block.previous ());
+            if (!previous.is_zero ())
+            {
+                current = previous;
+            }
+            else
+            {
+                request->end = current;
+            }
         }
     }
     return result;
@@ -1550,7 +1980,8 @@ rai::frontier_req_server::frontier_req_server (std::shared_ptr <rai::bootstrap_s
 connection (connection_a),
 current (request_a->start.number () - 1),
 info (0, 0, 0, 0, 0),
-request (std::move (request_a))
+request (std::move (request_a)),
+end (std::numeric_limits <rai::uint256_t>::max ())
 {
 	next ();
     skip_old ();
@@ -1570,7 +2001,7 @@ void rai::frontier_req_server::skip_old ()
 
 void rai::frontier_req_server::send_next ()
 {
-    if (!current.is_zero ())
+    if (!current.is_zero () && !(end < current))
     {
         {
             send_buffer.clear ();
@@ -1659,3 +2090,43 @@ void rai::frontier_req_server::next ()
 		current.clear ();
 	}
 }
+
+rai::checksum_req_server::checksum_req_server (std::shared_ptr <rai::bootstrap_server> const & connection_a, std::unique_ptr <rai::checksum_req> request_a) :
+connection (connection_a),
+request (std::move (request_a))
+{
+}
+
+void rai::checksum_req_server::send_checksums ()
+{
+	{
+		rai::transaction transaction (connection->node->store.environment, nullptr, false);
+		rai::vectorstream stream (send_buffer);
+		uint8_t depth (request->depth + rai::checksum_level_bits);
+		for (uint64_t i (0); i < (1 << rai::checksum_level_bits); ++i)
+		{
+			auto checksum (connection->node->store.checksum_node (transaction, request->prefix | (i << (64 - depth)), depth));
+			write (stream, checksum.bytes);
+		}
+	}
+	auto this_l (shared_from_this ());
+	async_write (*connection->socket, boost::asio::buffer (send_buffer.data (), send_buffer.size ()), [this_l] (boost::system::error_code const & ec, size_t size_a)
+	{
+		this_l->sent_action (ec, size_a);
+	});
+}
+
+void rai::checksum_req_server::sent_action (boost::system::error_code const & ec, size_t size_a)
+{
+	if (!ec)
+	{
+		connection->finish_request ();
+	}
+	else
+	{
+		if (connection->node->config.logging.network_logging ())
+		{
+			BOOST_LOG (connection->node->log) << boost::str (boost::format ("Error sending checksums %1%") % ec.message ());
+		}
+	}
+}
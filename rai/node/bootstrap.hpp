@@ -14,6 +14,7 @@ namespace rai
 {
 class bootstrap_attempt;
 class node;
+class stat_counter;
 enum class sync_result
 {
 	success,
@@ -61,13 +62,13 @@ class bootstrap_pull_cache
 {
 public:
 	bootstrap_pull_cache (rai::bootstrap_attempt &);
-	void add_block (std::unique_ptr <rai::block>);
+	void add_block (rai::block_value const &);
 	void flush (size_t);
 	size_t const block_count = 256;
 	bootstrap_attempt & attempt;
 private:
-	std::mutex mutex;
-	std::deque <std::unique_ptr <rai::block>> blocks;
+	rai::named_mutex mutex;
+	std::vector <rai::block_value> blocks;
 };
 class bootstrap_client;
 enum class attempt_state
@@ -114,12 +115,13 @@ public:
 	std::unordered_set <rai::endpoint> attempted;
 private:
 	std::shared_ptr <rai::bootstrap_client> start_connection (rai::endpoint const &);
-	std::mutex mutex;
+	rai::named_mutex mutex;
 };
+// Compares the peer's frontiers for an account range with ours, queueing pulls and marking unsynced blocks
 class frontier_req_client : public std::enable_shared_from_this <rai::frontier_req_client>
 {
 public:
-    frontier_req_client (std::shared_ptr <rai::bootstrap_client> const &);
+    frontier_req_client (std::shared_ptr <rai::bootstrap_client> const &, rai::account const &, rai::account const &, std::function <void ()> const &);
     ~frontier_req_client ();
     void receive_frontier ();
     void received_frontier (boost::system::error_code const &, size_t);
@@ -129,6 +131,33 @@ public:
     std::shared_ptr <rai::bootstrap_client> connection;
 	rai::account current;
 	rai::account_info info;
+	rai::account end;
+	// Called once the peer has sent every frontier in the range
+	std::function <void ()> completion;
+};
+// Walks the peer's checksum tree from the root, only descending into subranges whose checksum differs from ours
+// Frontiers are exchanged for differing leaves alone so a nearly synchronized node makes a handful of requests
+class checksum_req_client : public std::enable_shared_from_this <rai::checksum_req_client>
+{
+public:
+	checksum_req_client (std::shared_ptr <rai::bootstrap_client> const &);
+	void request_next ();
+	void send_request (bool);
+	void sent_request (boost::system::error_code const &, size_t, bool);
+	void received_checksums (boost::system::error_code const &, size_t);
+	std::shared_ptr <rai::bootstrap_client> connection;
+	// Tree node being requested as (prefix, depth)
+	std::pair <uint64_t, uint8_t> current;
+	// Tree nodes still to compare
+	std::deque <std::pair <uint64_t, uint8_t>> nodes;
+	std::array <uint8_t, sizeof (rai::checksum) << rai::checksum_level_bits> receive_buffer;
+	rai::stat_counter & requests;
+	rai::stat_counter & leaves;
+	rai::stat_counter & subtrees;
+	// Past this many differing children a round trip each costs more than streaming the node's frontiers at once
+	static size_t constexpr descend_limit = (1 << rai::checksum_level_bits) / 2;
+	// With no more accounts than the root has children nearly every subtree differs, the walk is skipped
+	static size_t constexpr accounts_min = 1 << rai::checksum_level_bits;
 };
 class bulk_pull_client
 {
@@ -144,6 +173,7 @@ public:
 	size_t account_count;
 	rai::block_hash expected;
 	rai::pull_info pull;
+	rai::stat_counter & pulled;
 };
 class bootstrap_client : public std::enable_shared_from_this <bootstrap_client>
 {
@@ -162,6 +192,29 @@ public:
 	rai::bulk_pull_client pull_client;
 	rai::tcp_endpoint endpoint;
 };
+// Pulls the chain below one missing block from a single peer without a frontier scan
+// The peer's bulk_pull server starts from a block hash when the start isn't an account
+class dependency_pull : public std::enable_shared_from_this <rai::dependency_pull>
+{
+public:
+	dependency_pull (std::shared_ptr <rai::node>, rai::tcp_endpoint const &, rai::block_hash const &, std::function <void (bool)> const &);
+	void run ();
+	void receive_block ();
+	void received_type ();
+	void received_block (boost::system::error_code const &, size_t);
+	// Processes what was pulled oldest first so the gap cache isn't needed within the chain
+	void finish ();
+	std::shared_ptr <rai::node> node;
+	boost::asio::ip::tcp::socket socket;
+	rai::tcp_endpoint endpoint;
+	rai::block_hash hash;
+	std::array <uint8_t, 200> receive_buffer;
+	std::vector <std::unique_ptr <rai::block>> blocks;
+	std::atomic <bool> completed;
+	// Called once when the pull ends with whether the requested block is still missing, errors and timeouts included
+	std::function <void (bool)> completion;
+	static size_t constexpr max_blocks = 4096;
+};
 class bulk_push_client : public std::enable_shared_from_this <rai::bulk_push_client>
 {
 public:
@@ -188,7 +241,7 @@ public:
 	std::weak_ptr <rai::bootstrap_attempt> attempt;
 	bool stopped;
 private:
-	std::mutex mutex;
+	rai::named_mutex mutex;
 	std::vector <std::function <void (bool)>> observers;
 };
 class bootstrap_listener
@@ -216,6 +269,7 @@ public:
     void receive_header_action (boost::system::error_code const &, size_t);
     void receive_bulk_pull_action (boost::system::error_code const &, size_t);
     void receive_frontier_req_action (boost::system::error_code const &, size_t);
+    void receive_checksum_req_action (boost::system::error_code const &, size_t);
     void receive_bulk_push_action ();
     void add_request (std::unique_ptr <rai::message>);
     void finish_request ();
@@ -232,7 +286,7 @@ class bulk_pull_server : public std::enable_shared_from_this <rai::bulk_pull_ser
 public:
     bulk_pull_server (std::shared_ptr <rai::bootstrap_server> const &, std::unique_ptr <rai::bulk_pull>);
     void set_current_end ();
-    std::unique_ptr <rai::block> get_next ();
+    bool get_next ();
     void send_next ();
     void sent_action (boost::system::error_code const &, size_t);
     void send_finished ();
@@ -270,5 +324,18 @@ public:
     std::unique_ptr <rai::frontier_req> request;
     std::vector <uint8_t> send_buffer;
     size_t count;
+	// Last account sent, checksum leaves are answered with the frontiers of their range
+	rai::account end;
+};
+class checksum_req;
+class checksum_req_server : public std::enable_shared_from_this <rai::checksum_req_server>
+{
+public:
+	checksum_req_server (std::shared_ptr <rai::bootstrap_server> const &, std::unique_ptr <rai::checksum_req>);
+	void send_checksums ();
+	void sent_action (boost::system::error_code const &, size_t);
+	std::shared_ptr <rai::bootstrap_server> connection;
+	std::unique_ptr <rai::checksum_req> request;
+	std::vector <uint8_t> send_buffer;
 };
 }
@@ -5,11 +5,13 @@
 std::array <uint8_t, 2> constexpr rai::message::magic_number;
 size_t constexpr rai::message::ipv4_only_position;
 size_t constexpr rai::message::bootstrap_server_position;
+size_t constexpr rai::message::pruned_position;
+size_t constexpr rai::message::frontiers_position;
 std::bitset <16> constexpr rai::message::block_type_mask;
 
 rai::message::message (rai::message_type type_a) :
-version_max (0x01),
-version_using (0x01),
+version_max (0x02),
+version_using (0x02),
 version_min (0x01),
 type (type_a)
 {
@@ -41,6 +43,26 @@ void rai::message::ipv4_only_set (bool value_a)
     extensions.set (ipv4_only_position, value_a);
 }
 
+bool rai::message::pruned () const
+{
+    return extensions.test (pruned_position);
+}
+
+void rai::message::pruned_set (bool value_a)
+{
+    extensions.set (pruned_position, value_a);
+}
+
+bool rai::message::frontiers () const
+{
+    return extensions.test (frontiers_position);
+}
+
+void rai::message::frontiers_set (bool value_a)
+{
+    extensions.set (frontiers_position, value_a);
+}
+
 void rai::message::write_header (rai::stream & stream_a)
 {
     rai::write (stream_a, rai::message::magic_number);
@@ -498,6 +520,61 @@ void rai::bulk_pull::serialize (rai::stream & stream_a)
     write (stream_a, end);
 }
 
+size_t constexpr rai::checksum_req::size;
+uint8_t constexpr rai::checksum_req::version;
+
+rai::checksum_req::checksum_req () :
+message (rai::message_type::checksum_req),
+prefix (0),
+depth (0)
+{
+}
+
+rai::checksum_req::checksum_req (uint64_t prefix_a, uint8_t depth_a) :
+message (rai::message_type::checksum_req),
+prefix (prefix_a),
+depth (depth_a)
+{
+}
+
+bool rai::checksum_req::deserialize (rai::stream & stream_a)
+{
+	auto result (read_header (stream_a, version_max, version_using, version_min, type, extensions));
+	assert (!result);
+	assert (rai::message_type::checksum_req == type);
+	if (!result)
+	{
+		result = read (stream_a, prefix);
+		if (!result)
+		{
+			result = read (stream_a, depth);
+			if (!result)
+			{
+				// Only nodes that exist in the tree, with no account bits set below their depth
+				result = depth > rai::checksum_leaf_depth || depth % rai::checksum_level_bits != 0 || prefix != rai::checksum_prefix (rai::checksum_range (prefix, 0).first, depth);
+			}
+		}
+	}
+	return result;
+}
+
+void rai::checksum_req::serialize (rai::stream & stream_a)
+{
+	write_header (stream_a);
+	write (stream_a, prefix);
+	write (stream_a, depth);
+}
+
+void rai::checksum_req::visit (rai::message_visitor & visitor_a) const
+{
+	visitor_a.checksum_req (*this);
+}
+
+bool rai::checksum_req::operator == (rai::checksum_req const & other_a) const
+{
+	return prefix == other_a.prefix && depth == other_a.depth;
+}
+
 rai::bulk_push::bulk_push () :
 message (rai::message_type::bulk_push)
 {
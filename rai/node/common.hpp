@@ -91,7 +91,8 @@ enum class message_type : uint8_t
     confirm_ack,
     bulk_pull,
     bulk_push,
-    frontier_req
+    frontier_req,
+    checksum_req
 };
 class message_visitor;
 class message
@@ -109,6 +110,12 @@ public:
     void block_type_set (rai::block_type);
     bool ipv4_only ();
     void ipv4_only_set (bool);
+    // Set by nodes that prune their ledger and can't serve full chains to bulk_pull
+    bool pruned () const;
+    void pruned_set (bool);
+    // Set on checksum_req to ask for the frontiers of the node's whole range instead of its child checksums
+    bool frontiers () const;
+    void frontiers_set (bool);
 	static std::array <uint8_t, 2> constexpr magic_number = rai::rai_network == rai::rai_networks::rai_test_network ? std::array <uint8_t, 2>({ 'R', 'A' }) : rai::rai_network == rai::rai_networks::rai_beta_network ? std::array <uint8_t, 2>({ 'R', 'B' }) : std::array <uint8_t, 2>({ 'R', 'C' });
     uint8_t version_max;
     uint8_t version_using;
@@ -117,6 +124,8 @@ public:
     std::bitset <16> extensions;
     static size_t constexpr ipv4_only_position = 1;
     static size_t constexpr bootstrap_server_position = 2;
+    static size_t constexpr pruned_position = 3;
+    static size_t constexpr frontiers_position = 4;
     static std::bitset <16> constexpr block_type_mask = std::bitset <16> (0x0f00);
 };
 class work_pool;
@@ -209,6 +218,22 @@ public:
     void serialize (rai::stream &) override;
     void visit (rai::message_visitor &) const override;
 };
+// Asks for the child checksums of a checksum tree node, or the frontiers of its accounts when the node is a leaf
+class checksum_req : public message
+{
+public:
+    checksum_req ();
+    checksum_req (uint64_t, uint8_t);
+    bool deserialize (rai::stream &) override;
+    void serialize (rai::stream &) override;
+    void visit (rai::message_visitor &) const override;
+    bool operator == (rai::checksum_req const &) const;
+    uint64_t prefix;
+    uint8_t depth;
+    static size_t constexpr size = sizeof (uint64_t) + sizeof (uint8_t);
+    // Peers advertising an older version_max drop the connection on a checksum_req
+    static uint8_t constexpr version = 0x02;
+};
 class message_visitor
 {
 public:
@@ -219,25 +244,30 @@ public:
     virtual void bulk_pull (rai::bulk_pull const &) = 0;
     virtual void bulk_push (rai::bulk_push const &) = 0;
     virtual void frontier_req (rai::frontier_req const &) = 0;
+    virtual void checksum_req (rai::checksum_req const &) = 0;
 };
 template <typename ... T>
 class observer_set
 {
 public:
+	observer_set () :
+	mutex ("observer_set")
+	{
+	}
 	void add (std::function <void (T...)> const & observer_a)
 	{
-		std::lock_guard <std::mutex> lock (mutex);
+		rai::lock_guard lock (mutex);
 		observers.push_back (observer_a);
 	}
 	void operator () (T ... args)
 	{
-		std::lock_guard <std::mutex> lock (mutex);
+		rai::lock_guard lock (mutex);
 		for (auto & i: observers)
 		{
 			i (args...);
 		}
 	}
-	std::mutex mutex;
+	rai::named_mutex mutex;
 	std::vector <std::function <void (T...)>> observers;
 };
 }
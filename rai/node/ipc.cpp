@@ -0,0 +1,313 @@
+#include <rai/node/ipc.hpp>
+
+rai::ipc_config::ipc_config () :
+io_threads (2),
+frame_limit (64 * 1024)
+{
+}
+
+void rai::ipc_config::serialize_json (boost::property_tree::ptree & tree_a) const
+{
+	tree_a.put ("path", path);
+	tree_a.put ("io_threads", io_threads);
+	tree_a.put ("frame_limit", frame_limit);
+}
+
+bool rai::ipc_config::deserialize_json (boost::property_tree::ptree const & tree_a)
+{
+	auto result (false);
+	try
+	{
+		path = tree_a.get <std::string> ("path");
+		io_threads = tree_a.get <unsigned> ("io_threads");
+		frame_limit = tree_a.get <uint32_t> ("frame_limit");
+		result = io_threads == 0;
+	}
+	catch (std::runtime_error const &)
+	{
+		result = true;
+	}
+	return result;
+}
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+rai::ipc_server::ipc_server (rai::node & node_a, rai::ipc_config const & config_a) :
+node (node_a),
+config (config_a),
+acceptor (service),
+on (false)
+{
+	handlers [static_cast <uint8_t> (rai::ipc_action::account_balance)] = [this] (rai::stream & request_a, rai::stream & response_a) { return account_balance (request_a, response_a); };
+	handlers [static_cast <uint8_t> (rai::ipc_action::block)] = [this] (rai::stream & request_a, rai::stream & response_a) { return block (request_a, response_a); };
+	handlers [static_cast <uint8_t> (rai::ipc_action::block_count)] = [this] (rai::stream & request_a, rai::stream & response_a) { return block_count (request_a, response_a); };
+	handlers [static_cast <uint8_t> (rai::ipc_action::frontier)] = [this] (rai::stream & request_a, rai::stream & response_a) { return frontier (request_a, response_a); };
+	handlers [static_cast <uint8_t> (rai::ipc_action::process)] = [this] (rai::stream & request_a, rai::stream & response_a) { return process_block (request_a, response_a); };
+}
+
+rai::ipc_server::~ipc_server ()
+{
+	stop ();
+}
+
+boost::filesystem::path rai::ipc_server::path () const
+{
+	return config.path.empty () ? node.application_path / "rai_node.ipc" : boost::filesystem::path (config.path);
+}
+
+void rai::ipc_server::start ()
+{
+	auto path_l (path ());
+	// A socket file left behind by an unclean shutdown would make bind fail
+	boost::system::error_code ec;
+	boost::filesystem::remove (path_l, ec);
+	boost::asio::local::stream_protocol::endpoint endpoint (path_l.string ());
+	acceptor.open (endpoint.protocol ());
+	acceptor.bind (endpoint, ec);
+	if (!ec)
+	{
+		acceptor.listen ();
+		on = true;
+		accept ();
+		runner.reset (new rai::thread_runner (service, config.io_threads));
+	}
+	else
+	{
+		BOOST_LOG (node.log) << boost::str (boost::format ("Error while binding for IPC on %1%: %2%") % path_l.string () % ec.message ());
+	}
+}
+
+void rai::ipc_server::stop ()
+{
+	if (on)
+	{
+		on = false;
+		service.stop ();
+		runner->join ();
+		boost::system::error_code ec;
+		acceptor.close (ec);
+		boost::filesystem::remove (path (), ec);
+	}
+}
+
+void rai::ipc_server::accept ()
+{
+	auto connection (std::make_shared <rai::ipc_connection> (*this));
+	acceptor.async_accept (connection->socket, [this, connection] (boost::system::error_code const & ec)
+	{
+		if (!ec)
+		{
+			accept ();
+			connection->read ();
+		}
+		else if (ec != boost::asio::error::operation_aborted)
+		{
+			BOOST_LOG (node.log) << boost::str (boost::format ("Error accepting IPC connection: %1%") % ec.message ());
+		}
+	});
+}
+
+void rai::ipc_server::process (std::vector <uint8_t> const & request_a, std::vector <uint8_t> & response_a)
+{
+	response_a.clear ();
+	response_a.push_back (static_cast <uint8_t> (rai::ipc_status::success));
+	auto status (rai::ipc_status::bad_request);
+	if (!request_a.empty ())
+	{
+		auto handler (handlers.find (request_a [0]));
+		if (handler != handlers.end ())
+		{
+			rai::bufferstream request_stream (request_a.data () + 1, request_a.size () - 1);
+			{
+				rai::vectorstream response_stream (response_a);
+				status = handler->second (request_stream, response_stream);
+			}
+			// Trailing bytes mean the client and server disagree on the layout of this action
+			if (status == rai::ipc_status::success && request_stream.in_avail () != 0)
+			{
+				status = rai::ipc_status::bad_request;
+			}
+		}
+		else
+		{
+			status = rai::ipc_status::unknown_action;
+		}
+	}
+	if (status != rai::ipc_status::success)
+	{
+		response_a.resize (1);
+	}
+	response_a [0] = static_cast <uint8_t> (status);
+}
+
+rai::ipc_status rai::ipc_server::account_balance (rai::stream & request_a, rai::stream & response_a)
+{
+	auto result (rai::ipc_status::bad_request);
+	rai::account account;
+	if (!rai::read (request_a, account.bytes))
+	{
+		auto balance (node.balance_pending (account));
+		rai::write (response_a, rai::amount (balance.first).bytes);
+		rai::write (response_a, rai::amount (balance.second).bytes);
+		result = rai::ipc_status::success;
+	}
+	return result;
+}
+
+rai::ipc_status rai::ipc_server::block (rai::stream & request_a, rai::stream & response_a)
+{
+	auto result (rai::ipc_status::bad_request);
+	rai::block_hash hash;
+	if (!rai::read (request_a, hash.bytes))
+	{
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		auto block_l (node.store.block_get (transaction, hash));
+		if (block_l != nullptr)
+		{
+			rai::serialize_block (response_a, *block_l);
+			result = rai::ipc_status::success;
+		}
+		else
+		{
+			result = rai::ipc_status::not_found;
+		}
+	}
+	return result;
+}
+
+rai::ipc_status rai::ipc_server::block_count (rai::stream &, rai::stream & response_a)
+{
+	rai::transaction transaction (node.store.environment, nullptr, false);
+	uint64_t count (node.store.block_count (transaction).sum ());
+	uint64_t unchecked (node.store.unchecked_count (transaction));
+	rai::write (response_a, count);
+	rai::write (response_a, unchecked);
+	return rai::ipc_status::success;
+}
+
+rai::ipc_status rai::ipc_server::frontier (rai::stream & request_a, rai::stream & response_a)
+{
+	auto result (rai::ipc_status::bad_request);
+	rai::account account;
+	if (!rai::read (request_a, account.bytes))
+	{
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		rai::account_info info;
+		if (!node.store.account_get (transaction, account, info))
+		{
+			rai::write (response_a, info.head.bytes);
+			result = rai::ipc_status::success;
+		}
+		else
+		{
+			result = rai::ipc_status::not_found;
+		}
+	}
+	return result;
+}
+
+rai::ipc_status rai::ipc_server::process_block (rai::stream & request_a, rai::stream &)
+{
+	auto result (rai::ipc_status::bad_request);
+	auto block_l (rai::deserialize_block (request_a));
+	if (block_l != nullptr)
+	{
+		if (!node.work.work_validate (*block_l))
+		{
+			node.process_receive_republish (std::move (block_l), 0);
+			result = rai::ipc_status::success;
+		}
+		else
+		{
+			result = rai::ipc_status::bad_work;
+		}
+	}
+	return result;
+}
+
+rai::ipc_connection::ipc_connection (rai::ipc_server & server_a) :
+server (server_a),
+socket (server_a.service)
+{
+}
+
+void rai::ipc_connection::read ()
+{
+	auto this_l (shared_from_this ());
+	boost::asio::async_read (socket, boost::asio::buffer (header), [this_l] (boost::system::error_code const & ec, size_t)
+	{
+		if (!ec)
+		{
+			this_l->read_payload ();
+		}
+	});
+}
+
+void rai::ipc_connection::read_payload ()
+{
+	uint32_t size ((uint32_t (header [0]) << 24) | (uint32_t (header [1]) << 16) | (uint32_t (header [2]) << 8) | uint32_t (header [3]));
+	if (size <= server.config.frame_limit)
+	{
+		request.resize (size);
+		auto this_l (shared_from_this ());
+		boost::asio::async_read (socket, boost::asio::buffer (request), [this_l] (boost::system::error_code const & ec, size_t)
+		{
+			if (!ec)
+			{
+				this_l->server.process (this_l->request, this_l->response);
+				this_l->write ();
+			}
+		});
+	}
+	else
+	{
+		if (server.node.config.logging.log_rpc ())
+		{
+			BOOST_LOG (server.node.log) << boost::str (boost::format ("Closing IPC connection sending a %1% byte frame") % size);
+		}
+	}
+}
+
+void rai::ipc_connection::write ()
+{
+	uint32_t size (response.size ());
+	header = { { uint8_t (size >> 24), uint8_t (size >> 16), uint8_t (size >> 8), uint8_t (size) } };
+	std::array <boost::asio::const_buffer, 2> buffers { { boost::asio::buffer (header), boost::asio::buffer (response) } };
+	auto this_l (shared_from_this ());
+	boost::asio::async_write (socket, buffers, [this_l] (boost::system::error_code const & ec, size_t)
+	{
+		if (!ec)
+		{
+			this_l->read ();
+		}
+	});
+}
+
+rai::ipc_client::ipc_client (boost::asio::io_service & service_a) :
+socket (service_a)
+{
+}
+
+void rai::ipc_client::connect (boost::filesystem::path const & path_a)
+{
+	socket.connect (boost::asio::local::stream_protocol::endpoint (path_a.string ()));
+}
+
+rai::ipc_status rai::ipc_client::request (rai::ipc_action action_a, std::vector <uint8_t> const & arguments_a, std::vector <uint8_t> & results_a)
+{
+	uint32_t size (arguments_a.size () + 1);
+	std::array <uint8_t, 5> header { { uint8_t (size >> 24), uint8_t (size >> 16), uint8_t (size >> 8), uint8_t (size), static_cast <uint8_t> (action_a) } };
+	std::array <boost::asio::const_buffer, 2> buffers { { boost::asio::buffer (header), boost::asio::buffer (arguments_a) } };
+	boost::asio::write (socket, buffers);
+	boost::asio::read (socket, boost::asio::buffer (header.data (), 4));
+	size = (uint32_t (header [0]) << 24) | (uint32_t (header [1]) << 16) | (uint32_t (header [2]) << 8) | uint32_t (header [3]);
+	results_a.resize (size);
+	boost::asio::read (socket, boost::asio::buffer (results_a));
+	auto result (rai::ipc_status::bad_request);
+	if (!results_a.empty ())
+	{
+		result = static_cast <rai::ipc_status> (results_a [0]);
+		results_a.erase (results_a.begin ());
+	}
+	return result;
+}
+#endif
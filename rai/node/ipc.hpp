@@ -0,0 +1,92 @@
+#pragma once
+
+#include <rai/node/node.hpp>
+
+#include <boost/asio/local/stream_protocol.hpp>
+
+#include <unordered_map>
+
+namespace rai
+{
+class ipc_config
+{
+public:
+	ipc_config ();
+	void serialize_json (boost::property_tree::ptree &) const;
+	bool deserialize_json (boost::property_tree::ptree const &);
+	std::string path; // Socket is created in the node's application path when empty
+	unsigned io_threads;
+	uint32_t frame_limit;
+};
+// Action and status values are part of the wire format, only ever append
+enum class ipc_action : uint8_t
+{
+	account_balance = 1, // account -> balance, pending
+	block = 2, // hash -> serialized block
+	block_count = 3, // -> count, unchecked as native uint64_t
+	frontier = 4, // account -> head block hash
+	process = 5 // serialized block ->
+};
+enum class ipc_status : uint8_t
+{
+	success = 0,
+	unknown_action = 1,
+	bad_request = 2,
+	not_found = 3,
+	bad_work = 4
+};
+// Unix domain sockets aren't available everywhere, e.g. Windows, where the IPC server isn't built
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+class ipc_connection;
+// Local binary RPC over a Unix domain socket
+// Every frame is a big endian uint32_t length followed by that many bytes
+// A request is an action byte followed by its arguments, a response is a status byte followed by its results
+// Blocks and numbers use the same serialization as the network protocol and the store
+class ipc_server
+{
+public:
+	ipc_server (rai::node &, rai::ipc_config const &);
+	~ipc_server ();
+	void start ();
+	void stop ();
+	void accept ();
+	void process (std::vector <uint8_t> const &, std::vector <uint8_t> &);
+	boost::filesystem::path path () const;
+	rai::ipc_status account_balance (rai::stream &, rai::stream &);
+	rai::ipc_status block (rai::stream &, rai::stream &);
+	rai::ipc_status block_count (rai::stream &, rai::stream &);
+	rai::ipc_status frontier (rai::stream &, rai::stream &);
+	rai::ipc_status process_block (rai::stream &, rai::stream &);
+	rai::node & node;
+	rai::ipc_config config;
+	std::unordered_map <uint8_t, std::function <rai::ipc_status (rai::stream &, rai::stream &)>> handlers;
+	// Handlers run on these threads so slow local clients never hold up the node's own io_service
+	boost::asio::io_service service;
+	boost::asio::local::stream_protocol::acceptor acceptor;
+	std::unique_ptr <rai::thread_runner> runner;
+	bool on;
+};
+class ipc_connection : public std::enable_shared_from_this <rai::ipc_connection>
+{
+public:
+	ipc_connection (rai::ipc_server &);
+	void read ();
+	void read_payload ();
+	void write ();
+	rai::ipc_server & server;
+	boost::asio::local::stream_protocol::socket socket;
+	std::array <uint8_t, 4> header;
+	std::vector <uint8_t> request;
+	std::vector <uint8_t> response;
+};
+// Blocking client for local integrations and tests
+class ipc_client
+{
+public:
+	ipc_client (boost::asio::io_service &);
+	void connect (boost::filesystem::path const &);
+	rai::ipc_status request (rai::ipc_action, std::vector <uint8_t> const &, std::vector <uint8_t> &);
+	boost::asio::local::stream_protocol::socket socket;
+};
+#endif
+}
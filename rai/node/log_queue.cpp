@@ -0,0 +1,203 @@
+#include <rai/node/log_queue.hpp>
+
+#include <rai/node/stats.hpp>
+
+#include <boost/format.hpp>
+#include <boost/log/trivial.hpp>
+
+size_t constexpr rai::log_queue::capacity;
+
+static_assert ((rai::log_queue::capacity & (rai::log_queue::capacity - 1)) == 0, "Log queue capacity must be a power of two");
+
+rai::log_queue::log_queue (boost::log::sources::logger_mt & log_a, rai::stats & stats_a, uint64_t rate_limit_a) :
+log (log_a),
+rate_limit (rate_limit_a),
+enqueue_position (0),
+dequeue_position (0),
+written (stats_a.counter ("log", "written")),
+overflow (stats_a.counter ("log", "overflow")),
+rate_limited (stats_a.counter ("log", "rate_limited")),
+window_overflow (0),
+sleeping (false),
+stopped (false)
+{
+	for (size_t i (0); i < records.size (); ++i)
+	{
+		records [i].sequence.store (i, std::memory_order_relaxed);
+	}
+	for (auto & i: window_counts)
+	{
+		i.store (0, std::memory_order_relaxed);
+	}
+	thread = std::thread ([this] () { run (); });
+}
+
+rai::log_queue::~log_queue ()
+{
+	stop ();
+}
+
+bool rai::log_queue::add (rai::log_category category_a, std::function <std::string ()> message_a)
+{
+	auto result (false);
+	if (rate_limit != 0 && window_counts [static_cast <size_t> (category_a)].fetch_add (1, std::memory_order_relaxed) >= rate_limit)
+	{
+		rate_limited.add ();
+		result = true;
+	}
+	else
+	{
+		auto position (enqueue_position.load (std::memory_order_relaxed));
+		rai::log_record * record (nullptr);
+		while (record == nullptr && !result)
+		{
+			auto & candidate (records [position & (capacity - 1)]);
+			auto difference (static_cast <intptr_t> (candidate.sequence.load (std::memory_order_acquire)) - static_cast <intptr_t> (position));
+			if (difference == 0)
+			{
+				if (enqueue_position.compare_exchange_weak (position, position + 1, std::memory_order_relaxed))
+				{
+					record = &candidate;
+				}
+			}
+			else if (difference < 0)
+			{
+				// The writer hasn't freed this slot from the previous lap yet
+				overflow.add ();
+				window_overflow.fetch_add (1, std::memory_order_relaxed);
+				result = true;
+			}
+			else
+			{
+				position = enqueue_position.load (std::memory_order_relaxed);
+			}
+		}
+		if (record != nullptr)
+		{
+			record->category = category_a;
+			record->message = std::move (message_a);
+			record->sequence.store (position + 1, std::memory_order_release);
+			if (sleeping.load ())
+			{
+				std::lock_guard <std::mutex> lock (mutex);
+				condition.notify_one ();
+			}
+		}
+	}
+	return result;
+}
+
+bool rai::log_queue::pop (std::function <std::string ()> & message_a)
+{
+	auto & record (records [dequeue_position & (capacity - 1)]);
+	auto result (record.sequence.load (std::memory_order_acquire) == dequeue_position + 1);
+	if (result)
+	{
+		message_a = std::move (record.message);
+		record.message = nullptr;
+		// Free the slot before formatting so producers can reuse it while we write
+		record.sequence.store (dequeue_position + capacity, std::memory_order_release);
+		++dequeue_position;
+	}
+	return result;
+}
+
+void rai::log_queue::roll_window ()
+{
+	for (size_t i (0); i < window_counts.size (); ++i)
+	{
+		auto count (window_counts [i].exchange (0, std::memory_order_relaxed));
+		if (rate_limit != 0 && count > rate_limit)
+		{
+			BOOST_LOG (log) << boost::str (boost::format ("Dropped %1% %2% log records over the rate limit of %3% per second") % (count - rate_limit) % category_name (static_cast <rai::log_category> (i)) % rate_limit);
+		}
+	}
+	auto overflowed (window_overflow.exchange (0, std::memory_order_relaxed));
+	if (overflowed > 0)
+	{
+		BOOST_LOG (log) << boost::str (boost::format ("Dropped %1% log records because the log queue was full") % overflowed);
+	}
+}
+
+void rai::log_queue::run ()
+{
+	auto window (std::chrono::steady_clock::now ());
+	std::function <std::string ()> message;
+	auto done (false);
+	while (!done)
+	{
+		auto stopping (stopped.load ());
+		while (pop (message))
+		{
+			BOOST_LOG (log) << message ();
+			written.add ();
+		}
+		auto now (std::chrono::steady_clock::now ());
+		if (now - window >= std::chrono::seconds (1))
+		{
+			roll_window ();
+			window = now;
+		}
+		// Records queued before stop was seen have been drained above
+		done = stopping;
+		if (!done)
+		{
+			std::unique_lock <std::mutex> lock (mutex);
+			sleeping = true;
+			auto & next (records [dequeue_position & (capacity - 1)]);
+			if (next.sequence.load (std::memory_order_acquire) != dequeue_position + 1 && !stopped)
+			{
+				// A producer racing with us setting sleeping is picked up by the timeout
+				condition.wait_for (lock, std::chrono::milliseconds (100));
+			}
+			sleeping = false;
+		}
+	}
+	roll_window ();
+}
+
+void rai::log_queue::stop ()
+{
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		stopped = true;
+		condition.notify_one ();
+	}
+	if (thread.joinable ())
+	{
+		thread.join ();
+	}
+}
+
+char const * rai::log_queue::category_name (rai::log_category category_a)
+{
+	char const * result;
+	switch (category_a)
+	{
+		case rai::log_category::network_message:
+			result = "network_message";
+			break;
+		case rai::log_category::network_publish:
+			result = "network_publish";
+			break;
+		case rai::log_category::network_packet:
+			result = "network_packet";
+			break;
+		case rai::log_category::network_keepalive:
+			result = "network_keepalive";
+			break;
+		case rai::log_category::ledger:
+			result = "ledger";
+			break;
+		case rai::log_category::ledger_duplicate:
+			result = "ledger_duplicate";
+			break;
+		case rai::log_category::vote:
+			result = "vote";
+			break;
+		case rai::log_category::count:
+			result = "";
+			break;
+	}
+	return result;
+}
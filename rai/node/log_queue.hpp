@@ -0,0 +1,67 @@
+#pragma once
+
+#include <boost/log/sources/logger.hpp>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace rai
+{
+class stats;
+class stat_counter;
+// Diagnostic categories that can log once per message or block and are rate limited separately
+enum class log_category : uint8_t
+{
+	network_message,
+	network_publish,
+	network_packet,
+	network_keepalive,
+	ledger,
+	ledger_duplicate,
+	vote,
+	count
+};
+class log_record
+{
+public:
+	std::atomic <size_t> sequence;
+	rai::log_category category;
+	std::function <std::string ()> message;
+};
+// Bounded multi-producer single-consumer ring, producers never block or take a lock
+// Messages are formatted and written by a background thread so the caller only pays for queueing the closure
+class log_queue
+{
+public:
+	log_queue (boost::log::sources::logger_mt &, rai::stats &, uint64_t);
+	~log_queue ();
+	// Returns true if the record was dropped by the rate limit or because the queue was full
+	bool add (rai::log_category, std::function <std::string ()>);
+	void stop ();
+	void run ();
+	bool pop (std::function <std::string ()> &);
+	void roll_window ();
+	static size_t constexpr capacity = 8192;
+	static char const * category_name (rai::log_category);
+	boost::log::sources::logger_mt & log;
+	uint64_t rate_limit; // Records per category per second, 0 for no limit
+	std::array <rai::log_record, capacity> records;
+	std::atomic <size_t> enqueue_position;
+	size_t dequeue_position;
+	std::array <std::atomic <uint64_t>, static_cast <size_t> (rai::log_category::count)> window_counts;
+	rai::stat_counter & written;
+	rai::stat_counter & overflow;
+	rai::stat_counter & rate_limited;
+	std::atomic <uint64_t> window_overflow;
+	std::atomic <bool> sleeping;
+	std::atomic <bool> stopped;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::thread thread;
+};
+}
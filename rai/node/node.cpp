@@ -2,9 +2,11 @@
 
 #include <rai/node/common.hpp>
 #include <rai/node/rpc.hpp>
+#include <rai/trace.hpp>
 
 #include <future>
 #include <memory>
+#include <set>
 #include <sstream>
 #include <thread>
 #include <unordered_set>
@@ -26,23 +28,34 @@ double constexpr rai::node::free_cutoff;
 std::chrono::seconds constexpr rai::node::period;
 std::chrono::seconds constexpr rai::node::cutoff;
 std::chrono::minutes constexpr rai::node::backup_interval;
+std::chrono::seconds constexpr rai::node::prune_interval;
+size_t constexpr rai::node::prune_batch;
 int constexpr rai::port_mapping::mapping_timeout;
 int constexpr rai::port_mapping::check_timeout;
 unsigned constexpr rai::active_transactions::announce_interval_ms;
+size_t constexpr rai::work_peer_client::max_fanout;
+size_t constexpr rai::work_peer_client::max_idle;
+unsigned constexpr rai::work_peer_client::failure_limit;
+std::chrono::seconds constexpr rai::work_peer_client::backoff;
 
 rai::network::network (boost::asio::io_service & service_a, uint16_t port, rai::node & node_a) :
 socket (service_a, rai::endpoint (boost::asio::ip::address_v6::any (), port)),
+socket_mutex ("network_socket"),
 service (service_a),
 resolver (service_a),
 node (node_a),
-bad_sender_count (0),
+bad_sender_count (node_a.stats.counter ("network", "bad_sender")),
 on (true),
-keepalive_count (0),
-publish_count (0),
-confirm_req_count (0),
-confirm_ack_count (0),
-insufficient_work_count (0),
-error_count (0)
+keepalive_count (node_a.stats.counter ("network", "keepalive_in")),
+publish_count (node_a.stats.counter ("network", "publish_in")),
+confirm_req_count (node_a.stats.counter ("network", "confirm_req_in")),
+confirm_ack_count (node_a.stats.counter ("network", "confirm_ack_in")),
+insufficient_work_count (node_a.stats.counter ("network", "insufficient_work")),
+error_count (node_a.stats.counter ("network", "error")),
+keepalive_out_count (node_a.stats.counter ("network", "keepalive_out")),
+publish_out_count (node_a.stats.counter ("network", "publish_out")),
+confirm_req_out_count (node_a.stats.counter ("network", "confirm_req_out")),
+confirm_ack_out_count (node_a.stats.counter ("network", "confirm_ack_out"))
 {
 }
 
@@ -50,9 +63,12 @@ void rai::network::receive ()
 {
     if (node.config.logging.network_packet_logging ())
     {
-        BOOST_LOG (node.log) << "Receiving packet";
+        node.log_queue.add (rai::log_category::network_packet, [] ()
+        {
+            return std::string ("Receiving packet");
+        });
     }
-    std::unique_lock <std::mutex> lock (socket_mutex);
+    rai::unique_lock lock (socket_mutex);
     socket.async_receive_from (boost::asio::buffer (buffer.data (), buffer.size ()), remote,
         [this] (boost::system::error_code const & error, size_t size_a)
         {
@@ -70,8 +86,10 @@ void rai::network::stop ()
 void rai::network::send_keepalive (rai::endpoint const & endpoint_a)
 {
     assert (endpoint_a.address ().is_v6 ());
+    keepalive_out_count.add ();
     rai::keepalive message;
     node.peers.random_fill (message.peers);
+    message.pruned_set (node.config.prune_tail != 0);
     std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
     {
         rai::vectorstream stream (*bytes);
@@ -79,7 +97,10 @@ void rai::network::send_keepalive (rai::endpoint const & endpoint_a)
     }
     if (node.config.logging.network_keepalive_logging ())
     {
-        BOOST_LOG (node.log) << boost::str (boost::format ("Keepalive req sent to %1%") % endpoint_a);
+        node.log_queue.add (rai::log_category::network_keepalive, [endpoint_a] ()
+        {
+            return boost::str (boost::format ("Keepalive req sent to %1%") % endpoint_a);
+        });
     }
     std::weak_ptr <rai::node> node_w (node.shared ());
     send_buffer (bytes->data (), bytes->size (), endpoint_a, 0, [bytes, node_w, endpoint_a] (boost::system::error_code const & ec, size_t)
@@ -90,7 +111,10 @@ void rai::network::send_keepalive (rai::endpoint const & endpoint_a)
 			{
 				if (ec)
 				{
-					BOOST_LOG (node_l->log) << boost::str (boost::format ("Error sending keepalive to %1% %2%") % endpoint_a % ec.message ());
+					node_l->log_queue.add (rai::log_category::network_keepalive, [endpoint_a, ec] ()
+					{
+						return boost::str (boost::format ("Error sending keepalive to %1% %2%") % endpoint_a % ec.message ());
+					});
 				}
 			}
 		}
@@ -125,8 +149,12 @@ void rai::network::republish (rai::block_hash const & hash_a, std::shared_ptr <s
 {
 	if (node.config.logging.network_publish_logging ())
 	{
-		BOOST_LOG (node.log) << boost::str (boost::format ("Publishing %1% to %2%") % hash_a.to_string () % endpoint_a);
+		node.log_queue.add (rai::log_category::network_publish, [hash_a, endpoint_a] ()
+		{
+			return boost::str (boost::format ("Publishing %1% to %2%") % hash_a.to_string () % endpoint_a);
+		});
 	}
+	publish_out_count.add ();
     std::weak_ptr <rai::node> node_w (node.shared ());
 	send_buffer (buffer_a->data (), buffer_a->size (), endpoint_a, 0, [buffer_a, node_w, endpoint_a] (boost::system::error_code const & ec, size_t size)
 	{
@@ -159,41 +187,24 @@ void rai::network::rebroadcast_reps (rai::block & block_a)
 	}
 }
 
-template <typename T>
-bool confirm_broadcast (rai::node & node_a, T & list_a, std::unique_ptr <rai::block> block_a, size_t rebroadcast_a)
+namespace
 {
-    bool result (false);
-	if (node_a.config.enable_voting)
-	{
-		rai::transaction transaction (node_a.store.environment, nullptr, true);
-		node_a.wallets.foreach_representative (transaction, [&result, &block_a, &list_a, &node_a, rebroadcast_a, &transaction] (rai::public_key const & pub_a, rai::raw_key const & prv_a)
-		{
-			auto sequence (node_a.store.sequence_atomic_inc (transaction, pub_a));
-			for (auto j (list_a.begin ()), m (list_a.end ()); j != m; ++j)
-			{
-				node_a.network.confirm_block (prv_a, pub_a, block_a->clone (), sequence, j->endpoint, rebroadcast_a);
-				result = true;
-			}
-		});
-	}
-    return result;
-}
-
-template <>
-bool confirm_broadcast (rai::node & node_a, rai::endpoint & peer_a, std::unique_ptr <rai::block> block_a, size_t rebroadcast_a)
+// Each representative signs one vote for all peers rather than one per peer
+bool confirm_broadcast (rai::node & node_a, std::vector <rai::endpoint> const & endpoints_a, rai::block const & block_a, size_t rebroadcast_a)
 {
-    bool result (false);
-	if (node_a.config.enable_voting)
+	bool result (false);
+	if (node_a.config.enable_voting && !endpoints_a.empty ())
 	{
 		rai::transaction transaction (node_a.store.environment, nullptr, true);
-		node_a.wallets.foreach_representative (transaction, [&result, &block_a, &peer_a, &node_a, rebroadcast_a, &transaction] (rai::public_key const & pub_a, rai::raw_key const & prv_a)
+		node_a.wallets.foreach_representative (transaction, [&result, &block_a, &endpoints_a, &node_a, rebroadcast_a, &transaction] (rai::public_key const & pub_a, rai::raw_key const & prv_a)
 		{
 			auto sequence (node_a.store.sequence_atomic_inc (transaction, pub_a));
-			node_a.network.confirm_block (prv_a, pub_a, block_a->clone (), sequence, peer_a, rebroadcast_a);
+			node_a.network.confirm_block (prv_a, pub_a, block_a, sequence, endpoints_a, rebroadcast_a);
 			result = true;
 		});
 	}
-    return result;
+	return result;
+}
 }
 
 void rai::network::republish_block (rai::block & block, size_t rebroadcast_a)
@@ -201,8 +212,14 @@ void rai::network::republish_block (rai::block & block, size_t rebroadcast_a)
 	rebroadcast_reps (block);
 	auto hash (block.hash ());
     auto list (node.peers.list ());
+	std::vector <rai::endpoint> endpoints;
+	endpoints.reserve (list.size ());
+	for (auto & i: list)
+	{
+		endpoints.push_back (i.endpoint);
+	}
 	// If we're a representative, broadcast a signed confirm, otherwise an unsigned publish
-    if (!confirm_broadcast (node, list, block.clone (), rebroadcast_a))
+    if (!confirm_broadcast (node, endpoints, block, rebroadcast_a))
     {
         rai::publish message (block.clone ());
         std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
@@ -245,6 +262,7 @@ void rai::network::broadcast_confirm_req (rai::block const & block_a)
 
 void rai::network::send_confirm_req (rai::endpoint const & endpoint_a, rai::block const & block)
 {
+	confirm_req_out_count.add ();
     rai::confirm_req message (block.clone ());
     std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
     {
@@ -253,7 +271,10 @@ void rai::network::send_confirm_req (rai::endpoint const & endpoint_a, rai::bloc
     }
     if (node.config.logging.network_message_logging ())
     {
-        BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm req to %1%") % endpoint_a);
+        node.log_queue.add (rai::log_category::network_message, [endpoint_a] ()
+        {
+            return boost::str (boost::format ("Sending confirm req to %1%") % endpoint_a);
+        });
     }
     std::weak_ptr <rai::node> node_w (node.shared ());
     send_buffer (bytes->data (), bytes->size (), endpoint_a, 0, [bytes, node_w] (boost::system::error_code const & ec, size_t size)
@@ -315,19 +336,30 @@ public:
     {
         if (node.config.logging.network_keepalive_logging ())
         {
-            BOOST_LOG (node.log) << boost::str (boost::format ("Received keepalive message from %1%") % sender);
+            auto sender_l (sender);
+            node.log_queue.add (rai::log_category::network_keepalive, [sender_l] ()
+            {
+                return boost::str (boost::format ("Received keepalive message from %1%") % sender_l);
+            });
         }
-        ++node.network.keepalive_count;
+        node.network.keepalive_count.add ();
         node.peers.contacted (sender);
+        node.peers.pruned (sender, message_a.pruned ());
+        node.peers.network_version (sender, message_a.version_max);
         node.network.merge_peers (message_a.peers);
     }
     void publish (rai::publish const & message_a) override
     {
         if (node.config.logging.network_message_logging ())
         {
-            BOOST_LOG (node.log) << boost::str (boost::format ("Publish message from %1% for %2%") % sender % message_a.block->hash ().to_string ());
+            auto sender_l (sender);
+            auto hash (message_a.block->hash ());
+            node.log_queue.add (rai::log_category::network_message, [sender_l, hash] ()
+            {
+                return boost::str (boost::format ("Publish message from %1% for %2%") % sender_l % hash.to_string ());
+            });
         }
-        ++node.network.publish_count;
+        node.network.publish_count.add ();
         node.peers.contacted (sender);
         node.peers.insert (sender);
         node.process_receive_republish (message_a.block->clone (), 0);
@@ -336,24 +368,34 @@ public:
     {
         if (node.config.logging.network_message_logging ())
         {
-            BOOST_LOG (node.log) << boost::str (boost::format ("Confirm_req message from %1% for %2%") % sender % message_a.block->hash ().to_string ());
+            auto sender_l (sender);
+            auto hash (message_a.block->hash ());
+            node.log_queue.add (rai::log_category::network_message, [sender_l, hash] ()
+            {
+                return boost::str (boost::format ("Confirm_req message from %1% for %2%") % sender_l % hash.to_string ());
+            });
         }
-        ++node.network.confirm_req_count;
+        node.network.confirm_req_count.add ();
         node.peers.contacted (sender);
         node.peers.insert (sender);
         node.process_receive_republish (message_a.block->clone (), 0);
 		if (node.ledger.block_exists (message_a.block->hash ()))
         {
-            confirm_broadcast (node, sender, message_a.block->clone (), 0);
+            confirm_broadcast (node, std::vector <rai::endpoint> ({ sender }), *message_a.block, 0);
         }
     }
     void confirm_ack (rai::confirm_ack const & message_a) override
     {
         if (node.config.logging.network_message_logging ())
         {
-            BOOST_LOG (node.log) << boost::str (boost::format ("Received confirm_ack message from %1% for %2%") % sender % message_a.vote.block->hash ().to_string ());
+            auto sender_l (sender);
+            auto hash (message_a.vote.block->hash ());
+            node.log_queue.add (rai::log_category::network_message, [sender_l, hash] ()
+            {
+                return boost::str (boost::format ("Received confirm_ack message from %1% for %2%") % sender_l % hash.to_string ());
+            });
         }
-        ++node.network.confirm_ack_count;
+        node.network.confirm_ack_count.add ();
         node.peers.contacted (sender);
         node.peers.insert (sender);
         node.process_receive_republish (message_a.vote.block->clone (), 0);
@@ -371,6 +413,10 @@ public:
     {
         assert (false);
     }
+    void checksum_req (rai::checksum_req const &) override
+    {
+        assert (false);
+    }
     rai::node & node;
     rai::endpoint sender;
 };
@@ -378,6 +424,7 @@ public:
 
 void rai::network::receive_action (boost::system::error_code const & error, size_t size_a)
 {
+	rai::trace_span span ("network", "receive");
     if (!error && on)
     {
         if (!rai::reserved_address (remote) && remote != endpoint ())
@@ -387,7 +434,7 @@ void rai::network::receive_action (boost::system::error_code const & error, size
             parser.deserialize_buffer (buffer.data (), size_a);
             if (parser.error)
             {
-                ++error_count;
+                error_count.add ();
             }
             else if (parser.insufficient_work)
             {
@@ -395,7 +442,7 @@ void rai::network::receive_action (boost::system::error_code const & error, size
                 {
                     BOOST_LOG (node.log) << "Insufficient work in message";
                 }
-                ++insufficient_work_count;
+                insufficient_work_count.add ();
             }
         }
         else
@@ -404,7 +451,7 @@ void rai::network::receive_action (boost::system::error_code const & error, size
             {
                 BOOST_LOG (node.log) << boost::str (boost::format ("Reserved sender %1%") % remote.address ().to_string ());
             }
-            ++bad_sender_count;
+            bad_sender_count.add ();
         }
         receive ();
     }
@@ -443,6 +490,7 @@ bool rai::operation::operator > (rai::operation const & other_a) const
 
 rai::alarm::alarm (boost::asio::io_service & service_a) :
 service (service_a),
+mutex ("alarm"),
 thread ([this] () { run (); })
 {
 }
@@ -455,7 +503,7 @@ rai::alarm::~alarm ()
 
 void rai::alarm::run ()
 {
-    std::unique_lock <std::mutex> lock (mutex);
+    rai::unique_lock lock (mutex);
 	auto done (false);
     while (!done)
     {
@@ -466,7 +514,19 @@ void rai::alarm::run ()
 			{
 				if (operation.wakeup <= std::chrono::system_clock::now ())
 				{
-					service.post (operation.function);
+					if (!rai::trace.enabled.load (std::memory_order_relaxed))
+					{
+						service.post (operation.function);
+					}
+					else
+					{
+						auto function (operation.function);
+						service.post ([function] ()
+						{
+							rai::trace_span span ("alarm", "operation");
+							function ();
+						});
+					}
 					operations.pop ();
 				}
 				else
@@ -489,7 +549,7 @@ void rai::alarm::run ()
 
 void rai::alarm::add (std::chrono::system_clock::time_point const & wakeup_a, std::function <void ()> const & operation)
 {
-    std::lock_guard <std::mutex> lock (mutex);
+    rai::lock_guard lock (mutex);
 	operations.push (rai::operation ({wakeup_a, operation}));
 	condition.notify_all ();
 }
@@ -509,7 +569,8 @@ log_rpc_value (true),
 bulk_pull_logging_value (false),
 work_generation_time_value (true),
 log_to_cerr_value (false),
-max_size (16 * 1024 * 1024)
+max_size (16 * 1024 * 1024),
+rate_limit (1000)
 {
 	if (log_to_cerr ())
     {
@@ -526,7 +587,7 @@ max_size (16 * 1024 * 1024)
 
 void rai::logging::serialize_json (boost::property_tree::ptree & tree_a) const
 {
-	tree_a.put ("version", "2");
+	tree_a.put ("version", "3");
 	tree_a.put ("ledger", ledger_logging_value);
 	tree_a.put ("ledger_duplicate", ledger_duplicate_logging_value);
 	tree_a.put ("vote", vote_logging_value);
@@ -542,6 +603,7 @@ void rai::logging::serialize_json (boost::property_tree::ptree & tree_a) const
 	tree_a.put ("work_generation_time", work_generation_time_value);
 	tree_a.put ("log_to_cerr", log_to_cerr_value);
 	tree_a.put ("max_size", max_size);
+	tree_a.put ("rate_limit", rate_limit);
 }
 
 bool rai::logging::upgrade_json (unsigned version_a, boost::property_tree::ptree & tree_a)
@@ -554,6 +616,10 @@ bool rai::logging::upgrade_json (unsigned version_a, boost::property_tree::ptree
 		tree_a.put ("version", "2");
 		result = true;
 	case 2:
+		tree_a.put ("rate_limit", rate_limit);
+		tree_a.put ("version", "3");
+		result = true;
+	case 3:
 	break;
 	default:
 		throw std::runtime_error ("Unknown logging_config version");
@@ -595,6 +661,7 @@ bool rai::logging::deserialize_json (bool & upgraded_a, boost::property_tree::pt
 		work_generation_time_value = tree_a.get <bool> ("work_generation_time");
 		log_to_cerr_value = tree_a.get <bool> ("log_to_cerr");
 		max_size = tree_a.get <uintmax_t> ("max_size");
+		rate_limit = tree_a.get <uint64_t> ("rate_limit");
 	}
 	catch (std::runtime_error const &)
 	{
@@ -675,7 +742,8 @@ bool rai::logging::log_to_cerr () const
 
 rai::node_init::node_init () :
 block_store_init (false),
-wallet_init (false)
+wallet_init (false),
+read_only (false)
 {
 }
 
@@ -701,7 +769,9 @@ inactive_supply (0),
 password_fanout (1024),
 io_threads (std::max <unsigned> (4, std::thread::hardware_concurrency ())),
 work_threads (std::max <unsigned> (4, std::thread::hardware_concurrency ())),
-enable_voting (true)
+enable_voting (true),
+prune_tail (0),
+gap_cache_bytes (4 * 1024 * 1024)
 {
 	switch (rai::rai_network)
 	{
@@ -734,7 +804,7 @@ enable_voting (true)
 
 void rai::node_config::serialize_json (boost::property_tree::ptree & tree_a) const
 {
-	tree_a.put ("version", "6");
+	tree_a.put ("version", "8");
 	tree_a.put ("peering_port", std::to_string (peering_port));
 	tree_a.put ("packet_delay_microseconds", std::to_string (packet_delay_microseconds));
 	tree_a.put ("bootstrap_fraction_numerator", std::to_string (bootstrap_fraction_numerator));
@@ -773,6 +843,8 @@ void rai::node_config::serialize_json (boost::property_tree::ptree & tree_a) con
 	tree_a.put ("io_threads", std::to_string (io_threads));
 	tree_a.put ("work_threads", std::to_string (work_threads));
 	tree_a.put ("enable_voting", enable_voting);
+	tree_a.put ("prune_tail", std::to_string (prune_tail));
+	tree_a.put ("gap_cache_bytes", std::to_string (gap_cache_bytes));
 }
 
 bool rai::node_config::upgrade_json (unsigned version, boost::property_tree::ptree & tree_a)
@@ -824,10 +896,21 @@ bool rai::node_config::upgrade_json (unsigned version, boost::property_tree::ptr
 		break;
 	case 5:
 		tree_a.put ("enable_voting", enable_voting);
+		tree_a.erase ("version");
 		tree_a.put ("version", "6");
 		result = true;
-		break;
 	case 6:
+		tree_a.put ("prune_tail", std::to_string (prune_tail));
+		tree_a.erase ("version");
+		tree_a.put ("version", "7");
+		result = true;
+	case 7:
+		tree_a.put ("gap_cache_bytes", std::to_string (gap_cache_bytes));
+		tree_a.erase ("version");
+		tree_a.put ("version", "8");
+		result = true;
+		break;
+	case 8:
 		break;
 	default:
 		throw std::runtime_error ("Unknown node_config version");
@@ -897,6 +980,8 @@ bool rai::node_config::deserialize_json (bool & upgraded_a, boost::property_tree
 		auto io_threads_l (tree_a.get <std::string> ("io_threads"));
 		auto work_threads_l (tree_a.get <std::string> ("work_threads"));
 		enable_voting = tree_a.get <bool> ("enable_voting");
+		auto prune_tail_l (tree_a.get <std::string> ("prune_tail"));
+		auto gap_cache_bytes_l (tree_a.get <std::string> ("gap_cache_bytes"));
 		try
 		{
 			peering_port = std::stoul (peering_port_l);
@@ -907,6 +992,8 @@ bool rai::node_config::deserialize_json (bool & upgraded_a, boost::property_tree
 			password_fanout = std::stoul (password_fanout_l);
 			io_threads = std::stoul (io_threads_l);
 			work_threads = std::stoul (work_threads_l);
+			prune_tail = std::stoull (prune_tail_l);
+			gap_cache_bytes = std::stoull (gap_cache_bytes_l);
 			result |= creation_rebroadcast > 10;
 			result |= rebroadcast_delay > 300;
 			result |= peering_port > std::numeric_limits <uint16_t>::max ();
@@ -945,6 +1032,7 @@ node (node_a)
 
 rai::vote_result rai::vote_processor::vote (rai::vote const & vote_a, rai::endpoint endpoint_a)
 {
+	rai::trace_span span ("vote", "process");
 	rai::vote_result result;
 	{
 		rai::transaction transaction (node.store.environment, nullptr, true);
@@ -965,7 +1053,13 @@ rai::vote_result rai::vote_processor::vote (rai::vote const & vote_a, rai::endpo
 				status = "Vote";
 				break;
 		}
-		BOOST_LOG (node.log) << boost::str (boost::format ("Vote from: %1% sequence: %2% block: %3% status: %4%") % vote_a.account.to_account () % std::to_string (vote_a.sequence) % vote_a.block->hash ().to_string () % status);
+		auto account (vote_a.account);
+		auto sequence (vote_a.sequence);
+		auto hash (vote_a.block->hash ());
+		node.log_queue.add (rai::log_category::vote, [account, sequence, hash, status] ()
+		{
+			return boost::str (boost::format ("Vote from: %1% sequence: %2% block: %3% status: %4%") % account.to_account () % std::to_string (sequence) % hash.to_string () % status);
+		});
 	}
 	switch (result)
 	{
@@ -1005,7 +1099,9 @@ rai::node::node (rai::node_init & init_a, boost::asio::io_service & service_a, b
 config (config_a),
 alarm (alarm_a),
 work (work_a),
-store (init_a.block_store_init, application_path_a / "data.ldb"),
+log_queue (log, stats, config.logging.rate_limit),
+store (init_a.block_store_init, application_path_a / "data.ldb", init_a.read_only),
+snapshot (store.environment),
 gap_cache (*this),
 ledger (store, config_a.inactive_supply.number ()),
 active (*this),
@@ -1017,8 +1113,32 @@ peers (network.endpoint ()),
 application_path (application_path_a),
 port_mapping (*this),
 vote_processor (*this),
-warmed_up (0)
+work_client (*this),
+warmed_up (0),
+prune_cursor (0)
 {
+	// Indexed by rai::process_result
+	for (auto i: { "progress", "bad_signature", "old", "overspend", "fork", "unreceivable", "gap_previous", "gap_source", "not_receive_from_send", "account_mismatch" })
+	{
+		ledger_results.push_back (&stats.counter ("ledger", i));
+	}
+	auto & commit (stats.histogram ("lmdb", "commit"));
+	store.environment.commit_observer = [&commit] (std::chrono::steady_clock::duration duration_a)
+	{
+		commit.add (std::chrono::duration_cast <std::chrono::microseconds> (duration_a).count ());
+	};
+	auto & account_hit (stats.counter ("store_cache", "account_hit"));
+	auto & account_miss (stats.counter ("store_cache", "account_miss"));
+	store.cache.account_observer = [&account_hit, &account_miss] (bool hit_a)
+	{
+		(hit_a ? account_hit : account_miss).add ();
+	};
+	auto & representation_hit (stats.counter ("store_cache", "representation_hit"));
+	auto & representation_miss (stats.counter ("store_cache", "representation_miss"));
+	store.cache.representation_observer = [&representation_hit, &representation_miss] (bool hit_a)
+	{
+		(hit_a ? representation_hit : representation_miss).add ();
+	};
 	wallets.observer = [this] (rai::account const & account_a, bool active)
 	{
 		observers.wallet (account_a, active);
@@ -1036,13 +1156,27 @@ warmed_up (0)
 		this->network.send_keepalive (endpoint_a);
 		rep_query (*this, endpoint_a);
 	});
+	observers.blocks.add ([this] (rai::block const & block_a, rai::account const & account_a, rai::amount const &)
+	{
+		// Most blocks, especially while bootstrapping, aren't ours; only those go to the background
+		if (wallets.exists (account_a))
+		{
+			// Observers run inside the processing transaction, look up wallets once it's committed
+			auto node_l (shared_from_this ());
+			auto hash (block_a.hash ());
+			background ([node_l, account_a, hash] ()
+			{
+				node_l->wallets.work_precache (account_a, hash);
+			});
+		}
+	});
     observers.vote.add ([this] (rai::vote const & vote_a, rai::endpoint const &)
     {
 		active.vote (vote_a);
     });
-    observers.vote.add ([this] (rai::vote const & vote_a, rai::endpoint const &)
+    observers.vote.add ([this] (rai::vote const & vote_a, rai::endpoint const & endpoint_a)
     {
-		this->gap_cache.vote (vote_a);
+		this->gap_cache.vote (vote_a, endpoint_a);
     });
 	observers.vote.add ([this] (rai::vote const & vote_a, rai::endpoint const & endpoint_a)
 	{
@@ -1064,13 +1198,17 @@ warmed_up (0)
         {
             std::cerr << "Constructing node\n";
         }
-		rai::transaction transaction (store.environment, nullptr, true);
-        if (store.latest_begin (transaction) == store.latest_end ())
-        {
-            // Store was empty meaning we just created it, add the genesis block
-            rai::genesis genesis;
-            genesis.initialize (transaction, store);
-        }
+		// A replica only reads what the writing node created
+		if (!store.environment.read_only)
+		{
+			rai::transaction transaction (store.environment, nullptr, true);
+			if (store.latest_begin (transaction) == store.latest_end ())
+			{
+				// Store was empty meaning we just created it, add the genesis block
+				rai::genesis genesis;
+				genesis.initialize (transaction, store);
+			}
+		}
     }
 }
 
@@ -1093,7 +1231,112 @@ void rai::node::send_keepalive (rai::endpoint const & endpoint_a)
     network.send_keepalive (endpoint_l);
 }
 
+rai::store_snapshot::store_snapshot (rai::mdb_env & environment_a) :
+environment (environment_a),
+active (false),
+error (false),
+estimate (0),
+size (0)
+{
+}
+
+rai::store_snapshot::~store_snapshot ()
+{
+	wait ();
+}
+
+bool rai::store_snapshot::start (boost::filesystem::path const & path_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto result (active);
+	if (!result)
+	{
+		if (thread.joinable ())
+		{
+			thread.join ();
+		}
+		MDB_stat stats;
+		mdb_env_stat (environment, &stats);
+		MDB_envinfo info;
+		mdb_env_info (environment, &info);
+		path = path_a;
+		active = true;
+		error = false;
+		estimate = (info.me_last_pgno + 1) * stats.ms_psize;
+		size = 0;
+		thread = std::thread ([this] ()
+		{
+			auto error_l (environment.copy (path, true));
+			boost::system::error_code ec;
+			auto size_l (boost::filesystem::file_size (path, ec));
+			std::lock_guard <std::mutex> lock (mutex);
+			error = error_l || ec;
+			size = ec ? 0 : size_l;
+			active = false;
+		});
+	}
+	return result;
+}
+
+void rai::store_snapshot::wait ()
+{
+	std::thread thread_l;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		thread_l = std::move (thread);
+	}
+	// The copy can't be interrupted, joined without the lock so it can record its result
+	if (thread_l.joinable ())
+	{
+		thread_l.join ();
+	}
+}
+
+bool rai::store_snapshot::running ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	return active;
+}
+
+double rai::store_snapshot::progress ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto result (1.0);
+	if (active)
+	{
+		boost::system::error_code ec;
+		auto written (boost::filesystem::file_size (path, ec));
+		result = ec || estimate == 0 ? 0.0 : std::min (1.0, static_cast <double> (written) / estimate);
+	}
+	return result;
+}
+
+void rai::store_snapshot::serialize_json (boost::property_tree::ptree & tree_a)
+{
+	auto progress_l (progress ());
+	std::lock_guard <std::mutex> lock (mutex);
+	if (path.empty ())
+	{
+		tree_a.put ("status", "idle");
+	}
+	else
+	{
+		tree_a.put ("status", active ? "running" : (error ? "failed" : "done"));
+		tree_a.put ("path", path.string ());
+		tree_a.put ("progress", std::to_string (progress_l));
+		tree_a.put ("estimate", std::to_string (estimate));
+		tree_a.put ("size", std::to_string (size));
+	}
+}
+
+std::chrono::seconds constexpr rai::gap_cache::cutoff;
+
 rai::gap_cache::gap_cache (rai::node & node_a) :
+bytes (0),
+evicted (node_a.stats.counter ("gap_cache", "evicted")),
+expired (node_a.stats.counter ("gap_cache", "expired")),
+requests (node_a.stats.counter ("gap_cache", "dependency_requests")),
+mutex ("gap_cache"),
 node (node_a)
 {
 }
@@ -1101,29 +1344,36 @@ node (node_a)
 void rai::gap_cache::add (rai::block const & block_a, rai::block_hash needed_a)
 {
 	auto hash (block_a.hash ());
-    std::lock_guard <std::mutex> lock (mutex);
+	auto now (std::chrono::system_clock::now ());
+    rai::lock_guard lock (mutex);
+	// Each entry expires once so purging here is amortized over the insertions
+	expire (now - cutoff);
     auto existing (blocks.get <2>().find (hash));
     if (existing != blocks.get <2> ().end ())
     {
-        blocks.get <2> ().modify (existing, [&block_a] (rai::gap_information & info)
+        blocks.get <2> ().modify (existing, [now] (rai::gap_information & info)
 		{
-			info.arrival = std::chrono::system_clock::now ();
+			info.arrival = now;
 		});
     }
     else
     {
-		blocks.insert ({std::chrono::system_clock::now (), needed_a, hash, std::unique_ptr <rai::votes> (new rai::votes (block_a)), block_a.clone ()});
-        if (blocks.size () > max)
-        {
-            blocks.get <1> ().erase (blocks.get <1> ().begin ());
-        }
+		auto size (entry_size (block_a));
+		blocks.insert ({now, needed_a, hash, std::vector <rai::account> (), block_a.clone (), size, false});
+		bytes += size;
+		while (bytes > node.config.gap_cache_bytes && blocks.size () > 1)
+		{
+			auto oldest (blocks.get <1> ().begin ());
+			bytes -= oldest->size;
+			blocks.get <1> ().erase (oldest);
+			evicted.add ();
+		}
     }
 }
 
 std::vector <std::unique_ptr <rai::block>> rai::gap_cache::get (rai::block_hash const & hash_a)
 {
-	purge_old ();
-    std::lock_guard <std::mutex> lock (mutex);
+    rai::lock_guard lock (mutex);
     std::vector <std::unique_ptr <rai::block>> result;
     for (auto i (blocks.find (hash_a)), n (blocks.end ()); i != n && i->required == hash_a; ++i)
     {
@@ -1131,35 +1381,99 @@ std::vector <std::unique_ptr <rai::block>> rai::gap_cache::get (rai::block_hash
 		{
 			result.push_back (std::move (info.block));
 		});
+		bytes -= i->size;
     }
 	blocks.erase (hash_a);
     return result;
 }
 
-void rai::gap_cache::vote (rai::vote const & vote_a)
+void rai::gap_cache::vote (rai::vote const & vote_a, rai::endpoint const & endpoint_a)
 {
-	std::lock_guard <std::mutex> lock (mutex);
 	auto hash (vote_a.block->hash ());
-	auto existing (blocks.get <2> ().find (hash));
-	if (existing != blocks.get <2> ().end ())
+	std::vector <rai::account> voters;
+	rai::block_hash required;
+	{
+		rai::lock_guard lock (mutex);
+		auto existing (blocks.get <2> ().find (hash));
+		if (existing != blocks.get <2> ().end () && !existing->requested)
+		{
+			if (std::find (existing->voters.begin (), existing->voters.end (), vote_a.account) == existing->voters.end ())
+			{
+				blocks.get <2> ().modify (existing, [&vote_a] (rai::gap_information & info)
+				{
+					info.voters.push_back (vote_a.account);
+					info.size += sizeof (rai::account);
+				});
+				bytes += sizeof (rai::account);
+			}
+			voters = existing->voters;
+			required = existing->required;
+		}
+	}
+	// Tallied without the mutex, block processing takes it from inside write transactions
+	if (!voters.empty ())
 	{
-		existing->votes->vote (vote_a);
-		rai::transaction transaction (node.store.environment, nullptr, false);
-		auto winner (node.ledger.winner (transaction, *existing->votes));
-		if (winner.first > bootstrap_threshold (transaction))
+		rai::uint128_t tally (0);
+		auto confirmed (false);
+		{
+			rai::transaction transaction (node.store.environment, nullptr, false);
+			for (auto & i: voters)
+			{
+				tally += node.ledger.weight (transaction, i);
+			}
+			confirmed = tally > bootstrap_threshold (transaction);
+		}
+		auto request (false);
+		if (confirmed)
+		{
+			rai::lock_guard lock (mutex);
+			auto existing (blocks.get <2> ().find (hash));
+			if (existing != blocks.get <2> ().end () && !existing->requested)
+			{
+				blocks.get <2> ().modify (existing, [] (rai::gap_information & info)
+				{
+					info.requested = true;
+				});
+				request = true;
+			}
+		}
+		if (request)
 		{
+			// The representative voted for the block so it has its dependencies, our own votes are fetched from any peer
+			auto peer (endpoint_a != node.network.endpoint () ? endpoint_a : node.peers.bootstrap_peer ());
 			auto node_l (node.shared ());
 			auto now (std::chrono::system_clock::now ());
-			node.alarm.add (rai::rai_network == rai::rai_networks::rai_test_network ? now + std::chrono::milliseconds (5) : now + std::chrono::seconds (5), [node_l, hash] ()
+			node.alarm.add (rai::rai_network == rai::rai_networks::rai_test_network ? now + std::chrono::milliseconds (5) : now + std::chrono::seconds (5), [node_l, hash, required, peer] ()
 			{
 				rai::transaction transaction (node_l->store.environment, nullptr, false);
 				if (!node_l->store.block_exists (transaction, hash))
 				{
-					if (!node_l->bootstrap_initiator.in_progress ())
+					if (node_l->config.logging.network_logging ())
+					{
+						BOOST_LOG (node_l->log) << boost::str (boost::format ("Missing confirmed block %1%, requesting %2% from %3%") % hash.to_string () % required.to_string () % peer);
+					}
+					// Peers whose bulk_pull doesn't start from a block hash answer with nothing, a full bootstrap still finds the block
+					auto fallback ([node_l, hash] ()
+					{
+						node_l->gap_cache.request_failed (hash);
+						node_l->bootstrap_initiator.bootstrap ();
+					});
+					if (peer != rai::endpoint ())
+					{
+						node_l->gap_cache.requests.add ();
+						auto pull (std::make_shared <rai::dependency_pull> (node_l, rai::tcp_endpoint (peer.address (), peer.port ()), required, [fallback] (bool missing_a)
+						{
+							if (missing_a)
+							{
+								fallback ();
+							}
+						}));
+						pull->run ();
+					}
+					else
 					{
-						BOOST_LOG (node_l->log) << boost::str (boost::format ("Missing confirmed block %1%") % hash.to_string ());
+						fallback ();
 					}
-					node_l->bootstrap_initiator.bootstrap ();
 				}
 				else
 				{
@@ -1170,6 +1484,19 @@ void rai::gap_cache::vote (rai::vote const & vote_a)
 	}
 }
 
+void rai::gap_cache::request_failed (rai::block_hash const & hash_a)
+{
+	rai::lock_guard lock (mutex);
+	auto existing (blocks.get <2> ().find (hash_a));
+	if (existing != blocks.get <2> ().end ())
+	{
+		blocks.get <2> ().modify (existing, [] (rai::gap_information & info)
+		{
+			info.requested = false;
+		});
+	}
+}
+
 rai::uint128_t rai::gap_cache::bootstrap_threshold (MDB_txn * transaction_a)
 {
     auto result ((node.ledger.supply (transaction_a) / 256) * node.config.bootstrap_fraction_numerator);
@@ -1178,15 +1505,22 @@ rai::uint128_t rai::gap_cache::bootstrap_threshold (MDB_txn * transaction_a)
 
 void rai::gap_cache::purge_old ()
 {
-	auto cutoff (std::chrono::system_clock::now () - std::chrono::seconds (10));
-    std::lock_guard <std::mutex> lock (mutex);
+	auto now (std::chrono::system_clock::now ());
+    rai::lock_guard lock (mutex);
+	expire (now - cutoff);
+}
+
+void rai::gap_cache::expire (std::chrono::system_clock::time_point const & cutoff_a)
+{
 	auto done (false);
 	while (!done && !blocks.empty ())
 	{
 		auto first (blocks.get <1> ().begin ());
-		if (first->arrival < cutoff)
+		if (first->arrival < cutoff_a)
 		{
+			bytes -= first->size;
 			blocks.get <1> ().erase (first);
+			expired.add ();
 		}
 		else
 		{
@@ -1195,36 +1529,83 @@ void rai::gap_cache::purge_old ()
 	}
 }
 
+size_t rai::gap_cache::size ()
+{
+    rai::lock_guard lock (mutex);
+	return bytes;
+}
+
+size_t rai::gap_cache::entry_size (rai::block const & block_a)
+{
+	// Index nodes of the three indexes and the allocation headers are roughly another entry's worth
+	size_t result (2 * sizeof (rai::gap_information));
+	switch (block_a.type ())
+	{
+		case rai::block_type::send:
+			result += sizeof (rai::send_block);
+			break;
+		case rai::block_type::receive:
+			result += sizeof (rai::receive_block);
+			break;
+		case rai::block_type::open:
+			result += sizeof (rai::open_block);
+			break;
+		case rai::block_type::change:
+			result += sizeof (rai::change_block);
+			break;
+		default:
+			assert (false);
+			break;
+	}
+	return result;
+}
+
 void rai::network::confirm_block (rai::raw_key const & prv, rai::public_key const & pub, std::unique_ptr <rai::block> block_a, uint64_t sequence_a, rai::endpoint const & endpoint_a, size_t rebroadcast_a)
 {
-    rai::confirm_ack confirm (pub, prv, sequence_a, std::move (block_a));
+	confirm_block (prv, pub, *block_a, sequence_a, std::vector <rai::endpoint> ({ endpoint_a }), rebroadcast_a);
+}
+
+void rai::network::confirm_block (rai::raw_key const & prv, rai::public_key const & pub, rai::block const & block_a, uint64_t sequence_a, std::vector <rai::endpoint> const & endpoints_a, size_t rebroadcast_a)
+{
+	// Signed and serialized once, every peer is sent the same bytes
+    rai::confirm_ack confirm (pub, prv, sequence_a, block_a.clone ());
     std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
     {
         rai::vectorstream stream (*bytes);
         confirm.serialize (stream);
     }
-    if (node.config.logging.network_publish_logging ())
-    {
-        BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm_ack for block %1% to %2%") % confirm.vote.block->hash ().to_string () % endpoint_a);
-    }
+    auto hash (block_a.hash ());
     std::weak_ptr <rai::node> node_w (node.shared ());
-    node.network.send_buffer (bytes->data (), bytes->size (), endpoint_a, 0, [bytes, node_w, endpoint_a] (boost::system::error_code const & ec, size_t size_a)
+	for (auto & endpoint_a: endpoints_a)
 	{
-		if (auto node_l = node_w.lock ())
+		confirm_ack_out_count.add ();
+		if (node.config.logging.network_publish_logging ())
 		{
-			if (node_l->config.logging.network_logging ())
+			auto endpoint_l (endpoint_a);
+			node.log_queue.add (rai::log_category::network_publish, [hash, endpoint_l] ()
 			{
-				if (ec)
+				return boost::str (boost::format ("Sending confirm_ack for block %1% to %2%") % hash.to_string () % endpoint_l);
+			});
+		}
+		node.network.send_buffer (bytes->data (), bytes->size (), endpoint_a, 0, [bytes, node_w, endpoint_a] (boost::system::error_code const & ec, size_t size_a)
+		{
+			if (auto node_l = node_w.lock ())
+			{
+				if (node_l->config.logging.network_logging ())
 				{
-					BOOST_LOG (node_l->log) << boost::str (boost::format ("Error broadcasting confirm_ack to %1%: %2%") % endpoint_a % ec.message ());
+					if (ec)
+					{
+						BOOST_LOG (node_l->log) << boost::str (boost::format ("Error broadcasting confirm_ack to %1%: %2%") % endpoint_a % ec.message ());
+					}
 				}
 			}
-		}
-	});
+		});
+	}
 }
 
 void rai::node::process_receive_republish (std::unique_ptr <rai::block> incoming, size_t rebroadcast_a)
 {
+	rai::trace_span span ("node", "process_receive_republish");
 	std::vector <std::tuple <rai::process_return, std::unique_ptr <rai::block>>> completed;
 	{
 		rai::transaction transaction (store.environment, nullptr, true);
@@ -1283,15 +1664,20 @@ rai::process_return rai::node::process_receive_one (MDB_txn * transaction_a, rai
 {
 	rai::process_return result;
 	result = ledger.process (transaction_a, block_a);
+	ledger_results [static_cast <size_t> (result.code)]->add ();
     switch (result.code)
     {
         case rai::process_result::progress:
         {
             if (config.logging.ledger_logging ())
             {
-                std::string block;
-                block_a.serialize_json (block);
-                BOOST_LOG (log) << boost::str (boost::format ("Processing block %1% %2%") % block_a.hash ().to_string () % block);
+                std::shared_ptr <rai::block> block (block_a.clone ());
+                log_queue.add (rai::log_category::ledger, [block] ()
+                {
+                    std::string json;
+                    block->serialize_json (json);
+                    return boost::str (boost::format ("Processing block %1% %2%") % block->hash ().to_string () % json);
+                });
             }
             break;
         }
@@ -1299,7 +1685,11 @@ rai::process_return rai::node::process_receive_one (MDB_txn * transaction_a, rai
         {
             if (config.logging.ledger_logging ())
             {
-                BOOST_LOG (log) << boost::str (boost::format ("Gap previous for: %1%") % block_a.hash ().to_string ());
+                auto hash (block_a.hash ());
+                log_queue.add (rai::log_category::ledger, [hash] ()
+                {
+                    return boost::str (boost::format ("Gap previous for: %1%") % hash.to_string ());
+                });
             }
             auto previous (block_a.previous ());
 			gap_cache.add (block_a, previous);
@@ -1309,7 +1699,11 @@ rai::process_return rai::node::process_receive_one (MDB_txn * transaction_a, rai
         {
             if (config.logging.ledger_logging ())
             {
-                BOOST_LOG (log) << boost::str (boost::format ("Gap source for: %1%") % block_a.hash ().to_string ());
+                auto hash (block_a.hash ());
+                log_queue.add (rai::log_category::ledger, [hash] ()
+                {
+                    return boost::str (boost::format ("Gap source for: %1%") % hash.to_string ());
+                });
             }
             auto source (block_a.source ());
 			gap_cache.add (block_a, source);
@@ -1336,7 +1730,11 @@ rai::process_return rai::node::process_receive_one (MDB_txn * transaction_a, rai
 			}
             if (config.logging.ledger_duplicate_logging ())
             {
-                BOOST_LOG (log) << boost::str (boost::format ("Old for: %1%") % block_a.hash ().to_string ());
+                auto hash (block_a.hash ());
+                log_queue.add (rai::log_category::ledger_duplicate, [hash] ()
+                {
+                    return boost::str (boost::format ("Old for: %1%") % hash.to_string ());
+                });
             }
             break;
         }
@@ -1344,7 +1742,11 @@ rai::process_return rai::node::process_receive_one (MDB_txn * transaction_a, rai
         {
             if (config.logging.ledger_logging ())
             {
-                BOOST_LOG (log) << boost::str (boost::format ("Bad signature for: %1%") % block_a.hash ().to_string ());
+                auto hash (block_a.hash ());
+                log_queue.add (rai::log_category::ledger, [hash] ()
+                {
+                    return boost::str (boost::format ("Bad signature for: %1%") % hash.to_string ());
+                });
             }
             break;
         }
@@ -1352,7 +1754,11 @@ rai::process_return rai::node::process_receive_one (MDB_txn * transaction_a, rai
         {
             if (config.logging.ledger_logging ())
             {
-                BOOST_LOG (log) << boost::str (boost::format ("Overspend for: %1%") % block_a.hash ().to_string ());
+                auto hash (block_a.hash ());
+                log_queue.add (rai::log_category::ledger, [hash] ()
+                {
+                    return boost::str (boost::format ("Overspend for: %1%") % hash.to_string ());
+                });
             }
             break;
         }
@@ -1360,7 +1766,11 @@ rai::process_return rai::node::process_receive_one (MDB_txn * transaction_a, rai
         {
             if (config.logging.ledger_logging ())
             {
-                BOOST_LOG (log) << boost::str (boost::format ("Unreceivable for: %1%") % block_a.hash ().to_string ());
+                auto hash (block_a.hash ());
+                log_queue.add (rai::log_category::ledger, [hash] ()
+                {
+                    return boost::str (boost::format ("Unreceivable for: %1%") % hash.to_string ());
+                });
             }
             break;
         }
@@ -1368,7 +1778,11 @@ rai::process_return rai::node::process_receive_one (MDB_txn * transaction_a, rai
         {
             if (config.logging.ledger_logging ())
             {
-                BOOST_LOG (log) << boost::str (boost::format ("Not receive from send for: %1%") % block_a.hash ().to_string ());
+                auto hash (block_a.hash ());
+                log_queue.add (rai::log_category::ledger, [hash] ()
+                {
+                    return boost::str (boost::format ("Not receive from send for: %1%") % hash.to_string ());
+                });
             }
             break;
         }
@@ -1376,7 +1790,12 @@ rai::process_return rai::node::process_receive_one (MDB_txn * transaction_a, rai
         {
 			if (config.logging.ledger_logging ())
 			{
-				BOOST_LOG (log) << boost::str (boost::format ("Fork for: %1% root: %2%") % block_a.hash ().to_string () % block_a.root ().to_string ());
+				auto hash (block_a.hash ());
+				auto root (block_a.root ());
+				log_queue.add (rai::log_category::ledger, [hash, root] ()
+				{
+					return boost::str (boost::format ("Fork for: %1% root: %2%") % hash.to_string () % root.to_string ());
+				});
 			}
             break;
         }
@@ -1384,7 +1803,11 @@ rai::process_return rai::node::process_receive_one (MDB_txn * transaction_a, rai
         {
             if (config.logging.ledger_logging ())
             {
-                BOOST_LOG (log) << boost::str (boost::format ("Account mismatch for: %1%") % block_a.hash ().to_string ());
+                auto hash (block_a.hash ());
+                log_queue.add (rai::log_category::ledger, [hash] ()
+                {
+                    return boost::str (boost::format ("Account mismatch for: %1%") % hash.to_string ());
+                });
             }
         }
     }
@@ -1414,7 +1837,7 @@ std::vector <rai::endpoint> rai::peer_container::list_sqrt ()
 std::vector <rai::peer_information> rai::peer_container::list ()
 {
     std::vector <rai::peer_information> result;
-    std::lock_guard <std::mutex> lock (mutex);
+    rai::lock_guard lock (mutex);
     result.reserve (peers.size ());
     for (auto i (peers.begin ()), j (peers.end ()); i != j; ++i)
     {
@@ -1427,8 +1850,8 @@ std::vector <rai::peer_information> rai::peer_container::list ()
 rai::endpoint rai::peer_container::bootstrap_peer ()
 {
     rai::endpoint result (boost::asio::ip::address_v6::any (), 0);
-    std::lock_guard <std::mutex> lock (mutex);
-	auto first (peers.get <4> ().begin ());
+    rai::lock_guard lock (mutex);
+	auto first (std::find_if (peers.get <4> ().begin (), peers.get <4> ().end (), [] (rai::peer_information const & peer_a) { return !peer_a.pruned; }));
 	if (first != peers.get <4> ().end ())
 	{
 		result = first->endpoint;
@@ -1440,6 +1863,44 @@ rai::endpoint rai::peer_container::bootstrap_peer ()
     return result;
 }
 
+void rai::peer_container::pruned (rai::endpoint const & endpoint_a, bool pruned_a)
+{
+	rai::lock_guard lock (mutex);
+	auto existing (peers.find (endpoint_a));
+	if (existing != peers.end ())
+	{
+		peers.modify (existing, [pruned_a] (rai::peer_information & peer_a)
+		{
+			peer_a.pruned = pruned_a;
+		});
+	}
+}
+
+void rai::peer_container::network_version (rai::endpoint const & endpoint_a, uint8_t version_a)
+{
+	rai::lock_guard lock (mutex);
+	auto existing (peers.find (endpoint_a));
+	if (existing != peers.end ())
+	{
+		peers.modify (existing, [version_a] (rai::peer_information & peer_a)
+		{
+			peer_a.network_version = version_a;
+		});
+	}
+}
+
+uint8_t rai::peer_container::network_version (rai::endpoint const & endpoint_a)
+{
+	uint8_t result (0x01);
+	rai::lock_guard lock (mutex);
+	auto existing (peers.find (endpoint_a));
+	if (existing != peers.end ())
+	{
+		result = existing->network_version;
+	}
+	return result;
+}
+
 bool rai::parse_port (std::string const & string_a, uint16_t & port_a)
 {
 	bool result;
@@ -1521,9 +1982,19 @@ void rai::node::start ()
     ongoing_keepalive ();
 	ongoing_bootstrap ();
 	ongoing_rep_crawl ();
+	ongoing_stats_sample ();
+	if (config.prune_tail != 0)
+	{
+		ongoing_prune ();
+	}
     bootstrap.start ();
 	backup_wallet ();
 	active.announce_votes ();
+	auto this_l (shared ());
+	background ([this_l] ()
+	{
+		this_l->wallets.work_precache_all ();
+	});
 	port_mapping.start ();
 	add_initial_peers ();
 }
@@ -1532,6 +2003,8 @@ void rai::node::stop ()
 {
     BOOST_LOG (log) << "Node stopping";
 	active.stop ();
+	wallets.stop ();
+	work_client.stop ();
     network.stop ();
 	bootstrap_initiator.stop ();
     bootstrap.stop ();
@@ -1595,6 +2068,8 @@ void rai::node::ongoing_keepalive ()
 {
     keepalive_preconfigured (config.preconfigured_peers);
     auto peers_l (peers.purge_list (std::chrono::system_clock::now () - cutoff));
+	// Insertions expire old entries, this ages out a cache that stopped receiving them
+	gap_cache.purge_old ();
     for (auto i (peers_l.begin ()), j (peers_l.end ()); i != j && std::chrono::system_clock::now () - i->last_attempt > period; ++i)
     {
         network.send_keepalive (i->endpoint);
@@ -1624,12 +2099,45 @@ void rai::node::ongoing_rep_crawl ()
 	});
 }
 
-void rai::node::ongoing_bootstrap ()
+void rai::node::ongoing_stats_sample ()
 {
-	auto next_wakeup (300);
-	if (warmed_up < 3)
+	stats.sample ();
+	std::weak_ptr <rai::node> node_w (shared_from_this ());
+	alarm.add (std::chrono::system_clock::now () + rai::stats::sample_interval, [node_w] ()
 	{
-		// Re-attempt bootstrapping more aggressively on startup
+		if (auto node_l = node_w.lock ())
+		{
+			node_l->ongoing_stats_sample ();
+		}
+	});
+}
+
+void rai::node::ongoing_prune ()
+{
+	size_t deleted;
+	{
+		rai::transaction transaction (store.environment, nullptr, true);
+		deleted = ledger.prune (transaction, prune_cursor, config.prune_tail, prune_batch);
+	}
+	stats.counter ("ledger", "pruned").add (deleted);
+	// A full batch means the pass isn't finished, the next batch goes in its own transaction right away
+	auto next (deleted == prune_batch ? std::chrono::system_clock::now () : std::chrono::system_clock::now () + prune_interval);
+	std::weak_ptr <rai::node> node_w (shared_from_this ());
+	alarm.add (next, [node_w] ()
+	{
+		if (auto node_l = node_w.lock ())
+		{
+			node_l->ongoing_prune ();
+		}
+	});
+}
+
+void rai::node::ongoing_bootstrap ()
+{
+	auto next_wakeup (300);
+	if (warmed_up < 3)
+	{
+		// Re-attempt bootstrapping more aggressively on startup
 		next_wakeup = 5;
 		if (!bootstrap_initiator.in_progress () && !peers.empty ())
 		{
@@ -1679,34 +2187,237 @@ int rai::node::price (rai::uint128_t const & balance_a, int amount_a)
 	return static_cast <int> (result * 100.0);
 }
 
+rai::work_peer::work_peer () :
+latency (0),
+successes (0),
+failures (0),
+consecutive_failures (0)
+{
+}
+
+rai::work_peer_client::work_peer_client (rai::node & node_a) :
+node (node_a)
+{
+}
+
+std::vector <rai::tcp_endpoint> rai::work_peer_client::select ()
+{
+	std::vector <std::pair <std::chrono::microseconds, rai::tcp_endpoint>> candidates;
+	auto now (std::chrono::steady_clock::now ());
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto & i: node.config.work_peers)
+	{
+		rai::tcp_endpoint endpoint (i.first, i.second);
+		auto & peer (peers [endpoint]);
+		if (peer.retry_after <= now)
+		{
+			// Unmeasured peers sort first so they get a chance to be measured
+			candidates.push_back (std::make_pair (peer.latency, endpoint));
+		}
+	}
+	std::sort (candidates.begin (), candidates.end ());
+	std::vector <rai::tcp_endpoint> result;
+	for (auto i (candidates.begin ()), n (candidates.end ()); i != n && result.size () < max_fanout; ++i)
+	{
+		result.push_back (i->second);
+	}
+	return result;
+}
+
+std::shared_ptr <boost::asio::ip::tcp::socket> rai::work_peer_client::connection (rai::tcp_endpoint const & endpoint_a)
+{
+	std::shared_ptr <boost::asio::ip::tcp::socket> result;
+	std::lock_guard <std::mutex> lock (mutex);
+	auto & idle (peers [endpoint_a].idle);
+	if (!idle.empty ())
+	{
+		result = idle.back ();
+		idle.pop_back ();
+	}
+	return result;
+}
+
+void rai::work_peer_client::release (rai::tcp_endpoint const & endpoint_a, std::shared_ptr <boost::asio::ip::tcp::socket> socket_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto & idle (peers [endpoint_a].idle);
+	if (idle.size () < max_idle)
+	{
+		idle.push_back (socket_a);
+	}
+}
+
+void rai::work_peer_client::success (rai::tcp_endpoint const & endpoint_a, std::chrono::microseconds latency_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto & peer (peers [endpoint_a]);
+	++peer.successes;
+	peer.consecutive_failures = 0;
+	peer.latency = peer.latency.count () == 0 ? latency_a : (peer.latency * 7 + latency_a) / 8;
+}
+
+void rai::work_peer_client::failure (rai::tcp_endpoint const & endpoint_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto & peer (peers [endpoint_a]);
+	++peer.failures;
+	++peer.consecutive_failures;
+	if (peer.consecutive_failures >= failure_limit)
+	{
+		peer.retry_after = std::chrono::steady_clock::now () + backoff;
+		peer.idle.clear ();
+	}
+}
+
+void rai::work_peer_client::stop ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto & i: peers)
+	{
+		i.second.idle.clear ();
+	}
+}
+
 namespace {
-class work_request
+class work_request : public std::enable_shared_from_this <work_request>
 {
 public:
-work_request (boost::asio::io_service & service_a, boost::asio::ip::address address_a, uint16_t port_a) :
-address (address_a),
-port (port_a),
-socket (service_a)
+work_request (rai::work_peer_client & client_a, rai::tcp_endpoint const & endpoint_a, std::string const & body_a, std::function <void (bool, std::string const &)> const & callback_a) :
+client (client_a),
+endpoint (endpoint_a),
+body (body_a),
+callback (callback_a),
+reused (false)
+{
+}
+void start ()
+{
+	socket = client.connection (endpoint);
+	if (socket != nullptr)
+	{
+		reused = true;
+		send ();
+	}
+	else
+	{
+		connect ();
+	}
+}
+void connect ()
+{
+	auto this_l (shared_from_this ());
+	socket = std::make_shared <boost::asio::ip::tcp::socket> (client.node.network.service);
+	socket->async_connect (endpoint, [this_l] (boost::system::error_code const & ec)
+	{
+		if (!ec)
+		{
+			this_l->send ();
+		}
+		else
+		{
+			BOOST_LOG (this_l->client.node.log) << boost::str (boost::format ("Unable to connect to work_peer %1% %2%") % this_l->endpoint.address () % this_l->endpoint.port ());
+			this_l->callback (true, std::string ());
+		}
+	});
+}
+void send ()
+{
+	auto this_l (shared_from_this ());
+	request.method = "POST";
+	request.url = "/";
+	request.version = 11;
+	request.body = body;
+	beast::http::prepare (request);
+	beast::http::async_write (*socket, request, [this_l] (boost::system::error_code const & ec)
+	{
+		if (!ec)
+		{
+			beast::http::async_read (*this_l->socket, this_l->buffer, this_l->response, [this_l] (boost::system::error_code const & ec)
+			{
+				if (!ec)
+				{
+					if (beast::http::is_keep_alive (this_l->response))
+					{
+						this_l->client.release (this_l->endpoint, this_l->socket);
+					}
+					if (this_l->response.status == 200)
+					{
+						this_l->callback (false, this_l->response.body);
+					}
+					else
+					{
+						BOOST_LOG (this_l->client.node.log) << boost::str (boost::format ("Work peer %1% %2% responded with an error %3%") % this_l->endpoint.address () % this_l->endpoint.port () % this_l->response.status);
+						this_l->callback (true, std::string ());
+					}
+				}
+				else
+				{
+					this_l->retry ("Unable to read from work_peer %1% %2%");
+				}
+			});
+		}
+		else
+		{
+			this_l->retry ("Unable to write to work_peer %1% %2%");
+		}
+	});
+}
+void retry (char const * message_a)
 {
+	if (reused)
+	{
+		// The peer may have closed an idle connection, try once more on a new one
+		auto retry (std::make_shared <work_request> (client, endpoint, body, callback));
+		retry->connect ();
+	}
+	else
+	{
+		BOOST_LOG (client.node.log) << boost::str (boost::format (message_a) % endpoint.address () % endpoint.port ());
+		callback (true, std::string ());
+	}
 }
-boost::asio::ip::address address;
-uint16_t port;
+rai::work_peer_client & client;
+rai::tcp_endpoint endpoint;
+std::string body;
+std::function <void (bool, std::string const &)> callback;
+bool reused;
+std::shared_ptr <boost::asio::ip::tcp::socket> socket;
 beast::streambuf buffer;
+beast::http::request <beast::http::string_body> request;
 beast::http::response <beast::http::string_body> response;
-boost::asio::ip::tcp::socket socket;
 };
+}
+
+void rai::work_peer_client::request (rai::tcp_endpoint const & endpoint_a, std::string const & body_a, std::function <void (bool, std::string const &)> const & callback_a)
+{
+	auto request (std::make_shared <work_request> (*this, endpoint_a, body_a, callback_a));
+	request->start ();
+}
+
+namespace {
+std::string work_request_body (char const * action_a, rai::block_hash const & root_a)
+{
+	boost::property_tree::ptree request;
+	request.put ("action", action_a);
+	request.put ("hash", root_a.to_string ());
+	std::stringstream ostream;
+	boost::property_tree::write_json (ostream, request, false);
+	return ostream.str ();
+}
 class distributed_work : public std::enable_shared_from_this <distributed_work>
 {
 public:
-distributed_work (std::shared_ptr <rai::node> const & node_a, rai::block_hash const & root_a, std::function <void (uint64_t)> callback_a) :
+distributed_work (std::shared_ptr <rai::node> const & node_a, rai::block_hash const & root_a, std::function <void (uint64_t)> callback_a, rai::work_priority priority_a) :
 callback (callback_a),
 node (node_a),
-root (root_a)
+root (root_a),
+priority (priority_a),
+begin (std::chrono::steady_clock::now ())
 {
 	completed.clear ();
-	for (auto & i : node_a->config.work_peers)
+	for (auto & i : node_a->work_client.select ())
 	{
-		outstanding [i.first] = i.second;
+		outstanding.insert (i);
 	}
 }
 void start ()
@@ -1714,71 +2425,21 @@ void start ()
 	if (!outstanding.empty ())
 	{
 		auto this_l (shared_from_this ());
+		auto body (work_request_body ("work_generate", root));
 		std::lock_guard <std::mutex> lock (mutex);
 		for (auto const & i: outstanding)
 		{
-			auto host (i.first);
-			auto service (i.second);
-			node->background ([this_l, host, service] ()
+			auto endpoint (i);
+			node->work_client.request (endpoint, body, [this_l, endpoint] (bool error_a, std::string const & body_a)
 			{
-				auto connection (std::make_shared <work_request> (this_l->node->network.service, host, service));
-				connection->socket.async_connect (rai::tcp_endpoint (host, service), [this_l, connection] (boost::system::error_code const & ec)
+				if (!error_a)
 				{
-					if (!ec)
-					{
-						std::string request_string;
-						{
-							boost::property_tree::ptree request;
-							request.put ("action", "work_generate");
-							request.put ("hash", this_l->root.to_string ());
-							std::stringstream ostream;
-							boost::property_tree::write_json (ostream, request);
-							request_string = ostream.str ();
-						}
-						beast::http::request <beast::http::string_body> request;
-						request.method = "POST";
-						request.url = "/";
-						request.version = 11;
-						request.body = request_string;
-						beast::http::prepare (request);
-						beast::http::async_write (connection->socket, request, [this_l, connection] (boost::system::error_code const & ec)
-						{
-							if (!ec)
-							{
-								beast::http::async_read (connection->socket, connection->buffer, connection->response, [this_l, connection] (boost::system::error_code const & ec)
-								{
-									if (!ec)
-									{
-										if (connection->response.status == 200)
-										{
-											this_l->success (connection->response.body, connection->address);
-										}
-										else
-										{
-											BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Work peer %1% responded with an error %2%") % connection->address % connection->port);
-											this_l->failure (connection->address);
-										}
-									}
-									else
-									{
-										BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Unable to read from work_peer %1% %2%") % connection->address % connection->port);
-										this_l->failure (connection->address);
-									}
-								});
-							}
-							else
-							{
-								BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Unable to write to work_peer %1% %2%") % connection->address % connection->port);
-								this_l->failure (connection->address);
-							}
-						});
-					}
-					else
-					{
-						BOOST_LOG (this_l->node->log) << boost::str (boost::format ("Unable to connect to work_peer %1% %2%") % connection->address % connection->port);
-						this_l->failure (connection->address);
-					}
-				});
+					this_l->success (body_a, endpoint);
+				}
+				else
+				{
+					this_l->failure (endpoint);
+				}
 			});
 		}
 	}
@@ -1787,73 +2448,58 @@ void start ()
 		handle_failure (true);
 	}
 }
+// Tell every peer still searching to stop as soon as one result is accepted
 void stop ()
 {
-	auto this_l (shared_from_this ());
+	auto body (work_request_body ("work_cancel", root));
 	std::lock_guard <std::mutex> lock (mutex);
 	for (auto const & i: outstanding)
 	{
-		auto host (i.first);
-		auto service (i.second);
-		node->background ([this_l, host, service] ()
-		{
-			std::string request_string;
-			{
-				boost::property_tree::ptree request;
-				request.put ("action", "work_cancel");
-				request.put ("hash", this_l->root.to_string ());
-				std::stringstream ostream;
-				boost::property_tree::write_json (ostream, request);
-				request_string = ostream.str ();
-			}
-			beast::http::request <beast::http::string_body> request;
-			request.method = "POST";
-			request.url = "/";
-			request.version = 11;
-			request.body = request_string;
-			beast::http::prepare (request);
-			auto socket (std::make_shared <boost::asio::ip::tcp::socket> (this_l->node->network.service));
-			beast::http::async_write (*socket, request, [socket] (boost::system::error_code const & ec)
-			{
-			});
-		});
+		node->work_client.request (i, body, [] (bool, std::string const &) {});
 	}
 	outstanding.clear ();
 }
-void success (std::string const & body_a, boost::asio::ip::address const & address)
+void success (std::string const & body_a, rai::tcp_endpoint const & endpoint_a)
 {
-	auto last (remove (address));
-	std::stringstream istream (body_a);
-	try
+	bool last;
+	if (remove (endpoint_a, last))
 	{
-		boost::property_tree::ptree result;
-		boost::property_tree::read_json (istream, result);
-		auto work_text (result.get <std::string> ("work"));
-		uint64_t work;
-		if (!rai::from_string_hex (work_text, work))
+		std::stringstream istream (body_a);
+		try
 		{
-			if (!node->work.work_validate (root, work))
+			boost::property_tree::ptree result;
+			boost::property_tree::read_json (istream, result);
+			auto work_text (result.get <std::string> ("work"));
+			uint64_t work;
+			if (!rai::from_string_hex (work_text, work))
 			{
-				set_once (work);
-				stop ();
+				if (!node->work.work_validate (root, work))
+				{
+					node->work_client.success (endpoint_a, std::chrono::duration_cast <std::chrono::microseconds> (std::chrono::steady_clock::now () - begin));
+					set_once (work);
+					stop ();
+				}
+				else
+				{
+					BOOST_LOG (node->log) << boost::str (boost::format ("Incorrect work response from %1% for root %2% value %3%") % endpoint_a % root.to_string () % work_text);
+					node->work_client.failure (endpoint_a);
+					handle_failure (last);
+				}
 			}
 			else
 			{
-				BOOST_LOG (node->log) << boost::str (boost::format ("Incorrect work response from %1% for root %2% value %3%") % address % root.to_string () % work_text);
+				BOOST_LOG (node->log) << boost::str (boost::format ("Work response from %1% wasn't a number %2%") % endpoint_a % work_text);
+				node->work_client.failure (endpoint_a);
 				handle_failure (last);
 			}
 		}
-		else
+		catch (...)
 		{
-			BOOST_LOG (node->log) << boost::str (boost::format ("Work response from %1% wasn't a number %2%") % address % work_text);
+			BOOST_LOG (node->log) << boost::str (boost::format ("Work response from %1% wasn't parsable %2%") % endpoint_a % body_a);
+			node->work_client.failure (endpoint_a);
 			handle_failure (last);
 		}
 	}
-	catch (...)
-	{
-		BOOST_LOG (node->log) << boost::str (boost::format ("Work response from %1% wasn't parsable %2%") % address % body_a);
-		handle_failure (last);
-	}
 }
 void set_once (uint64_t work_a)
 {
@@ -1862,10 +2508,14 @@ void set_once (uint64_t work_a)
 		callback (work_a);
 	}
 }
-void failure (boost::asio::ip::address const & address)
+void failure (rai::tcp_endpoint const & endpoint_a)
 {
-	auto last (remove (address));
-	handle_failure (last);
+	bool last;
+	if (remove (endpoint_a, last))
+	{
+		node->work_client.failure (endpoint_a);
+		handle_failure (last);
+	}
 }
 void handle_failure (bool last)
 {
@@ -1873,21 +2523,25 @@ void handle_failure (bool last)
 	{
 		if (!completed.test_and_set ())
 		{
-			callback (node->work.generate (root));
+			callback (node->work.generate (root, priority));
 		}
 	}
 }
-bool remove (boost::asio::ip::address const & address)
+// Returns false if endpoint_a was already cancelled, responses from it no longer count
+bool remove (rai::tcp_endpoint const & endpoint_a, bool & last_a)
 {
 	std::lock_guard <std::mutex> lock (mutex);
-	outstanding.erase (address);
-	return outstanding.empty ();
+	auto result (outstanding.erase (endpoint_a) != 0);
+	last_a = outstanding.empty ();
+	return result;
 }
 std::function <void (uint64_t)> callback;
 std::shared_ptr <rai::node> node;
 rai::block_hash root;
+rai::work_priority priority;
+std::chrono::steady_clock::time_point begin;
 std::mutex mutex;
-std::map <boost::asio::ip::address, uint16_t> outstanding;
+std::set <rai::tcp_endpoint> outstanding;
 std::atomic_flag completed;
 };
 }
@@ -1897,19 +2551,25 @@ void rai::node::generate_work (rai::block & block_a)
     block_a.block_work_set (generate_work (block_a.root ()));
 }
 
-void rai::node::generate_work (rai::uint256_union const & hash_a, std::function <void (uint64_t)> callback_a)
+void rai::node::generate_work (rai::uint256_union const & hash_a, std::function <void (uint64_t)> callback_a, rai::work_priority priority_a)
 {
-	auto work_generation (std::make_shared <distributed_work> (shared (), hash_a, callback_a));
+	auto & generate (stats.histogram ("work", "generate"));
+	auto begin (std::chrono::steady_clock::now ());
+	auto work_generation (std::make_shared <distributed_work> (shared (), hash_a, [callback_a, &generate, begin] (uint64_t work_a)
+	{
+		generate.add (std::chrono::duration_cast <std::chrono::microseconds> (std::chrono::steady_clock::now () - begin).count ());
+		callback_a (work_a);
+	}, priority_a));
 	work_generation->start ();
 }
 
-uint64_t rai::node::generate_work (rai::uint256_union const & hash_a)
+uint64_t rai::node::generate_work (rai::uint256_union const & hash_a, rai::work_priority priority_a)
 {
 	std::promise <uint64_t> promise;
 	generate_work (hash_a, [&promise] (uint64_t work_a)
 	{
 		promise.set_value (work_a);
-	});
+	}, priority_a);
 	return promise.get_future ().get ();
 }
 
@@ -1971,6 +2631,7 @@ public:
 
 void rai::node::process_unchecked (std::shared_ptr <rai::bootstrap_attempt> attempt_a)
 {
+	rai::trace_span span ("bootstrap", "process_unchecked");
 	auto block_count (0);
 	assert (attempt_a == nullptr || bootstrap_initiator.in_progress ());
 	static std::atomic_flag unchecked_in_progress = ATOMIC_FLAG_INIT;
@@ -2035,7 +2696,7 @@ std::unordered_set <rai::endpoint> rai::peer_container::random_set (size_t count
 {
 	std::unordered_set <rai::endpoint> result;
 	result.reserve (count_a);
-	std::lock_guard <std::mutex> lock (mutex);
+	rai::lock_guard lock (mutex);
 	// Stop trying to fill result with random samples after this many attempts
 	auto random_cutoff (count_a * 2);
 	auto peers_size (peers.size ());
@@ -2078,7 +2739,7 @@ std::vector <rai::peer_information> rai::peer_container::representatives (size_t
 {
 	std::vector <peer_information> result;
 	result.reserve (count_a);
-	std::lock_guard <std::mutex> lock (mutex);
+	rai::lock_guard lock (mutex);
 	for (auto i (peers.get <6> ().begin ()), n (peers.get <6> ().end ()); i != n && result.size () < count_a && !i->rep_weight.is_zero (); ++i)
 	{
 		result.push_back (*i);
@@ -2090,7 +2751,7 @@ std::vector <rai::peer_information> rai::peer_container::purge_list (std::chrono
 {
 	std::vector <rai::peer_information> result;
 	{
-		std::lock_guard <std::mutex> lock (mutex);
+		rai::lock_guard lock (mutex);
 		auto pivot (peers.get <1> ().lower_bound (cutoff));
 		result.assign (pivot, peers.get <1> ().end ());
 		peers.get <1> ().erase (peers.get <1> ().begin (), pivot);
@@ -2110,7 +2771,7 @@ std::vector <rai::endpoint> rai::peer_container::rep_crawl ()
 {
 	std::vector <rai::endpoint> result;
 	result.reserve (8);
-	std::lock_guard <std::mutex> lock (mutex);
+	rai::lock_guard lock (mutex);
 	auto count (0);
 	for (auto i (peers.get <5> ().begin ()), n (peers.get <5> ().end ()); i != n && count < 8; ++i, ++count)
 	{
@@ -2121,7 +2782,7 @@ std::vector <rai::endpoint> rai::peer_container::rep_crawl ()
 
 size_t rai::peer_container::size ()
 {
-    std::lock_guard <std::mutex> lock (mutex);
+    rai::lock_guard lock (mutex);
     return peers.size ();
 }
 
@@ -2157,7 +2818,7 @@ bool rai::peer_container::not_a_peer (rai::endpoint const & endpoint_a)
 bool rai::peer_container::rep_response (rai::endpoint const & endpoint_a, rai::amount const & weight_a)
 {
 	auto updated (false);
-    std::lock_guard <std::mutex> lock (mutex);
+    rai::lock_guard lock (mutex);
     auto existing (peers.find (endpoint_a));
     if (existing != peers.end ())
     {
@@ -2176,7 +2837,7 @@ bool rai::peer_container::rep_response (rai::endpoint const & endpoint_a, rai::a
 
 void rai::peer_container::rep_request (rai::endpoint const & endpoint_a)
 {
-    std::lock_guard <std::mutex> lock (mutex);
+    rai::lock_guard lock (mutex);
     auto existing (peers.find (endpoint_a));
     if (existing != peers.end ())
     {
@@ -2193,7 +2854,7 @@ bool rai::peer_container::insert (rai::endpoint const & endpoint_a)
     auto result (not_a_peer (endpoint_a));
     if (!result)
     {
-        std::lock_guard <std::mutex> lock (mutex);
+        rai::lock_guard lock (mutex);
         auto existing (peers.find (endpoint_a));
         if (existing != peers.end ())
         {
@@ -2292,7 +2953,9 @@ last_attempt (last_contact),
 last_bootstrap_attempt (std::chrono::system_clock::time_point ()),
 last_rep_request (std::chrono::system_clock::time_point ()),
 last_rep_response (std::chrono::system_clock::time_point ()),
-rep_weight (0)
+rep_weight (0),
+pruned (false),
+network_version (0x01)
 {
 }
 
@@ -2303,11 +2966,14 @@ last_attempt (last_attempt_a),
 last_bootstrap_attempt (std::chrono::system_clock::time_point ()),
 last_rep_request (std::chrono::system_clock::time_point ()),
 last_rep_response (std::chrono::system_clock::time_point ()),
-rep_weight (0)
+rep_weight (0),
+pruned (false),
+network_version (0x01)
 {
 }
 
 rai::peer_container::peer_container (rai::endpoint const & self_a) :
+mutex ("peer_container"),
 self (self_a),
 peer_observer ([] (rai::endpoint const &) {}),
 disconnect_observer ([] () {})
@@ -2341,7 +3007,10 @@ void rai::network::initiate_send ()
 	auto & front (sends.front ());
 	if (node.config.logging.network_packet_logging ())
 	{
-		BOOST_LOG (node.log) << "Sending packet";
+		node.log_queue.add (rai::log_category::network_packet, [] ()
+		{
+			return std::string ("Sending packet");
+		});
 	}
 	socket.async_send_to (boost::asio::buffer (front.data, front.size), front.endpoint, [this, front] (boost::system::error_code const & ec, size_t size_a)
 	{
@@ -2356,7 +3025,7 @@ void rai::network::initiate_send ()
 		{
 			rai::send_info self;
 			{
-				std::unique_lock <std::mutex> lock (socket_mutex);
+				rai::unique_lock lock (socket_mutex);
 				assert (!sends.empty ());
 				self = sends.front ();
 			}
@@ -2368,7 +3037,7 @@ void rai::network::initiate_send ()
 
 void rai::network::send_buffer (uint8_t const * data_a, size_t size_a, rai::endpoint const & endpoint_a, size_t rebroadcast_a, std::function <void (boost::system::error_code const &, size_t)> callback_a)
 {
-	std::unique_lock <std::mutex> lock (socket_mutex);
+	rai::unique_lock lock (socket_mutex);
 	auto initiate (sends.empty ());
 	sends.push ({data_a, size_a, endpoint_a, rebroadcast_a, callback_a});
 	if (initiate)
@@ -2381,20 +3050,27 @@ void rai::network::send_complete (boost::system::error_code const & ec, size_t s
 {
     if (node.config.logging.network_packet_logging ())
     {
-        BOOST_LOG (node.log) << "Packet send complete";
+        node.log_queue.add (rai::log_category::network_packet, [] ()
+        {
+            return std::string ("Packet send complete");
+        });
     }
-	std::unique_lock <std::mutex> lock (socket_mutex);
+	rai::unique_lock lock (socket_mutex);
 	assert (!sends.empty ());
 	sends.pop ();
 	if (!sends.empty ())
 	{
 		if (node.config.logging.network_packet_logging ())
 		{
-			BOOST_LOG (node.log) << boost::str (boost::format ("Delaying next packet send %1% microseconds") % node.config.packet_delay_microseconds);
+			auto delay (node.config.packet_delay_microseconds);
+			node.log_queue.add (rai::log_category::network_packet, [delay] ()
+			{
+				return boost::str (boost::format ("Delaying next packet send %1% microseconds") % delay);
+			});
 		}
 		node.alarm.add (std::chrono::system_clock::now () + std::chrono::microseconds (node.config.packet_delay_microseconds), [this] ()
 		{
-			std::unique_lock <std::mutex> lock (socket_mutex);
+			rai::unique_lock lock (socket_mutex);
 			initiate_send ();
 		});
 	}
@@ -2410,7 +3086,7 @@ uint64_t rai::block_store::now ()
 
 bool rai::peer_container::known_peer (rai::endpoint const & endpoint_a)
 {
-    std::lock_guard <std::mutex> lock (mutex);
+    rai::lock_guard lock (mutex);
     auto existing (peers.find (endpoint_a));
     return existing != peers.end () && existing->last_contact > std::chrono::system_clock::now () - rai::node::cutoff;
 }
@@ -2483,9 +3159,15 @@ void rai::election::confirm_once (MDB_txn * transaction_a)
 			{
 				BOOST_LOG (node.log) << boost::str (boost::format ("Rolling back %1% and replacing with %2%") % last_winner->hash ().to_string () % winner->second->hash ().to_string ());
 				// Replace our block with the winner and roll back any dependent blocks
-				node.ledger.rollback (transaction_a, last_winner->hash ());
-				node.ledger.process (transaction_a, *winner->second);
-				last_winner = std::move (winner->second);
+				if (!node.ledger.rollback (transaction_a, last_winner->hash ()))
+				{
+					node.ledger.process (transaction_a, *winner->second);
+					last_winner = std::move (winner->second);
+				}
+				else
+				{
+					BOOST_LOG (node.log) << boost::str (boost::format ("Retaining block %1%, rolling it back would reach pruned blocks") % last_winner->hash ().to_string ());
+				}
 			}
 			else
 			{
@@ -2494,9 +3176,13 @@ void rai::election::confirm_once (MDB_txn * transaction_a)
 		}
 		auto winner_l (last_winner);
 		auto confirmation_action_l (confirmation_action);
-		node.background ([winner_l, confirmation_action_l] ()
+		auto hash (winner_l->hash ());
+		auto account (node.store.block_exists (transaction_a, hash) ? node.ledger.account (transaction_a, hash) : rai::account (0));
+		auto node_l (node.shared ());
+		node.background ([node_l, winner_l, account, confirmation_action_l] ()
 		{
 			confirmation_action_l (*winner_l);
+			node_l->observers.elections (*winner_l, account);
 		});
 	}
 }
@@ -2533,9 +3219,10 @@ void rai::election::vote (rai::vote const & vote_a)
 
 void rai::active_transactions::announce_votes ()
 {
+	rai::trace_span span ("active", "announce_votes");
 	std::vector <rai::block_hash> inactive;
 	rai::transaction transaction (node.store.environment, nullptr, true);
-	std::lock_guard <std::mutex> lock (mutex);
+	rai::lock_guard lock (mutex);
 	size_t announcements (0);
 	{
 		auto i (roots.begin ());
@@ -2590,13 +3277,13 @@ void rai::active_transactions::announce_votes ()
 
 void rai::active_transactions::stop ()
 {
-	std::lock_guard <std::mutex> lock (mutex);
+	rai::lock_guard lock (mutex);
 	roots.clear ();
 }
 
 void rai::active_transactions::start (MDB_txn * transaction_a, rai::block const & block_a, std::function <void (rai::block &)> const & confirmation_action_a)
 {
-    std::lock_guard <std::mutex> lock (mutex);
+    rai::lock_guard lock (mutex);
     auto root (block_a.root ());
     auto existing (roots.find (root));
     if (existing == roots.end ())
@@ -2611,7 +3298,7 @@ void rai::active_transactions::vote (rai::vote const & vote_a)
 {
 	std::shared_ptr <rai::election> election;
 	{
-		std::lock_guard <std::mutex> lock (mutex);
+		rai::lock_guard lock (mutex);
 		auto root (vote_a.block->root ());
 		auto existing (roots.find (root));
 		if (existing != roots.end ())
@@ -2627,12 +3314,13 @@ void rai::active_transactions::vote (rai::vote const & vote_a)
 
 bool rai::active_transactions::active (rai::block const & block_a)
 {
-    std::lock_guard <std::mutex> lock (mutex);
+    rai::lock_guard lock (mutex);
 	return roots.find (block_a.root ()) != roots.end ();
 }
 
 rai::active_transactions::active_transactions (rai::node & node_a) :
-node (node_a)
+node (node_a),
+mutex ("active_transactions")
 {
 }
 
@@ -2672,6 +3360,313 @@ void rai::fan::value_set (rai::raw_key const & value_a)
     *(values [0]) ^= value_a.data;
 }
 
+size_t constexpr rai::ledger_validator::ranges_per_thread;
+size_t constexpr rai::ledger_validator::message_limit;
+size_t constexpr rai::ledger_validator::signature_batch;
+
+rai::ledger_validator::ledger_validator (rai::node & node_a) :
+node (node_a),
+accounts (0),
+blocks (0),
+sends (0),
+receives (0),
+pending (0),
+elapsed (0)
+{
+}
+
+void rai::ledger_validator::run (unsigned threads_a)
+{
+	auto begin (std::chrono::steady_clock::now ());
+	auto threads_l (std::max (1u, threads_a));
+	// More ranges than threads so a thread that drew dense ranges doesn't hold up the others
+	auto count (threads_l * ranges_per_thread);
+	auto starts (rai::account_range_starts (count));
+	std::atomic <size_t> next (0);
+	std::vector <rai::ledger_validator::worker> workers (threads_l);
+	std::vector <std::thread> threads;
+	for (auto i (0u); i < threads_l; ++i)
+	{
+		threads.push_back (std::thread ([this, &starts, &next, &workers, count, i] ()
+		{
+			auto & worker (workers [i]);
+			rai::transaction transaction (node.store.environment, nullptr, false);
+			for (auto range (next++); range < count; range = next++)
+			{
+				validate_range (transaction, starts [range], range + 1 < count ? starts [range + 1] : rai::account (0), worker);
+			}
+			flush (worker);
+		}));
+	}
+	for (auto & i: threads)
+	{
+		i.join ();
+	}
+	std::unordered_map <rai::account, rai::uint128_t> weights;
+	for (auto & i: workers)
+	{
+		for (auto & j: i.weights)
+		{
+			weights [j.first] += j.second;
+		}
+	}
+	rai::transaction transaction (node.store.environment, nullptr, false);
+	for (auto i (node.store.representation_begin (transaction)), n (node.store.representation_end ()); i != n; ++i)
+	{
+		rai::account representative (i->first);
+		auto stored (node.store.representation_get (transaction, representative));
+		auto existing (weights.find (representative));
+		rai::uint128_t calculated (existing != weights.end () ? existing->second : 0);
+		if (stored != calculated)
+		{
+			error ("weight", boost::str (boost::format ("Representative %1% has weight %2%, its accounts hold %3%") % representative.to_account () % stored.convert_to <std::string> () % calculated.convert_to <std::string> ()));
+		}
+		if (existing != weights.end ())
+		{
+			weights.erase (existing);
+		}
+	}
+	for (auto & i: weights)
+	{
+		if (i.second != 0)
+		{
+			error ("weight", boost::str (boost::format ("Representative %1% has no weight entry, its accounts hold %2%") % i.first.to_account () % i.second.convert_to <std::string> ()));
+		}
+	}
+	// Every send is either received or pending, pruning deletes sends that were counted on both sides
+	if (node.store.pruned_count (transaction) == 0 && sends != receives + pending)
+	{
+		error ("pending", boost::str (boost::format ("%1% sends but %2% receives and %3% pending entries") % sends % receives % pending));
+	}
+	elapsed = std::chrono::steady_clock::now () - begin;
+}
+
+void rai::ledger_validator::validate_range (MDB_txn * transaction_a, rai::account const & start_a, rai::account const & end_a, rai::ledger_validator::worker & worker_a)
+{
+	for (auto i (node.store.latest_begin (transaction_a, start_a)), n (node.store.latest_end ()); i != n && (end_a.is_zero () || rai::account (i->first).number () < end_a.number ()); ++i)
+	{
+		rai::account account (i->first);
+		rai::account_info info (i->second);
+		validate_account (transaction_a, account, info, worker_a);
+	}
+	for (auto i (node.store.pending_begin (transaction_a, rai::pending_key (start_a, 0))), n (node.store.pending_end ()); i != n && (end_a.is_zero () || rai::pending_key (i->first).account.number () < end_a.number ()); ++i)
+	{
+		rai::pending_key key (i->first);
+		rai::pending_info info (i->second);
+		validate_pending (transaction_a, key, info);
+	}
+}
+
+void rai::ledger_validator::validate_account (MDB_txn * transaction_a, rai::account const & account_a, rai::account_info const & info_a, rai::ledger_validator::worker & worker_a)
+{
+	++accounts;
+	// Walked down from the head and checked from the bottom up so balances can be carried forward
+	std::vector <std::unique_ptr <rai::block>> chain;
+	std::vector <rai::block_hash> hashes;
+	rai::uint128_t balance (0);
+	auto missing (false);
+	auto hash (info_a.head);
+	while (!hash.is_zero ())
+	{
+		auto block (node.store.block_get (transaction_a, hash));
+		if (block != nullptr)
+		{
+			hashes.push_back (hash);
+			hash = block->previous ();
+			chain.push_back (std::move (block));
+		}
+		else
+		{
+			rai::pruned_info pruned;
+			if (!chain.empty () && !node.store.pruned_get (transaction_a, hash, pruned))
+			{
+				// Pruned history ends the walk, its boundary record holds the balance carried into the rest
+				balance = pruned.balance.number ();
+			}
+			else
+			{
+				missing = true;
+				error ("chain", boost::str (boost::format ("Account %1% is missing block %2%") % account_a.to_account () % hash.to_string ()));
+			}
+			hash.clear ();
+		}
+	}
+	auto received ([this, transaction_a, &account_a, &balance] (rai::block_hash const & hash_a, rai::block_hash const & source_a)
+	{
+		if (node.store.block_exists (transaction_a, source_a) || node.store.pruned_exists (transaction_a, source_a))
+		{
+			++receives;
+			balance += node.ledger.amount (transaction_a, source_a);
+			if (node.store.pending_exists (transaction_a, rai::pending_key (account_a, source_a)))
+			{
+				error ("pending", boost::str (boost::format ("Block %1% received %2% but it's still pending") % hash_a.to_string () % source_a.to_string ()));
+			}
+		}
+		else
+		{
+			error ("chain", boost::str (boost::format ("Block %1% receives missing block %2%") % hash_a.to_string () % source_a.to_string ()));
+		}
+	});
+	for (auto i (chain.size ()); !missing && i > 0; --i)
+	{
+		auto & block (*chain [i - 1]);
+		auto & hash_l (hashes [i - 1]);
+		++blocks;
+		if (i < chain.size () && node.store.block_successor (transaction_a, hashes [i]) != hash_l)
+		{
+			error ("chain", boost::str (boost::format ("Block %1% isn't the successor of %2%") % hash_l.to_string () % hashes [i].to_string ()));
+		}
+		worker_a.work.push_back (std::make_pair (block.root (), block.block_work ()));
+		switch (block.type ())
+		{
+			case rai::block_type::send:
+			{
+				auto & send (static_cast <rai::send_block &> (block));
+				worker_a.signatures.push_back (send.signature);
+				++sends;
+				if (send.hashables.balance.number () <= balance)
+				{
+					rai::uint128_t amount (balance - send.hashables.balance.number ());
+					rai::pending_info pending_l;
+					if (!node.store.pending_get (transaction_a, rai::pending_key (send.hashables.destination, hash_l), pending_l) && (pending_l.amount.number () != amount || pending_l.source != account_a))
+					{
+						error ("pending", boost::str (boost::format ("Pending entry for %1% doesn't match the send") % hash_l.to_string ()));
+					}
+				}
+				else
+				{
+					error ("balance", boost::str (boost::format ("Block %1% sends more than account %2% holds") % hash_l.to_string () % account_a.to_account ()));
+				}
+				balance = send.hashables.balance.number ();
+				break;
+			}
+			case rai::block_type::receive:
+			{
+				auto & receive (static_cast <rai::receive_block &> (block));
+				worker_a.signatures.push_back (receive.signature);
+				received (hash_l, receive.hashables.source);
+				break;
+			}
+			case rai::block_type::open:
+			{
+				auto & open (static_cast <rai::open_block &> (block));
+				worker_a.signatures.push_back (open.signature);
+				if (open.hashables.account != account_a || info_a.open_block != hash_l)
+				{
+					error ("chain", boost::str (boost::format ("Open block %1% doesn't belong to account %2%") % hash_l.to_string () % account_a.to_account ()));
+				}
+				if (account_a == rai::genesis_account)
+				{
+					balance = rai::genesis_amount;
+				}
+				else
+				{
+					received (hash_l, open.hashables.source);
+				}
+				break;
+			}
+			case rai::block_type::change:
+			{
+				auto & change (static_cast <rai::change_block &> (block));
+				worker_a.signatures.push_back (change.signature);
+				break;
+			}
+			default:
+			{
+				assert (false);
+				break;
+			}
+		}
+		worker_a.accounts.push_back (account_a);
+		worker_a.hashes.push_back (hash_l);
+		if (worker_a.hashes.size () >= signature_batch)
+		{
+			flush (worker_a);
+		}
+	}
+	if (!missing)
+	{
+		if (balance != info_a.balance.number ())
+		{
+			error ("balance", boost::str (boost::format ("Account %1% records balance %2%, its chain adds up to %3%") % account_a.to_account () % info_a.balance.number ().convert_to <std::string> () % balance.convert_to <std::string> ()));
+		}
+		auto rep_block (node.ledger.representative_calculated (transaction_a, info_a.head));
+		auto representative (node.store.block_get (transaction_a, rep_block));
+		if (rep_block == info_a.rep_block && representative != nullptr)
+		{
+			worker_a.weights [representative->representative ()] += info_a.balance.number ();
+		}
+		else
+		{
+			error ("representative", boost::str (boost::format ("Account %1% records representative block %2%, its chain says %3%") % account_a.to_account () % info_a.rep_block.to_string () % rep_block.to_string ()));
+		}
+	}
+}
+
+void rai::ledger_validator::validate_pending (MDB_txn * transaction_a, rai::pending_key const & key_a, rai::pending_info const & info_a)
+{
+	++pending;
+	auto block (node.store.block_get (transaction_a, key_a.hash));
+	if (block != nullptr)
+	{
+		if (block->type () != rai::block_type::send || static_cast <rai::send_block &> (*block).hashables.destination != key_a.account || node.ledger.amount (transaction_a, key_a.hash) != info_a.amount.number ())
+		{
+			error ("pending", boost::str (boost::format ("Pending entry for %1% doesn't match the send") % key_a.hash.to_string ()));
+		}
+	}
+	else if (!node.store.pruned_exists (transaction_a, key_a.hash))
+	{
+		error ("pending", boost::str (boost::format ("Pending entry for %1% has no send") % key_a.hash.to_string ()));
+	}
+}
+
+void rai::ledger_validator::flush (rai::ledger_validator::worker & worker_a)
+{
+	auto invalid (rai::validate_message_batch (worker_a.accounts, worker_a.hashes, worker_a.signatures));
+	auto insufficient (node.work.work_validate_batch (worker_a.work));
+	for (size_t i (0); i < worker_a.hashes.size (); ++i)
+	{
+		if (invalid [i])
+		{
+			error ("signature", boost::str (boost::format ("Block %1% has a bad signature") % worker_a.hashes [i].to_string ()));
+		}
+		if (insufficient [i])
+		{
+			error ("work", boost::str (boost::format ("Block %1% has insufficient work") % worker_a.hashes [i].to_string ()));
+		}
+	}
+	worker_a.accounts.clear ();
+	worker_a.hashes.clear ();
+	worker_a.signatures.clear ();
+	worker_a.work.clear ();
+}
+
+void rai::ledger_validator::error (std::string const & kind_a, std::string const & message_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	++failures [kind_a];
+	if (messages.size () < message_limit)
+	{
+		messages.push_back (message_a);
+	}
+}
+
+bool rai::ledger_validator::report (std::ostream & stream_a)
+{
+	auto seconds (std::chrono::duration_cast <std::chrono::duration <double>> (elapsed).count ());
+	stream_a << boost::str (boost::format ("Checked %1% accounts, %2% blocks and %3% pending entries in %4% seconds, %5% blocks per second\n") % accounts % blocks % pending % seconds % static_cast <uint64_t> (seconds > 0 ? blocks / seconds : 0));
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto & i: failures)
+	{
+		stream_a << boost::str (boost::format ("%1% failures: %2%\n") % i.first % i.second);
+	}
+	for (auto & i: messages)
+	{
+		stream_a << i << '\n';
+	}
+	return !failures.empty ();
+}
+
 rai::thread_runner::thread_runner (boost::asio::io_service & service_a, unsigned service_threads_a)
 {
 	for (auto i (0); i < service_threads_a; ++i)
@@ -2715,6 +3710,7 @@ void rai::add_node_options (boost::program_options::options_description & descri
 	("diagnostics", "Run internal diagnostics")
 	("key_create", "Generates a adhoc random keypair and prints it to stdout")
 	("key_expand", "Derive public key and account number from <key>")
+	("snapshot", "Write a compacted copy of the block store to <file>, safe while a node is running")
 	("wallet_add_adhoc", "Insert <key> in to <wallet>")
 	("wallet_create", "Creates a new wallet and prints the ID")
 	("wallet_change_seed", "Changes seed for <wallet> to <key>")
@@ -2837,6 +3833,35 @@ bool rai::handle_node_options (boost::program_options::variables_map & vm)
 			std::cout << "Error initializing OpenCL" << std::endl;
 		}
 	}
+	else if (vm.count ("snapshot"))
+	{
+		if (vm.count ("file") == 1)
+		{
+			inactive_node node;
+			auto & snapshot (node.node->snapshot);
+			snapshot.start (vm ["file"].as <std::string> ());
+			while (snapshot.running ())
+			{
+				std::cout << boost::str (boost::format ("Progress: %1%%%\n") % static_cast <int> (snapshot.progress () * 100));
+				std::this_thread::sleep_for (std::chrono::seconds (1));
+			}
+			snapshot.wait ();
+			if (!snapshot.error)
+			{
+				std::cout << boost::str (boost::format ("Snapshot size: %1% bytes\n") % snapshot.size);
+			}
+			else
+			{
+				std::cerr << "Error writing snapshot, <file> must not exist\n";
+				result = true;
+			}
+		}
+		else
+		{
+			std::cerr << "snapshot command requires one <file> option\n";
+			result = true;
+		}
+	}
     else if (vm.count ("key_create"))
     {
         rai::keypair pair;
@@ -3276,6 +4301,34 @@ bool rai::handle_node_options (boost::program_options::variables_map & vm)
 	return result;
 }
 
+bool rai::compact_store (boost::filesystem::path const & path_a)
+{
+	auto result (false);
+	if (boost::filesystem::exists (path_a))
+	{
+		boost::filesystem::path copy (path_a.string () + ".compact");
+		boost::system::error_code ec;
+		boost::filesystem::remove (copy, ec);
+		{
+			rai::mdb_env environment (result, path_a);
+			if (!result)
+			{
+				result = environment.copy (copy, true);
+			}
+		}
+		if (!result)
+		{
+			boost::filesystem::rename (copy, path_a, ec);
+			result = !!ec;
+		}
+		else
+		{
+			boost::filesystem::remove (copy, ec);
+		}
+	}
+	return result;
+}
+
 rai::inactive_node::inactive_node () :
 path (rai::working_path ()),
 service (boost::make_shared <boost::asio::io_service> ()),
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <rai/node/bootstrap.hpp>
+#include <rai/node/log_queue.hpp>
+#include <rai/node/stats.hpp>
 #include <rai/node/wallet.hpp>
 
 #include <unordered_set>
+#include <map>
 #include <memory>
 #include <queue>
 #include <mutex>
@@ -92,7 +95,7 @@ public:
 		>
 	> roots;
     rai::node & node;
-    std::mutex mutex;
+    rai::named_mutex mutex;
 	// Maximum number of conflicts to vote on per interval, lowest root hash first
 	static unsigned constexpr announcements_per_interval = 32;
 	// After this many successive vote announcements, block is confirmed
@@ -114,8 +117,8 @@ public:
     void add (std::chrono::system_clock::time_point const &, std::function <void ()> const &);
 	void run ();
 	boost::asio::io_service & service;
-    std::mutex mutex;
-    std::condition_variable condition;
+    rai::named_mutex mutex;
+    rai::condition_variable condition;
     std::priority_queue <operation, std::vector <operation>, std::greater <operation>> operations;
 	std::thread thread;
 };
@@ -125,18 +128,26 @@ public:
     std::chrono::system_clock::time_point arrival;
     rai::block_hash required;
     rai::block_hash hash;
-	std::unique_ptr <rai::votes> votes;
+	std::vector <rai::account> voters; // Representatives that voted for the block, only their weights are tallied
     std::unique_ptr <rai::block> block;
+	size_t size; // Estimated bytes held by the entry, counted against the cache's budget
+	bool requested; // The missing dependency has already been asked for
 };
+// Blocks waiting on a missing previous or source block, indexed by that dependency
+// The cache is bounded by an estimate of the memory it holds rather than a block count
 class gap_cache
 {
 public:
     gap_cache (rai::node &);
     void add (rai::block const &, rai::block_hash);
     std::vector <std::unique_ptr <rai::block>> get (rai::block_hash const &);
-    void vote (rai::vote const &);
+    void vote (rai::vote const &, rai::endpoint const &);
+	// The dependency couldn't be fetched, later votes may request it again
+	void request_failed (rai::block_hash const &);
     rai::uint128_t bootstrap_threshold (MDB_txn *);
 	void purge_old ();
+	size_t size ();
+	static size_t entry_size (rai::block const &);
     boost::multi_index_container
     <
         rai::gap_information,
@@ -147,9 +158,15 @@ public:
             boost::multi_index::hashed_unique <boost::multi_index::member <gap_information, rai::block_hash, &gap_information::hash>>
         >
     > blocks;
-    size_t const max = 256;
-    std::mutex mutex;
+	size_t bytes;
+	rai::stat_counter & evicted;
+	rai::stat_counter & expired;
+	rai::stat_counter & requests;
+	static std::chrono::seconds constexpr cutoff = std::chrono::seconds (10);
+    rai::named_mutex mutex;
     rai::node & node;
+private:
+	void expire (std::chrono::system_clock::time_point const &);
 };
 class work_pool;
 class peer_information
@@ -164,6 +181,8 @@ public:
 	std::chrono::system_clock::time_point last_rep_request;
 	std::chrono::system_clock::time_point last_rep_response;
 	rai::amount rep_weight;
+	bool pruned; // Advertised in its keepalives, it can't serve full chains
+	uint8_t network_version; // Highest protocol version advertised in its keepalives
 };
 class peer_container
 {
@@ -185,8 +204,12 @@ public:
 	std::vector <peer_information> list ();
 	// A list of random peers with size the square root of total peer count
 	std::vector <rai::endpoint> list_sqrt ();
-	// Get the next peer for attempting bootstrap
+	// Get the next peer for attempting bootstrap, peers with pruned ledgers are skipped
 	rai::endpoint bootstrap_peer ();
+	void pruned (rai::endpoint const &, bool);
+	void network_version (rai::endpoint const &, uint8_t);
+	// Version last advertised by the peer, unknown peers are assumed to speak the oldest one
+	uint8_t network_version (rai::endpoint const &);
 	// Purge any peer where last_contact < time_point and return what was left
 	std::vector <rai::peer_information> purge_list (std::chrono::system_clock::time_point const &);
 	std::vector <rai::endpoint> rep_crawl ();
@@ -195,7 +218,7 @@ public:
 	size_t size ();
 	size_t size_sqrt ();
 	bool empty ();
-	std::mutex mutex;
+	rai::named_mutex mutex;
 	rai::endpoint self;
 	boost::multi_index_container
 	<
@@ -273,6 +296,7 @@ public:
 	void republish (rai::block_hash const &, std::shared_ptr <std::vector <uint8_t>>, rai::endpoint);
     void publish_broadcast (std::vector <rai::peer_information> &, std::unique_ptr <rai::block>);
 	void confirm_block (rai::raw_key const &, rai::public_key const &, std::unique_ptr <rai::block>, uint64_t, rai::endpoint const &, size_t);
+	void confirm_block (rai::raw_key const &, rai::public_key const &, rai::block const &, uint64_t, std::vector <rai::endpoint> const &, size_t);
     void merge_peers (std::array <rai::endpoint, 8> const &);
     void send_keepalive (rai::endpoint const &);
 	void broadcast_confirm_req (rai::block const &);
@@ -284,19 +308,23 @@ public:
     rai::endpoint remote;
     std::array <uint8_t, 512> buffer;
     boost::asio::ip::udp::socket socket;
-    std::mutex socket_mutex;
+    rai::named_mutex socket_mutex;
     boost::asio::io_service & service;
     boost::asio::ip::udp::resolver resolver;
     rai::node & node;
-    uint64_t bad_sender_count;
+    rai::stat_counter & bad_sender_count;
     std::queue <rai::send_info> sends;
     bool on;
-    uint64_t keepalive_count;
-    uint64_t publish_count;
-    uint64_t confirm_req_count;
-    uint64_t confirm_ack_count;
-    uint64_t insufficient_work_count;
-    uint64_t error_count;
+    rai::stat_counter & keepalive_count;
+    rai::stat_counter & publish_count;
+    rai::stat_counter & confirm_req_count;
+    rai::stat_counter & confirm_ack_count;
+    rai::stat_counter & insufficient_work_count;
+    rai::stat_counter & error_count;
+    rai::stat_counter & keepalive_out_count;
+    rai::stat_counter & publish_out_count;
+    rai::stat_counter & confirm_req_out_count;
+    rai::stat_counter & confirm_ack_out_count;
     static uint16_t const node_port = rai::rai_network == rai::rai_networks::rai_live_network ? 7075 : 54000;
 };
 class logging
@@ -335,6 +363,7 @@ public:
 	bool work_generation_time_value;
 	bool log_to_cerr_value;
 	uintmax_t max_size;
+	uint64_t rate_limit; // Queued diagnostic records per category per second, 0 for no limit
     boost::log::sources::logger_mt log;
 };
 class node_init
@@ -344,6 +373,8 @@ public:
     bool error ();
     bool block_store_init;
     bool wallet_init;
+	// Set by the caller, opens the store read-only without wallets for a replica next to a running node
+	bool read_only;
 };
 class node_config
 {
@@ -369,6 +400,10 @@ public:
 	unsigned io_threads;
 	unsigned work_threads;
 	bool enable_voting;
+	// Blocks kept below each account's head, older ones are pruned, 0 keeps the full ledger
+	uint64_t prune_tail;
+	// Memory the gap cache may hold for blocks waiting on a missing dependency
+	uint64_t gap_cache_bytes;
     static std::chrono::seconds constexpr keepalive_period = std::chrono::seconds (60);
     static std::chrono::seconds constexpr keepalive_cutoff = keepalive_period * 5;
 	static std::chrono::minutes constexpr wallet_backup_interval = std::chrono::minutes (5);
@@ -377,6 +412,7 @@ class node_observers
 {
 public:
 	rai::observer_set <rai::block const &, rai::account const &, rai::amount const &> blocks;
+	rai::observer_set <rai::block const &, rai::account const &> elections; // Winner of each finished election and its account
 	rai::observer_set <rai::account const &, bool> wallet;
 	rai::observer_set <rai::vote const &, rai::endpoint const &> vote;
 	rai::observer_set <rai::endpoint const &> endpoint;
@@ -399,6 +435,63 @@ public:
 	std::mutex mutex;
 	std::unordered_set <rai::block_hash> active;
 };
+class work_peer
+{
+public:
+	work_peer ();
+	// Connected sockets waiting for the next request
+	std::vector <std::shared_ptr <boost::asio::ip::tcp::socket>> idle;
+	// Smoothed time until a valid result, zero until the first success
+	std::chrono::microseconds latency;
+	uint64_t successes;
+	uint64_t failures;
+	unsigned consecutive_failures;
+	std::chrono::steady_clock::time_point retry_after;
+};
+// Keeps connections to work_peers open between requests and tracks how quickly and reliably each one answers
+class work_peer_client
+{
+public:
+	work_peer_client (rai::node &);
+	// Healthy peers, fastest first
+	std::vector <rai::tcp_endpoint> select ();
+	void request (rai::tcp_endpoint const &, std::string const &, std::function <void (bool, std::string const &)> const &);
+	std::shared_ptr <boost::asio::ip::tcp::socket> connection (rai::tcp_endpoint const &);
+	void release (rai::tcp_endpoint const &, std::shared_ptr <boost::asio::ip::tcp::socket>);
+	void success (rai::tcp_endpoint const &, std::chrono::microseconds);
+	void failure (rai::tcp_endpoint const &);
+	void stop ();
+	std::mutex mutex;
+	std::map <rai::tcp_endpoint, rai::work_peer> peers;
+	rai::node & node;
+	static size_t constexpr max_fanout = 4;
+	static size_t constexpr max_idle = 4;
+	// Peers failing this many times in a row are skipped until backoff has passed
+	static unsigned constexpr failure_limit = 3;
+	static std::chrono::seconds constexpr backoff = std::chrono::seconds (rai::rai_network == rai::rai_networks::rai_test_network ? 1 : 60);
+};
+// Copies the block store to a file on a background thread, one copy at a time
+class store_snapshot
+{
+public:
+	store_snapshot (rai::mdb_env &);
+	~store_snapshot ();
+	// Returns true if a copy is already running
+	bool start (boost::filesystem::path const &);
+	void wait ();
+	bool running ();
+	// Written bytes against the pages in use when the copy started, compaction can finish below 1
+	double progress ();
+	void serialize_json (boost::property_tree::ptree &);
+	rai::mdb_env & environment;
+	std::mutex mutex;
+	std::thread thread;
+	boost::filesystem::path path;
+	bool active;
+	bool error;
+	uint64_t estimate;
+	uint64_t size;
+};
 class node : public std::enable_shared_from_this <rai::node>
 {
 public:
@@ -434,17 +527,22 @@ public:
     void ongoing_keepalive ();
 	void ongoing_rep_crawl ();
 	void ongoing_bootstrap ();
+	void ongoing_stats_sample ();
+	void ongoing_prune ();
 	void backup_wallet ();
 	int price (rai::uint128_t const &, int);
 	void generate_work (rai::block &);
-	uint64_t generate_work (rai::uint256_union const &);
-	void generate_work (rai::uint256_union const &, std::function <void (uint64_t)>);
+	uint64_t generate_work (rai::uint256_union const &, rai::work_priority = rai::work_priority::interactive);
+	void generate_work (rai::uint256_union const &, std::function <void (uint64_t)>, rai::work_priority = rai::work_priority::interactive);
 	void add_initial_peers ();
 	rai::node_config config;
     rai::alarm & alarm;
 	rai::work_pool & work;
     boost::log::sources::logger_mt log;
+	rai::stats stats;
+	rai::log_queue log_queue;
     rai::block_store store;
+	rai::store_snapshot snapshot;
     rai::gap_cache gap_cache;
     rai::ledger ledger;
     rai::active_transactions active;
@@ -458,12 +556,57 @@ public:
 	rai::port_mapping port_mapping;
 	rai::vote_processor vote_processor;
 	rai::rep_crawler rep_crawler;
+	rai::work_peer_client work_client;
 	unsigned warmed_up;
+	std::vector <rai::stat_counter *> ledger_results;
+	rai::account prune_cursor;
 	static double constexpr price_max = 16.0;
 	static double constexpr free_cutoff = 1024.0;
     static std::chrono::seconds constexpr period = std::chrono::seconds (60);
     static std::chrono::seconds constexpr cutoff = period * 5;
 	static std::chrono::minutes constexpr backup_interval = std::chrono::minutes (5);
+	static std::chrono::seconds constexpr prune_interval = std::chrono::seconds (rai::rai_network == rai::rai_networks::rai_test_network ? 1 : 300);
+	// Blocks deleted per write transaction so other writers aren't held up
+	static size_t constexpr prune_batch = 1024;
+};
+// Checks every account chain in the store against the account, pending and representation tables
+// Accounts are split into ranges that worker threads take in turn, each worker reads through one transaction
+class ledger_validator
+{
+public:
+	ledger_validator (rai::node &);
+	void run (unsigned);
+	// Returns true if anything failed to check
+	bool report (std::ostream &);
+	// State of one worker thread, signatures and work are checked in batches
+	class worker
+	{
+	public:
+		std::unordered_map <rai::account, rai::uint128_t> weights;
+		std::vector <rai::public_key> accounts;
+		std::vector <rai::block_hash> hashes;
+		std::vector <rai::signature> signatures;
+		std::vector <std::pair <rai::block_hash, uint64_t>> work;
+	};
+	// A zero end runs to the last account
+	void validate_range (MDB_txn *, rai::account const &, rai::account const &, rai::ledger_validator::worker &);
+	void validate_account (MDB_txn *, rai::account const &, rai::account_info const &, rai::ledger_validator::worker &);
+	void validate_pending (MDB_txn *, rai::pending_key const &, rai::pending_info const &);
+	void flush (rai::ledger_validator::worker &);
+	void error (std::string const &, std::string const &);
+	rai::node & node;
+	std::mutex mutex;
+	std::map <std::string, uint64_t> failures; // Count per kind of check
+	std::vector <std::string> messages; // The first few failures in detail
+	std::atomic <uint64_t> accounts;
+	std::atomic <uint64_t> blocks;
+	std::atomic <uint64_t> sends;
+	std::atomic <uint64_t> receives;
+	std::atomic <uint64_t> pending;
+	std::chrono::steady_clock::duration elapsed;
+	static size_t constexpr ranges_per_thread = 16;
+	static size_t constexpr message_limit = 100;
+	static size_t constexpr signature_batch = 256;
 };
 class thread_runner
 {
@@ -475,6 +618,8 @@ public:
 };
 void add_node_options (boost::program_options::options_description &);
 bool handle_node_options (boost::program_options::variables_map &);
+// Rewrites the store at the given path without its free pages, nothing may have it open
+bool compact_store (boost::filesystem::path const &);
 class inactive_node
 {
 public:
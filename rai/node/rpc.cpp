@@ -1,16 +1,13 @@
 #include <rai/node/rpc.hpp>
 
 #include <rai/node/node.hpp>
+#include <rai/trace.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <ed25519-donna/ed25519.h>
 
 rai::rpc_config::rpc_config () :
-address (boost::asio::ip::address_v6::loopback ()),
-port (rai::rpc::rpc_port),
-enable_control (false),
-frontier_request_limit (16384),
-chain_request_limit (16384)
+rpc_config (false)
 {
 }
 
@@ -19,7 +16,14 @@ address (boost::asio::ip::address_v6::loopback ()),
 port (rai::rpc::rpc_port),
 enable_control (enable_control_a),
 frontier_request_limit (16384),
-chain_request_limit (16384)
+chain_request_limit (16384),
+batch_request_limit (4096),
+max_connections (64),
+idle_timeout (30),
+io_threads (2),
+worker_threads (4),
+worker_queue_limit (64),
+action_limits ({ {"accounts_balances", 2}, {"accounts_frontiers", 2}, {"accounts_pending", 2}, {"blocks_info", 2}, {"chain", 2}, {"frontiers", 1}, {"history", 2}, {"pending", 2}, {"wallet_export", 1} })
 {
 }
 
@@ -30,6 +34,18 @@ void rai::rpc_config::serialize_json (boost::property_tree::ptree & tree_a) cons
     tree_a.put ("enable_control", enable_control);
 	tree_a.put ("frontier_request_limit", frontier_request_limit);
 	tree_a.put ("chain_request_limit", chain_request_limit);
+	tree_a.put ("batch_request_limit", batch_request_limit);
+	tree_a.put ("max_connections", max_connections);
+	tree_a.put ("idle_timeout", idle_timeout);
+	tree_a.put ("io_threads", io_threads);
+	tree_a.put ("worker_threads", worker_threads);
+	tree_a.put ("worker_queue_limit", worker_queue_limit);
+	boost::property_tree::ptree action_limits_l;
+	for (auto & i: action_limits)
+	{
+		action_limits_l.put (i.first, i.second);
+	}
+	tree_a.add_child ("action_limits", action_limits_l);
 }
 
 bool rai::rpc_config::deserialize_json (boost::property_tree::ptree const & tree_a)
@@ -42,12 +58,57 @@ bool rai::rpc_config::deserialize_json (boost::property_tree::ptree const & tree
 		enable_control = tree_a.get <bool> ("enable_control");
 		auto frontier_request_limit_l (tree_a.get <std::string> ("frontier_request_limit"));
 		auto chain_request_limit_l (tree_a.get <std::string> ("chain_request_limit"));
+		auto batch_request_limit_l (tree_a.get_optional <std::string> ("batch_request_limit"));
+		auto max_connections_l (tree_a.get_optional <std::string> ("max_connections"));
+		auto idle_timeout_l (tree_a.get_optional <std::string> ("idle_timeout"));
+		auto io_threads_l (tree_a.get_optional <std::string> ("io_threads"));
+		auto worker_threads_l (tree_a.get_optional <std::string> ("worker_threads"));
+		auto worker_queue_limit_l (tree_a.get_optional <std::string> ("worker_queue_limit"));
+		auto action_limits_l (tree_a.get_child_optional ("action_limits"));
 		try
 		{
 			port = std::stoul (port_l);
 			result = port > std::numeric_limits <uint16_t>::max ();
 			frontier_request_limit = std::stoull (frontier_request_limit_l);
 			chain_request_limit = std::stoull (chain_request_limit_l);
+			if (batch_request_limit_l)
+			{
+				batch_request_limit = std::stoull (batch_request_limit_l.get ());
+			}
+			if (max_connections_l)
+			{
+				max_connections = std::stoul (max_connections_l.get ());
+			}
+			if (idle_timeout_l)
+			{
+				idle_timeout = std::stoul (idle_timeout_l.get ());
+			}
+			if (io_threads_l)
+			{
+				io_threads = std::stoul (io_threads_l.get ());
+			}
+			if (worker_threads_l)
+			{
+				worker_threads = std::stoul (worker_threads_l.get ());
+			}
+			if (worker_queue_limit_l)
+			{
+				worker_queue_limit = std::stoull (worker_queue_limit_l.get ());
+			}
+			if (action_limits_l)
+			{
+				action_limits.clear ();
+				for (auto & i: action_limits_l.get ())
+				{
+					action_limits [i.first] = std::stoul (i.second.data ());
+				}
+			}
+			// A pooled action with no workers or a zero limit would never run
+			result |= worker_threads == 0 && !action_limits.empty ();
+			for (auto & i: action_limits)
+			{
+				result |= i.second == 0;
+			}
 		}
 		catch (std::logic_error const &)
 		{
@@ -67,31 +128,109 @@ bool rai::rpc_config::deserialize_json (boost::property_tree::ptree const & tree
 	return result;
 }
 
+std::unordered_set <std::string> const rai::rpc::replica_actions ({ "account_balance", "account_representative", "account_weight", "accounts_balances", "accounts_frontiers", "accounts_pending", "available_supply", "block", "block_account", "block_count", "blocks_info", "chain", "frontier_count", "frontiers", "history", "krai_from_raw", "krai_to_raw", "mrai_from_raw", "mrai_to_raw", "pending", "rai_from_raw", "rai_to_raw", "stats", "validate_account_number", "version" });
+
 rai::rpc::rpc (boost::asio::io_service & service_a, rai::node & node_a, rai::rpc_config const & config_a) :
-acceptor (service_a),
 config (config_a),
-node (node_a)
+service (config_a.io_threads == 0 ? service_a : local_service),
+acceptor (service),
+node (node_a),
+workers (config),
+on (false)
 {
 	auto endpoint (rai::tcp_endpoint (config_a.address, config_a.port));
 	acceptor.open (endpoint.protocol ());
     acceptor.set_option (boost::asio::ip::tcp::acceptor::reuse_address (true));
+#ifdef SO_REUSEPORT
+	if (node_a.store.environment.read_only)
+	{
+		// Replicas on one host can share a port and have the kernel spread connections between them
+		acceptor.set_option (boost::asio::detail::socket_option::boolean <SOL_SOCKET, SO_REUSEPORT> (true));
+	}
+#endif
 	acceptor.bind (endpoint);
 	acceptor.listen ();
-	node_a.observers.blocks.add ([this] (rai::block const & block_a, rai::account const & account_a, rai::amount const &)
+	node_a.observers.blocks.add ([this] (rai::block const & block_a, rai::account const & account_a, rai::amount const & amount_a)
 	{
 		observer_action (account_a);
+		publish ("blocks", block_a, account_a, amount_a);
+	});
+	node_a.observers.elections.add ([this] (rai::block const & block_a, rai::account const & account_a)
+	{
+		if (!account_a.is_zero ())
+		{
+			rai::transaction transaction (node.store.environment, nullptr, false);
+			if (node.store.block_exists (transaction, block_a.hash ()))
+			{
+				publish ("confirmations", block_a, account_a, node.ledger.amount (transaction, block_a.hash ()));
+			}
+		}
 	});
 }
 
+rai::rpc::~rpc ()
+{
+	stop ();
+	for (auto & i: threads)
+	{
+		i.join ();
+	}
+}
+
 void rai::rpc::start ()
+{
+	accept ();
+	if (!on)
+	{
+		on = true;
+		// Runs until stop, an accept is always outstanding
+		for (unsigned i (0); i < config.io_threads; ++i)
+		{
+			threads.push_back (std::thread ([this] ()
+			{
+				try
+				{
+					local_service.run ();
+				}
+				catch (...)
+				{
+					assert (false && "Unhandled RPC service exception");
+				}
+			}));
+		}
+	}
+}
+
+void rai::rpc::accept ()
 {
 	auto connection (std::make_shared <rai::rpc_connection> (node, *this));
 	acceptor.async_accept (connection->socket, [this, connection] (boost::system::error_code const & ec)
 	{
 		if (!ec)
 		{
-			start ();
-			connection->parse_connection ();
+			accept ();
+			auto accepted (false);
+			{
+				std::lock_guard <std::mutex> lock (mutex);
+				connections.erase (std::remove_if (connections.begin (), connections.end (), [] (std::weak_ptr <rai::rpc_connection> const & connection_a) { return connection_a.expired (); }), connections.end ());
+				if (connections.size () < config.max_connections)
+				{
+					connections.push_back (connection);
+					accepted = true;
+				}
+			}
+			if (accepted)
+			{
+				connection->parse_connection ();
+			}
+			else
+			{
+				if (node.config.logging.log_rpc ())
+				{
+					BOOST_LOG (node.log) << boost::str (boost::format ("Refusing RPC connection, limit of %1% reached") % config.max_connections);
+				}
+				connection->close ();
+			}
 		}
 		else
 		{
@@ -103,14 +242,254 @@ void rai::rpc::start ()
 void rai::rpc::stop ()
 {
 	acceptor.close ();
+	std::vector <std::shared_ptr <rai::rpc_connection>> connections_l;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		for (auto & i: connections)
+		{
+			auto connection (i.lock ());
+			if (connection != nullptr)
+			{
+				connections_l.push_back (connection);
+			}
+		}
+		connections.clear ();
+	}
+	for (auto & i: connections_l)
+	{
+		std::lock_guard <std::mutex> lock (i->mutex);
+		i->close ();
+	}
+	workers.stop ();
+	if (config.io_threads > 0)
+	{
+		local_service.stop ();
+	}
 }
 
-rai::rpc_handler::rpc_handler (rai::node & node_a, rai::rpc & rpc_a, std::string const & body_a, std::function <void (boost::property_tree::ptree const &)> const & response_a) :
+rai::rpc_handler::rpc_handler (rai::node & node_a, rai::rpc & rpc_a, std::string const & body_a, std::function <void (boost::property_tree::ptree const &)> const & response_a, std::function <void (std::string)> const & response_json_a) :
 body (body_a),
 node (node_a),
 rpc (rpc_a),
-response (response_a)
+response (response_a),
+response_json (response_json_a)
+{
+}
+
+rai::json_writer::json_writer (std::string & output_a) :
+output (output_a)
+{
+}
+
+void rai::json_writer::begin_object (std::string const & key_a)
+{
+	key (key_a);
+	output.push_back ('{');
+	empty.push_back (true);
+}
+
+void rai::json_writer::end_object ()
+{
+	assert (!empty.empty ());
+	empty.pop_back ();
+	output.push_back ('}');
+}
+
+void rai::json_writer::begin_array (std::string const & key_a)
+{
+	key (key_a);
+	output.push_back ('[');
+	empty.push_back (true);
+}
+
+void rai::json_writer::end_array ()
+{
+	assert (!empty.empty ());
+	empty.pop_back ();
+	output.push_back (']');
+}
+
+void rai::json_writer::put (std::string const & key_a, std::string const & value_a)
 {
+	key (key_a);
+	string (value_a);
+}
+
+void rai::json_writer::put_child (std::string const & key_a, boost::property_tree::ptree const & tree_a)
+{
+	if (tree_a.empty ())
+	{
+		put (key_a, tree_a.data ());
+	}
+	else if (tree_a.count (std::string ()) == tree_a.size ())
+	{
+		begin_array (key_a);
+		for (auto & i: tree_a)
+		{
+			put_child (std::string (), i.second);
+		}
+		end_array ();
+	}
+	else
+	{
+		begin_object (key_a);
+		for (auto & i: tree_a)
+		{
+			put_child (i.first, i.second);
+		}
+		end_object ();
+	}
+}
+
+// Starts the next element of the enclosing object or array, array elements pass an empty key
+void rai::json_writer::key (std::string const & key_a)
+{
+	if (!empty.empty ())
+	{
+		if (!empty.back ())
+		{
+			output.push_back (',');
+		}
+		empty.back () = false;
+	}
+	if (!key_a.empty ())
+	{
+		string (key_a);
+		output.push_back (':');
+	}
+}
+
+void rai::json_writer::string (std::string const & value_a)
+{
+	output.push_back ('"');
+	for (auto i: value_a)
+	{
+		switch (i)
+		{
+			case '"':
+				output.append ("\\\"");
+				break;
+			case '\\':
+				output.append ("\\\\");
+				break;
+			case '\n':
+				output.append ("\\n");
+				break;
+			case '\r':
+				output.append ("\\r");
+				break;
+			case '\t':
+				output.append ("\\t");
+				break;
+			default:
+				if (static_cast <unsigned char> (i) < 0x20)
+				{
+					output.append (boost::str (boost::format ("\\u%04x") % static_cast <unsigned> (i)));
+				}
+				else
+				{
+					output.push_back (i);
+				}
+				break;
+		}
+	}
+	output.push_back ('"');
+}
+
+rai::rpc_action_stats::rpc_action_stats () :
+completed (0),
+rejected (0),
+wait_total (0),
+wait_max (0),
+execution_total (0),
+execution_max (0)
+{
+}
+
+rai::rpc_workers::rpc_workers (rai::rpc_config const & config_a) :
+config (config_a),
+stopped (false)
+{
+	for (unsigned i (0); i < config.worker_threads; ++i)
+	{
+		threads.push_back (std::thread ([this] ()
+		{
+			run ();
+		}));
+	}
+}
+
+rai::rpc_workers::~rpc_workers ()
+{
+	stop ();
+	for (auto & i: threads)
+	{
+		i.join ();
+	}
+}
+
+bool rai::rpc_workers::push (std::string const & action_a, std::function <void ()> const & function_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto result (stopped || queue.size () >= config.worker_queue_limit);
+	if (!result)
+	{
+		queue.push_back (rai::rpc_work ({ action_a, std::chrono::steady_clock::now (), function_a }));
+		condition.notify_all ();
+	}
+	else
+	{
+		++stats [action_a].rejected;
+	}
+	return result;
+}
+
+void rai::rpc_workers::run ()
+{
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!stopped)
+	{
+		// Oldest request whose action is under its limit, others keep their place in line
+		auto work (std::find_if (queue.begin (), queue.end (), [this] (rai::rpc_work const & work_a)
+		{
+			auto limit (config.action_limits.find (work_a.action));
+			return limit == config.action_limits.end () || running [work_a.action] < limit->second;
+		}));
+		if (work != queue.end ())
+		{
+			auto work_l (std::move (*work));
+			queue.erase (work);
+			++running [work_l.action];
+			lock.unlock ();
+			auto begin (std::chrono::steady_clock::now ());
+			work_l.function ();
+			auto end (std::chrono::steady_clock::now ());
+			lock.lock ();
+			--running [work_l.action];
+			auto & stats_l (stats [work_l.action]);
+			auto wait (std::chrono::duration_cast <std::chrono::microseconds> (begin - work_l.queued));
+			auto execution (std::chrono::duration_cast <std::chrono::microseconds> (end - begin));
+			++stats_l.completed;
+			stats_l.wait_total += wait;
+			stats_l.wait_max = std::max (stats_l.wait_max, wait);
+			stats_l.execution_total += execution;
+			stats_l.execution_max = std::max (stats_l.execution_max, execution);
+			// A slot for this action opened up, a worker may be waiting on it
+			condition.notify_all ();
+		}
+		else
+		{
+			condition.wait (lock);
+		}
+	}
+}
+
+void rai::rpc_workers::stop ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	stopped = true;
+	queue.clear ();
+	condition.notify_all ();
 }
 
 void rai::rpc::observer_action (rai::account const & account_a)
@@ -130,6 +509,50 @@ void rai::rpc::observer_action (rai::account const & account_a)
 	}
 }
 
+// Called from node threads, only formats the event and queues it for interested subscribers
+void rai::rpc::publish (std::string const & topic_a, rai::block const & block_a, rai::account const & account_a, rai::amount const & amount_a)
+{
+	std::vector <std::shared_ptr <rai::rpc_subscription>> targets;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		for (auto i (subscriptions.begin ()); i != subscriptions.end ();)
+		{
+			auto subscription (i->lock ());
+			if (subscription != nullptr)
+			{
+				if (subscription->wants (topic_a, account_a))
+				{
+					targets.push_back (subscription);
+				}
+				++i;
+			}
+			else
+			{
+				i = subscriptions.erase (i);
+			}
+		}
+	}
+	if (!targets.empty ())
+	{
+		std::string contents;
+		block_a.serialize_json (contents);
+		std::string event;
+		rai::json_writer writer (event);
+		writer.begin_object ();
+		writer.put ("topic", topic_a);
+		writer.put ("account", account_a.to_account ());
+		writer.put ("hash", block_a.hash ().to_string ());
+		writer.put ("amount", amount_a.number ().convert_to <std::string> ());
+		writer.put ("block", contents);
+		writer.end_object ();
+		event.push_back ('\n');
+		for (auto & i: targets)
+		{
+			i->push (event);
+		}
+	}
+}
+
 namespace
 {
 void error_response (std::function <void (boost::property_tree::ptree const &)> response_a, std::string const & message_a)
@@ -283,8 +706,11 @@ void rai::rpc_handler::account_move ()
 							account.decode_hex (i->second.get <std::string> (""));
 							accounts.push_back (account);
 						}
-						rai::transaction transaction (node.store.environment, nullptr, true);
-						auto error (wallet->store.move (transaction, source->store, accounts));
+						auto error (false);
+						{
+							rai::transaction transaction (node.store.environment, nullptr, true);
+							error = wallet->store.move (transaction, source->store, accounts);
+						}
 						boost::property_tree::ptree response_l;
 						response_l.put ("moved", error ? "0" : "1");
 						response (response_l);
@@ -412,6 +838,116 @@ void rai::rpc_handler::account_weight ()
 	}
 }
 
+// Decodes the "accounts" array of a batch request, answering with an error if it's malformed or too long
+bool rai::rpc_handler::batch_accounts (std::vector <rai::account> & accounts_a)
+{
+	auto result (false);
+	auto & accounts_l (request.get_child ("accounts"));
+	if (accounts_l.size () <= rpc.config.batch_request_limit)
+	{
+		accounts_a.reserve (accounts_l.size ());
+		for (auto i (accounts_l.begin ()), n (accounts_l.end ()); i != n && !result; ++i)
+		{
+			rai::account account;
+			result = account.decode_account (i->second.get <std::string> (""));
+			accounts_a.push_back (account);
+		}
+		if (result)
+		{
+			error_response (response, "Bad account number");
+		}
+	}
+	else
+	{
+		result = true;
+		error_response (response, "Too many items in batch");
+	}
+	return result;
+}
+
+void rai::rpc_handler::accounts_balances ()
+{
+	std::vector <rai::account> accounts;
+	if (!batch_accounts (accounts))
+	{
+		std::string body_l;
+		rai::json_writer writer (body_l);
+		writer.begin_object ();
+		writer.begin_object ("balances");
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		for (auto & i: accounts)
+		{
+			writer.begin_object (i.to_account ());
+			writer.put ("balance", node.ledger.account_balance (transaction, i).convert_to <std::string> ());
+			writer.put ("pending", node.ledger.account_pending (transaction, i).convert_to <std::string> ());
+			writer.end_object ();
+		}
+		writer.end_object ();
+		writer.end_object ();
+		response_json (std::move (body_l));
+	}
+}
+
+void rai::rpc_handler::accounts_frontiers ()
+{
+	std::vector <rai::account> accounts;
+	if (!batch_accounts (accounts))
+	{
+		std::string body_l;
+		rai::json_writer writer (body_l);
+		writer.begin_object ();
+		writer.begin_object ("frontiers");
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		for (auto & i: accounts)
+		{
+			rai::account_info info;
+			if (!node.store.account_get (transaction, i, info))
+			{
+				writer.put (i.to_account (), info.head.to_string ());
+			}
+		}
+		writer.end_object ();
+		writer.end_object ();
+		response_json (std::move (body_l));
+	}
+}
+
+void rai::rpc_handler::accounts_pending ()
+{
+	std::vector <rai::account> accounts;
+	if (!batch_accounts (accounts))
+	{
+		std::string count_text (request.get <std::string> ("count"));
+		uint64_t count;
+		if (!decode_unsigned (count_text, count))
+		{
+			std::string body_l;
+			rai::json_writer writer (body_l);
+			writer.begin_object ();
+			writer.begin_object ("blocks");
+			rai::transaction transaction (node.store.environment, nullptr, false);
+			for (auto & i: accounts)
+			{
+				writer.begin_array (i.to_account ());
+				rai::account end (i.number () + 1);
+				uint64_t written (0);
+				for (auto j (node.store.pending_begin (transaction, rai::pending_key (i, 0))), n (node.store.pending_begin (transaction, rai::pending_key (end, 0))); j != n && written < count; ++j, ++written)
+				{
+					writer.put ("", rai::pending_key (j->first).hash.to_string ());
+				}
+				writer.end_array ();
+			}
+			writer.end_object ();
+			writer.end_object ();
+			response_json (std::move (body_l));
+		}
+		else
+		{
+			error_response (response, "Invalid count limit");
+		}
+	}
+}
+
 void rai::rpc_handler::available_supply ()
 {
 	auto genesis_balance (node.balance (rai::genesis_account)); // Cold storage genesis
@@ -485,6 +1021,64 @@ void rai::rpc_handler::block_count ()
 	response (response_l);
 }
 
+void rai::rpc_handler::blocks_info ()
+{
+	auto & hashes_l (request.get_child ("hashes"));
+	if (hashes_l.size () <= rpc.config.batch_request_limit)
+	{
+		std::vector <rai::block_hash> hashes;
+		hashes.reserve (hashes_l.size ());
+		auto error (false);
+		for (auto i (hashes_l.begin ()), n (hashes_l.end ()); i != n && !error; ++i)
+		{
+			rai::block_hash hash;
+			error = hash.decode_hex (i->second.get <std::string> (""));
+			hashes.push_back (hash);
+		}
+		if (!error)
+		{
+			std::string body_l;
+			rai::json_writer writer (body_l);
+			writer.begin_object ();
+			writer.begin_object ("blocks");
+			rai::transaction transaction (node.store.environment, nullptr, false);
+			for (auto i (hashes.begin ()), n (hashes.end ()); i != n && !error; ++i)
+			{
+				auto block (node.store.block_get (transaction, *i));
+				if (block != nullptr)
+				{
+					std::string contents;
+					block->serialize_json (contents);
+					writer.begin_object (i->to_string ());
+					writer.put ("account", node.ledger.account (transaction, *i).to_account ());
+					writer.put ("amount", node.ledger.amount (transaction, *i).convert_to <std::string> ());
+					writer.put ("contents", contents);
+					writer.end_object ();
+				}
+				else
+				{
+					error = true;
+					error_response (response, boost::str (boost::format ("Block not found: %1%") % i->to_string ()));
+				}
+			}
+			if (!error)
+			{
+				writer.end_object ();
+				writer.end_object ();
+				response_json (std::move (body_l));
+			}
+		}
+		else
+		{
+			error_response (response, "Invalid block hash");
+		}
+	}
+	else
+	{
+		error_response (response, "Too many items in batch");
+	}
+}
+
 void rai::rpc_handler::bootstrap ()
 {
 	std::string address_text = request.get <std::string> ("address");
@@ -512,67 +1106,125 @@ void rai::rpc_handler::bootstrap ()
 	}
 }
 
+// Finds where a walk along an account chain starts: the cursor returned with a previous page, a block at some height of an account, or the hash in field_a
+bool rai::rpc_handler::chain_start (MDB_txn * transaction_a, std::string const & field_a, rai::block_hash & start_a)
+{
+	auto result (false);
+	auto cursor_text (request.get_optional <std::string> ("cursor"));
+	auto height_text (request.get_optional <std::string> ("height"));
+	if (cursor_text)
+	{
+		result = start_a.decode_hex (cursor_text.get ());
+		if (result)
+		{
+			error_response (response, "Invalid cursor");
+		}
+	}
+	else if (height_text)
+	{
+		std::string account_text (request.get <std::string> ("account"));
+		rai::account account;
+		result = account.decode_account (account_text);
+		if (!result)
+		{
+			uint64_t height;
+			result = decode_unsigned (height_text.get (), height);
+			if (!result)
+			{
+				start_a = node.store.height_get (transaction_a, account, height);
+			}
+			else
+			{
+				error_response (response, "Invalid height");
+			}
+		}
+		else
+		{
+			error_response (response, "Bad account number");
+		}
+	}
+	else
+	{
+		std::string hash_text (request.get <std::string> (field_a));
+		result = start_a.decode_hex (hash_text);
+		if (result)
+		{
+			error_response (response, "Invalid block hash");
+		}
+	}
+	return result;
+}
+
 void rai::rpc_handler::chain ()
 {
-	std::string block_text (request.get <std::string> ("block"));
 	std::string count_text (request.get <std::string> ("count"));
+	auto reverse (request.get <bool> ("reverse", false));
+	rai::transaction transaction (node.store.environment, nullptr, false);
 	rai::block_hash block;
-	if (!block.decode_hex (block_text))
+	if (!chain_start (transaction, "block", block))
 	{
 		uint64_t count;
 		if (!decode_unsigned (count_text, count))
 		{
-			boost::property_tree::ptree response_l;
-			boost::property_tree::ptree blocks;
-			rai::transaction transaction (node.store.environment, nullptr, false);
-			while (!block.is_zero () && blocks.size () < count)
+			std::string body_l;
+			rai::json_writer writer (body_l);
+			writer.begin_object ();
+			writer.begin_array ("blocks");
+			if (!node.store.block_exists (transaction, block))
 			{
-				auto block_l (node.store.block_get (transaction, block));
-				if (block_l != nullptr)
-				{
-					boost::property_tree::ptree entry;
-					entry.put ("", block.to_string ());
-					blocks.push_back (std::make_pair ("", entry));
-					block = block_l->previous ();
-				}
-				else
-				{
-					block.clear ();
-				}
+				block.clear ();
 			}
-			response_l.add_child ("blocks", blocks);
-			response (response_l);
+			// Links are read out of the stored blocks, nothing is deserialized
+			for (uint64_t written (0); !block.is_zero () && written < count; ++written)
+			{
+				writer.put ("", block.to_string ());
+				block = reverse ? node.store.block_successor (transaction, block) : node.store.block_previous (transaction, block);
+			}
+			writer.end_array ();
+			if (!block.is_zero ())
+			{
+				writer.put ("cursor", block.to_string ());
+			}
+			writer.end_object ();
+			response_json (std::move (body_l));
 		}
 		else
 		{
 			error_response (response, "Invalid count limit");
 		}
 	}
-	else
-	{
-		error_response (response, "Invalid block hash");
-	}
 }
 
 void rai::rpc_handler::frontiers ()
 {
-	std::string account_text (request.get <std::string> ("account"));
+	auto cursor_text (request.get_optional <std::string> ("cursor"));
 	std::string count_text (request.get <std::string> ("count"));
 	rai::account start;
-	if (!start.decode_account (account_text))
+	auto error (cursor_text ? start.decode_hex (cursor_text.get ()) : start.decode_account (request.get <std::string> ("account")));
+	if (!error)
 	{
 		uint64_t count;
 		if (!decode_unsigned (count_text, count))
 		{
-			boost::property_tree::ptree response_l;
-			boost::property_tree::ptree frontiers;
+			std::string body_l;
+			rai::json_writer writer (body_l);
+			writer.begin_object ();
+			writer.begin_object ("frontiers");
 			rai::transaction transaction (node.store.environment, nullptr, false);
-			for (auto i (node.store.latest_begin (transaction, start)), n (node.store.latest_end ()); i != n && frontiers.size () < count; ++i)
+			uint64_t written (0);
+			auto i (node.store.latest_begin (transaction, start));
+			auto n (node.store.latest_end ());
+			for (; i != n && written < count; ++i, ++written)
 			{
-				frontiers.put (rai::account (i->first).to_account (), rai::account_info (i->second).head.to_string ());
+				writer.put (rai::account (i->first).to_account (), rai::account_info (i->second).head.to_string ());
 			}
-			response_l.add_child ("frontiers", frontiers);
-			response (response_l);
+			writer.end_object ();
+			if (i != n)
+			{
+				writer.put ("cursor", rai::account (i->first).to_string ());
+			}
+			writer.end_object ();
+			response_json (std::move (body_l));
 		}
 		else
 		{
@@ -581,7 +1233,7 @@ void rai::rpc_handler::frontiers ()
 	}
 	else
 	{
-		error_response (response, "Invalid starting account");
+		error_response (response, cursor_text ? "Invalid cursor" : "Invalid starting account");
 	}
 }
 
@@ -596,98 +1248,103 @@ void rai::rpc_handler::frontier_count ()
 
 namespace
 {
-class history_visitor : public rai::block_visitor
-{
-public:
-	history_visitor (rai::rpc_handler & handler_a, rai::transaction & transaction_a, boost::property_tree::ptree & tree_a, rai::block_hash const & hash_a) :
-	handler (handler_a),
-	transaction (transaction_a),
-	tree (tree_a),
-	hash (hash_a)
-	{
-	}
-	void send_block (rai::send_block const & block_a)
-	{
-		tree.put ("type", "send");
-		auto account (block_a.hashables.destination.to_account ());
-		tree.put ("account", account);
-		auto amount (handler.node.ledger.amount (transaction, hash).convert_to <std::string> ());
-		tree.put ("amount", amount);
-	}
-	void receive_block (rai::receive_block const & block_a)
-	{
-		tree.put ("type", "receive");
-		auto account (handler.node.ledger.account (transaction, block_a.hashables.source).to_account ());
-		tree.put ("account", account);
-		auto amount (handler.node.ledger.amount (transaction, hash).convert_to <std::string> ());
-		tree.put ("amount", amount);
-	}
-	void open_block (rai::open_block const & block_a)
-	{
-		// Report opens as a receive
-		tree.put ("type", "receive");
-		if (block_a.hashables.source != rai::genesis_account)
-		{
-			tree.put ("account", handler.node.ledger.account (transaction, block_a.hashables.source).to_account ());
-			tree.put ("amount", handler.node.ledger.amount (transaction, hash).convert_to <std::string> ());
-		}
-		else
-		{
-			tree.put ("account", rai::genesis_account.to_account ());
-			tree.put ("amount", rai::genesis_amount.convert_to <std::string> ());
-		}
-	}
-	void change_block (rai::change_block const &)
-	{
-		// Don't report change blocks
+// Fills in what history reports for a block, change blocks are left empty
+void history_entry (rai::node & node_a, MDB_txn * transaction_a, rai::block_view const & block_a, rai::block_hash const & hash_a, boost::property_tree::ptree & tree_a)
+{
+	switch (block_a.type ())
+	{
+		case rai::block_type::send:
+			tree_a.put ("type", "send");
+			tree_a.put ("account", block_a.destination ().to_account ());
+			tree_a.put ("amount", node_a.ledger.amount (transaction_a, hash_a).convert_to <std::string> ());
+			break;
+		case rai::block_type::receive:
+			tree_a.put ("type", "receive");
+			tree_a.put ("account", node_a.ledger.account (transaction_a, block_a.source ()).to_account ());
+			tree_a.put ("amount", node_a.ledger.amount (transaction_a, hash_a).convert_to <std::string> ());
+			break;
+		case rai::block_type::open:
+			// Report opens as a receive
+			tree_a.put ("type", "receive");
+			if (block_a.source () != rai::genesis_account)
+			{
+				tree_a.put ("account", node_a.ledger.account (transaction_a, block_a.source ()).to_account ());
+				tree_a.put ("amount", node_a.ledger.amount (transaction_a, hash_a).convert_to <std::string> ());
+			}
+			else
+			{
+				tree_a.put ("account", rai::genesis_account.to_account ());
+				tree_a.put ("amount", rai::genesis_amount.convert_to <std::string> ());
+			}
+			break;
+		default:
+			break;
 	}
-	rai::rpc_handler & handler;
-	rai::transaction & transaction;
-	boost::property_tree::ptree & tree;
-	rai::block_hash const & hash;
-};
+}
 }
 
 void rai::rpc_handler::history ()
 {
-	std::string hash_text (request.get <std::string> ("hash"));
 	std::string count_text (request.get <std::string> ("count"));
+	auto hashes_only (request.get <bool> ("hashes_only", false));
+	auto reverse (request.get <bool> ("reverse", false));
+	rai::transaction transaction (node.store.environment, nullptr, false);
 	rai::block_hash hash;
-	if (!hash.decode_hex (hash_text))
+	if (!chain_start (transaction, "hash", hash))
 	{
 		uint64_t count;
 		if (!decode_unsigned (count_text, count))
 		{
-			boost::property_tree::ptree response_l;
-			boost::property_tree::ptree history;
-			rai::transaction transaction (node.store.environment, nullptr, false);
-			auto block (node.store.block_get (transaction, hash));
-			while (block != nullptr && count > 0)
+			std::string body_l;
+			rai::json_writer writer (body_l);
+			writer.begin_object ();
+			writer.begin_array ("history");
+			if (hashes_only)
 			{
-				boost::property_tree::ptree entry;
-				history_visitor visitor (*this, transaction, entry, hash);
-				block->visit (visitor);
-				if (!entry.empty ())
+				if (!node.store.block_exists (transaction, hash))
+				{
+					hash.clear ();
+				}
+				for (; !hash.is_zero () && count > 0; --count)
 				{
-					entry.put ("hash", hash.to_string ());
-					history.push_back (std::make_pair ("", entry));
+					writer.put ("", hash.to_string ());
+					hash = reverse ? node.store.block_successor (transaction, hash) : node.store.block_previous (transaction, hash);
 				}
-				hash = block->previous ();
-				block = node.store.block_get (transaction, hash);
-				--count;
 			}
-			response_l.add_child ("history", history);
-			response (response_l);
+			else
+			{
+				auto block (node.store.block_get_view (transaction, hash));
+				while (block.valid () && count > 0)
+				{
+					boost::property_tree::ptree entry;
+					history_entry (node, transaction, block, hash, entry);
+					if (!entry.empty ())
+					{
+						entry.put ("hash", hash.to_string ());
+						writer.put_child ("", entry);
+					}
+					hash = reverse ? block.successor () : block.previous ();
+					block = node.store.block_get_view (transaction, hash);
+					--count;
+				}
+				if (!block.valid ())
+				{
+					hash.clear ();
+				}
+			}
+			writer.end_array ();
+			if (!hash.is_zero ())
+			{
+				writer.put ("cursor", hash.to_string ());
+			}
+			writer.end_object ();
+			response_json (std::move (body_l));
 		}
 		else
 		{
 			error_response (response, "Invalid count limit");
 		}
 	}
-	else
-	{
-		error_response (response, "Invalid block hash");
-	}
 }
 
 void rai::rpc_handler::keepalive ()
@@ -796,6 +1453,28 @@ void rai::rpc_handler::krai_to_raw ()
 	}
 }
 
+void rai::rpc_handler::mutex_stats ()
+{
+	auto reset (request.get <bool> ("reset", false));
+	if (!reset || rpc.config.enable_control)
+	{
+		boost::property_tree::ptree response_l;
+		response_l.put ("enabled", rai::mutex_stats_enabled);
+		boost::property_tree::ptree mutexes_l;
+		rai::mutexes.serialize_json (mutexes_l);
+		response_l.add_child ("mutexes", mutexes_l);
+		if (reset)
+		{
+			rai::mutexes.reset ();
+		}
+		response (response_l);
+	}
+	else
+	{
+		error_response (response, "RPC control is disabled");
+	}
+}
+
 void rai::rpc_handler::password_change ()
 {
 	if (rpc.config.enable_control)
@@ -808,10 +1487,13 @@ void rai::rpc_handler::password_change ()
 			auto existing (node.wallets.items.find (wallet));
 			if (existing != node.wallets.items.end ())
 			{
-				rai::transaction transaction (node.store.environment, nullptr, true);
 				boost::property_tree::ptree response_l;
 				std::string password_text (request.get <std::string> ("password"));
-				auto error (existing->second->store.rekey (transaction, password_text));
+				auto error (false);
+				{
+					rai::transaction transaction (node.store.environment, nullptr, true);
+					error = existing->second->store.rekey (transaction, password_text);
+				}
 				response_l.put ("changed", error ? "0" : "1");
 				response (response_l);
 			}
@@ -911,21 +1593,38 @@ void rai::rpc_handler::pending ()
 		uint64_t count;
 		if (!decode_unsigned (count_text, count))
 		{
-			boost::property_tree::ptree response_l;
-			boost::property_tree::ptree peers_l;
+			auto cursor_text (request.get_optional <std::string> ("cursor"));
+			rai::block_hash start (0);
+			if (!cursor_text || !start.decode_hex (cursor_text.get ()))
 			{
-				rai::transaction transaction (node.store.environment, nullptr, false);
-				rai::account end (account.number () + 1);
-				for (auto i (node.store.pending_begin (transaction, rai::pending_key (account, 0))), n (node.store.pending_begin (transaction, rai::pending_key (end, 0))); i != n && peers_l.size ()< count; ++i)
+				std::string body_l;
+				rai::json_writer writer (body_l);
+				writer.begin_object ();
+				writer.begin_array ("blocks");
 				{
-					rai::pending_key key (i->first);
-					boost::property_tree::ptree entry;
-					entry.put ("", key.hash.to_string ());
-					peers_l.push_back (std::make_pair ("", entry));
+					rai::transaction transaction (node.store.environment, nullptr, false);
+					rai::account end (account.number () + 1);
+					uint64_t written (0);
+					auto i (node.store.pending_begin (transaction, rai::pending_key (account, start)));
+					auto n (node.store.pending_begin (transaction, rai::pending_key (end, 0)));
+					for (; i != n && written < count; ++i, ++written)
+					{
+						rai::pending_key key (i->first);
+						writer.put ("", key.hash.to_string ());
+					}
+					writer.end_array ();
+					if (i != n)
+					{
+						writer.put ("cursor", rai::pending_key (i->first).hash.to_string ());
+					}
 				}
+				writer.end_object ();
+				response_json (std::move (body_l));
+			}
+			else
+			{
+				error_response (response, "Invalid cursor");
 			}
-			response_l.add_child ("blocks", peers_l);
-			response (response_l);
 		}
 	}
 	else
@@ -943,12 +1642,14 @@ void rai::rpc_handler::payment_begin ()
 		auto existing (node.wallets.items.find (id));
 		if (existing != node.wallets.items.end ())
 		{
-			rai::transaction transaction (node.store.environment, nullptr, true);
 			std::shared_ptr <rai::wallet> wallet (existing->second);
-			if (wallet->store.valid_password (transaction))
+			rai::account account (0);
+			auto locked (false);
 			{
-				rai::account account (0);
-				do
+				// Committed before responding so the client sees the account it's given
+				rai::transaction transaction (node.store.environment, nullptr, true);
+				locked = !wallet->store.valid_password (transaction);
+				while (!locked && account.is_zero ())
 				{
 					auto existing (wallet->free_accounts.begin ());
 					if (existing != wallet->free_accounts.end ())
@@ -974,22 +1675,22 @@ void rai::rpc_handler::payment_begin ()
 						account = wallet->deterministic_insert (transaction);
 						break;
 					}
-				} while (account.is_zero ());
-				if (!account.is_zero ())
-				{
-					boost::property_tree::ptree response_l;
-					response_l.put ("account", account.to_account ());
-					response (response_l);
-				}
-				else
-				{
-					error_response (response, "Unable to create transaction account");
 				}
 			}
-			else
+			if (locked)
 			{
 				error_response (response, "Wallet locked");
 			}
+			else if (!account.is_zero ())
+			{
+				boost::property_tree::ptree response_l;
+				response_l.put ("account", account.to_account ());
+				response (response_l);
+			}
+			else
+			{
+				error_response (response, "Unable to create transaction account");
+			}
 		}
 		else
 		{
@@ -1288,8 +1989,58 @@ void rai::rpc_handler::send ()
 		}
 		else
 		{
-			error_response (response, "Bad wallet number");
+			error_response (response, "Bad wallet number");
+		}
+	}
+	else
+	{
+		error_response (response, "RPC control is disabled");
+	}
+}
+
+void rai::rpc_handler::snapshot ()
+{
+	auto path (request.get_optional <std::string> ("path"));
+	if (!path || rpc.config.enable_control)
+	{
+		auto error (false);
+		if (path)
+		{
+			error = node.snapshot.start (*path);
+		}
+		if (!error)
+		{
+			boost::property_tree::ptree response_l;
+			node.snapshot.serialize_json (response_l);
+			response (response_l);
+		}
+		else
+		{
+			error_response (response, "Snapshot already running");
+		}
+	}
+	else
+	{
+		error_response (response, "RPC control is disabled");
+	}
+}
+
+void rai::rpc_handler::stats ()
+{
+	auto reset (request.get <bool> ("reset", false));
+	if (!reset || rpc.config.enable_control)
+	{
+		if (request.get <bool> ("sample", false))
+		{
+			node.stats.sample ();
 		}
+		boost::property_tree::ptree response_l;
+		node.stats.serialize_json (response_l);
+		if (reset)
+		{
+			node.stats.reset ();
+		}
+		response (response_l);
 	}
 	else
 	{
@@ -1310,6 +2061,51 @@ void rai::rpc_handler::stop ()
 	}
 }
 
+void rai::rpc_handler::subscribe ()
+{
+	if (response_stream)
+	{
+		auto error (false);
+		std::unordered_set <std::string> topics;
+		for (auto & i: request.get_child ("topics"))
+		{
+			auto topic (i.second.get <std::string> (""));
+			error |= topic != "blocks" && topic != "confirmations";
+			topics.insert (topic);
+		}
+		if (!error)
+		{
+			std::unordered_set <rai::account> accounts;
+			auto accounts_l (request.get_child_optional ("accounts"));
+			if (accounts_l)
+			{
+				for (auto i (accounts_l->begin ()), n (accounts_l->end ()); i != n && !error; ++i)
+				{
+					rai::account account;
+					error = account.decode_account (i->second.get <std::string> (""));
+					accounts.insert (account);
+				}
+			}
+			if (!error)
+			{
+				response_stream (std::make_shared <rai::rpc_subscription> (topics, accounts));
+			}
+			else
+			{
+				error_response (response, "Bad account number");
+			}
+		}
+		else
+		{
+			error_response (response, "Unknown topic");
+		}
+	}
+	else
+	{
+		error_response (response, "Subscriptions need an RPC connection to stream on");
+	}
+}
+
 void rai::rpc_handler::version ()
 {
 	boost::property_tree::ptree response_l;
@@ -1319,6 +2115,41 @@ void rai::rpc_handler::version ()
 	response (response_l);
 }
 
+void rai::rpc_handler::trace ()
+{
+	auto enable (request.get_optional <bool> ("enable"));
+	if (!enable || rpc.config.enable_control)
+	{
+		if (enable)
+		{
+			rai::trace.enabled = *enable;
+		}
+		auto since (rai::trace.epoch);
+		auto window (request.get_optional <std::string> ("window"));
+		auto error (false);
+		if (window)
+		{
+			uint64_t window_l;
+			error = decode_unsigned (*window, window_l);
+			since = std::chrono::steady_clock::now () - std::chrono::milliseconds (window_l);
+		}
+		if (!error)
+		{
+			std::stringstream body_l;
+			rai::trace.chrome_json (body_l, since);
+			response_json (body_l.str ());
+		}
+		else
+		{
+			error_response (response, "Bad window number");
+		}
+	}
+	else
+	{
+		error_response (response, "RPC control is disabled");
+	}
+}
+
 void rai::rpc_handler::validate_account_number ()
 {
 	std::string account_text (request.get <std::string> ("account"));
@@ -1562,8 +2393,10 @@ void rai::rpc_handler::wallet_representative_set ()
 				auto error (representative.decode_account (representative_text));
 				if (!error)
 				{
-					rai::transaction transaction (node.store.environment, nullptr, true);
-					existing->second->store.representative_set (transaction, representative);
+					{
+						rai::transaction transaction (node.store.environment, nullptr, true);
+						existing->second->store.representative_set (transaction, representative);
+					}
 					boost::property_tree::ptree response_l;
 					response_l.put ("set", "1");
 					response (response_l);
@@ -1598,7 +2431,7 @@ void rai::rpc_handler::work_generate ()
 		auto error (hash.decode_hex (hash_text));
 		if (!error)
 		{
-			auto work (node.work.generate_maybe (hash));
+			auto work (node.work.generate_maybe (hash, rai::work_priority::rpc));
 			if (work)
 			{
 				boost::property_tree::ptree response_l;
@@ -1645,50 +2478,350 @@ void rai::rpc_handler::work_cancel ()
 	}
 }
 
+void rai::rpc_handler::work_stats ()
+{
+	std::array <rai::work_stats, 3> stats;
+	size_t queued (0);
+	{
+		rai::lock_guard lock (node.work.mutex);
+		stats = node.work.stats;
+		queued = node.work.pending.size ();
+	}
+	std::array <char const *, 3> names ({ "interactive", "rpc", "precache" });
+	boost::property_tree::ptree response_l;
+	response_l.put ("queued", std::to_string (queued));
+	response_l.put ("cache_hits", std::to_string (node.wallets.work_cache_hits.load ()));
+	response_l.put ("cache_misses", std::to_string (node.wallets.work_cache_misses.load ()));
+	for (size_t i (0); i < stats.size (); ++i)
+	{
+		auto & stats_l (stats [i]);
+		boost::property_tree::ptree entry;
+		entry.put ("solved", std::to_string (stats_l.solved));
+		entry.put ("cancelled", std::to_string (stats_l.cancelled));
+		entry.put ("wait_average_us", std::to_string (stats_l.solved > 0 ? stats_l.wait_total.count () / stats_l.solved : 0));
+		entry.put ("wait_max_us", std::to_string (stats_l.wait_max.count ()));
+		entry.put ("solve_average_us", std::to_string (stats_l.solved > 0 ? stats_l.solve_total.count () / stats_l.solved : 0));
+		entry.put ("solve_max_us", std::to_string (stats_l.solve_max.count ()));
+		response_l.add_child (names [i], entry);
+	}
+	response (response_l);
+}
+
+void rai::rpc_handler::worker_stats ()
+{
+	boost::property_tree::ptree response_l;
+	boost::property_tree::ptree actions;
+	{
+		std::lock_guard <std::mutex> lock (rpc.workers.mutex);
+		response_l.put ("queued", std::to_string (rpc.workers.queue.size ()));
+		for (auto & i: rpc.config.action_limits)
+		{
+			auto & stats_l (rpc.workers.stats [i.first]);
+			boost::property_tree::ptree entry;
+			entry.put ("limit", std::to_string (i.second));
+			entry.put ("running", std::to_string (rpc.workers.running [i.first]));
+			entry.put ("completed", std::to_string (stats_l.completed));
+			entry.put ("rejected", std::to_string (stats_l.rejected));
+			entry.put ("wait_average_us", std::to_string (stats_l.completed > 0 ? stats_l.wait_total.count () / stats_l.completed : 0));
+			entry.put ("wait_max_us", std::to_string (stats_l.wait_max.count ()));
+			entry.put ("execution_average_us", std::to_string (stats_l.completed > 0 ? stats_l.execution_total.count () / stats_l.completed : 0));
+			entry.put ("execution_max_us", std::to_string (stats_l.execution_max.count ()));
+			actions.add_child (i.first, entry);
+		}
+	}
+	response_l.add_child ("actions", actions);
+	response (response_l);
+}
+
+rai::rpc_response::rpc_response (bool keep_alive_a) :
+keep_alive (keep_alive_a),
+ready (false)
+{
+}
+
+constexpr size_t rai::rpc_connection::pipeline_limit;
+constexpr size_t rai::rpc_subscription::queue_limit;
+
+rai::rpc_subscription::rpc_subscription (std::unordered_set <std::string> const & topics_a, std::unordered_set <rai::account> const & accounts_a) :
+topics (topics_a),
+accounts (accounts_a),
+dropped (0),
+started (false)
+{
+}
+
+bool rai::rpc_subscription::wants (std::string const & topic_a, rai::account const & account_a) const
+{
+	return topics.find (topic_a) != topics.end () && (accounts.empty () || accounts.find (account_a) != accounts.end ());
+}
+
+void rai::rpc_subscription::push (std::string const & event_a)
+{
+	auto connection_l (connection.lock ());
+	if (connection_l != nullptr)
+	{
+		std::lock_guard <std::mutex> lock (connection_l->mutex);
+		if (events.size () + (dropped > 0 ? 1 : 0) < queue_limit)
+		{
+			if (dropped > 0)
+			{
+				// Tell the client how many events it missed before carrying on
+				events.push_back (boost::str (boost::format ("{\"topic\":\"dropped\",\"count\":\"%1%\"}\n") % dropped));
+				dropped = 0;
+			}
+			events.push_back (event_a);
+			connection_l->write ();
+		}
+		else
+		{
+			++dropped;
+		}
+	}
+}
+
 rai::rpc_connection::rpc_connection (rai::node & node_a, rai::rpc & rpc_a) :
 node (node_a.shared ()),
 rpc (rpc_a),
-socket (node_a.network.service)
+socket (rpc_a.service),
+last_activity (std::chrono::system_clock::now ()),
+reading (false),
+writing (false),
+finished (false),
+closed (false)
 {
 }
 
 void rai::rpc_connection::parse_connection ()
+{
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		reading = true;
+		read ();
+	}
+	idle_check ();
+}
+
+// Requires mutex held and reading set
+void rai::rpc_connection::read ()
 {
 	auto this_l (shared_from_this ());
-	beast::http::async_read (socket, buffer, request, [this_l] (boost::system::error_code const & ec)
+	auto request (std::make_shared <beast::http::request <beast::http::string_body>> ());
+	beast::http::async_read (socket, buffer, *request, [this_l, request] (boost::system::error_code const & ec)
 	{
+		std::unique_lock <std::mutex> lock (this_l->mutex);
 		if (!ec)
 		{
-			auto version (this_l->request.version);
-			auto response_handler ([this_l, version] (boost::property_tree::ptree const & tree_a)
+			this_l->last_activity = std::chrono::system_clock::now ();
+			auto keep_alive (beast::http::is_keep_alive (*request));
+			auto response_l (std::make_shared <rai::rpc_response> (keep_alive));
+			response_l->message.version = request->version;
+			this_l->responses.push_back (response_l);
+			if (!keep_alive)
+			{
+				this_l->finished = true;
+			}
+			if (!this_l->finished && this_l->responses.size () < rai::rpc_connection::pipeline_limit)
+			{
+				this_l->read ();
+			}
+			else
+			{
+				// Resumed by write once responses drain
+				this_l->reading = false;
+			}
+			lock.unlock ();
+			auto response_json ([this_l, response_l] (std::string body_a)
+			{
+				this_l->respond (response_l, std::move (body_a));
+			});
+			auto response_handler ([response_json] (boost::property_tree::ptree const & tree_a)
 			{
 				std::stringstream ostream;
 				boost::property_tree::write_json (ostream, tree_a);
 				ostream.flush ();
-				auto body (ostream.str ());
-				this_l->res.fields.insert ("content-type", "application/json");
-				this_l->res.fields.insert ("Access-Control-Allow-Origin",  "*");
-				this_l->res.status = 200;
-				this_l->res.body = body;
-				this_l->res.version = version;
-				beast::http::prepare (this_l->res);
-				beast::http::async_write (this_l->socket, this_l->res, [this_l] (boost::system::error_code const & ec)
-				{
-				});
+				response_json (ostream.str ());
 			});
-			if (this_l->request.method == "POST")
+			if (request->method == "POST")
 			{
-				auto handler (std::make_shared <rai::rpc_handler> (*this_l->node, this_l->rpc, this_l->request.body, response_handler));
+				auto handler (std::make_shared <rai::rpc_handler> (*this_l->node, this_l->rpc, request->body, response_handler, response_json));
+				handler->response_stream = [this_l, response_l] (std::shared_ptr <rai::rpc_subscription> subscription_a)
+				{
+					this_l->stream (response_l, subscription_a);
+				};
 				handler->process_request ();
 			}
+			else if (request->method == "GET" && request->url == "/metrics")
+			{
+				// Prometheus text exposition format
+				this_l->respond (response_l, this_l->node->stats.prometheus (), "text/plain; version=0.0.4");
+			}
 			else
 			{
 				error_response (response_handler, "Can only POST requests");
 			}
 		}
+		else
+		{
+			this_l->reading = false;
+			this_l->finished = true;
+			if (this_l->responses.empty () || this_l->responses.front ()->subscription != nullptr)
+			{
+				this_l->close ();
+			}
+		}
 	});
 }
 
+void rai::rpc_connection::respond (std::shared_ptr <rai::rpc_response> response_a, std::string body_a, std::string const & content_type_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto & message (response_a->message);
+	message.fields.insert ("content-type", content_type_a);
+	message.fields.insert ("Access-Control-Allow-Origin",  "*");
+	message.status = 200;
+	message.body = std::move (body_a);
+	if (response_a->keep_alive)
+	{
+		beast::http::prepare (message, beast::http::connection::keep_alive);
+	}
+	else
+	{
+		beast::http::prepare (message, beast::http::connection::close);
+	}
+	response_a->ready = true;
+	write ();
+}
+
+void rai::rpc_connection::stream (std::shared_ptr <rai::rpc_response> response_a, std::shared_ptr <rai::rpc_subscription> subscription_a)
+{
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		subscription_a->connection = shared_from_this ();
+		response_a->subscription = subscription_a;
+		response_a->ready = true;
+		write ();
+	}
+	std::lock_guard <std::mutex> lock (rpc.mutex);
+	rpc.subscriptions.push_back (subscription_a);
+}
+
+// Requires mutex held, writes the oldest response once it's ready so pipelined responses keep request order
+// A subscription is never finished so it stays at the front, streaming its queued events
+void rai::rpc_connection::write ()
+{
+	if (!writing && !closed && !responses.empty () && responses.front ()->ready)
+	{
+		auto this_l (shared_from_this ());
+		auto response_l (responses.front ());
+		if (response_l->subscription == nullptr)
+		{
+			writing = true;
+			beast::http::async_write (socket, response_l->message, [this_l, response_l] (boost::system::error_code const & ec)
+			{
+				std::lock_guard <std::mutex> lock (this_l->mutex);
+				this_l->writing = false;
+				this_l->responses.pop_front ();
+				this_l->last_activity = std::chrono::system_clock::now ();
+				if (!ec && response_l->keep_alive)
+				{
+					if (!this_l->reading && !this_l->finished)
+					{
+						this_l->reading = true;
+						this_l->read ();
+					}
+					this_l->write ();
+					if (this_l->finished && this_l->responses.empty ())
+					{
+						this_l->close ();
+					}
+				}
+				else
+				{
+					this_l->close ();
+				}
+			});
+		}
+		else
+		{
+			auto & subscription (*response_l->subscription);
+			auto data (std::make_shared <std::string> ());
+			if (!subscription.started)
+			{
+				subscription.started = true;
+				data->append ("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nAccess-Control-Allow-Origin: *\r\nTransfer-Encoding: chunked\r\n\r\n");
+			}
+			for (; !subscription.events.empty (); subscription.events.pop_front ())
+			{
+				auto & event (subscription.events.front ());
+				data->append (boost::str (boost::format ("%1$x\r\n") % event.size ()));
+				data->append (event);
+				data->append ("\r\n");
+			}
+			if (!data->empty ())
+			{
+				writing = true;
+				boost::asio::async_write (socket, boost::asio::buffer (*data), [this_l, data] (boost::system::error_code const & ec, size_t)
+				{
+					std::lock_guard <std::mutex> lock (this_l->mutex);
+					this_l->writing = false;
+					this_l->last_activity = std::chrono::system_clock::now ();
+					if (!ec)
+					{
+						this_l->write ();
+					}
+					else
+					{
+						this_l->close ();
+					}
+				});
+			}
+		}
+	}
+}
+
+void rai::rpc_connection::idle_check ()
+{
+	std::weak_ptr <rai::rpc_connection> this_w (shared_from_this ());
+	std::chrono::system_clock::time_point wakeup;
+	auto closed_l (false);
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		auto now (std::chrono::system_clock::now ());
+		auto timeout (std::chrono::seconds (rpc.config.idle_timeout));
+		if (!closed && responses.empty () && now - last_activity >= timeout)
+		{
+			close ();
+		}
+		// Connections with requests in flight aren't idle, look again later
+		wakeup = std::max (last_activity + timeout, now + std::chrono::seconds (1));
+		closed_l = closed;
+	}
+	if (!closed_l)
+	{
+		node->alarm.add (wakeup, [this_w] ()
+		{
+			auto this_l (this_w.lock ());
+			if (this_l != nullptr)
+			{
+				this_l->idle_check ();
+			}
+		});
+	}
+}
+
+// Requires mutex held unless the connection was never started
+void rai::rpc_connection::close ()
+{
+	if (!closed)
+	{
+		closed = true;
+		finished = true;
+		boost::system::error_code ec;
+		socket.shutdown (boost::asio::ip::tcp::socket::shutdown_both, ec);
+		socket.close (ec);
+	}
+}
+
 namespace
 {
 void reprocess_body (std::string & body, boost::property_tree::ptree & tree_a)
@@ -1706,6 +2839,11 @@ void rai::rpc_handler::process_request ()
 		std::stringstream istream (body);
 		boost::property_tree::read_json (istream, request);
 		std::string action (request.get <std::string> ("action"));
+		if (node.store.environment.read_only && rai::rpc::replica_actions.find (action) == rai::rpc::replica_actions.end ())
+		{
+			error_response (response, "Action not available on a read-only replica");
+			return;
+		}
 		if (action == "password_enter")
 		{
 			password_enter ();
@@ -1722,6 +2860,38 @@ void rai::rpc_handler::process_request ()
 		{
 			BOOST_LOG (node.log) << body;
 		}
+		if (rpc.config.action_limits.find (action) != rpc.config.action_limits.end ())
+		{
+			auto this_l (shared_from_this ());
+			auto busy (rpc.workers.push (action, [this_l, action] ()
+			{
+				this_l->dispatch (action);
+			}));
+			if (busy)
+			{
+				error_response (response, "RPC busy, try again later");
+			}
+		}
+		else
+		{
+			dispatch (action);
+		}
+	}
+	catch (std::runtime_error const & err)
+	{
+		error_response (response, "Unable to parse JSON");
+	}
+	catch (...)
+	{
+		error_response (response, "Internal server error in RPC");
+	}
+}
+
+void rai::rpc_handler::dispatch (std::string const & action)
+{
+	rai::trace_span span ("rpc", "dispatch");
+	try
+	{
 		if (action == "account_balance")
 		{
 			account_balance ();
@@ -1750,6 +2920,18 @@ void rai::rpc_handler::process_request ()
 		{
 			account_weight ();
 		}
+		else if (action == "accounts_balances")
+		{
+			accounts_balances ();
+		}
+		else if (action == "accounts_frontiers")
+		{
+			accounts_frontiers ();
+		}
+		else if (action == "accounts_pending")
+		{
+			accounts_pending ();
+		}
 		else if (action == "available_supply")
 		{
 			available_supply ();
@@ -1766,6 +2948,10 @@ void rai::rpc_handler::process_request ()
 		{
 			block_count ();
 		}
+		else if (action == "blocks_info")
+		{
+			blocks_info ();
+		}
 		else if (action == "bootstrap")
 		{
 			bootstrap ();
@@ -1806,6 +2992,10 @@ void rai::rpc_handler::process_request ()
 		{
 			mrai_to_raw ();
 		}
+		else if (action == "mutex_stats")
+		{
+			mutex_stats ();
+		}
 		else if (action == "password_change")
 		{
 			// Processed before logging
@@ -1862,10 +3052,26 @@ void rai::rpc_handler::process_request ()
 		{
 			send ();
 		}
+		else if (action == "snapshot")
+		{
+			snapshot ();
+		}
+		else if (action == "stats")
+		{
+			stats ();
+		}
 		else if (action == "stop")
 		{
 			stop ();
 		}
+		else if (action == "subscribe")
+		{
+			subscribe ();
+		}
+		else if (action == "trace")
+		{
+			trace ();
+		}
 		else if (action == "validate_account_number")
 		{
 			validate_account_number ();
@@ -1914,6 +3120,14 @@ void rai::rpc_handler::process_request ()
 		{
 			work_cancel ();
 		}
+		else if (action == "work_stats")
+		{
+			work_stats ();
+		}
+		else if (action == "worker_stats")
+		{
+			worker_stats ();
+		}
 		else
 		{
 			error_response (response, "Unknown command");
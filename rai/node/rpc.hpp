@@ -9,11 +9,17 @@
 #include <boost/property_tree/ptree.hpp>
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <unordered_set>
 #include <unordered_map>
 
 namespace rai
 {
 class node;
+class block;
 class rpc_config
 {
 public:
@@ -26,6 +32,13 @@ public:
 	bool enable_control;
 	uint64_t frontier_request_limit;
 	uint64_t chain_request_limit;
+	uint64_t batch_request_limit;
+	unsigned max_connections;
+	unsigned idle_timeout; // Seconds a keep-alive connection may sit idle before it's closed
+	unsigned io_threads; // Connections share the node's io_service when 0
+	unsigned worker_threads;
+	size_t worker_queue_limit;
+	std::unordered_map <std::string, unsigned> action_limits; // Actions run by the worker pool and how many may run at once
 };
 enum class payment_status
 {
@@ -39,32 +52,122 @@ enum class payment_status
 };
 class wallet;
 class payment_observer;
+class rpc_connection;
+class rpc_subscription;
+class rpc_action_stats
+{
+public:
+	rpc_action_stats ();
+	uint64_t completed;
+	uint64_t rejected;
+	std::chrono::microseconds wait_total;
+	std::chrono::microseconds wait_max;
+	std::chrono::microseconds execution_total;
+	std::chrono::microseconds execution_max;
+};
+class rpc_work
+{
+public:
+	std::string action;
+	std::chrono::steady_clock::time_point queued;
+	std::function <void ()> function;
+};
+// Runs expensive actions away from the io threads, at most action_limits [action] of each at once
+// Requests are rejected rather than queued once worker_queue_limit are already waiting
+class rpc_workers
+{
+public:
+	rpc_workers (rai::rpc_config const &);
+	~rpc_workers ();
+	bool push (std::string const &, std::function <void ()> const &);
+	void run ();
+	void stop ();
+	rai::rpc_config const & config;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque <rai::rpc_work> queue;
+	std::unordered_map <std::string, unsigned> running;
+	std::unordered_map <std::string, rai::rpc_action_stats> stats;
+	bool stopped;
+	std::vector <std::thread> threads;
+};
 class rpc
 {
 public:
     rpc (boost::asio::io_service &, rai::node &, rai::rpc_config const &);
+	~rpc ();
     void start ();
     void stop ();
+	void accept ();
 	void observer_action (rai::account const &);
+	void publish (std::string const &, rai::block const &, rai::account const &, rai::amount const &);
+	rai::rpc_config config;
+	boost::asio::io_service local_service;
+	boost::asio::io_service & service; // local_service unless io_threads is 0
 	boost::asio::ip::tcp::acceptor acceptor;
 	std::mutex mutex;
 	std::unordered_map <rai::account, std::shared_ptr <rai::payment_observer>> payment_observers;
-	rai::rpc_config config;
+	std::vector <std::weak_ptr <rai::rpc_connection>> connections;
+	std::vector <std::weak_ptr <rai::rpc_subscription>> subscriptions;
     rai::node & node;
+	rai::rpc_workers workers;
+	std::vector <std::thread> threads;
     bool on;
     static uint16_t const rpc_port = rai::rai_network == rai::rai_networks::rai_live_network ? 7076 : 55000;
+	// Actions served when the node's store is read-only, they only query the ledger
+	static std::unordered_set <std::string> const replica_actions;
+};
+// Streams events for a subscribe request as chunks of a never ending HTTP response
+// Events are queued by node threads and dropped once the queue is full, a slow client can only lose its own events
+class rpc_subscription
+{
+public:
+	rpc_subscription (std::unordered_set <std::string> const &, std::unordered_set <rai::account> const &);
+	bool wants (std::string const &, rai::account const &) const;
+	void push (std::string const &);
+	std::weak_ptr <rai::rpc_connection> connection;
+	std::unordered_set <std::string> topics;
+	std::unordered_set <rai::account> accounts; // Every account when empty
+	// Guarded by the connection's mutex
+	std::deque <std::string> events;
+	uint64_t dropped;
+	bool started;
+	static size_t constexpr queue_limit = 1024;
+};
+class rpc_response
+{
+public:
+	rpc_response (bool);
+	beast::http::response <beast::http::string_body> message;
+	std::shared_ptr <rai::rpc_subscription> subscription;
+	bool keep_alive;
+	bool ready;
 };
+// Serves HTTP/1.1 requests on one socket until the client closes it, sends Connection: close or stays idle too long
+// Pipelined requests are processed as they arrive and their responses are written back in request order
 class rpc_connection : public std::enable_shared_from_this <rai::rpc_connection>
 {
 public:
 	rpc_connection (rai::node &, rai::rpc &);
 	void parse_connection ();
+	void read ();
+	void respond (std::shared_ptr <rai::rpc_response>, std::string, std::string const & = "application/json");
+	void stream (std::shared_ptr <rai::rpc_response>, std::shared_ptr <rai::rpc_subscription>);
+	void write ();
+	void idle_check ();
+	void close ();
 	std::shared_ptr <rai::node> node;
 	rai::rpc & rpc;
 	boost::asio::ip::tcp::socket socket;
 	beast::streambuf buffer;
-	beast::http::request <beast::http::string_body> request;
-	beast::http::response <beast::http::string_body> res;
+	std::mutex mutex;
+	std::deque <std::shared_ptr <rai::rpc_response>> responses;
+	std::chrono::system_clock::time_point last_activity;
+	bool reading;
+	bool writing;
+	bool finished; // No more requests will be read from this connection
+	bool closed;
+	static size_t constexpr pipeline_limit = 16;
 };
 class payment_observer : public std::enable_shared_from_this <rai::payment_observer>
 {
@@ -83,11 +186,29 @@ public:
 	std::function <void (boost::property_tree::ptree const &)> response;
 	std::atomic_flag completed;
 };
+// Writes compact JSON text straight into a string so responses with many entries don't build a ptree first
+// Values are written as strings, matching what boost::property_tree::write_json produces
+class json_writer
+{
+public:
+	json_writer (std::string &);
+	void begin_object (std::string const & = std::string ());
+	void end_object ();
+	void begin_array (std::string const & = std::string ());
+	void end_array ();
+	void put (std::string const &, std::string const &);
+	void put_child (std::string const &, boost::property_tree::ptree const &);
+	void key (std::string const &);
+	void string (std::string const &);
+	std::string & output;
+	std::vector <bool> empty;
+};
 class rpc_handler : public std::enable_shared_from_this <rai::rpc_handler>
 {
 public:
-	rpc_handler (rai::node &, rai::rpc &, std::string const &, std::function <void (boost::property_tree::ptree const &)> const &);
+	rpc_handler (rai::node &, rai::rpc &, std::string const &, std::function <void (boost::property_tree::ptree const &)> const &, std::function <void (std::string)> const &);
 	void process_request ();
+	void dispatch (std::string const &);
 	void account_balance ();
 	void account_create ();
 	void account_list ();
@@ -95,11 +216,17 @@ public:
 	void account_representative ();
 	void account_representative_set ();
 	void account_weight ();
+	bool batch_accounts (std::vector <rai::account> &);
+	void accounts_balances ();
+	void accounts_frontiers ();
+	void accounts_pending ();
 	void available_supply ();
 	void block ();
 	void block_account ();
 	void block_count ();
+	void blocks_info ();
 	void bootstrap ();
+	bool chain_start (MDB_txn *, std::string const &, rai::block_hash &);
 	void chain ();
 	void frontiers ();
 	void frontier_count ();
@@ -109,6 +236,7 @@ public:
 	void krai_from_raw ();
 	void mrai_to_raw ();
 	void mrai_from_raw ();
+	void mutex_stats ();
 	void password_change ();
 	void password_enter ();
 	void password_valid ();
@@ -123,7 +251,11 @@ public:
 	void rai_from_raw ();
 	void search_pending ();
 	void send ();
+	void snapshot ();
+	void stats ();
 	void stop ();
+	void subscribe ();
+	void trace ();
 	void validate_account_number ();
 	void version ();
 	void wallet_add ();
@@ -136,10 +268,14 @@ public:
 	void wallet_representative_set ();
 	void work_generate ();
 	void work_cancel ();
+	void work_stats ();
+	void worker_stats ();
 	std::string body;
 	rai::node & node;
 	rai::rpc & rpc;
 	boost::property_tree::ptree request;
 	std::function <void (boost::property_tree::ptree const &)> response;
+	std::function <void (std::string)> response_json;
+	std::function <void (std::shared_ptr <rai::rpc_subscription>)> response_stream;
 };
 }
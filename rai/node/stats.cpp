@@ -0,0 +1,284 @@
+#include <rai/node/stats.hpp>
+
+#include <boost/format.hpp>
+
+#include <limits>
+#include <sstream>
+
+namespace
+{
+// Position of the highest set bit, value_a is nonzero
+size_t highest_bit (uint64_t value_a)
+{
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll (value_a);
+#else
+	size_t result (0);
+	while (value_a >>= 1)
+	{
+		++result;
+	}
+	return result;
+#endif
+}
+
+// Threads are spread round robin over the shards the first time they count something
+size_t shard_index ()
+{
+	static std::atomic <size_t> next (0);
+	thread_local size_t index (next.fetch_add (1) % rai::stat_counter::shard_count);
+	return index;
+}
+}
+
+static_assert (sizeof (rai::stat_counter::shard) == 64, "Counter shards must fill exactly one cache line");
+
+std::chrono::seconds constexpr rai::stats::sample_interval;
+size_t constexpr rai::stat_counter::shard_count;
+size_t constexpr rai::stat_histogram::bucket_count;
+
+rai::stat_counter::stat_counter ()
+{
+	reset ();
+}
+
+void rai::stat_counter::add (uint64_t value_a)
+{
+	shards [shard_index ()].value.fetch_add (value_a, std::memory_order_relaxed);
+}
+
+uint64_t rai::stat_counter::value () const
+{
+	uint64_t result (0);
+	for (auto & i: shards)
+	{
+		result += i.value.load (std::memory_order_relaxed);
+	}
+	return result;
+}
+
+void rai::stat_counter::reset ()
+{
+	for (auto & i: shards)
+	{
+		i.value.store (0, std::memory_order_relaxed);
+	}
+}
+
+rai::stat_histogram::stat_histogram ()
+{
+	reset ();
+}
+
+size_t rai::stat_histogram::index (uint64_t value_a)
+{
+	size_t result;
+	if (value_a < 16)
+	{
+		result = value_a;
+	}
+	else
+	{
+		auto exponent (highest_bit (value_a));
+		result = 16 + (exponent - 4) * 8 + ((value_a >> (exponent - 3)) & 7);
+	}
+	return result;
+}
+
+uint64_t rai::stat_histogram::lower_bound (size_t index_a)
+{
+	uint64_t result;
+	if (index_a < 16)
+	{
+		result = index_a;
+	}
+	else
+	{
+		auto exponent ((index_a - 16) / 8 + 4);
+		result = uint64_t (8 + (index_a - 16) % 8) << (exponent - 3);
+	}
+	return result;
+}
+
+void rai::stat_histogram::add (uint64_t value_a)
+{
+	buckets [index (value_a)].fetch_add (1, std::memory_order_relaxed);
+	sum_m.fetch_add (value_a, std::memory_order_relaxed);
+	auto max_l (max_m.load (std::memory_order_relaxed));
+	while (value_a > max_l && !max_m.compare_exchange_weak (max_l, value_a, std::memory_order_relaxed))
+	{
+	}
+}
+
+uint64_t rai::stat_histogram::count () const
+{
+	uint64_t result (0);
+	for (auto & i: buckets)
+	{
+		result += i.load (std::memory_order_relaxed);
+	}
+	return result;
+}
+
+uint64_t rai::stat_histogram::sum () const
+{
+	return sum_m.load (std::memory_order_relaxed);
+}
+
+uint64_t rai::stat_histogram::max () const
+{
+	return max_m.load (std::memory_order_relaxed);
+}
+
+uint64_t rai::stat_histogram::percentile (double percentile_a) const
+{
+	uint64_t result (0);
+	auto count_l (count ());
+	if (count_l > 0)
+	{
+		auto target (std::max <uint64_t> (1, static_cast <uint64_t> (percentile_a * count_l + 0.5)));
+		uint64_t seen (0);
+		for (size_t i (0); i < buckets.size () && seen < target; ++i)
+		{
+			seen += buckets [i].load (std::memory_order_relaxed);
+			// Highest value the bucket stands for, as HdrHistogram reports it
+			result = i + 1 < buckets.size () ? lower_bound (i + 1) - 1 : std::numeric_limits <uint64_t>::max ();
+		}
+		result = std::min (result, max ());
+	}
+	return result;
+}
+
+void rai::stat_histogram::reset ()
+{
+	for (auto & i: buckets)
+	{
+		i.store (0, std::memory_order_relaxed);
+	}
+	sum_m.store (0, std::memory_order_relaxed);
+	max_m.store (0, std::memory_order_relaxed);
+}
+
+rai::stats::stats () :
+sampled (std::chrono::steady_clock::now ())
+{
+}
+
+rai::stat_counter & rai::stats::counter (std::string const & subsystem_a, std::string const & event_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto & result (counters [key (subsystem_a, event_a)]);
+	if (result == nullptr)
+	{
+		result.reset (new rai::stat_counter);
+	}
+	return *result;
+}
+
+rai::stat_histogram & rai::stats::histogram (std::string const & subsystem_a, std::string const & event_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto & result (histograms [key (subsystem_a, event_a)]);
+	if (result == nullptr)
+	{
+		result.reset (new rai::stat_histogram);
+	}
+	return *result;
+}
+
+void rai::stats::sample ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto now (std::chrono::steady_clock::now ());
+	auto elapsed (std::chrono::duration_cast <std::chrono::duration <double>> (now - sampled).count ());
+	for (auto & i: counters)
+	{
+		auto value (i.second->value ());
+		auto & previous (sampled_values [i.first]);
+		// A reset since the last sample leaves nothing sensible to compare against
+		rates [i.first] = elapsed > 0 && value >= previous ? (value - previous) / elapsed : 0.0;
+		previous = value;
+	}
+	sampled = now;
+}
+
+void rai::stats::reset ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	for (auto & i: counters)
+	{
+		i.second->reset ();
+	}
+	for (auto & i: histograms)
+	{
+		i.second->reset ();
+	}
+	sampled_values.clear ();
+	rates.clear ();
+	sampled = std::chrono::steady_clock::now ();
+}
+
+void rai::stats::serialize_json (boost::property_tree::ptree & tree_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	boost::property_tree::ptree counters_l;
+	for (auto & i: counters)
+	{
+		boost::property_tree::ptree entry;
+		entry.put ("value", std::to_string (i.second->value ()));
+		auto rate (rates.find (i.first));
+		entry.put ("rate", std::to_string (rate != rates.end () ? rate->second : 0.0));
+		auto subsystem (counters_l.get_child_optional (i.first.first));
+		if (!subsystem)
+		{
+			subsystem = counters_l.add_child (i.first.first, boost::property_tree::ptree ());
+		}
+		subsystem->add_child (i.first.second, entry);
+	}
+	tree_a.add_child ("counters", counters_l);
+	boost::property_tree::ptree histograms_l;
+	for (auto & i: histograms)
+	{
+		auto & histogram_l (*i.second);
+		auto count (histogram_l.count ());
+		boost::property_tree::ptree entry;
+		entry.put ("count", std::to_string (count));
+		entry.put ("sum", std::to_string (histogram_l.sum ()));
+		entry.put ("average", std::to_string (count > 0 ? histogram_l.sum () / count : 0));
+		entry.put ("p50", std::to_string (histogram_l.percentile (0.5)));
+		entry.put ("p90", std::to_string (histogram_l.percentile (0.9)));
+		entry.put ("p99", std::to_string (histogram_l.percentile (0.99)));
+		entry.put ("max", std::to_string (histogram_l.max ()));
+		auto subsystem (histograms_l.get_child_optional (i.first.first));
+		if (!subsystem)
+		{
+			subsystem = histograms_l.add_child (i.first.first, boost::property_tree::ptree ());
+		}
+		subsystem->add_child (i.first.second, entry);
+	}
+	tree_a.add_child ("histograms", histograms_l);
+}
+
+std::string rai::stats::prometheus ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	std::stringstream result;
+	result << "# TYPE rai_events_total counter\n";
+	for (auto & i: counters)
+	{
+		result << boost::str (boost::format ("rai_events_total{subsystem=\"%1%\",event=\"%2%\"} %3%\n") % i.first.first % i.first.second % i.second->value ());
+	}
+	// Histograms are all recorded in microseconds
+	result << "# TYPE rai_latency_microseconds summary\n";
+	for (auto & i: histograms)
+	{
+		auto & histogram_l (*i.second);
+		for (auto quantile: { 0.5, 0.9, 0.99 })
+		{
+			result << boost::str (boost::format ("rai_latency_microseconds{subsystem=\"%1%\",event=\"%2%\",quantile=\"%3%\"} %4%\n") % i.first.first % i.first.second % quantile % histogram_l.percentile (quantile));
+		}
+		result << boost::str (boost::format ("rai_latency_microseconds_sum{subsystem=\"%1%\",event=\"%2%\"} %3%\n") % i.first.first % i.first.second % histogram_l.sum ());
+		result << boost::str (boost::format ("rai_latency_microseconds_count{subsystem=\"%1%\",event=\"%2%\"} %3%\n") % i.first.first % i.first.second % histogram_l.count ());
+	}
+	return result.str ();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace rai
+{
+// Counter split over cache line sized shards so threads bumping the same event don't contend
+class stat_counter
+{
+public:
+	stat_counter ();
+	void add (uint64_t = 1);
+	uint64_t value () const;
+	void reset ();
+	// Padded rather than aligned, plain new doesn't honour over-alignment under C++11
+	// Values sit exactly a cache line apart so no two shards ever share one
+	class shard
+	{
+	public:
+		std::atomic <uint64_t> value;
+		char padding [64 - sizeof (std::atomic <uint64_t>)];
+	};
+	static size_t constexpr shard_count = 16;
+	std::array <shard, shard_count> shards;
+};
+// Log-linear buckets in the style of HdrHistogram, 8 sub-buckets per power of two keeps any value within 12.5% of its bucket
+class stat_histogram
+{
+public:
+	stat_histogram ();
+	void add (uint64_t);
+	uint64_t count () const;
+	uint64_t sum () const;
+	uint64_t max () const;
+	uint64_t percentile (double) const;
+	void reset ();
+	static size_t index (uint64_t);
+	static uint64_t lower_bound (size_t);
+	static size_t constexpr bucket_count = 16 + 60 * 8;
+	std::array <std::atomic <uint64_t>, bucket_count> buckets;
+	std::atomic <uint64_t> sum_m;
+	std::atomic <uint64_t> max_m;
+};
+// Counters and histograms keyed by subsystem and event
+// Lookups take the mutex so hot paths look up their entries once and keep the reference, entries are never removed
+class stats
+{
+public:
+	stats ();
+	rai::stat_counter & counter (std::string const &, std::string const &);
+	rai::stat_histogram & histogram (std::string const &, std::string const &);
+	// Remembers every counter's value so the next sample can report its rate
+	void sample ();
+	void reset ();
+	void serialize_json (boost::property_tree::ptree &);
+	std::string prometheus ();
+	using key = std::pair <std::string, std::string>;
+	std::mutex mutex;
+	std::map <key, std::unique_ptr <rai::stat_counter>> counters;
+	std::map <key, std::unique_ptr <rai::stat_histogram>> histograms;
+	std::map <key, uint64_t> sampled_values;
+	std::map <key, double> rates; // Events per second between the last two samples
+	std::chrono::steady_clock::time_point sampled;
+	static std::chrono::seconds constexpr sample_interval = std::chrono::seconds (10);
+};
+}
@@ -1,5 +1,7 @@
 #include <rai/node/testing.hpp>
 
+#include <beast/http.hpp>
+
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
@@ -319,6 +321,156 @@ void rai::system::stop ()
 	work.stop ();
 }
 
+rai::fake_work_peer::fake_work_peer (rai::work_pool & work_a, boost::asio::io_service & service_a, uint16_t port_a, rai::work_peer_type type_a) :
+work (work_a),
+service (service_a),
+acceptor (service_a, rai::tcp_endpoint (boost::asio::ip::address_v6::loopback (), port_a)),
+type (type_a),
+connections (0),
+generations (0),
+cancels (0)
+{
+}
+
+namespace
+{
+class fake_work_peer_connection : public std::enable_shared_from_this <fake_work_peer_connection>
+{
+public:
+	fake_work_peer_connection (std::shared_ptr <rai::fake_work_peer> const & peer_a) :
+	peer (peer_a),
+	socket (peer_a->service)
+	{
+	}
+	void receive ()
+	{
+		auto this_l (shared_from_this ());
+		request = beast::http::request <beast::http::string_body> ();
+		beast::http::async_read (socket, buffer, request, [this_l] (boost::system::error_code const & ec)
+		{
+			if (!ec)
+			{
+				this_l->handle ();
+			}
+		});
+	}
+	void handle ()
+	{
+		boost::property_tree::ptree request_l;
+		std::stringstream istream (request.body);
+		boost::property_tree::read_json (istream, request_l);
+		auto action (request_l.get <std::string> ("action"));
+		rai::block_hash root;
+		root.decode_hex (request_l.get <std::string> ("hash"));
+		if (action == "work_generate")
+		{
+			++peer->generations;
+			switch (peer->type)
+			{
+				case rai::work_peer_type::good:
+				{
+					auto this_l (shared_from_this ());
+					peer->work.generate (root, [this_l] (boost::optional <uint64_t> const & work_a)
+					{
+						this_l->peer->service.post ([this_l, work_a] ()
+						{
+							boost::property_tree::ptree response_l;
+							if (work_a)
+							{
+								response_l.put ("work", rai::to_string_hex (work_a.value ()));
+							}
+							else
+							{
+								response_l.put ("error", "Cancelled");
+							}
+							this_l->respond (response_l);
+						});
+					}, rai::work_priority::rpc);
+					break;
+				}
+				case rai::work_peer_type::malicious:
+				{
+					uint64_t work (0);
+					while (!peer->work.work_validate (root, work))
+					{
+						++work;
+					}
+					boost::property_tree::ptree response_l;
+					response_l.put ("work", rai::to_string_hex (work));
+					respond (response_l);
+					break;
+				}
+				case rai::work_peer_type::silent:
+					// Keep the connection open without ever answering
+					receive ();
+					break;
+			}
+		}
+		else if (action == "work_cancel")
+		{
+			++peer->cancels;
+			peer->work.cancel (root);
+			respond (boost::property_tree::ptree ());
+		}
+	}
+	void respond (boost::property_tree::ptree const & tree_a)
+	{
+		auto this_l (shared_from_this ());
+		std::stringstream ostream;
+		boost::property_tree::write_json (ostream, tree_a);
+		response = beast::http::response <beast::http::string_body> ();
+		response.status = 200;
+		response.version = 11;
+		response.body = ostream.str ();
+		beast::http::prepare (response);
+		beast::http::async_write (socket, response, [this_l] (boost::system::error_code const & ec)
+		{
+			if (!ec)
+			{
+				// Keep the connection open for the next request
+				this_l->receive ();
+			}
+		});
+	}
+	std::shared_ptr <rai::fake_work_peer> peer;
+	boost::asio::ip::tcp::socket socket;
+	beast::streambuf buffer;
+	beast::http::request <beast::http::string_body> request;
+	beast::http::response <beast::http::string_body> response;
+};
+}
+
+void rai::fake_work_peer::start ()
+{
+	acceptor.listen ();
+	accept ();
+}
+
+void rai::fake_work_peer::stop ()
+{
+	acceptor.close ();
+}
+
+void rai::fake_work_peer::accept ()
+{
+	auto this_l (shared_from_this ());
+	auto connection (std::make_shared <fake_work_peer_connection> (this_l));
+	acceptor.async_accept (connection->socket, [this_l, connection] (boost::system::error_code const & ec)
+	{
+		if (!ec)
+		{
+			++this_l->connections;
+			connection->receive ();
+			this_l->accept ();
+		}
+	});
+}
+
+rai::tcp_endpoint rai::fake_work_peer::endpoint ()
+{
+	return rai::tcp_endpoint (boost::asio::ip::address_v6::loopback (), acceptor.local_endpoint ().port ());
+}
+
 rai::landing_store::landing_store ()
 {
 }
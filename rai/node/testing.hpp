@@ -31,6 +31,29 @@ public:
 	rai::logging logging;
 	rai::work_pool work;
 };
+enum class work_peer_type
+{
+	good, // Answers with valid work
+	malicious, // Answers with work below the threshold
+	silent // Never answers work_generate, still acknowledges work_cancel
+};
+// Stands in for a node's RPC work_generate and work_cancel actions so work_peer_client can be tested on its own
+class fake_work_peer : public std::enable_shared_from_this <rai::fake_work_peer>
+{
+public:
+	fake_work_peer (rai::work_pool &, boost::asio::io_service &, uint16_t, rai::work_peer_type);
+	void start ();
+	void stop ();
+	void accept ();
+	rai::tcp_endpoint endpoint ();
+	rai::work_pool & work;
+	boost::asio::io_service & service;
+	boost::asio::ip::tcp::acceptor acceptor;
+	rai::work_peer_type type;
+	std::atomic <unsigned> connections;
+	std::atomic <unsigned> generations;
+	std::atomic <unsigned> cancels;
+};
 class landing_store
 {
 public:
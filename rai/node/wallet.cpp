@@ -12,9 +12,38 @@
 
 #include <future>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+rai::work_item::work_item (rai::uint256_union const & root_a, uint64_t threshold_a, rai::work_priority priority_a, std::function <void (boost::optional <uint64_t> const &)> const & callback_a) :
+root (root_a),
+threshold (threshold_a),
+priority (priority_a),
+callback (callback_a),
+queued (std::chrono::steady_clock::now ()),
+workers (0),
+finished (false)
+{
+}
+
+rai::work_stats::work_stats () :
+solved (0),
+cancelled (0),
+wait_total (0),
+wait_max (0),
+solve_total (0),
+solve_max (0)
+{
+}
+
 rai::work_pool::work_pool (unsigned max_threads_a, std::unique_ptr <rai::opencl_work> opencl_a) :
-ticket (0),
+generation (0),
 done (false),
+mutex ("work_pool"),
 opencl (std::move (opencl_a))
 {
 	static_assert (ATOMIC_INT_LOCK_FREE == 2, "Atomic int needed");
@@ -50,6 +79,152 @@ uint64_t rai::work_pool::work_value (rai::block_hash const & root_a, uint64_t wo
 	return result;
 }
 
+namespace
+{
+#ifdef __SSE2__
+// Work values are a single blake2b compression of an 8 byte nonce followed by a 32 byte root.
+// Hashing two of them at once, one per 64 bit lane, roughly halves the cost per value.
+uint64_t const blake2b_iv [8] =
+{
+	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+	0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+uint8_t const blake2b_sigma [12][16] =
+{
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+	{ 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+	{ 11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4 },
+	{ 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8 },
+	{ 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13 },
+	{ 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9 },
+	{ 12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11 },
+	{ 13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10 },
+	{ 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5 },
+	{ 10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+	{ 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 }
+};
+template <int bits>
+__m128i rotate_right (__m128i value_a)
+{
+	return _mm_or_si128 (_mm_srli_epi64 (value_a, bits), _mm_slli_epi64 (value_a, 64 - bits));
+}
+template <>
+__m128i rotate_right <32> (__m128i value_a)
+{
+	return _mm_shuffle_epi32 (value_a, _MM_SHUFFLE (2, 3, 0, 1));
+}
+#ifdef __SSSE3__
+template <>
+__m128i rotate_right <24> (__m128i value_a)
+{
+	return _mm_shuffle_epi8 (value_a, _mm_setr_epi8 (3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10));
+}
+template <>
+__m128i rotate_right <16> (__m128i value_a)
+{
+	return _mm_shuffle_epi8 (value_a, _mm_setr_epi8 (2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9));
+}
+#endif
+inline void blake2b_g (__m128i & a, __m128i & b, __m128i & c, __m128i & d, __m128i const & x, __m128i const & y)
+{
+	a = _mm_add_epi64 (_mm_add_epi64 (a, b), x);
+	d = rotate_right <32> (_mm_xor_si128 (d, a));
+	c = _mm_add_epi64 (c, d);
+	b = rotate_right <24> (_mm_xor_si128 (b, c));
+	a = _mm_add_epi64 (_mm_add_epi64 (a, b), y);
+	d = rotate_right <16> (_mm_xor_si128 (d, a));
+	c = _mm_add_epi64 (c, d);
+	b = rotate_right <63> (_mm_xor_si128 (b, c));
+}
+uint64_t root_word (rai::block_hash const & root_a, size_t index_a)
+{
+	uint64_t result;
+	std::copy (root_a.bytes.begin () + index_a * 8, root_a.bytes.begin () + index_a * 8 + 8, reinterpret_cast <uint8_t *> (&result));
+	return result;
+}
+// Equivalent to work_value for two (root, work) pairs, assumes a little endian host which SSE2 implies
+void work_value_pair (std::pair <rai::block_hash, uint64_t> const & first_a, std::pair <rai::block_hash, uint64_t> const & second_a, uint64_t & first_value_a, uint64_t & second_value_a)
+{
+	// Parameter block for an unkeyed 8 byte digest
+	auto h0 (blake2b_iv [0] ^ 0x01010008ULL);
+	// Plain arrays, std::array drops the vector type's alignment attribute and warns about it
+	__m128i m [16];
+	for (auto & i: m)
+	{
+		i = _mm_setzero_si128 ();
+	}
+	m [0] = _mm_set_epi64x (second_a.second, first_a.second);
+	for (size_t i (0); i < 4; ++i)
+	{
+		m [i + 1] = _mm_set_epi64x (root_word (second_a.first, i), root_word (first_a.first, i));
+	}
+	__m128i v [16];
+	v [0] = _mm_set1_epi64x (h0);
+	for (size_t i (1); i < 8; ++i)
+	{
+		v [i] = _mm_set1_epi64x (blake2b_iv [i]);
+	}
+	for (size_t i (0); i < 8; ++i)
+	{
+		v [i + 8] = _mm_set1_epi64x (blake2b_iv [i]);
+	}
+	// 40 bytes hashed in a single, final block
+	v [12] = _mm_set1_epi64x (blake2b_iv [4] ^ 40);
+	v [14] = _mm_set1_epi64x (~blake2b_iv [6]);
+	for (size_t r (0); r < 12; ++r)
+	{
+		auto s (blake2b_sigma [r]);
+		blake2b_g (v [0], v [4], v [8], v [12], m [s [0]], m [s [1]]);
+		blake2b_g (v [1], v [5], v [9], v [13], m [s [2]], m [s [3]]);
+		blake2b_g (v [2], v [6], v [10], v [14], m [s [4]], m [s [5]]);
+		blake2b_g (v [3], v [7], v [11], v [15], m [s [6]], m [s [7]]);
+		blake2b_g (v [0], v [5], v [10], v [15], m [s [8]], m [s [9]]);
+		blake2b_g (v [1], v [6], v [11], v [12], m [s [10]], m [s [11]]);
+		blake2b_g (v [2], v [7], v [8], v [13], m [s [12]], m [s [13]]);
+		blake2b_g (v [3], v [4], v [9], v [14], m [s [14]], m [s [15]]);
+	}
+	auto result (_mm_xor_si128 (_mm_set1_epi64x (h0), _mm_xor_si128 (v [0], v [8])));
+	std::array <uint64_t, 2> values;
+	_mm_storeu_si128 (reinterpret_cast <__m128i *> (values.data ()), result);
+	first_value_a = values [0];
+	second_value_a = values [1];
+}
+#endif
+}
+
+void rai::work_pool::work_value_batch (std::vector <std::pair <rai::block_hash, uint64_t>> const & items_a, std::vector <uint64_t> & values_a)
+{
+	values_a.resize (items_a.size ());
+	size_t i (0);
+#ifdef __SSE2__
+	for (; i + 1 < items_a.size (); i += 2)
+	{
+		work_value_pair (items_a [i], items_a [i + 1], values_a [i], values_a [i + 1]);
+	}
+#endif
+	for (; i < items_a.size (); ++i)
+	{
+		values_a [i] = work_value (items_a [i].first, items_a [i].second);
+	}
+}
+
+// Pick the item in the most urgent priority class with the fewest threads on it so a burst of requests is worked on concurrently
+std::shared_ptr <rai::work_item> rai::work_pool::select ()
+{
+	assert (!pending.empty ());
+	auto result (pending.front ());
+	auto priority (result->priority);
+	for (auto i (pending.begin ()), n (pending.end ()); i != n && (*i)->priority == priority && result->workers != 0; ++i)
+	{
+		if ((*i)->workers < result->workers)
+		{
+			result = *i;
+		}
+	}
+	return result;
+}
+
 void rai::work_pool::loop (uint64_t thread)
 {
     xorshift1024star rng;
@@ -58,7 +233,7 @@ void rai::work_pool::loop (uint64_t thread)
 	uint64_t output;
     blake2b_state hash;
 	blake2b_init (&hash, sizeof (output));
-	std::unique_lock <std::mutex> lock (mutex);
+	rai::unique_lock lock (mutex);
 	while (!done || !pending.empty())
 	{
 		auto empty (pending.empty ());
@@ -68,34 +243,46 @@ void rai::work_pool::loop (uint64_t thread)
 		}
 		if (!empty)
 		{
-			auto current_l (pending.front ());
-			int ticket_l (ticket);
+			auto current_l (select ());
+			if (current_l->workers == 0 && current_l->started == std::chrono::steady_clock::time_point ())
+			{
+				current_l->started = std::chrono::steady_clock::now ();
+			}
+			++current_l->workers;
+			auto generation_l (generation.load ());
 			lock.unlock ();
 			output = 0;
-			while (ticket == ticket_l && output < rai::work_pool::publish_threshold)
+			while (!current_l->finished && generation == generation_l && output < current_l->threshold)
 			{
 				unsigned iteration (256);
-				while (iteration && output < rai::work_pool::publish_threshold)
+				while (iteration && output < current_l->threshold)
 				{
 					work = rng.next ();
 					blake2b_update (&hash, reinterpret_cast <uint8_t *> (&work), sizeof (work));
-					blake2b_update (&hash, current_l.first.bytes.data (), current_l.first.bytes.size ());
+					blake2b_update (&hash, current_l->root.bytes.data (), current_l->root.bytes.size ());
 					blake2b_final (&hash, reinterpret_cast <uint8_t *> (&output), sizeof (output));
 					blake2b_init (&hash, sizeof (output));
 					iteration -= 1;
 				}
 			}
 			lock.lock ();
-			if (!pending.empty () && pending.front () == current_l && output >= rai::work_pool::publish_threshold)
-			{
-				assert (output >= rai::work_pool::publish_threshold);
-				assert (work_value (current_l.first, work) == output);
-				++ticket;
-				current_l.second->set_value (work);
-				pending.pop_front ();
-			}
-			else
+			--current_l->workers;
+			if (output >= current_l->threshold && !current_l->finished.exchange (true))
 			{
+				assert (work_value (current_l->root, work) == output);
+				pending.remove (current_l);
+				auto now (std::chrono::steady_clock::now ());
+				auto wait (std::chrono::duration_cast <std::chrono::microseconds> (current_l->started - current_l->queued));
+				auto solve (std::chrono::duration_cast <std::chrono::microseconds> (now - current_l->started));
+				auto & stats_l (stats [static_cast <size_t> (current_l->priority)]);
+				++stats_l.solved;
+				stats_l.wait_total += wait;
+				stats_l.wait_max = std::max (stats_l.wait_max, wait);
+				stats_l.solve_total += solve;
+				stats_l.solve_max = std::max (stats_l.solve_max, solve);
+				lock.unlock ();
+				current_l->callback (work);
+				lock.lock ();
 			}
 		}
 		else
@@ -107,21 +294,32 @@ void rai::work_pool::loop (uint64_t thread)
 
 void rai::work_pool::cancel (rai::uint256_union const & root_a)
 {
-	std::lock_guard <std::mutex> lock (mutex);
-	pending.remove_if ([&root_a] (decltype (pending)::value_type const & item_a)
+	std::vector <std::shared_ptr <rai::work_item>> cancelled;
 	{
-		bool result;
-		if (item_a.first == root_a)
+		rai::lock_guard lock (mutex);
+		pending.remove_if ([&root_a, &cancelled] (std::shared_ptr <rai::work_item> const & item_a)
 		{
-			item_a.second->set_value (boost::none);
-			result = true;
-		}
-		else
+			bool result;
+			if (item_a->root == root_a && !item_a->finished.exchange (true))
+			{
+				cancelled.push_back (item_a);
+				result = true;
+			}
+			else
+			{
+				result = false;
+			}
+			return result;
+		});
+		for (auto & i: cancelled)
 		{
-			result = false;
+			++stats [static_cast <size_t> (i->priority)].cancelled;
 		}
-		return result;
-	});
+	}
+	for (auto & i: cancelled)
+	{
+		i->callback (boost::none);
+	}
 }
 
 bool rai::work_pool::work_validate (rai::block_hash const & root_a, uint64_t work_a)
@@ -135,37 +333,68 @@ bool rai::work_pool::work_validate (rai::block & block_a)
     return work_validate (block_a.root (), block_a.block_work ());
 }
 
+// Entry i is true if item i doesn't meet the publish threshold, the same as work_validate
+std::vector <bool> rai::work_pool::work_validate_batch (std::vector <std::pair <rai::block_hash, uint64_t>> const & items_a)
+{
+	std::vector <uint64_t> values;
+	work_value_batch (items_a, values);
+	std::vector <bool> result;
+	result.reserve (values.size ());
+	for (auto i: values)
+	{
+		result.push_back (i < rai::work_pool::publish_threshold);
+	}
+	return result;
+}
+
 void rai::work_pool::stop ()
 {
-	std::lock_guard <std::mutex> lock (mutex);
+	rai::lock_guard lock (mutex);
 	done = true;
 	producer_condition.notify_all ();
 }
 
-boost::optional <uint64_t> rai::work_pool::generate_maybe (rai::uint256_union const & root_a)
+void rai::work_pool::generate (rai::uint256_union const & root_a, std::function <void (boost::optional <uint64_t> const &)> const & callback_a, rai::work_priority priority_a, uint64_t threshold_a)
+{
+	assert (!root_a.is_zero ());
+	auto item (std::make_shared <rai::work_item> (root_a, threshold_a, priority_a, callback_a));
+	rai::lock_guard lock (mutex);
+	auto position (std::find_if (pending.begin (), pending.end (), [priority_a] (std::shared_ptr <rai::work_item> const & item_a)
+	{
+		return item_a->priority > priority_a;
+	}));
+	if (pending.empty () || priority_a <= pending.front ()->priority)
+	{
+		// Threads working on a less urgent item, or doubled up on one item, should move over
+		++generation;
+	}
+	pending.insert (position, item);
+	producer_condition.notify_all ();
+}
+
+boost::optional <uint64_t> rai::work_pool::generate_maybe (rai::uint256_union const & root_a, rai::work_priority priority_a, uint64_t threshold_a)
 {
 	assert (!root_a.is_zero ());
 	boost::optional <uint64_t> result;
-	if (opencl != nullptr)
+	if (opencl != nullptr && threshold_a == rai::work_pool::publish_threshold)
 	{
 		result = opencl->generate_work (*this, root_a);
 	}
 	if (!result)
 	{
 		std::promise <boost::optional <uint64_t>> work;
+		generate (root_a, [&work] (boost::optional <uint64_t> const & work_a)
 		{
-			std::lock_guard <std::mutex> lock (mutex);
-			pending.push_back (std::make_pair (root_a, &work));
-			producer_condition.notify_all ();
-		}
+			work.set_value (work_a);
+		}, priority_a, threshold_a);
 		result = work.get_future ().get ();
 	}
 	return result;
 }
 
-uint64_t rai::work_pool::generate (rai::uint256_union const & root_a)
+uint64_t rai::work_pool::generate (rai::uint256_union const & root_a, rai::work_priority priority_a, uint64_t threshold_a)
 {
-	return generate_maybe (root_a).value ();
+	return generate_maybe (root_a, priority_a, threshold_a).value ();
 }
 
 rai::uint256_union rai::wallet_store::check (MDB_txn * transaction_a)
@@ -223,6 +452,7 @@ rai::public_key rai::wallet_store::deterministic_insert (MDB_txn * transaction_a
 	marker <<= 32;
 	marker |= index;
 	entry_put_raw (transaction_a, result, rai::uint256_union (marker));
+	insert_observer (result);
 	++index;
 	deterministic_index_set (transaction_a, index);
 	return result;
@@ -373,6 +603,7 @@ int const rai::wallet_store::special_count (7);
 
 rai::wallet_store::wallet_store (bool & init_a, rai::kdf & kdf_a, rai::transaction & transaction_a, rai::account representative_a, unsigned fanout_a, std::string const & wallet_a, std::string const & json_a) :
 password (0, fanout_a),
+insert_observer ([] (rai::public_key const &) {}),
 kdf (kdf_a),
 environment (transaction_a.environment)
 {
@@ -427,6 +658,7 @@ environment (transaction_a.environment)
 
 rai::wallet_store::wallet_store (bool & init_a, rai::kdf & kdf_a, rai::transaction & transaction_a, rai::account representative_a, unsigned fanout_a, std::string const & wallet_a) :
 password (0, fanout_a),
+insert_observer ([] (rai::public_key const &) {}),
 kdf (kdf_a),
 environment (transaction_a.environment)
 {
@@ -511,6 +743,7 @@ rai::public_key rai::wallet_store::insert_adhoc (MDB_txn * transaction_a, rai::r
 	rai::uint256_union ciphertext;
 	ciphertext.encrypt (prv, password_l, salt (transaction_a).owords [0]);
 	entry_put_raw (transaction_a, pub, rai::wallet_value (ciphertext));
+	insert_observer (pub);
 	return pub;
 }
 
@@ -793,6 +1026,10 @@ lock_observer ([](bool, bool){}),
 store (init_a, node_a.wallets.kdf, transaction_a, node_a.config.random_representative (), node_a.config.password_fanout, wallet_a),
 node (node_a)
 {
+	store.insert_observer = [&node_a] (rai::public_key const & pub_a)
+	{
+		node_a.wallets.insert_account (pub_a);
+	};
 }
 
 rai::wallet::wallet (bool & init_a, rai::transaction & transaction_a, rai::node & node_a, std::string const & wallet_a, std::string const & json) :
@@ -800,6 +1037,10 @@ lock_observer ([](bool, bool){}),
 store (init_a, node_a.wallets.kdf, transaction_a, node_a.config.random_representative (), node_a.config.password_fanout, wallet_a, json),
 node (node_a)
 {
+	store.insert_observer = [&node_a] (rai::public_key const & pub_a)
+	{
+		node_a.wallets.insert_account (pub_a);
+	};
 }
 
 void rai::wallet::enter_initial_password ()
@@ -922,7 +1163,7 @@ void rai::wallet_store::destroy (MDB_txn * transaction_a)
 namespace
 {
 bool check_ownership (rai::wallets & wallets_a, rai::account const & account_a) {
-	std::lock_guard <std::mutex> lock (wallets_a.action_mutex);
+	rai::lock_guard lock (wallets_a.action_mutex);
 	return wallets_a.current_actions.find (account_a) == wallets_a.current_actions.end ();
 }
 }
@@ -975,7 +1216,7 @@ std::unique_ptr <rai::block> rai::wallet::receive_action (rai::send_block const
 		auto source (send_a.hashables.destination);
 		node.wallets.queue_wallet_action (source, rai::wallets::generate_priority, [this_l, source, hash]
 		{
-			this_l->work_generate (source, hash);
+			this_l->work_precache (source, hash);
 		});
 	}
     return block;
@@ -1012,7 +1253,7 @@ std::unique_ptr <rai::block> rai::wallet::change_action (rai::account const & so
 		auto this_l (shared_from_this ());
 		node.wallets.queue_wallet_action (source_a, rai::wallets::generate_priority, [this_l, source_a, hash]
 		{
-			this_l->work_generate (source_a, hash);
+			this_l->work_precache (source_a, hash);
 		});
 	}
 	return block;
@@ -1053,7 +1294,7 @@ std::unique_ptr <rai::block> rai::wallet::send_action (rai::account const & sour
 		auto this_l (shared_from_this ());
 		node.wallets.queue_wallet_action (source_a, rai::wallets::generate_priority, [this_l, source_a, hash]
 		{
-			this_l->work_generate (source_a, hash);
+			this_l->work_precache (source_a, hash);
 		});
 	}
 	return block;
@@ -1146,6 +1387,7 @@ uint64_t rai::wallet::work_fetch (MDB_txn * transaction_a, rai::account const &
     auto error (store.work_get (transaction_a, account_a, result));
     if (error)
 	{
+		++node.wallets.work_cache_misses;
         result = node.generate_work (root_a);
     }
 	else
@@ -1153,8 +1395,13 @@ uint64_t rai::wallet::work_fetch (MDB_txn * transaction_a, rai::account const &
 		if (node.work.work_validate (root_a, result))
 		{
 			BOOST_LOG (node.log) << "Cached work invalid, regenerating";
+			++node.wallets.work_cache_misses;
 			result = node.generate_work (root_a);
 		}
+		else
+		{
+			++node.wallets.work_cache_hits;
+		}
 	}
     return result;
 }
@@ -1168,10 +1415,42 @@ void rai::wallet::work_ensure (MDB_txn * transaction_a, rai::account const & acc
 	assert (!error);
 	if (node.work.work_validate (root, work))
 	{
-		auto this_l (shared_from_this ());
-		node.background ([this_l, account_a, root] () {
-			this_l->work_generate (account_a, root);
-		});
+		work_precache (account_a, root);
+	}
+}
+
+// Queue generation of work for root_a at precache priority and store it once it's found, doesn't block the caller
+void rai::wallet::work_precache (rai::account const & account_a, rai::block_hash const & root_a)
+{
+	if (node.wallets.precache_begin (account_a, root_a))
+	{
+		std::weak_ptr <rai::wallet> this_w (shared_from_this ());
+		auto node_l (node.shared ());
+		auto begin (std::chrono::system_clock::now ());
+		node.work.generate (root_a, [this_w, node_l, account_a, root_a, begin] (boost::optional <uint64_t> const & work_a)
+		{
+			node_l->wallets.precache_end (account_a, root_a);
+			if (work_a)
+			{
+				auto work (work_a.value ());
+				if (node_l->config.logging.work_generation_time ())
+				{
+					BOOST_LOG (node_l->log) << "Work generation complete: " << (std::chrono::duration_cast <std::chrono::microseconds> (std::chrono::system_clock::now () - begin).count ()) << " us";
+				}
+				node_l->background ([this_w, account_a, root_a, work] ()
+				{
+					auto this_l (this_w.lock ());
+					if (this_l != nullptr)
+					{
+						rai::transaction transaction (this_l->store.environment, nullptr, true);
+						if (this_l->store.exists (transaction, account_a))
+						{
+							this_l->work_update (transaction, account_a, root_a, work);
+						}
+					}
+				});
+			}
+		}, rai::work_priority::precache);
 	}
 }
 
@@ -1296,26 +1575,17 @@ void rai::wallet::init_free_accounts (MDB_txn * transaction_a)
 	}
 }
 
-void rai::wallet::work_generate (rai::account const & account_a, rai::block_hash const & root_a)
-{
-	auto begin (std::chrono::system_clock::now ());
-    auto work (node.generate_work (root_a));
-	if (node.config.logging.work_generation_time ())
-	{
-		BOOST_LOG (node.log) << "Work generation complete: " << (std::chrono::duration_cast <std::chrono::microseconds> (std::chrono::system_clock::now () - begin).count ()) << " us";
-	}
-	rai::transaction transaction (store.environment, nullptr, true);
-	if (store.exists (transaction, account_a))
-	{
-		work_update (transaction, account_a, root_a, work);
-	}
-}
-
 rai::wallets::wallets (bool & error_a, rai::node & node_a) :
 observer ([] (rai::account const &, bool) {}),
+mutex ("wallets"),
+action_mutex ("wallets_action"),
+precache_mutex ("wallets_precache"),
+work_cache_hits (0),
+work_cache_misses (0),
 node (node_a)
 {
-	if (!error_a)
+	// Wallets are written to, a read-only replica goes without them
+	if (!error_a && !node.store.environment.read_only)
 	{
 		rai::transaction transaction (node.store.environment, nullptr, true);
 		auto status (mdb_dbi_open (transaction, nullptr, MDB_CREATE, &handle));
@@ -1343,12 +1613,14 @@ node (node_a)
 				// Couldn't open wallet
 			}
 		}
+		index_accounts (transaction);
 	}
 }
 
 std::shared_ptr <rai::wallet> rai::wallets::open (rai::uint256_union const & id_a)
 {
     std::shared_ptr <rai::wallet> result;
+	rai::lock_guard lock (mutex);
     auto existing (items.find (id_a));
     if (existing != items.end ())
     {
@@ -1359,14 +1631,18 @@ std::shared_ptr <rai::wallet> rai::wallets::open (rai::uint256_union const & id_
 
 std::shared_ptr <rai::wallet> rai::wallets::create (rai::uint256_union const & id_a)
 {
-    assert (items.find (id_a) == items.end ());
     std::shared_ptr <rai::wallet> result;
     bool error;
 	{
 		rai::transaction transaction (node.store.environment, nullptr, true);
 		result = std::make_shared <rai::wallet> (error, transaction, node, id_a.to_string ());
+		rai::lock_guard lock (mutex);
+		assert (items.find (id_a) == items.end ());
         items [id_a] = result;
-        result = result;
+		for (auto & account: result->store.accounts (transaction))
+		{
+			accounts.insert (account);
+		}
 	}
     if (!error)
     {
@@ -1402,17 +1678,19 @@ void rai::wallets::search_pending_all ()
 void rai::wallets::destroy (rai::uint256_union const & id_a)
 {
 	rai::transaction transaction (node.store.environment, nullptr, true);
+	rai::lock_guard lock (mutex);
 	auto existing (items.find (id_a));
 	assert (existing != items.end ());
 	auto wallet (existing->second);
 	items.erase (existing);
 	wallet->store.destroy (transaction);
+	index_accounts (transaction);
 }
 
 void rai::wallets::do_wallet_actions (rai::account const & account_a)
 {
 	observer (account_a, true);
-	std::unique_lock <std::mutex> lock (node.wallets.action_mutex);
+	rai::unique_lock lock (node.wallets.action_mutex);
 	auto existing (node.wallets.pending_actions.find (account_a));
 	while (existing != node.wallets.pending_actions.end ())
 	{
@@ -1439,7 +1717,7 @@ void rai::wallets::do_wallet_actions (rai::account const & account_a)
 
 void rai::wallets::queue_wallet_action (rai::account const & account_a, rai::uint128_t const & amount_a, std::function <void ()> const & action_a)
 {
-	std::lock_guard <std::mutex> lock (action_mutex);
+	rai::lock_guard lock (action_mutex);
 	pending_actions [account_a].insert (decltype (pending_actions)::mapped_type::value_type (amount_a, std::move (action_a)));
 	if (current_actions.insert (account_a).second)
 	{
@@ -1477,6 +1755,139 @@ void rai::wallets::foreach_representative (MDB_txn * transaction_a, std::functio
     }
 }
 
+// Precompute work for the new head of account_a if it belongs to any of our wallets
+void rai::wallets::work_precache (rai::account const & account_a, rai::block_hash const & root_a)
+{
+	std::vector <std::shared_ptr <rai::wallet>> wallets_l;
+	{
+		rai::lock_guard lock (mutex);
+		if (accounts.find (account_a) != accounts.end ())
+		{
+			for (auto & i: items)
+			{
+				wallets_l.push_back (i.second);
+			}
+		}
+	}
+	if (!wallets_l.empty ())
+	{
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		for (auto & i: wallets_l)
+		{
+			if (i->store.exists (transaction, account_a))
+			{
+				i->work_precache (account_a, root_a);
+			}
+		}
+	}
+}
+
+void rai::wallets::work_precache_all ()
+{
+	std::vector <std::shared_ptr <rai::wallet>> wallets_l;
+	{
+		rai::lock_guard lock (mutex);
+		for (auto & i: items)
+		{
+			wallets_l.push_back (i.second);
+		}
+	}
+	rai::transaction transaction (node.store.environment, nullptr, false);
+	for (auto & i: wallets_l)
+	{
+		for (auto & account: i->store.accounts (transaction))
+		{
+			i->work_ensure (transaction, account);
+		}
+	}
+}
+
+// Cheap check whether account_a may belong to one of our wallets, false positives are possible after removals
+bool rai::wallets::exists (rai::account const & account_a)
+{
+	rai::lock_guard lock (mutex);
+	return accounts.find (account_a) != accounts.end ();
+}
+
+void rai::wallets::insert_account (rai::account const & account_a)
+{
+	rai::lock_guard lock (mutex);
+	accounts.insert (account_a);
+}
+
+// Rebuild accounts from every wallet's store, callers hold mutex unless still constructing
+void rai::wallets::index_accounts (MDB_txn * transaction_a)
+{
+	accounts.clear ();
+	for (auto & i: items)
+	{
+		for (auto & account: i.second->store.accounts (transaction_a))
+		{
+			accounts.insert (account);
+		}
+	}
+}
+
+// Returns true if generation for root_a should be started, false if it's already in progress
+bool rai::wallets::precache_begin (rai::account const & account_a, rai::block_hash const & root_a)
+{
+	auto result (true);
+	rai::block_hash superseded (0);
+	{
+		rai::lock_guard lock (precache_mutex);
+		auto existing (precaching.find (account_a));
+		if (existing != precaching.end ())
+		{
+			if (existing->second == root_a)
+			{
+				result = false;
+			}
+			else
+			{
+				superseded = existing->second;
+				existing->second = root_a;
+			}
+		}
+		else
+		{
+			precaching [account_a] = root_a;
+		}
+	}
+	if (!superseded.is_zero ())
+	{
+		// The account moved on, work for the old head will never be used
+		node.work.cancel (superseded);
+	}
+	return result;
+}
+
+void rai::wallets::precache_end (rai::account const & account_a, rai::block_hash const & root_a)
+{
+	rai::lock_guard lock (precache_mutex);
+	auto existing (precaching.find (account_a));
+	if (existing != precaching.end () && existing->second == root_a)
+	{
+		precaching.erase (existing);
+	}
+}
+
+void rai::wallets::stop ()
+{
+	std::vector <rai::block_hash> roots;
+	{
+		rai::lock_guard lock (precache_mutex);
+		for (auto & i: precaching)
+		{
+			roots.push_back (i.second);
+		}
+		precaching.clear ();
+	}
+	for (auto & i: roots)
+	{
+		node.work.cancel (i);
+	}
+}
+
 rai::uint128_t const rai::wallets::generate_priority = std::numeric_limits <rai::uint128_t>::max ();
 rai::uint128_t const rai::wallets::high_priority = std::numeric_limits <rai::uint128_t>::max () - 1;
 
@@ -15,6 +15,41 @@
 
 namespace rai
 {
+// Work requests are served strictly in this order, lower values first
+enum class work_priority : uint8_t
+{
+	interactive, // Blocks a user or wallet action that's waiting on the result
+	rpc, // Requested through RPC work_generate, usually by a peer doing distributed work
+	precache // Background precomputation for an account head that isn't needed yet
+};
+class work_item
+{
+public:
+	work_item (rai::uint256_union const &, uint64_t, rai::work_priority, std::function <void (boost::optional <uint64_t> const &)> const &);
+	rai::uint256_union root;
+	uint64_t threshold;
+	rai::work_priority priority;
+	std::function <void (boost::optional <uint64_t> const &)> callback;
+	std::chrono::steady_clock::time_point queued;
+	std::chrono::steady_clock::time_point started;
+	// Number of threads currently searching this root
+	unsigned workers;
+	// Set once solved or cancelled, threads searching this root stop on their next iteration batch
+	std::atomic <bool> finished;
+};
+class work_stats
+{
+public:
+	work_stats ();
+	uint64_t solved;
+	uint64_t cancelled;
+	// Time from being queued until a thread started on the item
+	std::chrono::microseconds wait_total;
+	std::chrono::microseconds wait_max;
+	// Time from the first thread starting until a solution was found
+	std::chrono::microseconds solve_total;
+	std::chrono::microseconds solve_max;
+};
 class work_pool
 {
 public:
@@ -23,17 +58,25 @@ public:
 	void loop (uint64_t);
 	void stop ();
 	void cancel (rai::uint256_union const &);
-	uint64_t generate (rai::uint256_union const &);
-	boost::optional <uint64_t> generate_maybe (rai::uint256_union const &);
+	void generate (rai::uint256_union const &, std::function <void (boost::optional <uint64_t> const &)> const &, rai::work_priority = rai::work_priority::interactive, uint64_t = rai::work_pool::publish_threshold);
+	uint64_t generate (rai::uint256_union const &, rai::work_priority = rai::work_priority::interactive, uint64_t = rai::work_pool::publish_threshold);
+	boost::optional <uint64_t> generate_maybe (rai::uint256_union const &, rai::work_priority = rai::work_priority::interactive, uint64_t = rai::work_pool::publish_threshold);
 	uint64_t work_value (rai::block_hash const &, uint64_t);
+	void work_value_batch (std::vector <std::pair <rai::block_hash, uint64_t>> const &, std::vector <uint64_t> &);
 	bool work_validate (rai::block &);
 	bool work_validate (rai::block_hash const &, uint64_t);
-	std::atomic <int> ticket;
+	std::vector <bool> work_validate_batch (std::vector <std::pair <rai::block_hash, uint64_t>> const &);
+	std::shared_ptr <rai::work_item> select ();
+	// Incremented when a more urgent item is queued so threads reselect what they're working on
+	std::atomic <uint64_t> generation;
 	bool done;
 	std::vector <std::thread> threads;
-	std::list <std::pair <rai::uint256_union, std::promise <boost::optional <uint64_t>> *>> pending;
-	std::mutex mutex;
-	std::condition_variable producer_condition;
+	// Ordered by priority, then by arrival
+	std::list <std::shared_ptr <rai::work_item>> pending;
+	// Indexed by work_priority, protected by mutex
+	std::array <rai::work_stats, 3> stats;
+	rai::named_mutex mutex;
+	rai::condition_variable producer_condition;
 	std::unique_ptr <rai::opencl_work> opencl;
 	rai::observer_set <bool> work_observers;
 	// Local work threshold for rate-limiting publishing blocks. ~5 seconds of work.
@@ -136,6 +179,8 @@ public:
     static unsigned const kdf_full_work = 64 * 1024;
     static unsigned const kdf_test_work = 8;
     static unsigned const kdf_work = rai::rai_network == rai::rai_networks::rai_test_network ? kdf_test_work : kdf_full_work;
+	// Called with each account key added to the store
+	std::function <void (rai::public_key const &)> insert_observer;
 	rai::kdf & kdf;
 	rai::mdb_env & environment;
     MDB_dbi handle;
@@ -166,7 +211,7 @@ public:
 	void receive_async (rai::send_block const &, rai::account const &, rai::uint128_t const &, std::function <void (std::unique_ptr <rai::block>)> const &);
 	rai::block_hash send_sync (rai::account const &, rai::account const &, rai::uint128_t const &);
 	void send_async (rai::account const &, rai::account const &, rai::uint128_t const &, std::function <void (std::unique_ptr <rai::block>)> const &);
-    void work_generate (rai::account const &, rai::block_hash const &);
+    void work_precache (rai::account const &, rai::block_hash const &);
     void work_update (MDB_txn *, rai::account const &, rai::block_hash const &, uint64_t);
     uint64_t work_fetch (MDB_txn *, rai::account const &, rai::block_hash const &);
 	void work_ensure (MDB_txn *, rai::account const &);
@@ -190,11 +235,28 @@ public:
 	void do_wallet_actions (rai::account const &);
 	void queue_wallet_action (rai::account const &, rai::uint128_t const &, std::function <void ()> const &);
 	void foreach_representative (MDB_txn *, std::function <void (rai::public_key const &, rai::raw_key const &)> const &);
+	void work_precache (rai::account const &, rai::block_hash const &);
+	void work_precache_all ();
+	bool exists (rai::account const &);
+	void insert_account (rai::account const &);
+	void index_accounts (MDB_txn *);
+	bool precache_begin (rai::account const &, rai::block_hash const &);
+	void precache_end (rai::account const &, rai::block_hash const &);
+	void stop ();
 	std::function <void (rai::account const &, bool)> observer;
 	std::unordered_map <rai::uint256_union, std::shared_ptr <rai::wallet>> items;
+	// Accounts held by any wallet, may still contain removed accounts until a wallet is destroyed
+	std::unordered_set <rai::account> accounts;
+	// Guards items and accounts against wallet create and destroy
+	rai::named_mutex mutex;
 	std::unordered_map <rai::account, std::multimap <rai::uint128_t, std::function <void ()>, std::greater <rai::uint128_t>>> pending_actions;
 	std::unordered_set <rai::account> current_actions;
-	std::mutex action_mutex;
+	rai::named_mutex action_mutex;
+	// Root being precomputed for each account, a newer head cancels the previous root
+	std::unordered_map <rai::account, rai::block_hash> precaching;
+	rai::named_mutex precache_mutex;
+	std::atomic <uint64_t> work_cache_hits;
+	std::atomic <uint64_t> work_cache_misses;
 	rai::kdf kdf;
 	MDB_dbi handle;
 	rai::node & node;
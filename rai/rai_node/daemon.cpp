@@ -8,13 +8,14 @@
 rai_daemon::daemon_config::daemon_config (boost::filesystem::path const & application_path_a) :
 rpc_enable (false),
 node (application_path_a),
-opencl_enable (false)
+opencl_enable (false),
+ipc_enable (false)
 {
 }
 
 void rai_daemon::daemon_config::serialize_json (boost::property_tree::ptree & tree_a)
 {
-	tree_a.put ("version", "2");
+	tree_a.put ("version", "3");
 	tree_a.put ("rpc_enable", rpc_enable);
 	boost::property_tree::ptree rpc_l;
 	rpc.serialize_json (rpc_l);
@@ -26,6 +27,10 @@ void rai_daemon::daemon_config::serialize_json (boost::property_tree::ptree & tr
 	boost::property_tree::ptree opencl_l;
 	opencl.serialize_json (opencl_l);
 	tree_a.add_child ("opencl", opencl_l);
+	tree_a.put ("ipc_enable", ipc_enable);
+	boost::property_tree::ptree ipc_l;
+	ipc.serialize_json (ipc_l);
+	tree_a.add_child ("ipc", ipc_l);
 }
 
 bool rai_daemon::daemon_config::deserialize_json (bool & upgraded_a, boost::property_tree::ptree & tree_a)
@@ -50,6 +55,9 @@ bool rai_daemon::daemon_config::deserialize_json (bool & upgraded_a, boost::prop
 			opencl_enable = tree_a.get <bool> ("opencl_enable");
 			auto & opencl_l (tree_a.get_child ("opencl"));
 			error |= opencl.deserialize_json (opencl_l);
+			ipc_enable = tree_a.get <bool> ("ipc_enable");
+			auto & ipc_l (tree_a.get_child ("ipc"));
+			error |= ipc.deserialize_json (ipc_l);
 		}
 		else
 		{
@@ -88,6 +96,15 @@ bool rai_daemon::daemon_config::upgrade_json (unsigned version_a, boost::propert
 		result = true;
 	}
 	case 2:
+	{
+		tree_a.put ("ipc_enable", "false");
+		boost::property_tree::ptree ipc_l;
+		ipc.serialize_json (ipc_l);
+		tree_a.put_child ("ipc", ipc_l);
+		tree_a.put ("version", "3");
+		result = true;
+	}
+	case 3:
 		break;
 	default:
 		throw std::runtime_error ("Unknown daemon_config version");
@@ -120,6 +137,18 @@ void rai_daemon::daemon::run ()
 			{
 				rpc.start ();
 			}
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+			rai::ipc_server ipc (*node, config.ipc);
+			if (config.ipc_enable)
+			{
+				ipc.start ();
+			}
+#else
+			if (config.ipc_enable)
+			{
+				std::cerr << "IPC isn't supported on this platform\n";
+			}
+#endif
 			runner.reset (new rai::thread_runner (service, node->config.io_threads));
 			runner->join ();
 		}
@@ -133,3 +162,41 @@ void rai_daemon::daemon::run ()
 		std::cerr << "Error deserializing config\n";
 	}
 }
+
+void rai_daemon::daemon::run_replica (uint16_t port_a)
+{
+	auto working (rai::working_path ());
+	rai_daemon::daemon_config config (working);
+	auto config_path ((working / "config.json"));
+	std::fstream config_file;
+	auto error (rai::fetch_object (config, config_path, config_file));
+	if (!error)
+	{
+		config_file.close ();
+		boost::asio::io_service service;
+		rai::work_pool work (1, nullptr);
+		rai::alarm alarm (service);
+		rai::node_init init;
+		init.read_only = true;
+		// The node is never started so it stays off the network, an ephemeral port keeps it from clashing with the writer
+		config.node.peering_port = 0;
+		auto node (std::make_shared <rai::node> (init, service, working, alarm, config.node, work));
+		if (!init.error ())
+		{
+			config.rpc.port = port_a;
+			config.rpc.enable_control = false;
+			rai::rpc rpc (service, *node, config.rpc);
+			rpc.start ();
+			rai::thread_runner runner (service, node->config.io_threads);
+			runner.join ();
+		}
+		else
+		{
+			std::cerr << "Error opening the block store read-only, it must exist and be upgraded by the node first\n";
+		}
+	}
+	else
+	{
+		std::cerr << "Error deserializing config\n";
+	}
+}
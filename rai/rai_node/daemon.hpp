@@ -1,3 +1,4 @@
+#include <rai/node/ipc.hpp>
 #include <rai/node/node.hpp>
 #include <rai/node/rpc.hpp>
 
@@ -7,6 +8,8 @@ namespace rai_daemon
     {
     public:
         void run ();
+        // Serves the query RPC actions on the given port from a read-only view of a running node's store
+        void run_replica (uint16_t);
     };
     class daemon_config
     {
@@ -20,5 +23,7 @@ namespace rai_daemon
 		rai::node_config node;
 		bool opencl_enable;
 		rai::opencl_config opencl;
+		bool ipc_enable;
+		rai::ipc_config ipc;
     };
 }
\ No newline at end of file
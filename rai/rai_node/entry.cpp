@@ -1,6 +1,7 @@
 #include <rai/node/node.hpp>
 #include <rai/node/testing.hpp>
 #include <rai/rai_node/daemon.hpp>
+#include <rai/trace.hpp>
 
 #include <argon2.h>
 
@@ -111,6 +112,10 @@ int main (int argc, char * const * argv)
 	description.add_options ()
 		("help", "Print out options")
 		("daemon", "Start node daemon")
+		("trace", boost::program_options::value <std::string> (), "With --daemon, record tracing spans and write them to the given file as Chrome trace JSON on exit")
+		("rpc_replica", boost::program_options::value <uint16_t> (), "Serve query RPC actions on the given port from a read-only view of the block store, run several to share the port")
+		("compact", "With --daemon, compact the block store in place before opening it")
+		("mutex_stats", boost::program_options::value <std::string> (), "With --daemon, write lock contention per named mutex to the given file as JSON on exit, needs a RAIBLOCKS_MUTEX_STATS build")
 		("debug_block_count", "Display the number of block")
 		("debug_bootstrap_generate", "Generate bootstrap sequence of blocks")
 		("debug_dump_representatives", "List representatives and weights")
@@ -118,8 +123,11 @@ int main (int argc, char * const * argv)
 		("debug_mass_activity", "Generates fake debug activity")
 		("debug_profile_generate", "Profile work generation")
 		("debug_profile_verify", "Profile work verification")
+		("debug_profile_validate_batch", "Profile batched work verification against one at a time")
 		("debug_profile_kdf", "Profile kdf function")
 		("debug_verify_profile", "Profile signature verification")
+		("rebuild_weights", "Recompute every representative's weight from account balances on all cores")
+		("debug_validate_ledger", "Check signatures, work, chain links, balances, pending entries and representative weights on all cores")
 		("debug_xorshift_profile", "Profile xorshift algorithms");
 	boost::program_options::variables_map vm;
 	boost::program_options::store (boost::program_options::parse_command_line(argc, argv, description), vm);
@@ -131,7 +139,35 @@ int main (int argc, char * const * argv)
 	else if (vm.count ("daemon") > 0)
 	{
         rai_daemon::daemon daemon;
+		if (vm.count ("compact") > 0)
+		{
+			if (rai::compact_store (rai::working_path () / "data.ldb"))
+			{
+				std::cerr << "Error compacting block store\n";
+			}
+		}
+		if (vm.count ("trace") > 0)
+		{
+			rai::trace.enabled = true;
+		}
         daemon.run ();
+		if (vm.count ("trace") > 0)
+		{
+			std::ofstream trace_file (vm ["trace"].as <std::string> ());
+			rai::trace.chrome_json (trace_file, rai::trace.epoch);
+		}
+		if (vm.count ("mutex_stats") > 0)
+		{
+			boost::property_tree::ptree tree;
+			rai::mutexes.serialize_json (tree);
+			std::ofstream mutex_file (vm ["mutex_stats"].as <std::string> ());
+			boost::property_tree::write_json (mutex_file, tree);
+		}
+	}
+	else if (vm.count ("rpc_replica") > 0)
+	{
+		rai_daemon::daemon daemon;
+		daemon.run_replica (vm ["rpc_replica"].as <uint16_t> ());
 	}
 	else if (vm.count ("debug_block_count"))
 	{
@@ -187,6 +223,24 @@ int main (int argc, char * const * argv)
 			result = -1;
 		}
 	}
+	else if (vm.count ("rebuild_weights"))
+	{
+		rai::inactive_node node;
+		auto begin (std::chrono::steady_clock::now ());
+		auto changed (node.node->store.rebuild_weights (std::thread::hardware_concurrency ()));
+		auto elapsed (std::chrono::duration_cast <std::chrono::milliseconds> (std::chrono::steady_clock::now () - begin).count ());
+		std::cout << boost::str (boost::format ("Rebuilt representative weights in %1% ms, %2% had drifted\n") % elapsed % changed);
+	}
+	else if (vm.count ("debug_validate_ledger"))
+	{
+		rai::inactive_node node;
+		rai::ledger_validator validator (*node.node);
+		validator.run (std::thread::hardware_concurrency ());
+		if (validator.report (std::cout))
+		{
+			result = -1;
+		}
+	}
 	else if (vm.count ("debug_dump_representatives"))
 	{
 		rai::inactive_node node;
@@ -268,6 +322,32 @@ int main (int argc, char * const * argv)
             std::cerr << boost::str (boost::format ("%|1$ 12d|\n") % std::chrono::duration_cast <std::chrono::microseconds> (end1 - begin1).count ());
         }
     }
+    else if (vm.count ("debug_profile_validate_batch"))
+    {
+		rai::work_pool work (std::numeric_limits <unsigned>::max (), nullptr);
+		std::vector <std::pair <rai::block_hash, uint64_t>> items;
+		for (uint64_t i (0); i < 1024; ++i)
+		{
+			rai::block_hash root;
+			rai::random_pool.GenerateBlock (root.bytes.data (), root.bytes.size ());
+			items.push_back (std::make_pair (root, i));
+		}
+		std::cerr << "Starting batched verification profiling\n";
+		for (uint64_t i (0); true; ++i)
+		{
+			auto begin1 (std::chrono::high_resolution_clock::now ());
+			size_t invalid1 (0);
+			for (auto & j: items)
+			{
+				invalid1 += work.work_validate (j.first, j.second) ? 1 : 0;
+			}
+			auto end1 (std::chrono::high_resolution_clock::now ());
+			auto invalid2 (work.work_validate_batch (items));
+			auto end2 (std::chrono::high_resolution_clock::now ());
+			assert (invalid1 == std::count (invalid2.begin (), invalid2.end (), true));
+			std::cerr << boost::str (boost::format ("Single %|1$ 8d|us batch %|2$ 8d|us for %3% roots\n") % std::chrono::duration_cast <std::chrono::microseconds> (end1 - begin1).count () % std::chrono::duration_cast <std::chrono::microseconds> (end2 - end1).count () % items.size ());
+		}
+    }
     else if (vm.count ("debug_verify_profile"))
     {
         rai::keypair key;
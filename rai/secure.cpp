@@ -1,6 +1,7 @@
 #include <rai/secure.hpp>
 
 #include <rai/node/working.hpp>
+#include <rai/trace.hpp>
 #include <rai/versioning.hpp>
 
 #include <boost/property_tree/json_parser.hpp>
@@ -10,6 +11,9 @@
 #include <ed25519-donna/ed25519.h>
 
 #include <queue>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
 
 // Genesis keys for network variants
 namespace
@@ -1501,8 +1505,291 @@ size_t rai::block_counts::sum ()
 	return send + receive + open + change;
 }
 
-rai::block_store::block_store (bool & error_a, boost::filesystem::path const & path_a) :
-environment (error_a, path_a),
+namespace
+{
+rai::uint256_union view_read (uint8_t const * data_a, size_t offset_a)
+{
+	rai::uint256_union result;
+	std::copy (data_a + offset_a, data_a + offset_a + result.bytes.size (), result.bytes.begin ());
+	return result;
+}
+}
+
+rai::block_view::block_view () :
+type_m (rai::block_type::invalid),
+data (nullptr),
+size (0)
+{
+}
+
+rai::block_view::block_view (rai::block_type type_a, MDB_val const & value_a) :
+type_m (type_a),
+data (reinterpret_cast <uint8_t const *> (value_a.mv_data)),
+size (value_a.mv_size)
+{
+	assert (size == block_size () + sizeof (rai::block_hash));
+}
+
+rai::block_view::block_view (rai::block_type type_a, uint8_t const * data_a) :
+type_m (type_a),
+data (data_a),
+size (block_size ())
+{
+}
+
+bool rai::block_view::valid () const
+{
+	return data != nullptr;
+}
+
+rai::block_type rai::block_view::type () const
+{
+	return type_m;
+}
+
+size_t rai::block_view::block_size () const
+{
+	size_t result (0);
+	switch (type_m)
+	{
+		case rai::block_type::send:
+			result = rai::send_block::size;
+			break;
+		case rai::block_type::receive:
+			result = rai::receive_block::size;
+			break;
+		case rai::block_type::open:
+			result = rai::open_block::size;
+			break;
+		case rai::block_type::change:
+			result = rai::change_block::size;
+			break;
+		default:
+			assert (false);
+			break;
+	}
+	return result;
+}
+
+rai::block_hash rai::block_view::hash () const
+{
+	// Hashables are serialized first and in hashing order, followed by the signature and work
+	rai::block_hash result;
+	blake2b_state hash_l;
+	auto status (blake2b_init (&hash_l, sizeof (result.bytes)));
+	assert (status == 0);
+	status = blake2b_update (&hash_l, data, block_size () - sizeof (rai::signature) - sizeof (uint64_t));
+	assert (status == 0);
+	status = blake2b_final (&hash_l, result.bytes.data (), sizeof (result.bytes));
+	assert (status == 0);
+	return result;
+}
+
+rai::block_hash rai::block_view::previous () const
+{
+	return type_m != rai::block_type::open ? view_read (data, 0) : rai::block_hash (0);
+}
+
+rai::block_hash rai::block_view::source () const
+{
+	rai::block_hash result (0);
+	switch (type_m)
+	{
+		case rai::block_type::receive:
+			result = view_read (data, sizeof (rai::block_hash));
+			break;
+		case rai::block_type::open:
+			result = view_read (data, 0);
+			break;
+		default:
+			break;
+	}
+	return result;
+}
+
+rai::block_hash rai::block_view::root () const
+{
+	return type_m != rai::block_type::open ? view_read (data, 0) : view_read (data, sizeof (rai::block_hash) + sizeof (rai::account));
+}
+
+rai::account rai::block_view::representative () const
+{
+	return type_m == rai::block_type::open || type_m == rai::block_type::change ? view_read (data, sizeof (rai::block_hash)) : rai::account (0);
+}
+
+rai::account rai::block_view::destination () const
+{
+	return type_m == rai::block_type::send ? view_read (data, sizeof (rai::block_hash)) : rai::account (0);
+}
+
+rai::amount rai::block_view::balance () const
+{
+	rai::amount result (0);
+	if (type_m == rai::block_type::send)
+	{
+		auto begin (data + sizeof (rai::block_hash) + sizeof (rai::account));
+		std::copy (begin, begin + result.bytes.size (), result.bytes.begin ());
+	}
+	return result;
+}
+
+uint64_t rai::block_view::block_work () const
+{
+	uint64_t result;
+	std::copy (data + block_size () - sizeof (result), data + block_size (), reinterpret_cast <uint8_t *> (&result));
+	return result;
+}
+
+rai::block_hash rai::block_view::successor () const
+{
+	return view_read (data, block_size ());
+}
+
+std::unique_ptr <rai::block> rai::block_view::block () const
+{
+	rai::bufferstream stream (data, block_size ());
+	return rai::deserialize_block (stream, type_m);
+}
+
+static_assert (std::is_trivially_copyable <rai::block_value>::value, "Block values are copied as plain bytes");
+static_assert (rai::open_block::size >= rai::send_block::size && rai::open_block::size >= rai::receive_block::size && rai::open_block::size >= rai::change_block::size, "Open blocks are the largest");
+
+rai::block_value::block_value () :
+type (rai::block_type::invalid)
+{
+}
+
+rai::block_value::block_value (rai::block const & block_a) :
+type (block_a.type ())
+{
+	std::vector <uint8_t> bytes_l;
+	{
+		rai::vectorstream stream (bytes_l);
+		block_a.serialize (stream);
+	}
+	assert (bytes_l.size () <= bytes.size ());
+	std::copy (bytes_l.begin (), bytes_l.end (), bytes.begin ());
+}
+
+rai::block_value::block_value (rai::block_type type_a, uint8_t const * data_a) :
+type (type_a)
+{
+	auto size (rai::block_view (type_a, data_a).block_size ());
+	std::copy (data_a, data_a + size, bytes.begin ());
+}
+
+rai::block_view rai::block_value::view () const
+{
+	return rai::block_view (type, bytes.data ());
+}
+
+uint64_t rai::checksum_prefix (rai::account const & account_a, uint8_t depth_a)
+{
+	assert (depth_a <= rai::checksum_leaf_depth);
+	// Account numbers are stored most significant byte first
+	uint64_t top (0);
+	for (auto i (0); i < 8; ++i)
+	{
+		top = (top << 8) | account_a.bytes [i];
+	}
+	return depth_a == 0 ? 0 : top & (~uint64_t (0) << (64 - depth_a));
+}
+
+std::pair <rai::account, rai::account> rai::checksum_range (uint64_t prefix_a, uint8_t depth_a)
+{
+	rai::uint256_t first (rai::uint256_t (prefix_a) << 192);
+	rai::uint256_t span (depth_a == 0 ? std::numeric_limits <rai::uint256_t>::max () : (rai::uint256_t (1) << (256 - depth_a)) - 1);
+	return std::make_pair (rai::account (first), rai::account (first + span));
+}
+
+size_t constexpr rai::store_cache::default_capacity;
+
+rai::store_cache::store_cache (size_t capacity_a) :
+capacity (capacity_a)
+{
+}
+
+bool rai::store_cache::account_get (rai::account const & account_a, rai::account_info & info_a)
+{
+	auto existing (accounts.find (account_a));
+	auto result (existing == accounts.end ());
+	if (!result)
+	{
+		info_a = existing->second;
+	}
+	if (account_observer)
+	{
+		account_observer (!result);
+	}
+	return result;
+}
+
+void rai::store_cache::account_put (rai::account const & account_a, rai::account_info const & info_a)
+{
+	if (capacity > 0)
+	{
+		if (accounts.size () >= capacity && accounts.find (account_a) == accounts.end ())
+		{
+			// Any entry will do, hot rows come straight back on their next read
+			accounts.erase (accounts.begin ());
+		}
+		accounts [account_a] = info_a;
+	}
+}
+
+void rai::store_cache::account_del (rai::account const & account_a)
+{
+	accounts.erase (account_a);
+}
+
+bool rai::store_cache::representation_get (rai::account const & account_a, rai::uint128_t & representation_a)
+{
+	auto existing (representation.find (account_a));
+	auto result (existing == representation.end ());
+	if (!result)
+	{
+		representation_a = existing->second;
+	}
+	if (representation_observer)
+	{
+		representation_observer (!result);
+	}
+	return result;
+}
+
+void rai::store_cache::representation_put (rai::account const & account_a, rai::uint128_t const & representation_a)
+{
+	if (capacity > 0)
+	{
+		if (representation.size () >= capacity && representation.find (account_a) == representation.end ())
+		{
+			representation.erase (representation.begin ());
+		}
+		representation [account_a] = representation_a;
+	}
+}
+
+void rai::store_cache::clear ()
+{
+	accounts.clear ();
+	representation.clear ();
+}
+
+int constexpr rai::block_store::version_current;
+
+std::vector <rai::account> rai::account_range_starts (size_t count_a)
+{
+	rai::uint256_t step (std::numeric_limits <rai::uint256_t>::max () / count_a);
+	std::vector <rai::account> result;
+	for (size_t i (0); i < count_a; ++i)
+	{
+		result.push_back (step * i);
+	}
+	return result;
+}
+
+rai::block_store::block_store (bool & error_a, boost::filesystem::path const & path_a, bool read_only_a) :
+environment (error_a, path_a, read_only_a),
 frontiers (0),
 accounts (0),
 send_blocks (0),
@@ -1513,30 +1800,56 @@ pending (0),
 representation (0),
 unchecked (0),
 unsynced (0),
-checksum (0)
+checksum (0),
+heights (0),
+pruned (0),
+cache (rai::store_cache::default_capacity)
 {
 	if (!error_a)
 	{
-		rai::transaction transaction (environment, nullptr, true);
-		error_a |= mdb_dbi_open (transaction, "frontiers", MDB_CREATE, &frontiers) != 0;
-		error_a |= mdb_dbi_open (transaction, "accounts", MDB_CREATE, &accounts) != 0;
-		error_a |= mdb_dbi_open (transaction, "send", MDB_CREATE, &send_blocks) != 0;
-		error_a |= mdb_dbi_open (transaction, "receive", MDB_CREATE, &receive_blocks) != 0;
-		error_a |= mdb_dbi_open (transaction, "open", MDB_CREATE, &open_blocks) != 0;
-		error_a |= mdb_dbi_open (transaction, "change", MDB_CREATE, &change_blocks) != 0;
-		error_a |= mdb_dbi_open (transaction, "pending", MDB_CREATE, &pending) != 0;
-		error_a |= mdb_dbi_open (transaction, "representation", MDB_CREATE, &representation) != 0;
-		error_a |= mdb_dbi_open (transaction, "unchecked", MDB_CREATE, &unchecked) != 0;
-		error_a |= mdb_dbi_open (transaction, "unsynced", MDB_CREATE, &unsynced) != 0;
-		error_a |= mdb_dbi_open (transaction, "checksum", MDB_CREATE, &checksum) != 0;
-		error_a |= mdb_dbi_open (transaction, "sequence", MDB_CREATE, &sequence) != 0;
-		error_a |= mdb_dbi_open (transaction, "meta", MDB_CREATE, &meta) != 0;
+		rai::transaction transaction (environment, nullptr, !read_only_a);
+		auto flags (read_only_a ? 0 : MDB_CREATE);
+		error_a |= mdb_dbi_open (transaction, "frontiers", flags, &frontiers) != 0;
+		error_a |= mdb_dbi_open (transaction, "accounts", flags, &accounts) != 0;
+		error_a |= mdb_dbi_open (transaction, "send", flags, &send_blocks) != 0;
+		error_a |= mdb_dbi_open (transaction, "receive", flags, &receive_blocks) != 0;
+		error_a |= mdb_dbi_open (transaction, "open", flags, &open_blocks) != 0;
+		error_a |= mdb_dbi_open (transaction, "change", flags, &change_blocks) != 0;
+		error_a |= mdb_dbi_open (transaction, "pending", flags, &pending) != 0;
+		error_a |= mdb_dbi_open (transaction, "representation", flags, &representation) != 0;
+		error_a |= mdb_dbi_open (transaction, "unchecked", flags, &unchecked) != 0;
+		error_a |= mdb_dbi_open (transaction, "unsynced", flags, &unsynced) != 0;
+		error_a |= mdb_dbi_open (transaction, "checksum", flags, &checksum) != 0;
+		error_a |= mdb_dbi_open (transaction, "sequence", flags, &sequence) != 0;
+		error_a |= mdb_dbi_open (transaction, "meta", flags, &meta) != 0;
+		error_a |= mdb_dbi_open (transaction, "heights", flags, &heights) != 0;
+		error_a |= mdb_dbi_open (transaction, "pruned", flags, &pruned) != 0;
 		if (!error_a)
 		{
-			do_upgrades (transaction);
-			checksum_put (transaction, 0, 0, 0);
+			if (!read_only_a)
+			{
+				do_upgrades (transaction);
+			}
+			else
+			{
+				error_a = version_get (transaction) != version_current;
+			}
+		}
+	}
+	if (!error_a && !read_only_a)
+	{
+		auto stale (false);
+		{
+			rai::transaction transaction (environment, nullptr, false);
+			stale = weights_stale (transaction);
+		}
+		if (stale)
+		{
+			rebuild_weights (std::thread::hardware_concurrency ());
 		}
 	}
+	// Upgrades rewrite rows with cursors behind the cache's back
+	cache.clear ();
 }
 
 void rai::block_store::version_put (MDB_txn * transaction_a, int version_a)
@@ -1566,6 +1879,96 @@ int rai::block_store::version_get (MDB_txn * transaction_a)
 	return result;
 }
 
+void rai::block_store::weights_stale_put (MDB_txn * transaction_a)
+{
+	rai::uint256_union stale_key (2);
+	rai::uint256_union stale_value (1);
+	auto status (mdb_put (transaction_a, meta, stale_key.val (), stale_value.val (), 0));
+	assert (status == 0);
+}
+
+bool rai::block_store::weights_stale (MDB_txn * transaction_a)
+{
+	rai::uint256_union stale_key (2);
+	MDB_val data {0, nullptr};
+	return mdb_get (transaction_a, meta, stale_key.val (), &data) == 0;
+}
+
+size_t rai::block_store::rebuild_weights (unsigned threads_a)
+{
+	rai::transaction transaction (environment, nullptr, true);
+	auto threads_l (std::max (1u, threads_a));
+	// More ranges than threads so a thread that drew dense ranges doesn't hold up the others
+	auto starts (rai::account_range_starts (threads_l * 16));
+	std::atomic <size_t> next (0);
+	std::vector <std::unordered_map <rai::account, rai::uint128_t>> sums (threads_l);
+	std::vector <std::thread> threads;
+	for (auto i (0u); i < threads_l; ++i)
+	{
+		threads.push_back (std::thread ([this, &starts, &next, &sums, i] ()
+		{
+			auto & sums_l (sums [i]);
+			rai::transaction transaction_l (environment, nullptr, false);
+			for (auto range (next++); range < starts.size (); range = next++)
+			{
+				rai::account end (range + 1 < starts.size () ? starts [range + 1] : rai::account (0));
+				for (auto j (latest_begin (transaction_l, starts [range])), n (latest_end ()); j != n && (end.is_zero () || rai::account (j->first).number () < end.number ()); ++j)
+				{
+					rai::account_info info (j->second);
+					auto block (block_get (transaction_l, info.rep_block));
+					assert (block != nullptr);
+					sums_l [block->representative ()] += info.balance.number ();
+				}
+			}
+		}));
+	}
+	for (auto & i: threads)
+	{
+		i.join ();
+	}
+	std::unordered_map <rai::account, rai::uint128_t> weights;
+	for (auto & i: sums)
+	{
+		for (auto & j: i)
+		{
+			weights [j.first] += j.second;
+		}
+	}
+	size_t result (0);
+	std::unordered_set <rai::account> stored;
+	for (auto i (representation_begin (transaction)), n (representation_end ()); i != n; ++i)
+	{
+		rai::account representative (i->first);
+		stored.insert (representative);
+		auto existing (weights.find (representative));
+		if (representation_get (transaction, representative) != (existing != weights.end () ? existing->second : 0))
+		{
+			++result;
+		}
+	}
+	for (auto & i: weights)
+	{
+		if (i.second != 0 && stored.find (i.first) == stored.end ())
+		{
+			++result;
+		}
+	}
+	auto status1 (mdb_drop (transaction, representation, 0));
+	assert (status1 == 0);
+	cache.clear ();
+	for (auto & i: weights)
+	{
+		if (i.second != 0)
+		{
+			representation_put (transaction, i.first, i.second);
+		}
+	}
+	rai::uint256_union stale_key (2);
+	auto status2 (mdb_del (transaction, meta, stale_key.val (), nullptr));
+	assert (status2 == 0 || status2 == MDB_NOTFOUND);
+	return result;
+}
+
 void rai::block_store::do_upgrades (MDB_txn * transaction_a)
 {
 	switch (version_get (transaction_a))
@@ -1579,6 +1982,10 @@ void rai::block_store::do_upgrades (MDB_txn * transaction_a)
 		case 4:
 			upgrade_v4_to_v5 (transaction_a);
 		case 5:
+			upgrade_v5_to_v6 (transaction_a);
+		case 6:
+			upgrade_v6_to_v7 (transaction_a);
+		case 7:
 			break;
 		default:
 		assert (false);
@@ -1635,8 +2042,19 @@ public:
 		while (result.is_zero ())
 		{
 			auto block (store.block_get (transaction, current));
-			assert (block != nullptr);
-			block->visit (*this);
+			if (block != nullptr)
+			{
+				block->visit (*this);
+			}
+			else
+			{
+				// Walked into pruned history, the newest pruned block remembers the representative
+				rai::pruned_info info;
+				auto error (store.pruned_get (transaction, current, info));
+				assert (!error);
+				assert (!info.rep_block.is_zero ());
+				result = info.rep_block;
+			}
 		}
     }
     void send_block (rai::send_block const & block_a) override
@@ -1664,7 +2082,7 @@ public:
 void rai::block_store::upgrade_v2_to_v3 (MDB_txn * transaction_a)
 {
 	version_put (transaction_a, 3);
-	mdb_drop (transaction_a, representation, 0);
+	cache.clear ();
 	for (auto i (latest_begin (transaction_a)), n (latest_end ()); i != n; ++i)
 	{
 		rai::account account_l (i->first);
@@ -1674,8 +2092,9 @@ void rai::block_store::upgrade_v2_to_v3 (MDB_txn * transaction_a)
 		assert (!visitor.result.is_zero ());
 		info.rep_block = visitor.result;
 		mdb_cursor_put (i.cursor, account_l.val (), info.val (), MDB_CURRENT);
-		representation_add (transaction_a, visitor.result, info.balance.number());
 	}
+	// Weights are summed once the upgrade has committed and readers on other threads can see the new rep_blocks
+	weights_stale_put (transaction_a);
 }
 
 void rai::block_store::upgrade_v3_to_v4 (MDB_txn * transaction_a)
@@ -1722,11 +2141,47 @@ void rai::block_store::upgrade_v4_to_v5 (MDB_txn * transaction_a)
 	//std::cerr << boost::str (boost::format ("Fixed up %1% blocks\n") % fixes);
 }
 
+void rai::block_store::upgrade_v5_to_v6 (MDB_txn * transaction_a)
+{
+	version_put (transaction_a, 6);
+	for (auto i (latest_begin (transaction_a)), n (latest_end ()); i != n; ++i)
+	{
+		rai::account account (i->first);
+		rai::account_info info (i->second);
+		std::vector <rai::block_hash> chain;
+		for (auto hash (info.head); !hash.is_zero (); hash = block_previous (transaction_a, hash))
+		{
+			chain.push_back (hash);
+		}
+		uint64_t height (chain.size ());
+		for (auto & j: chain)
+		{
+			height_put (transaction_a, account, height, j);
+			--height;
+		}
+	}
+}
+
+void rai::block_store::upgrade_v6_to_v7 (MDB_txn * transaction_a)
+{
+	version_put (transaction_a, 7);
+	// Only the root used to be maintained, and it was reset every time the store was opened
+	mdb_drop (transaction_a, checksum, 0);
+	for (auto i (latest_begin (transaction_a)), n (latest_end ()); i != n; ++i)
+	{
+		checksum_xor (transaction_a, rai::account (i->first), rai::account_info (i->second).head);
+	}
+}
+
 void rai::block_store::clear (MDB_dbi db_a)
 {
 	rai::transaction transaction (environment, nullptr, true);
 	auto status (mdb_drop (transaction, db_a, 0));
 	assert (status == 0);
+	if (db_a == accounts || db_a == representation)
+	{
+		cache.clear ();
+	}
 }
 
 namespace
@@ -1920,10 +2375,48 @@ rai::block_hash rai::block_store::block_successor (MDB_txn * transaction_a, rai:
 	return result;
 }
 
+// Reads previous out of the stored block without deserializing it, zero for open blocks and missing blocks
+rai::block_hash rai::block_store::block_previous (MDB_txn * transaction_a, rai::block_hash const & hash_a)
+{
+	rai::block_type type;
+	auto value (block_get_raw (transaction_a, hash_a, type));
+	rai::block_hash result (0);
+	if (value.mv_size != 0 && type != rai::block_type::open)
+	{
+		// previous is the first field of send, receive and change blocks
+		rai::bufferstream stream (reinterpret_cast <uint8_t const *> (value.mv_data), value.mv_size);
+		auto error (rai::read (stream, result.bytes));
+		assert (!error);
+	}
+	return result;
+}
+
 void rai::block_store::block_successor_clear (MDB_txn * transaction_a, rai::block_hash const & hash_a)
 {
-	auto block (block_get (transaction_a, hash_a));
-	block_put (transaction_a, hash_a, *block);
+	block_successor_set (transaction_a, hash_a, rai::block_hash (0));
+}
+
+void rai::block_store::block_successor_set (MDB_txn * transaction_a, rai::block_hash const & hash_a, rai::block_hash const & successor_a)
+{
+	// Rewritten in place, putting the block again would touch its predecessor which may have been pruned
+	rai::block_type type;
+	auto value (block_get_raw (transaction_a, hash_a, type));
+	assert (value.mv_size != 0);
+	std::vector <uint8_t> data (static_cast <uint8_t *> (value.mv_data), static_cast <uint8_t *> (value.mv_data) + value.mv_size);
+	std::copy (successor_a.bytes.begin (), successor_a.bytes.end (), data.end () - sizeof (rai::block_hash));
+	block_put_raw (transaction_a, block_database (type), hash_a, rai::mdb_val (data.size (), data.data ()));
+}
+
+rai::block_view rai::block_store::block_get_view (MDB_txn * transaction_a, rai::block_hash const & hash_a)
+{
+	rai::block_type type;
+	auto value (block_get_raw (transaction_a, hash_a, type));
+	rai::block_view result;
+	if (value.mv_size != 0)
+	{
+		result = rai::block_view (type, value);
+	}
+	return result;
 }
 
 std::unique_ptr <rai::block> rai::block_store::block_get (MDB_txn * transaction_a, rai::block_hash const & hash_a)
@@ -2015,6 +2508,7 @@ void rai::block_store::account_del (MDB_txn * transaction_a, rai::account const
 {
 	auto status (mdb_del (transaction_a, accounts, account_a.val (), nullptr));
     assert (status == 0);
+	cache.account_del (account_a);
 }
 
 bool rai::block_store::account_exists (MDB_txn * transaction_a, rai::account const & account_a)
@@ -2025,21 +2519,30 @@ bool rai::block_store::account_exists (MDB_txn * transaction_a, rai::account con
 
 bool rai::block_store::account_get (MDB_txn * transaction_a, rai::account const & account_a, rai::account_info & info_a)
 {
-	MDB_val value;
-	auto status (mdb_get (transaction_a, accounts, account_a.val (), &value));
-	assert (status == 0 || status == MDB_NOTFOUND);
-    bool result;
-    if (status == MDB_NOTFOUND)
-    {
-        result = true;
-    }
-    else
-    {
-        rai::bufferstream stream (reinterpret_cast <uint8_t const *> (value.mv_data), value.mv_size);
-        result = info_a.deserialize (stream);
-        assert (!result);
-    }
-    return result;
+	auto cached (transaction_a == environment.writer);
+	if (!cached || cache.account_get (account_a, info_a))
+	{
+		MDB_val value;
+		auto status (mdb_get (transaction_a, accounts, account_a.val (), &value));
+		assert (status == 0 || status == MDB_NOTFOUND);
+		bool result;
+		if (status == MDB_NOTFOUND)
+		{
+			result = true;
+		}
+		else
+		{
+			rai::bufferstream stream (reinterpret_cast <uint8_t const *> (value.mv_data), value.mv_size);
+			result = info_a.deserialize (stream);
+			assert (!result);
+			if (cached)
+			{
+				cache.account_put (account_a, info_a);
+			}
+		}
+		return result;
+	}
+	return false;
 }
 	
 void rai::block_store::frontier_put (MDB_txn * transaction_a, rai::block_hash const & block_a, rai::account const & account_a)
@@ -2078,13 +2581,9 @@ size_t rai::block_store::frontier_count (MDB_txn * transaction_a)
 
 void rai::block_store::account_put (MDB_txn * transaction_a, rai::account const & account_a, rai::account_info const & info_a)
 {
-    std::vector <uint8_t> vector;
-    {
-        rai::vectorstream stream (vector);
-        info_a.serialize (stream);
-    }
 	auto status (mdb_put (transaction_a, accounts, account_a.val (), info_a.val (), 0));
     assert (status == 0);
+	cache.account_put (account_a, info_a);
 }
 
 void rai::block_store::pending_put (MDB_txn * transaction_a, rai::pending_key const & key_a, rai::pending_info const & pending_a)
@@ -2179,81 +2678,280 @@ void rai::pending_info::serialize (rai::stream & stream_a) const
 
 bool rai::pending_info::deserialize (rai::stream & stream_a)
 {
-    auto result (rai::read (stream_a, source.bytes));
-    if (!result)
-    {
-        result = rai::read (stream_a, amount.bytes);
-    }
-    return result;
+    auto result (rai::read (stream_a, source.bytes));
+    if (!result)
+    {
+        result = rai::read (stream_a, amount.bytes);
+    }
+    return result;
+}
+
+bool rai::pending_info::operator == (rai::pending_info const & other_a) const
+{
+    return source == other_a.source && amount == other_a.amount;
+}
+
+rai::mdb_val rai::pending_info::val () const
+{
+	return rai::mdb_val (sizeof (*this), const_cast <rai::pending_info *> (this));
+}
+
+rai::pruned_info::pruned_info () :
+type (rai::block_type::invalid),
+account (0),
+balance (0),
+amount (0),
+rep_block (0)
+{
+}
+
+rai::pruned_info::pruned_info (rai::block_type type_a, rai::account const & account_a, rai::amount const & balance_a, rai::amount const & amount_a, rai::block_hash const & rep_block_a) :
+type (type_a),
+account (account_a),
+balance (balance_a),
+amount (amount_a),
+rep_block (rep_block_a)
+{
+}
+
+void rai::pruned_info::serialize (rai::stream & stream_a) const
+{
+	rai::write (stream_a, type);
+	rai::write (stream_a, account.bytes);
+	rai::write (stream_a, balance.bytes);
+	rai::write (stream_a, amount.bytes);
+	rai::write (stream_a, rep_block.bytes);
+}
+
+bool rai::pruned_info::deserialize (rai::stream & stream_a)
+{
+	auto result (rai::read (stream_a, type));
+	if (!result)
+	{
+		result = rai::read (stream_a, account.bytes);
+		if (!result)
+		{
+			result = rai::read (stream_a, balance.bytes);
+			if (!result)
+			{
+				result = rai::read (stream_a, amount.bytes);
+				if (!result)
+				{
+					result = rai::read (stream_a, rep_block.bytes);
+				}
+			}
+		}
+	}
+	return result;
+}
+
+rai::pending_key::pending_key (rai::account const & account_a, rai::block_hash const & hash_a) :
+account (account_a),
+hash (hash_a)
+{
+}
+
+rai::pending_key::pending_key (MDB_val const & val_a)
+{
+	assert(val_a.mv_size == sizeof (*this));
+	static_assert (sizeof (account) + sizeof (hash) == sizeof (*this), "Packed class");
+	std::copy (reinterpret_cast <uint8_t const *> (val_a.mv_data), reinterpret_cast <uint8_t const *> (val_a.mv_data) + sizeof (*this), reinterpret_cast <uint8_t *> (this));
+}
+
+void rai::pending_key::serialize (rai::stream & stream_a) const
+{
+	rai::write (stream_a, account.bytes);
+	rai::write (stream_a, hash.bytes);
+}
+
+bool rai::pending_key::deserialize (rai::stream & stream_a)
+{
+	auto result (rai::read (stream_a, account.bytes));
+	if (!result)
+	{
+		result = rai::read (stream_a, hash.bytes);
+	}
+	return result;
+}
+
+bool rai::pending_key::operator == (rai::pending_key const & other_a) const
+{
+	return account == other_a.account && hash == other_a.hash;
+}
+
+rai::mdb_val rai::pending_key::val () const
+{
+	return rai::mdb_val (sizeof (*this), const_cast <rai::pending_key *> (this));
+}
+
+rai::height_key::height_key (rai::account const & account_a, uint64_t height_a) :
+account (account_a)
+{
+	for (auto i (height_bytes.rbegin ()), n (height_bytes.rend ()); i != n; ++i)
+	{
+		*i = static_cast <uint8_t> (height_a);
+		height_a >>= 8;
+	}
+}
+
+rai::height_key::height_key (MDB_val const & val_a)
+{
+	assert (val_a.mv_size == sizeof (*this));
+	static_assert (sizeof (account) + sizeof (height_bytes) == sizeof (*this), "Packed class");
+	std::copy (reinterpret_cast <uint8_t const *> (val_a.mv_data), reinterpret_cast <uint8_t const *> (val_a.mv_data) + sizeof (*this), reinterpret_cast <uint8_t *> (this));
+}
+
+uint64_t rai::height_key::height () const
+{
+	uint64_t result (0);
+	for (auto i: height_bytes)
+	{
+		result = (result << 8) | i;
+	}
+	return result;
+}
+
+rai::mdb_val rai::height_key::val () const
+{
+	return rai::mdb_val (sizeof (*this), const_cast <rai::height_key *> (this));
+}
+
+void rai::block_store::height_put (MDB_txn * transaction_a, rai::account const & account_a, uint64_t height_a, rai::block_hash const & hash_a)
+{
+	auto status (mdb_put (transaction_a, heights, rai::height_key (account_a, height_a).val (), hash_a.val (), 0));
+	assert (status == 0);
+}
+
+void rai::block_store::height_del (MDB_txn * transaction_a, rai::account const & account_a, uint64_t height_a)
+{
+	auto status (mdb_del (transaction_a, heights, rai::height_key (account_a, height_a).val (), nullptr));
+	assert (status == 0);
 }
 
-bool rai::pending_info::operator == (rai::pending_info const & other_a) const
+rai::block_hash rai::block_store::height_get (MDB_txn * transaction_a, rai::account const & account_a, uint64_t height_a)
 {
-    return source == other_a.source && amount == other_a.amount;
+	MDB_val value;
+	auto status (mdb_get (transaction_a, heights, rai::height_key (account_a, height_a).val (), &value));
+	assert (status == 0 || status == MDB_NOTFOUND);
+	rai::block_hash result (0);
+	if (status == 0)
+	{
+		result = rai::block_hash (value);
+	}
+	return result;
 }
 
-rai::mdb_val rai::pending_info::val () const
+// Height of the account's head block, 0 if the account isn't open
+uint64_t rai::block_store::height_latest (MDB_txn * transaction_a, rai::account const & account_a)
 {
-	return rai::mdb_val (sizeof (*this), const_cast <rai::pending_info *> (this));
+	uint64_t result (0);
+	MDB_cursor * cursor;
+	auto status (mdb_cursor_open (transaction_a, heights, &cursor));
+	assert (status == 0);
+	rai::height_key key (account_a, std::numeric_limits <uint64_t>::max ());
+	MDB_val key_l (key.val ());
+	MDB_val value;
+	auto status2 (mdb_cursor_get (cursor, &key_l, &value, MDB_SET_RANGE));
+	auto status3 (mdb_cursor_get (cursor, &key_l, &value, status2 == 0 ? MDB_PREV : MDB_LAST));
+	if (status3 == 0)
+	{
+		rai::height_key found (key_l);
+		if (found.account == account_a)
+		{
+			result = found.height ();
+		}
+	}
+	mdb_cursor_close (cursor);
+	return result;
 }
 
-rai::pending_key::pending_key (rai::account const & account_a, rai::block_hash const & hash_a) :
-account (account_a),
-hash (hash_a)
+rai::store_iterator rai::block_store::height_begin (MDB_txn * transaction_a, rai::account const & account_a, uint64_t height_a)
 {
+	rai::store_iterator result (transaction_a, heights, rai::height_key (account_a, height_a).val ());
+	return result;
 }
 
-rai::pending_key::pending_key (MDB_val const & val_a)
+rai::store_iterator rai::block_store::height_end ()
 {
-	assert(val_a.mv_size == sizeof (*this));
-	static_assert (sizeof (account) + sizeof (hash) == sizeof (*this), "Packed class");
-	std::copy (reinterpret_cast <uint8_t const *> (val_a.mv_data), reinterpret_cast <uint8_t const *> (val_a.mv_data) + sizeof (*this), reinterpret_cast <uint8_t *> (this));
+	rai::store_iterator result (nullptr);
+	return result;
 }
 
-void rai::pending_key::serialize (rai::stream & stream_a) const
+void rai::block_store::pruned_put (MDB_txn * transaction_a, rai::block_hash const & hash_a, rai::pruned_info const & info_a)
 {
-	rai::write (stream_a, account.bytes);
-	rai::write (stream_a, hash.bytes);
+	std::vector <uint8_t> bytes;
+	{
+		rai::vectorstream stream (bytes);
+		info_a.serialize (stream);
+	}
+	auto status (mdb_put (transaction_a, pruned, hash_a.val (), rai::mdb_val (bytes.size (), bytes.data ()), 0));
+	assert (status == 0);
 }
 
-bool rai::pending_key::deserialize (rai::stream & stream_a)
+bool rai::block_store::pruned_get (MDB_txn * transaction_a, rai::block_hash const & hash_a, rai::pruned_info & info_a)
 {
-	auto result (rai::read (stream_a, account.bytes));
+	MDB_val value;
+	auto status (mdb_get (transaction_a, pruned, hash_a.val (), &value));
+	assert (status == 0 || status == MDB_NOTFOUND);
+	auto result (status != 0);
 	if (!result)
 	{
-		result = rai::read (stream_a, hash.bytes);
+		rai::bufferstream stream (reinterpret_cast <uint8_t const *> (value.mv_data), value.mv_size);
+		auto error (info_a.deserialize (stream));
+		assert (!error);
 	}
 	return result;
 }
 
-bool rai::pending_key::operator == (rai::pending_key const & other_a) const
+void rai::block_store::pruned_del (MDB_txn * transaction_a, rai::block_hash const & hash_a)
 {
-	return account == other_a.account && hash == other_a.hash;
+	auto status (mdb_del (transaction_a, pruned, hash_a.val (), nullptr));
+	assert (status == 0);
 }
 
-rai::mdb_val rai::pending_key::val () const
+bool rai::block_store::pruned_exists (MDB_txn * transaction_a, rai::block_hash const & hash_a)
 {
-	return rai::mdb_val (sizeof (*this), const_cast <rai::pending_key *> (this));
+	MDB_val junk;
+	auto status (mdb_get (transaction_a, pruned, hash_a.val (), &junk));
+	assert (status == 0 || status == MDB_NOTFOUND);
+	return status == 0;
+}
+
+size_t rai::block_store::pruned_count (MDB_txn * transaction_a)
+{
+	MDB_stat pruned_stats;
+	auto status (mdb_stat (transaction_a, pruned, &pruned_stats));
+	assert (status == 0);
+	return pruned_stats.ms_entries;
 }
 
 rai::uint128_t rai::block_store::representation_get (MDB_txn * transaction_a, rai::account const & account_a)
 {
-	MDB_val value;
-	auto status (mdb_get (transaction_a, representation, account_a.val (), &value));
-	assert (status == 0 || status == MDB_NOTFOUND);
     rai::uint128_t result;
-    if (status == 0)
-    {
-        rai::uint128_union rep;
-        rai::bufferstream stream (reinterpret_cast <uint8_t const *> (value.mv_data), value.mv_size);
-        auto error (rai::read (stream, rep));
-        assert (!error);
-        result = rep.number ();
-    }
-    else
-    {
-        result = 0;
-    }
+	auto cached (transaction_a == environment.writer);
+	if (!cached || cache.representation_get (account_a, result))
+	{
+		MDB_val value;
+		auto status (mdb_get (transaction_a, representation, account_a.val (), &value));
+		assert (status == 0 || status == MDB_NOTFOUND);
+		if (status == 0)
+		{
+			rai::uint128_union rep;
+			rai::bufferstream stream (reinterpret_cast <uint8_t const *> (value.mv_data), value.mv_size);
+			auto error (rai::read (stream, rep));
+			assert (!error);
+			result = rep.number ();
+		}
+		else
+		{
+			result = 0;
+		}
+		if (cached)
+		{
+			// Accounts without weight are cached as zero
+			cache.representation_put (account_a, result);
+		}
+	}
     return result;
 }
 
@@ -2262,6 +2960,7 @@ void rai::block_store::representation_put (MDB_txn * transaction_a, rai::account
     rai::uint128_union rep (representation_a);
 	auto status (mdb_put (transaction_a, representation, account_a.val (), rep.val (), 0));
     assert (status == 0);
+	cache.representation_put (account_a, representation_a);
 }
 
 rai::store_iterator rai::block_store::representation_begin (MDB_txn * transaction_a)
@@ -2293,6 +2992,16 @@ void rai::block_store::unchecked_put (MDB_txn * transaction_a, rai::block_hash c
 	assert (status == 0);
 }
 
+void rai::block_store::unchecked_put (MDB_txn * transaction_a, rai::block_hash const & hash_a, rai::block_view const & block_a)
+{
+	// Same layout rai::serialize_block writes, type then the serialized block
+	std::array <uint8_t, 1 + rai::open_block::size> bytes;
+	bytes [0] = static_cast <uint8_t> (block_a.type ());
+	std::copy (block_a.data, block_a.data + block_a.block_size (), bytes.begin () + 1);
+	auto status (mdb_put (transaction_a, unchecked, hash_a.val (), rai::mdb_val (1 + block_a.block_size (), bytes.data ()), 0));
+	assert (status == 0);
+}
+
 std::unique_ptr <rai::block> rai::block_store::unchecked_get (MDB_txn * transaction_a, rai::block_hash const & hash_a)
 {
 	MDB_val value;
@@ -2411,6 +3120,36 @@ void rai::block_store::checksum_del (MDB_txn * transaction_a, uint64_t prefix, u
 	auto status (mdb_del (transaction_a, checksum, rai::mdb_val (sizeof (key), &key), nullptr));
 	assert (status == 0);
 }
+
+void rai::block_store::checksum_xor (MDB_txn * transaction_a, rai::account const & account_a, rai::checksum const & hash_a)
+{
+	for (uint8_t depth (0); depth <= rai::checksum_leaf_depth; depth += rai::checksum_level_bits)
+	{
+		auto prefix (rai::checksum_prefix (account_a, depth));
+		auto value (checksum_node (transaction_a, prefix, depth));
+		auto existed (!value.is_zero ());
+		value ^= hash_a;
+		if (!value.is_zero ())
+		{
+			checksum_put (transaction_a, prefix, depth, value);
+		}
+		else if (existed)
+		{
+			// Nodes covering no accounts aren't stored
+			checksum_del (transaction_a, prefix, depth);
+		}
+	}
+}
+
+rai::checksum rai::block_store::checksum_node (MDB_txn * transaction_a, uint64_t prefix_a, uint8_t depth_a)
+{
+	rai::checksum result;
+	if (checksum_get (transaction_a, prefix_a, depth_a, result))
+	{
+		result.clear ();
+	}
+	return result;
+}
 	
 uint64_t rai::block_store::sequence_atomic_inc (MDB_txn * transaction_a, rai::account const & account_a)
 {
@@ -2531,31 +3270,24 @@ public:
 };
 
 // Determine the amount delta resultant from this block
-class amount_visitor : public rai::block_visitor
+// Both walkers read stored blocks through rai::block_view so long chains don't allocate per block
+class amount_visitor
 {
 public:
     amount_visitor (MDB_txn *, rai::block_store &);
     void compute (rai::block_hash const &);
-    void send_block (rai::send_block const &) override;
-    void receive_block (rai::receive_block const &) override;
-    void open_block (rai::open_block const &) override;
-    void change_block (rai::change_block const &) override;
-    void from_send (rai::block_hash const &);
+    void compute (rai::block_view const &);
 	MDB_txn * transaction;
     rai::block_store & store;
     rai::uint128_t result;
 };
 
 // Determine the balance as of this block
-class balance_visitor : public rai::block_visitor
+class balance_visitor
 {
 public:
     balance_visitor (MDB_txn *, rai::block_store &);
     void compute (rai::block_hash const &);
-    void send_block (rai::send_block const &) override;
-    void receive_block (rai::receive_block const &) override;
-    void open_block (rai::open_block const &) override;
-    void change_block (rai::change_block const &) override;
 	MDB_txn * transaction;
     rai::block_store & store;
 	rai::block_hash current;
@@ -2568,42 +3300,41 @@ store (store_a)
 {
 }
 
-void amount_visitor::send_block (rai::send_block const & block_a)
-{
-    balance_visitor prev (transaction, store);
-    prev.compute (block_a.hashables.previous);
-    result = prev.result - block_a.hashables.balance.number ();
-}
-
-void amount_visitor::receive_block (rai::receive_block const & block_a)
-{
-    from_send (block_a.hashables.source);
-}
-
-void amount_visitor::open_block (rai::open_block const & block_a)
+void amount_visitor::compute (rai::block_view const & block_a)
 {
-	if (block_a.hashables.source != rai::genesis_account)
+	switch (block_a.type ())
 	{
-		from_send (block_a.hashables.source);
-	}
-	else
-	{
-		result = rai::genesis_amount;
+		case rai::block_type::send:
+		{
+			balance_visitor prev (transaction, store);
+			prev.compute (block_a.previous ());
+			result = prev.result - block_a.balance ().number ();
+			break;
+		}
+		case rai::block_type::receive:
+		{
+			compute (block_a.source ());
+			break;
+		}
+		case rai::block_type::open:
+		{
+			auto source_hash (block_a.source ());
+			if (source_hash != rai::genesis_account)
+			{
+				compute (source_hash);
+			}
+			else
+			{
+				result = rai::genesis_amount;
+			}
+			break;
+		}
+		default:
+			result = 0;
+			break;
 	}
 }
 
-void amount_visitor::change_block (rai::change_block const & block_a)
-{
-	result = 0;
-}
-
-void amount_visitor::from_send (rai::block_hash const & hash_a)
-{
-    auto source_block (store.block_get (transaction, hash_a));
-    assert (source_block != nullptr);
-	source_block->visit (*this);
-}
-
 balance_visitor::balance_visitor (MDB_txn * transaction_a, rai::block_store & store_a) :
 transaction (transaction_a),
 store (store_a),
@@ -2612,33 +3343,6 @@ result (0)
 {
 }
 
-void balance_visitor::send_block (rai::send_block const & block_a)
-{
-    result += block_a.hashables.balance.number ();
-	current = 0;
-}
-
-void balance_visitor::receive_block (rai::receive_block const & block_a)
-{
-    amount_visitor source (transaction, store);
-    source.compute (block_a.hashables.source);
-    result += source.result;
-	current = block_a.hashables.previous;
-}
-
-void balance_visitor::open_block (rai::open_block const & block_a)
-{
-    amount_visitor source (transaction, store);
-    source.compute (block_a.hashables.source);
-    result += source.result;
-	current = 0;
-}
-
-void balance_visitor::change_block (rai::change_block const & block_a)
-{
-	current = block_a.hashables.previous;
-}
-
 // Rollback this block
 class rollback_visitor : public rai::block_visitor
 {
@@ -2718,17 +3422,22 @@ public:
 
 void amount_visitor::compute (rai::block_hash const & block_hash)
 {
-    auto block (store.block_get (transaction, block_hash));
-	if (block != nullptr)
+    auto block (store.block_get_view (transaction, block_hash));
+	if (block.valid ())
 	{
-		block->visit (*this);
+		compute (block);
 	}
 	else
 	{
+		rai::pruned_info info;
 		if (block_hash == rai::genesis_account)
 		{
 			result = std::numeric_limits <rai::uint128_t>::max ();
 		}
+		else if (!store.pruned_get (transaction, block_hash, info))
+		{
+			result = info.amount.number ();
+		}
 		else
 		{
 			assert (false);
@@ -2742,9 +3451,36 @@ void balance_visitor::compute (rai::block_hash const & block_hash)
 	current = block_hash;
 	while (!current.is_zero ())
 	{
-		auto block (store.block_get (transaction, current));
-		assert (block != nullptr);
-		block->visit (*this);
+		auto block (store.block_get_view (transaction, current));
+		switch (block.valid () ? block.type () : rai::block_type::invalid)
+		{
+			case rai::block_type::invalid:
+			{
+				// Walked into pruned history, the newest pruned block remembers the balance
+				rai::pruned_info info;
+				auto error (store.pruned_get (transaction, current, info));
+				assert (!error);
+				result += info.balance.number ();
+				current = 0;
+				break;
+			}
+			case rai::block_type::send:
+				result += block.balance ().number ();
+				current = 0;
+				break;
+			case rai::block_type::receive:
+			case rai::block_type::open:
+			{
+				amount_visitor source (transaction, store);
+				source.compute (block.source ());
+				result += source.result;
+				current = block.previous ();
+				break;
+			}
+			default:
+				current = block.previous ();
+				break;
+		}
 	}
 }
 
@@ -2783,6 +3519,7 @@ rai::uint128_t rai::ledger::account_pending (MDB_txn * transaction_a, rai::accou
 
 rai::process_return rai::ledger::process (MDB_txn * transaction_a, rai::block const & block_a)
 {
+	rai::trace_span span ("ledger", "process");
 	ledger_processor processor (*this, transaction_a);
 	block_a.visit (processor);
 	return processor.result;
@@ -2842,36 +3579,191 @@ rai::uint128_t rai::ledger::weight (MDB_txn * transaction_a, rai::account const
 }
 
 // Rollback blocks until `block_a' doesn't exist
-void rai::ledger::rollback (MDB_txn * transaction_a, rai::block_hash const & block_a)
+bool rai::ledger::rollback (MDB_txn * transaction_a, rai::block_hash const & block_a)
 {
 	assert (store.block_exists (transaction_a, block_a));
-    auto account_l (account (transaction_a, block_a));
-    rollback_visitor rollback (transaction_a, *this);
-    rai::account_info info;
-    while (store.block_exists (transaction_a, block_a))
-    {
-        auto latest_error (store.account_get (transaction_a, account_l, info));
-        assert (!latest_error);
-        auto block (store.block_get (transaction_a, info.head));
-        block->visit (rollback);
-    }
+	auto result (rollback_pruned (transaction_a, block_a));
+	if (!result)
+	{
+		auto account_l (account (transaction_a, block_a));
+		rollback_visitor rollback (transaction_a, *this);
+		rai::account_info info;
+		while (store.block_exists (transaction_a, block_a))
+		{
+			auto latest_error (store.account_get (transaction_a, account_l, info));
+			assert (!latest_error);
+			auto block (store.block_get (transaction_a, info.head));
+			block->visit (rollback);
+		}
+	}
+	return result;
+}
+
+// Whether rolling back the block would leave an account's head on a pruned block, following sends into the chains that received them
+bool rai::ledger::rollback_pruned (MDB_txn * transaction_a, rai::block_hash const & block_a)
+{
+	auto result (false);
+	if (store.pruned_count (transaction_a) > 0)
+	{
+		std::unordered_set <rai::block_hash> checked;
+		std::vector <rai::block_hash> targets ({ block_a });
+		while (!result && !targets.empty ())
+		{
+			auto target (targets.back ());
+			targets.pop_back ();
+			if (checked.insert (target).second)
+			{
+				// Everything from the head down to the target is rolled back and the target's predecessor becomes the head
+				auto previous (store.block_previous (transaction_a, target));
+				result = !previous.is_zero () && !store.block_exists (transaction_a, previous);
+				for (auto current (latest (transaction_a, account (transaction_a, target))); !result && current != previous; current = store.block_previous (transaction_a, current))
+				{
+					auto block (store.block_get_view (transaction_a, current));
+					assert (block.valid ());
+					if (block.type () == rai::block_type::send && !store.pending_exists (transaction_a, rai::pending_key (block.destination (), current)))
+					{
+						// Already received, the destination is rolled back down to the receiving block
+						auto found (false);
+						for (auto receive (latest (transaction_a, block.destination ())); !result && !found; receive = store.block_previous (transaction_a, receive))
+						{
+							auto receiving (store.block_get_view (transaction_a, receive));
+							result = !receiving.valid ();
+							if (!result && (receiving.type () == rai::block_type::receive || receiving.type () == rai::block_type::open) && receiving.source () == current)
+							{
+								targets.push_back (receive);
+								found = true;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	return result;
+}
+
+size_t rai::ledger::prune (MDB_txn * transaction_a, rai::account & account_a, uint64_t tail_a, size_t max_a)
+{
+	size_t result (0);
+	for (auto i (store.latest_begin (transaction_a, account_a)), n (store.latest_end ()); i != n && result < max_a; ++i)
+	{
+		account_a = rai::account (i->first);
+		result += prune_account (transaction_a, account_a, tail_a, max_a - result);
+	}
+	if (result < max_a)
+	{
+		// Every account was visited, the next pass starts over
+		account_a.clear ();
+	}
+	return result;
+}
+
+size_t rai::ledger::prune_account (MDB_txn * transaction_a, rai::account const & account_a, uint64_t tail_a, size_t max_a)
+{
+	size_t result (0);
+	auto latest_l (store.height_latest (transaction_a, account_a));
+	if (latest_l > tail_a && max_a > 0)
+	{
+		auto lowest (rai::height_key (store.height_begin (transaction_a, account_a, 0)->first).height ());
+		auto boundary (std::min <uint64_t> (latest_l - tail_a, lowest + max_a - 1));
+		// Walks stop at the newest pruned block's record so it can't be an open or change block, those are kept as the representative block
+		auto settled (false);
+		while (!settled && boundary >= lowest)
+		{
+			auto type (store.block_get_view (transaction_a, store.height_get (transaction_a, account_a, boundary)).type ());
+			settled = type == rai::block_type::send || type == rai::block_type::receive;
+			boundary -= settled ? 0 : 1;
+		}
+		if (boundary >= lowest)
+		{
+			auto boundary_hash (store.height_get (transaction_a, account_a, boundary));
+			auto rep_block (representative (transaction_a, boundary_hash));
+			// Everything is read before anything is deleted, balance and amount walks can reach back into the range
+			std::vector <std::pair <rai::block_hash, rai::pruned_info>> records;
+			std::vector <rai::block_hash> hashes;
+			for (auto height (lowest); height <= boundary; ++height)
+			{
+				auto hash (store.height_get (transaction_a, account_a, height));
+				auto block (store.block_get_view (transaction_a, hash));
+				assert (block.valid ());
+				if (hash == boundary_hash)
+				{
+					auto amount_l (block.type () == rai::block_type::send ? amount (transaction_a, hash) : 0);
+					records.push_back (std::make_pair (hash, rai::pruned_info (block.type (), account_a, balance (transaction_a, hash), amount_l, rep_block)));
+				}
+				else if (block.type () == rai::block_type::send)
+				{
+					// Sends stay receivable, and receives of them can be rolled back
+					records.push_back (std::make_pair (hash, rai::pruned_info (block.type (), account_a, block.balance (), amount (transaction_a, hash), 0)));
+				}
+				hashes.push_back (hash);
+			}
+			if (lowest > 1)
+			{
+				// The previous newest pruned block only keeps its record if it's a send
+				auto old_boundary (store.block_previous (transaction_a, store.height_get (transaction_a, account_a, lowest)));
+				rai::pruned_info old_info;
+				auto error (store.pruned_get (transaction_a, old_boundary, old_info));
+				assert (!error);
+				if (old_info.rep_block != rep_block)
+				{
+					store.block_del (transaction_a, old_info.rep_block);
+				}
+				if (old_info.type == rai::block_type::send)
+				{
+					old_info.rep_block.clear ();
+					store.pruned_put (transaction_a, old_boundary, old_info);
+				}
+				else
+				{
+					store.pruned_del (transaction_a, old_boundary);
+				}
+			}
+			for (auto & i: records)
+			{
+				store.pruned_put (transaction_a, i.first, i.second);
+			}
+			for (auto height (lowest); height <= boundary; ++height)
+			{
+				auto & hash (hashes [height - lowest]);
+				// The representative block is read whenever weight moves, it's kept until a newer one is pruned
+				if (hash != rep_block)
+				{
+					store.block_del (transaction_a, hash);
+				}
+				store.height_del (transaction_a, account_a, height);
+			}
+			// The representative block's successor was pruned, chain walks from it continue at the oldest block kept
+			store.block_successor_set (transaction_a, rep_block, store.height_get (transaction_a, account_a, boundary + 1));
+			result = hashes.size ();
+		}
+	}
+	return result;
 }
 
 // Return account containing hash
 rai::account rai::ledger::account (MDB_txn * transaction_a, rai::block_hash const & hash_a)
 {
-	assert (store.block_exists (transaction_a, hash_a));
-	auto hash (hash_a);
-	rai::block_hash successor (1);
-	while (!successor.is_zero ())
+	rai::account result;
+	rai::pruned_info pruned_l;
+	if (store.block_exists (transaction_a, hash_a) || store.pruned_get (transaction_a, hash_a, pruned_l))
 	{
-		successor = store.block_successor (transaction_a, hash);
-		if (!successor.is_zero ())
+		auto hash (hash_a);
+		rai::block_hash successor (1);
+		while (!successor.is_zero ())
 		{
-			hash = successor;
+			successor = store.block_successor (transaction_a, hash);
+			if (!successor.is_zero ())
+			{
+				hash = successor;
+			}
 		}
+		result = store.frontier_get (transaction_a, hash);
+	}
+	else
+	{
+		result = pruned_l.account;
 	}
-	auto result (store.frontier_get (transaction_a, hash));
 	assert (!result.is_zero ());
 	return result;
 }
@@ -2919,12 +3811,45 @@ rai::block_hash rai::ledger::latest_root (MDB_txn * transaction_a, rai::account
     return result;
 }
 
+namespace
+{
+// Uses stored tree nodes for whatever the range covers completely and sums accounts in partially covered leaves
+rai::checksum checksum_range_xor (rai::block_store & store_a, MDB_txn * transaction_a, uint64_t prefix_a, uint8_t depth_a, rai::uint256_t const & begin_a, rai::uint256_t const & end_a)
+{
+	rai::checksum result (0);
+	auto range (rai::checksum_range (prefix_a, depth_a));
+	auto first (range.first.number ());
+	auto last (range.second.number ());
+	if (first >= begin_a && last <= end_a)
+	{
+		result = store_a.checksum_node (transaction_a, prefix_a, depth_a);
+	}
+	else if (last >= begin_a && first <= end_a)
+	{
+		if (depth_a < rai::checksum_leaf_depth)
+		{
+			uint8_t depth_l (depth_a + rai::checksum_level_bits);
+			for (uint64_t i (0); i < (1 << rai::checksum_level_bits); ++i)
+			{
+				result ^= checksum_range_xor (store_a, transaction_a, prefix_a | (i << (64 - depth_l)), depth_l, begin_a, end_a);
+			}
+		}
+		else
+		{
+			auto end_l (std::min (last, end_a));
+			for (auto i (store_a.latest_begin (transaction_a, rai::account (std::max (first, begin_a)))), n (store_a.latest_end ()); i != n && rai::account (i->first).number () <= end_l; ++i)
+			{
+				result ^= rai::account_info (i->second).head;
+			}
+		}
+	}
+	return result;
+}
+}
+
 rai::checksum rai::ledger::checksum (MDB_txn * transaction_a, rai::account const & begin_a, rai::account const & end_a)
 {
-    rai::checksum result;
-    auto error (store.checksum_get (transaction_a, 0, 0, result));
-    assert (!error);
-    return result;
+	return checksum_range_xor (store, transaction_a, 0, 0, begin_a.number (), end_a.number ());
 }
 
 void rai::ledger::dump_account_chain (rai::account const & account_a)
@@ -2940,22 +3865,19 @@ void rai::ledger::dump_account_chain (rai::account const & account_a)
     }
 }
 
-void rai::ledger::checksum_update (MDB_txn * transaction_a, rai::block_hash const & hash_a)
+void rai::ledger::checksum_update (MDB_txn * transaction_a, rai::account const & account_a, rai::block_hash const & hash_a)
 {
-	rai::checksum value;
-    auto error (store.checksum_get (transaction_a, 0, 0, value));
-    assert (!error);
-    value ^= hash_a;
-    store.checksum_put (transaction_a, 0, 0, value);
+	store.checksum_xor (transaction_a, account_a, hash_a);
 }
 
 void rai::ledger::change_latest (MDB_txn * transaction_a, rai::account const & account_a, rai::block_hash const & hash_a, rai::block_hash const & rep_block_a, rai::amount const & balance_a)
 {
     rai::account_info info;
     auto exists (!store.account_get (transaction_a, account_a, info));
+    auto height (store.height_latest (transaction_a, account_a));
     if (exists)
     {
-        checksum_update (transaction_a, info.head);
+        checksum_update (transaction_a, account_a, info.head);
     }
 	else
 	{
@@ -2964,15 +3886,25 @@ void rai::ledger::change_latest (MDB_txn * transaction_a, rai::account const & a
 	}
     if (!hash_a.is_zero())
     {
+        if (!exists || store.block_previous (transaction_a, hash_a) == info.head)
+        {
+            store.height_put (transaction_a, account_a, height + 1, hash_a);
+        }
+        else
+        {
+            // Rolled back to the previous block
+            store.height_del (transaction_a, account_a, height);
+        }
         info.head = hash_a;
         info.rep_block = rep_block_a;
         info.balance = balance_a;
         info.modified = store.now ();
         store.account_put (transaction_a, account_a, info);
-        checksum_update (transaction_a, hash_a);
+        checksum_update (transaction_a, account_a, hash_a);
     }
     else
     {
+        store.height_del (transaction_a, account_a, height);
         store.account_del (transaction_a, account_a);
     }
 }
@@ -3101,7 +4033,7 @@ void ledger_processor::receive_block (rai::receive_block const & block_a)
     result.code = existing ? rai::process_result::old : rai::process_result::progress; // Have we seen this block already?  (Harmless)
     if (result.code == rai::process_result::progress)
     {
-        result.code = ledger.store.block_exists (transaction, block_a.hashables.source) ? rai::process_result::progress: rai::process_result::gap_source; // Have we seen the source block already? (Harmless)
+        result.code = ledger.store.block_exists (transaction, block_a.hashables.source) || ledger.store.pruned_exists (transaction, block_a.hashables.source) ? rai::process_result::progress: rai::process_result::gap_source; // Have we seen the source block already? (Harmless)
         if (result.code == rai::process_result::progress)
         {
 			auto account (ledger.store.frontier_get (transaction, block_a.hashables.previous));
@@ -3152,7 +4084,7 @@ void ledger_processor::open_block (rai::open_block const & block_a)
     result.code = existing ? rai::process_result::old : rai::process_result::progress; // Have we seen this block already? (Harmless)
     if (result.code == rai::process_result::progress)
     {
-        auto source_missing (!ledger.store.block_exists (transaction, block_a.hashables.source));
+        auto source_missing (!ledger.store.block_exists (transaction, block_a.hashables.source) && !ledger.store.pruned_exists (transaction, block_a.hashables.source));
         result.code = source_missing ? rai::process_result::gap_source : rai::process_result::progress; // Have we seen the source block? (Harmless)
         if (result.code == rai::process_result::progress)
         {
@@ -3269,8 +4201,9 @@ void rai::genesis::initialize (MDB_txn * transaction_a, rai::block_store & store
 	store_a.block_put (transaction_a, hash_l, *open);
 	store_a.account_put (transaction_a, genesis_account, {hash_l, open->hash (), open->hash (), std::numeric_limits <rai::uint128_t>::max (), store_a.now ()});
 	store_a.representation_put (transaction_a, genesis_account, std::numeric_limits <rai::uint128_t>::max ());
-	store_a.checksum_put (transaction_a, 0, 0, hash_l);
+	store_a.checksum_xor (transaction_a, genesis_account, hash_l);
 	store_a.frontier_put (transaction_a, hash_l, genesis_account);
+	store_a.height_put (transaction_a, genesis_account, 1, hash_l);
 }
 
 rai::block_hash rai::genesis::hash () const
@@ -294,6 +294,20 @@ public:
 	rai::account source;
 	rai::amount amount;
 };
+// Remembered for a block deleted by ledger pruning
+class pruned_info
+{
+public:
+	pruned_info ();
+	pruned_info (rai::block_type, rai::account const &, rai::amount const &, rai::amount const &, rai::block_hash const &);
+	void serialize (rai::stream &) const;
+	bool deserialize (rai::stream &);
+	rai::block_type type;
+	rai::account account;
+	rai::amount balance; // Account balance as of the block
+	rai::amount amount; // Amount sent, zero for anything but send blocks
+	rai::block_hash rep_block; // Representative block in effect as of the block, only kept for each account's newest pruned block
+};
 class pending_key
 {
 public:
@@ -306,6 +320,17 @@ public:
 	rai::account account;
 	rai::block_hash hash;
 };
+// Key of the heights table, the height is stored big endian so an account's blocks sort in chain order
+class height_key
+{
+public:
+	height_key (rai::account const &, uint64_t);
+	height_key (MDB_val const &);
+	uint64_t height () const;
+	rai::mdb_val val () const;
+	rai::account account;
+	std::array <uint8_t, 8> height_bytes;
+};
 class block_counts
 {
 public:
@@ -316,10 +341,83 @@ public:
 	size_t open;
 	size_t change;
 };
+// Reads fields straight out of a stored block's bytes without deserializing it
+// Doesn't own the bytes, only valid until the transaction that read them ends or writes to the block
+class block_view
+{
+public:
+	block_view ();
+	block_view (rai::block_type, MDB_val const &);
+	// Serialized block without a stored successor, successor () can't be used
+	block_view (rai::block_type, uint8_t const *);
+	bool valid () const;
+	rai::block_type type () const;
+	rai::block_hash hash () const;
+	// Same meaning as the rai::block member functions of the same names
+	rai::block_hash previous () const;
+	rai::block_hash source () const;
+	rai::block_hash root () const;
+	rai::account representative () const;
+	// Destination and balance are zero for anything but send blocks
+	rai::account destination () const;
+	rai::amount balance () const;
+	uint64_t block_work () const;
+	rai::block_hash successor () const;
+	// Serialized block without the stored successor, as rai::block::serialize writes it
+	size_t block_size () const;
+	std::unique_ptr <rai::block> block () const;
+	rai::block_type type_m;
+	uint8_t const * data;
+	size_t size;
+};
+// Any block's serialized bytes inline behind its type tag
+// Trivially copyable so batches sit contiguously in a vector with no allocation per block
+class block_value
+{
+public:
+	block_value ();
+	block_value (rai::block const &);
+	block_value (rai::block_type, uint8_t const *);
+	rai::block_view view () const;
+	rai::block_type type;
+	std::array <uint8_t, rai::open_block::size> bytes;
+};
+// Checksums are kept in a tree over account numbers, each level splits its parent's range on the next 4 bits of the account
+// A node is keyed by the account bits above its depth, the root at depth 0 holds the XOR of every account's head block
+uint8_t const checksum_level_bits = 4;
+uint8_t const checksum_leaf_depth = 16;
+uint64_t checksum_prefix (rai::account const &, uint8_t);
+// First and last account covered by a checksum tree node
+std::pair <rai::account, rai::account> checksum_range (uint64_t, uint8_t);
+// Write-through copy of hot accounts and representation rows
+// Only the write transaction reads it, LMDB allows a single writer so the cache always holds what that writer would read
+// Read-only transactions keep reading the database, their snapshot can be older than the cache
+class store_cache
+{
+public:
+	store_cache (size_t);
+	bool account_get (rai::account const &, rai::account_info &);
+	void account_put (rai::account const &, rai::account_info const &);
+	void account_del (rai::account const &);
+	bool representation_get (rai::account const &, rai::uint128_t &);
+	void representation_put (rai::account const &, rai::uint128_t const &);
+	void clear ();
+	// Entries held per table, zero disables the cache
+	size_t capacity;
+	std::unordered_map <rai::account, rai::account_info> accounts;
+	std::unordered_map <rai::account, rai::uint128_t> representation;
+	// Called with whether each cached lookup hit, set before the store is shared between threads
+	std::function <void (bool)> account_observer;
+	std::function <void (bool)> representation_observer;
+	static size_t constexpr default_capacity = 64 * 1024;
+};
+// Splits the account space into equal ranges for parallel passes, a range ends where the next starts and the last runs to the end
+std::vector <rai::account> account_range_starts (size_t);
 class block_store
 {
 public:
-	block_store (bool &, boost::filesystem::path const &);
+	// Read-only stores skip upgrades and fail to open unless the writer already brought the file to the current version
+	block_store (bool &, boost::filesystem::path const &, bool = false);
 	uint64_t now ();
 	
 	MDB_dbi block_database (rai::block_type);
@@ -327,8 +425,11 @@ public:
 	void block_put (MDB_txn *, rai::block_hash const &, rai::block const &, rai::block_hash const & = rai::block_hash (0));
 	MDB_val block_get_raw (MDB_txn *, rai::block_hash const &, rai::block_type &);
 	rai::block_hash block_successor (MDB_txn *, rai::block_hash const &);
+	rai::block_hash block_previous (MDB_txn *, rai::block_hash const &);
 	void block_successor_clear (MDB_txn *, rai::block_hash const &);
+	void block_successor_set (MDB_txn *, rai::block_hash const &, rai::block_hash const &);
 	std::unique_ptr <rai::block> block_get (MDB_txn *, rai::block_hash const &);
+	rai::block_view block_get_view (MDB_txn *, rai::block_hash const &);
 	std::unique_ptr <rai::block> block_random (MDB_txn *);
 	std::unique_ptr <rai::block> block_random (MDB_txn *, MDB_dbi);
 	void block_del (MDB_txn *, rai::block_hash const &);
@@ -355,6 +456,13 @@ public:
 	rai::store_iterator pending_begin (MDB_txn *, rai::pending_key const &);
 	rai::store_iterator pending_begin (MDB_txn *);
 	rai::store_iterator pending_end ();
+
+	void height_put (MDB_txn *, rai::account const &, uint64_t, rai::block_hash const &);
+	void height_del (MDB_txn *, rai::account const &, uint64_t);
+	rai::block_hash height_get (MDB_txn *, rai::account const &, uint64_t);
+	uint64_t height_latest (MDB_txn *, rai::account const &);
+	rai::store_iterator height_begin (MDB_txn *, rai::account const &, uint64_t);
+	rai::store_iterator height_end ();
 	
 	rai::uint128_t representation_get (MDB_txn *, rai::account const &);
 	void representation_put (MDB_txn *, rai::account const &, rai::uint128_t const &);
@@ -364,6 +472,7 @@ public:
 	
 	void unchecked_clear (MDB_txn *);
 	void unchecked_put (MDB_txn *, rai::block_hash const &, rai::block const &);
+	void unchecked_put (MDB_txn *, rai::block_hash const &, rai::block_view const &);
 	std::unique_ptr <rai::block> unchecked_get (MDB_txn *, rai::block_hash const &);
 	void unchecked_del (MDB_txn *, rai::block_hash const &);
 	rai::store_iterator unchecked_begin (MDB_txn *);
@@ -381,6 +490,16 @@ public:
 	void checksum_put (MDB_txn *, uint64_t, uint8_t, rai::checksum const &);
 	bool checksum_get (MDB_txn *, uint64_t, uint8_t, rai::checksum &);
 	void checksum_del (MDB_txn *, uint64_t, uint8_t);
+	// Applies a head block change to every checksum tree node above the account
+	void checksum_xor (MDB_txn *, rai::account const &, rai::checksum const &);
+	// Tree node value, zero for nodes covering no accounts
+	rai::checksum checksum_node (MDB_txn *, uint64_t, uint8_t);
+	
+	void pruned_put (MDB_txn *, rai::block_hash const &, rai::pruned_info const &);
+	bool pruned_get (MDB_txn *, rai::block_hash const &, rai::pruned_info &);
+	void pruned_del (MDB_txn *, rai::block_hash const &);
+	bool pruned_exists (MDB_txn *, rai::block_hash const &);
+	size_t pruned_count (MDB_txn *);
 	
 	uint64_t sequence_atomic_inc (MDB_txn *, rai::account const &);
 	uint64_t sequence_atomic_observe (MDB_txn *, rai::account const &, uint64_t);
@@ -392,6 +511,15 @@ public:
 	void upgrade_v2_to_v3 (MDB_txn *);
 	void upgrade_v3_to_v4 (MDB_txn *);
 	void upgrade_v4_to_v5 (MDB_txn *);
+	void upgrade_v5_to_v6 (MDB_txn *);
+	void upgrade_v6_to_v7 (MDB_txn *);
+	static int constexpr version_current = 7;
+	// Set by upgrades that leave the representation table out of date, rebuild_weights clears it when it swaps the table in
+	void weights_stale_put (MDB_txn *);
+	bool weights_stale (MDB_txn *);
+	// Recomputes the representation table from each account's balance and rep_block, summing account ranges on worker threads
+	// The write transaction is held throughout so the readers see exactly the state being replaced, returns how many weights changed
+	size_t rebuild_weights (unsigned);
 	
 	void clear (MDB_dbi);
 	
@@ -416,12 +544,17 @@ public:
 	MDB_dbi unchecked;
 	// block_hash ->                                                // Blocks that haven't been broadcast
 	MDB_dbi unsynced;
-	// (uint56_t, uint8_t) -> block_hash                            // Mapping of region to checksum
+	// (uint56_t, uint8_t) -> block_hash                            // Checksum tree node at an account prefix and depth
 	MDB_dbi checksum;
 	// account -> uint64_t											// Highest vote sequence observed for account
 	MDB_dbi sequence;
 	// uint256_union -> ?											// Meta information about block store
 	MDB_dbi meta;
+	// account, uint64_t -> block_hash								// Block at each height of an account chain, the open block is height 1
+	MDB_dbi heights;
+	// block_hash -> account, balance, amount, rep_block				// Pruned send blocks and each account's newest pruned block
+	MDB_dbi pruned;
+	rai::store_cache cache;
 };
 enum class process_result
 {
@@ -505,9 +638,16 @@ public:
 	std::string block_text (rai::block_hash const &);
 	rai::uint128_t supply (MDB_txn *);
 	rai::process_return process (MDB_txn *, rai::block const &);
-	void rollback (MDB_txn *, rai::block_hash const &);
+	// Returns true without changing anything if the rollback would reach blocks removed by pruning
+	bool rollback (MDB_txn *, rai::block_hash const &);
+	bool rollback_pruned (MDB_txn *, rai::block_hash const &);
+	// Deletes blocks more than tail_a below each account's head starting at account_a, stopping after max_a blocks
+	// Returns the number of blocks deleted and leaves account_a where the next call should resume
+	size_t prune (MDB_txn *, rai::account &, uint64_t, size_t);
+	size_t prune_account (MDB_txn *, rai::account const &, uint64_t, size_t);
 	void change_latest (MDB_txn *, rai::account const &, rai::block_hash const &, rai::account const &, rai::uint128_union const &);
-	void checksum_update (MDB_txn *, rai::block_hash const &);
+	void checksum_update (MDB_txn *, rai::account const &, rai::block_hash const &);
+	// XOR of the head blocks of accounts from the first to the last account inclusive
 	rai::checksum checksum (MDB_txn *, rai::account const &, rai::account const &);
 	void dump_account_chain (rai::account const &);
 	static rai::uint128_t const unit;
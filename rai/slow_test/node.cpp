@@ -1,8 +1,37 @@
 #include <gtest/gtest.h>
+#include <rai/node/ipc.hpp>
 #include <rai/node/testing.hpp>
+#include <rai/node/rpc.hpp>
+
+#include <beast/http.hpp>
+#include <beast/http/string_body.hpp>
+
+#include <boost/property_tree/json_parser.hpp>
 
 #include <thread>
 
+namespace
+{
+// Heap allocations made by the current thread, lets benchmarks report allocations per operation
+thread_local size_t allocations (0);
+}
+
+void * operator new (size_t size_a)
+{
+	++allocations;
+	auto result (std::malloc (size_a));
+	if (result == nullptr)
+	{
+		throw std::bad_alloc ();
+	}
+	return result;
+}
+
+void operator delete (void * pointer_a) noexcept
+{
+	std::free (pointer_a);
+}
+
 TEST (system, generate_mass_activity)
 {
     rai::system system (24000, 1);
@@ -233,14 +262,17 @@ TEST (node, fork_storm)
 TEST (gap_cache, limit)
 {
     rai::system system (24000, 1);
+    size_t max (256);
+    system.nodes [0]->config.gap_cache_bytes = max * rai::gap_cache::entry_size (rai::send_block (0, 0, 1, rai::keypair ().prv, 3, 4));
     rai::gap_cache cache (*system.nodes [0]);
-    for (auto i (0); i < cache.max * 2; ++i)
+    for (auto i (0); i < max * 2; ++i)
     {
         rai::send_block block1 (i, 0, 1, rai::keypair ().prv, 3, 4);
         auto previous (block1.previous ());
         cache.add (rai::send_block (block1), previous);
     }
-    ASSERT_EQ (cache.max, cache.blocks.size ());
+    ASSERT_EQ (max, cache.blocks.size ());
+    ASSERT_GE (system.nodes [0]->config.gap_cache_bytes, cache.size ());
 }
 
 namespace
@@ -392,3 +424,351 @@ TEST (peer_container, random_set)
 	auto old_ms (std::chrono::duration_cast <std::chrono::milliseconds> (current - old));
 	auto new_ms (std::chrono::duration_cast <std::chrono::milliseconds> (end - current));
 }
+
+TEST (rpc, keepalive_throughput)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	rai::thread_runner runner (system.service, system.nodes [0]->config.io_threads);
+	rai::tcp_endpoint endpoint (boost::asio::ip::address_v6::loopback (), rpc.config.port);
+	boost::property_tree::ptree request_l;
+	request_l.put ("action", "block_count");
+	std::stringstream ostream;
+	boost::property_tree::write_json (ostream, request_l);
+	auto body (ostream.str ());
+	size_t count (5000);
+	auto run ([&endpoint, &body, count] (bool keep_alive_a)
+	{
+		boost::asio::io_service service;
+		std::unique_ptr <boost::asio::ip::tcp::socket> socket;
+		beast::streambuf buffer;
+		auto begin (std::chrono::steady_clock::now ());
+		for (size_t i (0); i < count; ++i)
+		{
+			if (socket == nullptr)
+			{
+				socket.reset (new boost::asio::ip::tcp::socket (service));
+				socket->connect (endpoint);
+				buffer.consume (buffer.size ());
+			}
+			beast::http::request <beast::http::string_body> req;
+			req.method = "POST";
+			req.url = "/";
+			req.version = 11;
+			req.body = body;
+			if (keep_alive_a)
+			{
+				beast::http::prepare (req, beast::http::connection::keep_alive);
+			}
+			else
+			{
+				beast::http::prepare (req, beast::http::connection::close);
+			}
+			beast::http::write (*socket, req);
+			beast::http::response <beast::http::string_body> resp;
+			beast::http::read (*socket, buffer, resp);
+			EXPECT_EQ (200, resp.status);
+			if (!keep_alive_a)
+			{
+				socket.reset ();
+			}
+		}
+		auto elapsed (std::chrono::duration_cast <std::chrono::microseconds> (std::chrono::steady_clock::now () - begin));
+		return count * 1000000.0 / elapsed.count ();
+	});
+	auto without (run (false));
+	auto with (run (true));
+	std::cerr << boost::str (boost::format ("%1% requests, %2% req/s with a connection per request, %3% req/s with keep-alive\n") % count % without % with);
+	ASSERT_GT (with, without);
+	rpc.stop ();
+	system.stop ();
+	runner.join ();
+}
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+TEST (ipc, latency)
+{
+	rai::system system (24000, 1);
+	rai::rpc rpc (system.service, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	rai::ipc_server server (*system.nodes [0], rai::ipc_config ());
+	server.start ();
+	rai::thread_runner runner (system.service, system.nodes [0]->config.io_threads);
+	size_t count (20000);
+	boost::asio::io_service service;
+	boost::property_tree::ptree request_l;
+	request_l.put ("action", "account_balance");
+	request_l.put ("account", rai::test_genesis_key.pub.to_account ());
+	std::stringstream ostream;
+	boost::property_tree::write_json (ostream, request_l);
+	auto body (ostream.str ());
+	boost::asio::ip::tcp::socket socket (service);
+	socket.connect (rai::tcp_endpoint (boost::asio::ip::address_v6::loopback (), rpc.config.port));
+	beast::streambuf buffer;
+	auto begin (std::chrono::steady_clock::now ());
+	for (size_t i (0); i < count; ++i)
+	{
+		beast::http::request <beast::http::string_body> req;
+		req.method = "POST";
+		req.url = "/";
+		req.version = 11;
+		req.body = body;
+		beast::http::prepare (req, beast::http::connection::keep_alive);
+		beast::http::write (socket, req);
+		beast::http::response <beast::http::string_body> resp;
+		beast::http::read (socket, buffer, resp);
+		EXPECT_EQ (200, resp.status);
+	}
+	auto http (std::chrono::duration_cast <std::chrono::nanoseconds> (std::chrono::steady_clock::now () - begin).count () / count);
+	rai::ipc_client client (service);
+	client.connect (server.path ());
+	std::vector <uint8_t> arguments (rai::test_genesis_key.pub.bytes.begin (), rai::test_genesis_key.pub.bytes.end ());
+	std::vector <uint8_t> results;
+	begin = std::chrono::steady_clock::now ();
+	for (size_t i (0); i < count; ++i)
+	{
+		EXPECT_EQ (rai::ipc_status::success, client.request (rai::ipc_action::account_balance, arguments, results));
+	}
+	auto ipc (std::chrono::duration_cast <std::chrono::nanoseconds> (std::chrono::steady_clock::now () - begin).count () / count);
+	std::cerr << boost::str (boost::format ("account_balance x%1%, %2% ns per request over HTTP, %3% ns per request over IPC\n") % count % http % ipc);
+	ASSERT_LT (ipc, http);
+	server.stop ();
+	rpc.stop ();
+	system.stop ();
+	runner.join ();
+}
+#endif
+
+TEST (rpc, frontiers_million)
+{
+	rai::system system (24000, 1);
+	rai::rpc_config config (true);
+	// Time the handler itself rather than the worker pool
+	config.action_limits.clear ();
+	rai::rpc rpc (system.service, *system.nodes [0], config);
+	size_t count (1000000);
+	for (size_t i (0); i < count; i += 100)
+	{
+		rai::transaction transaction (system.nodes [0]->store.environment, nullptr, true);
+		for (size_t j (0); j < 100; ++j)
+		{
+			rai::account account;
+			rai::random_pool.GenerateBlock (account.bytes.data (), account.bytes.size ());
+			rai::account_info info;
+			info.head = account;
+			system.nodes [0]->store.account_put (transaction, account, info);
+		}
+	}
+	boost::property_tree::ptree request;
+	request.put ("action", "frontiers");
+	request.put ("account", rai::account (0).to_account ());
+	request.put ("count", std::to_string (count + 1));
+	std::stringstream ostream;
+	boost::property_tree::write_json (ostream, request);
+	std::string body;
+	auto begin (std::chrono::steady_clock::now ());
+	auto handler (std::make_shared <rai::rpc_handler> (*system.nodes [0], rpc, ostream.str (), [] (boost::property_tree::ptree const &) {}, [&body] (std::string body_a) { body = std::move (body_a); }));
+	handler->process_request ();
+	auto elapsed (std::chrono::duration_cast <std::chrono::milliseconds> (std::chrono::steady_clock::now () - begin));
+	std::cerr << boost::str (boost::format ("frontiers for %1% accounts: %2% ms, %3% bytes\n") % (count + 1) % elapsed.count () % body.size ());
+	std::stringstream istream (body);
+	boost::property_tree::ptree response;
+	boost::property_tree::read_json (istream, response);
+	ASSERT_EQ (count + 1, response.get_child ("frontiers").size ());
+}
+
+TEST (rpc, accounts_balances_batch)
+{
+	rai::system system (24000, 1);
+	rai::rpc_config config (true);
+	config.action_limits.clear ();
+	rai::rpc rpc (system.service, *system.nodes [0], config);
+	size_t count (4096);
+	std::vector <rai::account> accounts;
+	for (size_t i (0); i < count; ++i)
+	{
+		rai::keypair key;
+		accounts.push_back (key.pub);
+	}
+	auto call ([&system, &rpc] (boost::property_tree::ptree const & request_a)
+	{
+		std::stringstream ostream;
+		boost::property_tree::write_json (ostream, request_a);
+		std::string body;
+		auto handler (std::make_shared <rai::rpc_handler> (*system.nodes [0], rpc, ostream.str (), [&body] (boost::property_tree::ptree const & tree_a)
+		{
+			std::stringstream ostream;
+			boost::property_tree::write_json (ostream, tree_a);
+			body = ostream.str ();
+		}, [&body] (std::string body_a) { body = std::move (body_a); }));
+		handler->process_request ();
+		return body;
+	});
+	auto begin1 (std::chrono::steady_clock::now ());
+	for (auto & i: accounts)
+	{
+		boost::property_tree::ptree request;
+		request.put ("action", "account_balance");
+		request.put ("account", i.to_account ());
+		call (request);
+	}
+	auto single (std::chrono::duration_cast <std::chrono::microseconds> (std::chrono::steady_clock::now () - begin1));
+	boost::property_tree::ptree request;
+	request.put ("action", "accounts_balances");
+	boost::property_tree::ptree accounts_l;
+	for (auto & i: accounts)
+	{
+		boost::property_tree::ptree entry;
+		entry.put ("", i.to_account ());
+		accounts_l.push_back (std::make_pair ("", entry));
+	}
+	request.add_child ("accounts", accounts_l);
+	auto begin2 (std::chrono::steady_clock::now ());
+	auto body (call (request));
+	auto batch (std::chrono::duration_cast <std::chrono::microseconds> (std::chrono::steady_clock::now () - begin2));
+	std::cerr << boost::str (boost::format ("%1% balances: %2% us one at a time, %3% us batched\n") % count % single.count () % batch.count ());
+	std::stringstream istream (body);
+	boost::property_tree::ptree response;
+	boost::property_tree::read_json (istream, response);
+	ASSERT_EQ (count, response.get_child ("balances").size ());
+}
+
+TEST (log_queue, hot_path_cost)
+{
+	rai::system system (24000, 1);
+	auto & node (*system.nodes [0]);
+	rai::keypair key;
+	rai::endpoint endpoint (boost::asio::ip::address_v6::loopback (), 24000);
+	rai::block_hash hash (key.pub);
+	size_t count (20000);
+	// Synchronous formatting and file write as the message handlers did it
+	auto begin (std::chrono::steady_clock::now ());
+	for (size_t i (0); i < count; ++i)
+	{
+		BOOST_LOG (node.log) << boost::str (boost::format ("Publish message from %1% for %2%") % endpoint % hash.to_string ());
+	}
+	auto direct (std::chrono::duration_cast <std::chrono::nanoseconds> (std::chrono::steady_clock::now () - begin).count () / count);
+	rai::stats stats;
+	rai::log_queue queue (node.log, stats, 0);
+	begin = std::chrono::steady_clock::now ();
+	for (size_t i (0); i < count; ++i)
+	{
+		queue.add (rai::log_category::network_message, [endpoint, hash] ()
+		{
+			return boost::str (boost::format ("Publish message from %1% for %2%") % endpoint % hash.to_string ());
+		});
+	}
+	auto queued (std::chrono::duration_cast <std::chrono::nanoseconds> (std::chrono::steady_clock::now () - begin).count () / count);
+	queue.stop ();
+	std::cerr << boost::str (boost::format ("%1% records, %2% ns per record written directly, %3% ns per record queued, %4% dropped\n") % count % direct % queued % stats.counter ("log", "overflow").value ());
+	ASSERT_LT (queued, direct);
+}
+
+TEST (block_view, chain_walk)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_FALSE (init);
+	rai::keypair key;
+	size_t count (50000);
+	rai::open_block open (0, key.pub, key.pub, key.prv, key.pub, 0);
+	auto head (open.hash ());
+	{
+		rai::transaction transaction (store.environment, nullptr, true);
+		store.block_put (transaction, open.hash (), open);
+	}
+	// Small write transactions leave the store room to grow its map between them
+	for (size_t i (1); i < count; i += 100)
+	{
+		rai::transaction transaction (store.environment, nullptr, true);
+		for (size_t j (i); j < std::min (count, i + 100); ++j)
+		{
+			rai::send_block send (head, key.pub, count - j, key.prv, key.pub, 0);
+			store.block_put (transaction, send.hash (), send);
+			head = send.hash ();
+		}
+	}
+	rai::transaction transaction (store.environment, nullptr, false);
+	// Deserializing every block as the walkers did before
+	auto allocations_begin (allocations);
+	auto begin (std::chrono::steady_clock::now ());
+	size_t walked (0);
+	for (rai::block_hash hash (head); !hash.is_zero (); ++walked)
+	{
+		hash = store.block_get (transaction, hash)->previous ();
+	}
+	auto copied (std::chrono::duration_cast <std::chrono::nanoseconds> (std::chrono::steady_clock::now () - begin).count () / count);
+	auto copied_allocations (allocations - allocations_begin);
+	ASSERT_EQ (count, walked);
+	allocations_begin = allocations;
+	begin = std::chrono::steady_clock::now ();
+	walked = 0;
+	for (rai::block_hash hash (head); !hash.is_zero (); ++walked)
+	{
+		hash = store.block_get_view (transaction, hash).previous ();
+	}
+	auto viewed (std::chrono::duration_cast <std::chrono::nanoseconds> (std::chrono::steady_clock::now () - begin).count () / count);
+	auto viewed_allocations (allocations - allocations_begin);
+	ASSERT_EQ (count, walked);
+	std::cerr << boost::str (boost::format ("%1% blocks, deserialized %2% ns and %3% allocations per block, viewed %4% ns and %5% allocations per block\n") % count % copied % (double (copied_allocations) / count) % viewed % (double (viewed_allocations) / count));
+	ASSERT_EQ (0, viewed_allocations);
+	ASSERT_LT (viewed, copied);
+}
+
+TEST (store_cache, hot_account)
+{
+	rai::keypair key;
+	size_t count (20000);
+	std::vector <std::unique_ptr <rai::send_block>> blocks;
+	rai::genesis genesis;
+	auto previous (genesis.hash ());
+	for (size_t i (0); i < count; ++i)
+	{
+		blocks.emplace_back (new rai::send_block (previous, key.pub, rai::genesis_amount - i - 1, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
+		previous = blocks.back ()->hash ();
+	}
+	for (auto capacity: { size_t (0), rai::store_cache::default_capacity })
+	{
+		bool init (false);
+		rai::block_store store (init, rai::unique_path ());
+		ASSERT_FALSE (init);
+		store.cache.capacity = capacity;
+		size_t hits (0);
+		size_t lookups (0);
+		store.cache.account_observer = store.cache.representation_observer = [&hits, &lookups] (bool hit_a)
+		{
+			hits += hit_a;
+			++lookups;
+		};
+		rai::ledger ledger (store, 0);
+		{
+			rai::transaction transaction (store.environment, nullptr, true);
+			genesis.initialize (transaction, store);
+		}
+		auto begin (std::chrono::steady_clock::now ());
+		for (size_t i (0); i < count; i += 100)
+		{
+			rai::transaction transaction (store.environment, nullptr, true);
+			for (size_t j (i); j < std::min (count, i + 100); ++j)
+			{
+				ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, *blocks [j]).code);
+			}
+		}
+		auto elapsed (std::chrono::duration_cast <std::chrono::nanoseconds> (std::chrono::steady_clock::now () - begin).count ());
+		// Processing is dominated by signature checks, the rows themselves are timed on their own
+		rai::transaction transaction (store.environment, nullptr, true);
+		rai::uint128_t weight (0);
+		rai::account_info info;
+		begin = std::chrono::steady_clock::now ();
+		for (size_t i (0); i < count; ++i)
+		{
+			store.account_get (transaction, rai::test_genesis_key.pub, info);
+			weight = store.representation_get (transaction, rai::test_genesis_key.pub);
+		}
+		auto rows (std::chrono::duration_cast <std::chrono::nanoseconds> (std::chrono::steady_clock::now () - begin).count ());
+		std::cerr << boost::str (boost::format ("Cache capacity %1%: %2% ns per processed block, %3% ns per account and weight read, %4% of %5% cached lookups hit\n") % capacity % (elapsed / count) % (rows / count) % hits % lookups);
+		ASSERT_EQ (previous, info.head);
+		ASSERT_EQ (rai::genesis_amount - count, weight);
+	}
+}
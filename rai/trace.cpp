@@ -0,0 +1,109 @@
+#include <rai/trace.hpp>
+
+rai::tracer rai::trace;
+
+size_t constexpr rai::trace_buffer::size;
+
+rai::trace_event::trace_event () :
+sequence (0),
+category (nullptr),
+name (nullptr),
+begin (0),
+duration (0)
+{
+}
+
+rai::trace_buffer::trace_buffer (unsigned thread_a) :
+written (0),
+thread (thread_a)
+{
+}
+
+void rai::trace_buffer::record (char const * category_a, char const * name_a, uint64_t begin_a, uint64_t duration_a)
+{
+	auto index (written.load (std::memory_order_relaxed));
+	auto & event (events [index % size]);
+	event.sequence.store (2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence (std::memory_order_release);
+	event.category.store (category_a, std::memory_order_relaxed);
+	event.name.store (name_a, std::memory_order_relaxed);
+	event.begin.store (begin_a, std::memory_order_relaxed);
+	event.duration.store (duration_a, std::memory_order_relaxed);
+	event.sequence.store (2 * index + 2, std::memory_order_release);
+	written.store (index + 1, std::memory_order_release);
+}
+
+rai::tracer::tracer () :
+enabled (false),
+epoch (std::chrono::steady_clock::now ())
+{
+}
+
+rai::trace_buffer & rai::tracer::buffer ()
+{
+	thread_local std::shared_ptr <rai::trace_buffer> result;
+	if (result == nullptr)
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		result = std::make_shared <rai::trace_buffer> (buffers.size () + 1);
+		buffers.push_back (result);
+	}
+	return *result;
+}
+
+void rai::tracer::record (char const * category_a, char const * name_a, std::chrono::steady_clock::time_point begin_a, std::chrono::steady_clock::time_point end_a)
+{
+	auto begin_l (std::chrono::duration_cast <std::chrono::microseconds> (begin_a - epoch).count ());
+	auto duration_l (std::chrono::duration_cast <std::chrono::microseconds> (end_a - begin_a).count ());
+	buffer ().record (category_a, name_a, begin_l, duration_l);
+}
+
+void rai::tracer::chrome_json (std::ostream & stream_a, std::chrono::steady_clock::time_point since_a)
+{
+	uint64_t since_l (since_a > epoch ? std::chrono::duration_cast <std::chrono::microseconds> (since_a - epoch).count () : 0);
+	std::vector <std::shared_ptr <rai::trace_buffer>> buffers_l;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		buffers_l = buffers;
+	}
+	stream_a << "{\"traceEvents\":[";
+	auto first (true);
+	for (auto & i: buffers_l)
+	{
+		for (auto & j: i->events)
+		{
+			auto sequence (j.sequence.load (std::memory_order_acquire));
+			auto category_l (j.category.load (std::memory_order_relaxed));
+			auto name_l (j.name.load (std::memory_order_relaxed));
+			auto begin_l (j.begin.load (std::memory_order_relaxed));
+			auto duration_l (j.duration.load (std::memory_order_relaxed));
+			std::atomic_thread_fence (std::memory_order_acquire);
+			// Skip slots never written, being written or overwritten while we read them
+			if (sequence != 0 && sequence % 2 == 0 && sequence == j.sequence.load (std::memory_order_relaxed) && begin_l + duration_l >= since_l)
+			{
+				stream_a << (first ? "" : ",") << "{\"name\":\"" << name_l << "\",\"cat\":\"" << category_l << "\",\"ph\":\"X\",\"ts\":" << begin_l << ",\"dur\":" << duration_l << ",\"pid\":1,\"tid\":" << i->thread << "}";
+				first = false;
+			}
+		}
+	}
+	stream_a << "],\"displayTimeUnit\":\"ms\"}";
+}
+
+rai::trace_span::trace_span (char const * category_a, char const * name_a) :
+category (category_a),
+name (name_a),
+enabled (rai::trace.enabled.load (std::memory_order_relaxed))
+{
+	if (enabled)
+	{
+		begin = std::chrono::steady_clock::now ();
+	}
+}
+
+rai::trace_span::~trace_span ()
+{
+	if (enabled)
+	{
+		rai::trace.record (category, name, begin, std::chrono::steady_clock::now ());
+	}
+}
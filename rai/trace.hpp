@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace rai
+{
+// One slot of a trace_buffer, sequence is odd while the owning thread is writing it
+class trace_event
+{
+public:
+	trace_event ();
+	std::atomic <uint64_t> sequence;
+	std::atomic <char const *> category;
+	std::atomic <char const *> name;
+	std::atomic <uint64_t> begin; // Microseconds since the tracer's epoch
+	std::atomic <uint64_t> duration;
+};
+// Ring of the most recent spans of a single thread, only that thread writes and readers never block it
+class trace_buffer
+{
+public:
+	trace_buffer (unsigned);
+	void record (char const *, char const *, uint64_t, uint64_t);
+	static size_t constexpr size = 8192;
+	std::array <rai::trace_event, size> events;
+	std::atomic <uint64_t> written;
+	unsigned thread;
+};
+class tracer
+{
+public:
+	tracer ();
+	void record (char const *, char const *, std::chrono::steady_clock::time_point, std::chrono::steady_clock::time_point);
+	// Writes spans that ended at or after the given time as Chrome trace-event JSON
+	void chrome_json (std::ostream &, std::chrono::steady_clock::time_point);
+	rai::trace_buffer & buffer ();
+	std::atomic <bool> enabled;
+	std::chrono::steady_clock::time_point epoch;
+	std::mutex mutex;
+	// Kept after their thread exits so its last spans can still be dumped
+	std::vector <std::shared_ptr <rai::trace_buffer>> buffers;
+};
+extern rai::tracer trace;
+// Records the time between construction and destruction, costs a relaxed load while tracing is disabled
+// Category and name must be string literals, only the pointers are stored
+class trace_span
+{
+public:
+	trace_span (char const *, char const *);
+	~trace_span ();
+	char const * category;
+	char const * name;
+	bool enabled;
+	std::chrono::steady_clock::time_point begin;
+};
+}
@@ -1,5 +1,7 @@
 #include <rai/utility.hpp>
 
+#include <rai/trace.hpp>
+
 #include <cryptopp/aes.h>
 #include <cryptopp/modes.h>
 
@@ -44,10 +46,14 @@ bool rai::from_string_hex (std::string const & value_a, uint64_t & target_a)
     return result;
 }
 
-rai::mdb_env::mdb_env (bool & error_a, boost::filesystem::path const & path_a) :
+rai::mdb_env::mdb_env (bool & error_a, boost::filesystem::path const & path_a, bool read_only_a) :
+read_only (read_only_a),
+lock ("mdb_env"),
 open_transactions (0),
+open_copies (0),
 transaction_iteration (0),
-resizing (false)
+resizing (false),
+writer (nullptr)
 {
 	boost::system::error_code error;
 	if (path_a.has_parent_path ())
@@ -61,7 +67,7 @@ resizing (false)
 			assert (status2 == 0);
 			auto status3 (mdb_env_set_mapsize (environment, 2 * database_size_increment));
 			assert (status3 == 0);
-			auto status4 (mdb_env_open (environment, path_a.string ().c_str (), MDB_NOSUBDIR, 00600));
+			auto status4 (mdb_env_open (environment, path_a.string ().c_str (), MDB_NOSUBDIR | (read_only_a ? MDB_RDONLY : 0), 00600));
 			error_a = status4 != 0;
 		}
 		else
@@ -92,47 +98,115 @@ rai::mdb_env::operator MDB_env * () const
 
 void rai::mdb_env::add_transaction ()
 {
-	std::unique_lock <std::mutex> lock_l (lock);
+	rai::unique_lock lock_l (lock);
 	while (resizing)
 	{
 		resize_notify.wait (lock_l);
 	}
-	if ((transaction_iteration % rai::database_check_interval) == 0)
+	// Only the writing process grows the map, a running copy already made room before it started
+	if (!read_only && open_copies == 0 && (transaction_iteration % rai::database_check_interval) == 0)
 	{
-		MDB_stat stats;
-		mdb_env_stat (environment, &stats);
-		MDB_envinfo info;
-		mdb_env_info (environment, &info);
-		size_t load (info.me_last_pgno * stats.ms_psize);
-		auto slack (info.me_mapsize - load);
-		if (slack < (rai::database_size_increment / 4))
-		{
-			resizing = true;
-			auto done (std::chrono::system_clock::now () + std::chrono::milliseconds (500));
-			while (std::chrono::system_clock::now () < done && open_transactions > 0)
-			{
-				open_notify.wait_for (lock_l, std::chrono::milliseconds (50));
-			}
-			if (open_transactions == 0)
-			{
-				auto next_size (((info.me_mapsize / database_size_increment) + 1) * database_size_increment);
-				mdb_env_set_mapsize (environment, next_size);
-			}
-			resizing = false;
-			resize_notify.notify_all ();
-		}
+		grow (lock_l, rai::database_size_increment / 4);
 	}
 	++transaction_iteration;
 	++open_transactions;
 }
 
+bool rai::mdb_env::grow (rai::unique_lock & lock_a, size_t slack_a)
+{
+	auto result (false);
+	MDB_stat stats;
+	mdb_env_stat (environment, &stats);
+	MDB_envinfo info;
+	mdb_env_info (environment, &info);
+	size_t load (info.me_last_pgno * stats.ms_psize);
+	auto slack (info.me_mapsize - load);
+	if (slack < slack_a && open_copies > 0)
+	{
+		result = true;
+	}
+	else if (slack < slack_a)
+	{
+		resizing = true;
+		auto done (std::chrono::system_clock::now () + std::chrono::milliseconds (500));
+		while (std::chrono::system_clock::now () < done && open_transactions > 0)
+		{
+			open_notify.wait_for (lock_a, std::chrono::milliseconds (50));
+		}
+		if (open_transactions == 0)
+		{
+			auto next_size (((load + slack_a) / database_size_increment + 1) * database_size_increment);
+			result = mdb_env_set_mapsize (environment, next_size) != 0;
+		}
+		else
+		{
+			result = true;
+		}
+		resizing = false;
+		resize_notify.notify_all ();
+	}
+	return result;
+}
+
 void rai::mdb_env::remove_transaction ()
 {
-	std::lock_guard <std::mutex> lock_l (lock);
+	rai::lock_guard lock_l (lock);
 	--open_transactions;
 	open_notify.notify_all ();
 }
 
+void rai::mdb_env::adopt_mapsize ()
+{
+	rai::unique_lock lock_l (lock);
+	while (resizing)
+	{
+		resize_notify.wait (lock_l);
+	}
+	resizing = true;
+	while (open_transactions > 0 || open_copies > 0)
+	{
+		open_notify.wait (lock_l);
+	}
+	// Zero takes the size the writer recorded in the meta page
+	auto status (mdb_env_set_mapsize (environment, 0));
+	assert (status == 0);
+	resizing = false;
+	resize_notify.notify_all ();
+}
+
+bool rai::mdb_env::copy (boost::filesystem::path const & path_a, bool compact_a)
+{
+	auto result (false);
+	{
+		rai::unique_lock lock_l (lock);
+		while (resizing)
+		{
+			resize_notify.wait (lock_l);
+		}
+		// The map can't be resized underneath the copy's reader, so writers get their room for the whole copy up front
+		// Without that room the first write that fills the map would fail, so the copy is refused instead
+		if (!read_only)
+		{
+			MDB_envinfo info;
+			mdb_env_info (environment, &info);
+			result = grow (lock_l, std::max <size_t> (rai::database_size_increment, info.me_mapsize / 4));
+		}
+		if (!result)
+		{
+			++open_copies;
+		}
+	}
+	if (!result)
+	{
+		auto status (mdb_env_copy2 (environment, path_a.string ().c_str (), compact_a ? MDB_CP_COMPACT : 0));
+		result = status != 0;
+		rai::lock_guard lock_l (lock);
+		--open_copies;
+		open_notify.notify_all ();
+	}
+	return result;
+}
+
 rai::mdb_val::mdb_val (size_t size_a, void * data_a) :
 value ({size_a, data_a})
 {
@@ -149,17 +223,53 @@ rai::mdb_val::operator MDB_val const & () const
 	return value;
 }
 
-rai::transaction::transaction (rai::mdb_env & environment_a, MDB_txn * parent_a, bool write) :
-environment (environment_a)
+rai::transaction::transaction (rai::mdb_env & environment_a, MDB_txn * parent_a, bool write_a) :
+environment (environment_a),
+write (write_a)
 {
 	environment_a.add_transaction ();
-	auto status (mdb_txn_begin (environment_a, parent_a, write ? 0 : MDB_RDONLY, &handle));
+	auto status (mdb_txn_begin (environment_a, parent_a, write_a ? 0 : MDB_RDONLY, &handle));
+	while (status == MDB_MAP_RESIZED)
+	{
+		// Another process grew the file past our map
+		environment_a.remove_transaction ();
+		environment_a.adopt_mapsize ();
+		environment_a.add_transaction ();
+		status = mdb_txn_begin (environment_a, parent_a, write_a ? 0 : MDB_RDONLY, &handle);
+	}
 	assert (status == 0);
+	if (write_a)
+	{
+		environment_a.writer = handle;
+	}
 }
 
 rai::transaction::~transaction ()
 {
+	auto traced (write && rai::trace.enabled.load (std::memory_order_relaxed));
+	auto timed (write && (environment.commit_observer || traced));
+	std::chrono::steady_clock::time_point begin;
+	if (timed)
+	{
+		begin = std::chrono::steady_clock::now ();
+	}
+	if (write)
+	{
+		environment.writer = nullptr;
+	}
 	auto status (mdb_txn_commit (handle));
+	if (timed)
+	{
+		auto end (std::chrono::steady_clock::now ());
+		if (environment.commit_observer)
+		{
+			environment.commit_observer (end - begin);
+		}
+		if (traced)
+		{
+			rai::trace.record ("lmdb", "commit", begin, end);
+		}
+	}
 	environment.remove_transaction ();
 	assert (status == 0);
 }
@@ -755,7 +865,9 @@ extern "C"
 #include <ed25519-donna/ed25519-hash-custom.h>
 void ed25519_randombytes_unsafe (void * out, size_t outlen)
 {
-    rai::random_pool.GenerateBlock (reinterpret_cast <uint8_t *> (out), outlen);
+    // Batch verification runs on several threads at once and the shared pool isn't thread safe
+    thread_local CryptoPP::AutoSeededRandomPool pool;
+    pool.GenerateBlock (reinterpret_cast <uint8_t *> (out), outlen);
 }
 void ed25519_hash_init (ed25519_hash_context * ctx)
 {
@@ -792,10 +904,40 @@ rai::uint512_union rai::sign_message (rai::raw_key const & private_key, rai::pub
 
 bool rai::validate_message (rai::public_key const & public_key, rai::uint256_union const & message, rai::uint512_union const & signature)
 {
+	rai::trace_span span ("crypto", "validate_message");
     auto result (0 != ed25519_sign_open (message.bytes.data (), sizeof (message.bytes), public_key.bytes.data (), signature.bytes.data ()));
     return result;
 }
 
+std::vector <bool> rai::validate_message_batch (std::vector <rai::public_key> const & public_keys_a, std::vector <rai::uint256_union> const & messages_a, std::vector <rai::uint512_union> const & signatures_a)
+{
+	rai::trace_span span ("crypto", "validate_message_batch");
+	assert (public_keys_a.size () == messages_a.size () && messages_a.size () == signatures_a.size ());
+	auto size (messages_a.size ());
+	std::vector <unsigned char const *> messages (size);
+	std::vector <size_t> lengths (size, sizeof (rai::uint256_union));
+	std::vector <unsigned char const *> public_keys (size);
+	std::vector <unsigned char const *> signatures (size);
+	for (size_t i (0); i < size; ++i)
+	{
+		messages [i] = messages_a [i].bytes.data ();
+		public_keys [i] = public_keys_a [i].bytes.data ();
+		signatures [i] = signatures_a [i].bytes.data ();
+	}
+	std::vector <int> valid (size);
+	if (size > 0)
+	{
+		ed25519_sign_open_batch (messages.data (), lengths.data (), public_keys.data (), signatures.data (), size, valid.data ());
+	}
+	std::vector <bool> result;
+	result.reserve (size);
+	for (auto i: valid)
+	{
+		result.push_back (i != 1);
+	}
+	return result;
+}
+
 void rai::open_or_create (std::fstream & stream_a, std::string const & path_a)
 {
 	stream_a.open (path_a, std::ios_base::in);
@@ -1,8 +1,12 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <type_traits>
+#include <vector>
 
 #include <blake2/blake2.h>
 
@@ -17,6 +21,7 @@
 #include <liblmdb/lmdb.h>
 
 #include <rai/config.hpp>
+#include <rai/mutex.hpp>
 
 namespace rai
 {
@@ -133,18 +138,34 @@ rai::uint128_t const urai_ratio = rai::uint128_t ("1000000000000000000"); // 10^
 class mdb_env
 {
 public:
-	mdb_env (bool &, boost::filesystem::path const &);
+	// A read-only environment shares the file with a writer in another process and can't open write transactions
+	mdb_env (bool &, boost::filesystem::path const &, bool = false);
 	~mdb_env ();
 	operator MDB_env * () const;
 	void add_transaction ();
 	void remove_transaction ();
+	// Grows the map until it has at least the given free space, callers hold lock
+	// Returns true if the room couldn't be made because transactions stayed open or a copy is running
+	bool grow (rai::unique_lock &, size_t);
+	// Maps the size another process grew the file to, waits until this process has no transaction open
+	void adopt_mapsize ();
+	// Writes a consistent copy to the given file from a single read transaction, writers aren't blocked while it runs
+	// Compacting leaves out free pages so the copy is only as large as the live data, returns true on error
+	bool copy (boost::filesystem::path const &, bool);
 	MDB_env * environment;
-	std::mutex lock;
-	std::condition_variable open_notify;
+	bool read_only;
+	rai::named_mutex lock;
+	rai::condition_variable open_notify;
 	unsigned open_transactions;
+	// Copies running, their reader pins the map so it isn't resized but transactions don't wait on them
+	unsigned open_copies;
 	unsigned transaction_iteration;
-	std::condition_variable resize_notify;
+	rai::condition_variable resize_notify;
 	bool resizing;
+	// Handle of the open write transaction, LMDB allows only one at a time
+	std::atomic <MDB_txn *> writer;
+	// Called with how long each write transaction took to commit, set before the environment is shared between threads
+	std::function <void (std::chrono::steady_clock::duration)> commit_observer;
 };
 class mdb_val
 {
@@ -162,6 +183,7 @@ public:
 	operator MDB_txn * () const;
 	MDB_txn * handle;
 	rai::mdb_env & environment;
+	bool write;
 };
 union uint128_union
 {
@@ -266,6 +288,9 @@ union uint512_union
 using signature = uint512_union;
 rai::uint512_union sign_message (rai::raw_key const &, rai::public_key const &, rai::uint256_union const &);
 bool validate_message (rai::public_key const &, rai::uint256_union const &, rai::uint512_union const &);
+// Entry i is true if signature i is invalid, the same as validate_message
+// Checks the batch with one multi-scalar multiplication and only falls back to single checks if it fails
+std::vector <bool> validate_message_batch (std::vector <rai::public_key> const &, std::vector <rai::uint256_union> const &, std::vector <rai::uint512_union> const &);
 }
 namespace std
 {